@@ -15,6 +15,9 @@
 
 #include <math.h>
 #include <algorithm>
+#include <thread>
+#include <atomic>
+#include <exception>
 #include <boost/foreach.hpp>
 
 using namespace std;
@@ -26,7 +29,8 @@ using namespace HitSorting;
 HiveCleaning_ParameterSet::HiveCleaning_ParameterSet():
   multiplicity(1),
   max_tresidual_early(-INFINITY),
-  max_tresidual_late(INFINITY)
+  max_tresidual_late(INFINITY),
+  nThreads(1)
 {}
 
 
@@ -34,54 +38,337 @@ HiveCleaning_ParameterSet::HiveCleaning_ParameterSet():
 
 HiveCleaning::HiveCleaning(const HiveCleaning_ParameterSet& params) :
   params_(params)
-{};
+{
+  //the connectors are evaluated from several threads at once, unless cleaning on one thread only
+  if (params_.connectorBlock && params_.nThreads!=1)
+    params_.connectorBlock->HashDistancesUnlessCarried();
+};
 
 
 AbsHitSet HiveCleaning::Clean (const AbsHitSet& hits) {
   log_debug("Entering Clean()");
-  using namespace HitSorting;
 
   AbsHitSet outhits;
 
-  if (hits.size()==0) {
+  std::vector<uint8_t> keep;
+  Clean(hits, keep);
+  
+  size_t i=0;
+  BOOST_FOREACH(const AbsHit& h, hits) {
+    if (keep[i++])
+      outhits.insert(outhits.end(), h); //and keep the hit
+  }
+
+  log_debug("Leaving Clean()");
+  return outhits;
+};
+
+
+CompactHitSeries HiveCleaning::Clean (const CompactHitSeries& hits) {
+  log_debug("Entering Clean()");
+
+  CompactHitSeries outhits;
+
+  std::vector<uint8_t> keep;
+  Clean(ToSpan(hits), keep);
+  
+  for (size_t i=0; i<hits.size(); i++) {
+    if (keep[i])
+      outhits.push_back(hits[i]);
+  }
+
+  log_debug("Leaving Clean()");
+  return outhits;
+};
+
+
+void HiveCleaning::Clean (
+  const CompactHitSpan& hits,
+  std::vector<uint8_t>& keep)
+{
+  if (hits.empty()) {
     log_warn("The series of hits is empty; Will do nothing");
-    return outhits;
+    keep.clear();
+    return;
   }
+  EvaluateHits(hits, keep);
+};
 
-  log_debug("Starting Cleaning routine");
-  for (AbsHitSet::const_iterator hit_iter = hits.begin(); hit_iter !=hits.end(); ++hit_iter) { //for all hits
-    log_trace_stream(" Probing next hit: " << *hit_iter);
-    size_t connected_neighbors=0;
-    AbsHitSet::const_reverse_iterator past_riter(hit_iter);
-    while (past_riter != hits.rend() //
-      && (hit_iter->GetTime() - past_riter->GetTime())<=params_.max_tresidual_early)
-    { // iterate over all past hits within the time limitation
-      if (params_.connectorBlock->Connected(*hit_iter, *past_riter)) { //find connected neighbours
-        log_trace_stream("found a past hit to link to : " << *past_riter);
-        ++connected_neighbors;
+
+void HiveCleaning::Clean (
+  const CompactHitSpan& hits,
+  const HitConnectivity& connectivity,
+  std::vector<uint8_t>& keep)
+{
+  if (connectivity.GetConnectorBlock()!=params_.connectorBlock)
+    log_fatal("The connectivity needs to be evaluated by the configured ConnectorBlock");
+  if (hits.empty()) {
+    log_warn("The series of hits is empty; Will do nothing");
+    keep.clear();
+    return;
+  }
+  EvaluateHits(hits, keep, &connectivity);
+};
+
+
+void HiveCleaning::Clean (
+  const AbsHitSet& hits,
+  std::vector<uint8_t>& keep)
+{
+  //convert to compact hits, which are the same order as the set
+  const CompactHitSeries chits = ToCompactHits(hits);
+  Clean(ToSpan(chits), keep);
+};
+
+
+void HiveCleaning::CleanIndices (
+  const CompactHitSpan& hits,
+  std::vector<uint32_t>& kept)
+{
+  std::vector<uint8_t> keep;
+  Clean(hits, keep);
+  
+  kept.clear();
+  for (size_t i=0; i<keep.size(); i++) {
+    if (keep[i])
+      kept.push_back(i);
+  }
+};
+
+
+void HiveCleaning::EvaluateHits (
+  const CompactHitSpan& hits,
+  std::vector<uint8_t>& keep,
+  const HitConnectivity* connectivity) const
+{
+  const size_t n_hits = hits.size();
+  keep.assign(n_hits, false);
+  const DOMHitIndex index(hits, params_.connectorBlock->GetHashService()->HashSize());
+  
+  //the pairs are looked up by the positions of the hits in the series of the connectivity
+  std::vector<size_t> positions;
+  if (connectivity) {
+    positions.reserve(n_hits);
+    for (size_t i=0; i<n_hits && connectivity; i++) {
+      positions.push_back(connectivity->Find(hits[i]));
+      if (positions.back()==HitConnectivity::npos) {
+        log_warn("Hits are not part of the series of the connectivity; evaluating them directly");
+        connectivity = NULL;
       }
-      ++past_riter; //try the next possible neighbour
+    }
+  }
+  
+  //the decision for each hit only depends on the hits within its time residuals, which are read-only;
+  // so ranges of hits can be evaluated independently, each reading into its neighbours as far as the residuals reach
+  unsigned n_threads = (params_.nThreads ? params_.nThreads : std::thread::hardware_concurrency());
+  n_threads = std::max(1u, n_threads);
+  const size_t range_size = std::max<size_t>(minHitsPerRange, n_hits/(8*n_threads));
+  n_threads = std::min<size_t>(n_threads, (n_hits+range_size-1)/range_size);
+  
+  log_debug_stream("Starting Cleaning routine with "<<n_threads<<" threads");
+  if (n_threads==1) {
+    EvaluateRange(hits, index, connectivity, positions, 0, n_hits, keep);
+    log_debug("Finished Cleaning routine");
+    return;
+  }
+  
+  //the workers pick up ranges until all are done; each range of the keep-mask is written by exactly one worker
+  std::atomic<size_t> next_range(0);
+  std::vector<std::exception_ptr> errors(n_threads);
+  const auto worker = [&](const unsigned t) {
+    try {
+      for (size_t begin = next_range.fetch_add(range_size); begin<n_hits; begin = next_range.fetch_add(range_size))
+        EvaluateRange(hits, index, connectivity, positions, begin, std::min(begin+range_size, n_hits), keep);
+    }
+    catch (...) {
+      errors[t] = std::current_exception();
+    }
+  };
+  std::vector<std::thread> workers;
+  for (unsigned t=1; t<n_threads; t++)
+    workers.push_back(std::thread(worker, t));
+  worker(0);
+  BOOST_FOREACH(std::thread& w, workers)
+    w.join();
+  BOOST_FOREACH(const std::exception_ptr& error, errors) {
+    if (error)
+      std::rethrow_exception(error);
+  }
+  log_debug("Finished Cleaning routine");
+};
+
+void HiveCleaning::EvaluateRange (
+  const CompactHitSpan& hits,
+  const DOMHitIndex& index,
+  const HitConnectivity* connectivity,
+  const std::vector<size_t>& positions,
+  const size_t begin,
+  const size_t end,
+  std::vector<uint8_t>& keep) const
+{
+  const ConnectorBlock& connectorBlock = *params_.connectorBlock;
+  const size_t n_hits = hits.size();
+  
+  //any hit that can be connected to a hit on DOM 'a', in either direction and at any time, is on a DOM related to 'a'
+  // in the symmetric closure of the cumulative relation; only these DOMs need to be visited
+  const Relation& neighbours = *connectorBlock.GetCumulativeSymRelation();
+  const bool sparse = (neighbours.GetStorageType()==Relation::SPARSE);
+  const size_t hash_size = connectorBlock.GetHashService()->HashSize();
+  
+  //the window of hits within the time residuals [past, future) only moves forward;
+  // it starts at the first hit of the range, evaluated with the very same expression as when moving
+  const double t_begin = hits[begin].GetTime();
+  const double early = params_.max_tresidual_early;
+  size_t past = std::partition_point(hits.begin(), hits.begin()+begin,
+    [t_begin, early](const CompactHit& h) {return !((t_begin - h.GetTime())<=early);}) - hits.begin();
+  size_t future = begin;
+  
+  for (size_t i=begin; i<end; i++) { //for all hits
+    const CompactHit& hit = hits[i];
+    
+    while (past<i && !((hit.GetTime() - hits[past].GetTime())<=params_.max_tresidual_early))
+      ++past;
+    future = std::max(future, i);
+    while (future<n_hits && (hits[future].GetTime() - hit.GetTime())<=params_.max_tresidual_late)
+      ++future;
+    
+    if (params_.multiplicity==0) {
+      keep[i] = true;
+      continue;
     }
     
-    AbsHitSet::const_iterator future_iter(hit_iter);
-    while (future_iter!=hits.end()
-      && (future_iter->GetTime() - hit_iter->GetTime())<=params_.max_tresidual_late)
-    {
-      if (params_.connectorBlock->Connected(*future_iter, *hit_iter)) {
-        log_trace_stream("found a future hit to link to : " << *future_iter);
+    //past hits are connected from this hit, future hits (including itself) to this hit
+    size_t connected_neighbors=0;
+    const auto probe = [&](const size_t j) {
+      const size_t later = (j<i) ? i : j;
+      const size_t earlier = (j<i) ? j : i;
+      const bool connected = connectivity
+        ? connectivity->Connected(positions[later], positions[earlier])
+        : connectorBlock.Connected(hits[later], hits[earlier]);
+      if (connected)
         ++connected_neighbors;
+      return connected_neighbors>=params_.multiplicity;
+    };
+    
+    //visit the hits on the related DOMs within the window, unless the window holds fewer hits than there are related DOMs
+    const CompactHash dom = hit.GetDOMIndex();
+    const size_t n_related = sparse
+      ? neighbours.GetSparseRelationMap().RowEnd(dom)-neighbours.GetSparseRelationMap().RowBegin(dom)
+      : hash_size;
+    bool satisfied = false;
+    if (n_related < future-past) {
+      const Relation::RelatedRange related = neighbours.RelatedSpan(dom);
+      for (Relation::RelatedIterator b=related.begin(); b!=related.end() && !satisfied; ++b) {
+        const DOMHitIndex::Position* const last = index.End(*b);
+        for (const DOMHitIndex::Position* j=index.LowerBound(*b, past); j!=last && *j<future && !satisfied; ++j)
+          satisfied = probe(*j);
       }
-      ++future_iter; //try the next possible neighbour
     }
-    
-    if (connected_neighbors>=params_.multiplicity) {
-      log_debug("found enough connected neighbors");
-      outhits.insert(outhits.end(), *hit_iter); //and keep the hit
-    }  
+    else {
+      for (size_t j=past; j<future && !satisfied; j++)
+        satisfied = probe(j);
+    }
+    keep[i] = satisfied;
   }
-  log_debug("Finished Cleaning routine");
+};
 
-  log_debug("Leaving Clean()");
-  return outhits;
+
+//===============class StreamingHiveCleaning=================================
+
+StreamingHiveCleaning::StreamingHiveCleaning(const HiveCleaning_ParameterSet& params) :
+  params_(params),
+  window_(),
+  n_decided_(0),
+  watermark_(std::numeric_limits<int64_t>::min()),
+  cleaned_()
+{
+  //the lookahead and the kept past of the hits have to be bounded
+  if (!std::isfinite(params_.max_tresidual_late))
+    log_fatal("Streaming cleaning requires a finite late time residual");
+  if (std::isnan(params_.max_tresidual_early) || params_.max_tresidual_early==INFINITY)
+    log_fatal("Streaming cleaning requires a finite early time residual, or none at all (-INFINITY)");
+  if (!params_.connectorBlock)
+    log_fatal("Streaming cleaning requires a ConnectorBlock");
+};
+
+void StreamingHiveCleaning::AddHit (const AbsDAQHit& h) {
+  if (h.GetDAQTicks()<watermark_)
+    log_fatal_stream("Hit at "<<h.GetDAQTicks()<<" arrives after the stream has been advanced to "<<watermark_);
+  
+  //hits after the watermark can only be sorted in between the undecided hits
+  window_.insert(std::upper_bound(window_.begin()+n_decided_, window_.end(), h), h);
+};
+
+void StreamingHiveCleaning::AdvanceTime (const int64_t tick) {
+  log_debug("Entering AdvanceTime()");
+  if (tick<=watermark_)
+    return;
+  watermark_ = tick;
+  
+  //any hit still to come is later than the watermark, so hits further in the past than the late residual have seen all of their future
+  while (n_decided_<window_.size()
+    && (watermark_-window_[n_decided_].GetDAQTicks())/10. > params_.max_tresidual_late)
+    DecideNext();
+  Prune();
+  log_debug("Leaving AdvanceTime()");
+};
+
+void StreamingHiveCleaning::Finalize () {
+  log_debug("Entering Finalize()");
+  while (n_decided_<window_.size())
+    DecideNext();
+  watermark_ = std::numeric_limits<int64_t>::max();
+  Prune();
+  log_debug("Leaving Finalize()");
+};
+
+int64_t StreamingHiveCleaning::DecidedUntil () const {
+  if (n_decided_<window_.size())
+    return std::min(watermark_, window_[n_decided_].GetDAQTicks());
+  return watermark_;
 };
 
+AbsDAQHitSet StreamingHiveCleaning::PullCleaned () {
+  AbsDAQHitSet output;
+  output.swap(cleaned_);
+  return output;
+};
+
+void StreamingHiveCleaning::DecideNext () {
+  const ConnectorBlock& connectorBlock = *params_.connectorBlock;
+  const AbsDAQHit& hit = window_[n_decided_];
+  
+  //the same window and order of evaluation as HiveCleaning:
+  // past hits are connected from this hit, future hits (including itself) to this hit
+  size_t connected_neighbors=0;
+  bool satisfied = (params_.multiplicity==0);
+  for (size_t j=n_decided_; j>0 && !satisfied; j--) {
+    const AbsDAQHit& past = window_[j-1];
+    if (!(past.TimeDiff(hit)<=params_.max_tresidual_early))
+      break;
+    if (connectorBlock.Connected(hit, past))
+      satisfied = (++connected_neighbors>=params_.multiplicity);
+  }
+  for (size_t j=n_decided_; j<window_.size() && !satisfied; j++) {
+    const AbsDAQHit& future = window_[j];
+    if (!(hit.TimeDiff(future)<=params_.max_tresidual_late))
+      break;
+    if (connectorBlock.Connected(future, hit))
+      satisfied = (++connected_neighbors>=params_.multiplicity);
+  }
+  
+  if (satisfied)
+    cleaned_.insert(cleaned_.end(), hit); //and keep the hit
+  n_decided_++;
+};
+
+void StreamingHiveCleaning::Prune () {
+  //all undecided hits and all hits still to come are at or after this time
+  const int64_t earliest = DecidedUntil();
+  while (n_decided_>0
+    && !((earliest-window_.front().GetDAQTicks())/10. <= params_.max_tresidual_early))
+  {
+    window_.pop_front();
+    n_decided_--;
+  }
+};
@@ -16,12 +16,15 @@
 
 #include <limits>
 #include <list>
+#include <deque>
 #include <map>
 #include <sstream>
 
 #include "ToolZ/OMKeyHash.h"
 #include "ToolZ/HitSorting.h"
 #include "IceHiveZ/internals/Connector.h"
+#include "IceHiveZ/internals/CompactHits.h"
+#include "IceHiveZ/internals/HitConnectivity.h"
 
 
 /// A set of parameters that steer HiveCleaning
@@ -35,6 +38,8 @@ struct HiveCleaning_ParameterSet{
   double max_tresidual_late;
   /// PARAM: pointer to the ConnectorBlock providing DOM to DOM and Hit connections
   ConnectorBlockPtr connectorBlock;
+  /// PARAM: number of threads long series of hits are cleaned with; 0 for as many as the hardware supports
+  unsigned nThreads;
   
   ///constructor
   HiveCleaning_ParameterSet();
@@ -51,6 +56,10 @@ protected://parameters
   /// A parameter-set to run on
   HiveCleaning_ParameterSet params_;
 
+public:
+  /// series of hits are cleaned in ranges of at least this many hits; shorter series are cleaned in one go
+  static const size_t minHitsPerRange = 1024;
+
 public://methods
   //================
   // Main Interface
@@ -70,6 +79,138 @@ public://methods
    */
   template <class AbsHitContainer>
   AbsHitSet Clean(const AbsHitContainer &hits);
+  
+  /** @brief ACTION; on compact hits
+   * @param hits the hits to process on; need to be time-ordered
+   * @return the hits which are kept
+   */
+  CompactHitSeries Clean(const CompactHitSeries &hits);
+  
+  /** @brief ACTION; decide for each hit in place, without copying any of them
+   * @param hits the hits to process on; need to be time-ordered
+   * @param keep for each hit if it is kept (1) or not (0), aligned with the hits; its storage is reused
+   */
+  void Clean(
+    const CompactHitSpan &hits,
+    std::vector<uint8_t> &keep);
+  
+  /** @brief ACTION; decide for each hit in place, with the connectivity of the hits evaluated ahead, e.g. shared with other algorithms
+   * @param hits the hits to process on; need to be time-ordered
+   * @param connectivity the connectivity of a series holding the hits; needs to be evaluated by the configured ConnectorBlock
+   * @param keep for each hit if it is kept (1) or not (0), aligned with the hits; its storage is reused
+   */
+  void Clean(
+    const CompactHitSpan &hits,
+    const HitConnectivity &connectivity,
+    std::vector<uint8_t> &keep);
+  
+  /** @brief ACTION; decide for each hit in place
+   * @param hits the hits to process on
+   * @param keep for each hit if it is kept (1) or not (0), aligned with the order of the container; its storage is reused
+   */
+  void Clean(
+    const AbsHitSet &hits,
+    std::vector<uint8_t> &keep);
+  
+  /** @brief ACTION; list the kept hits by their position
+   * @param hits the hits to process on; need to be time-ordered
+   * @param kept the ascending positions of the kept hits in the series; its storage is reused
+   */
+  void CleanIndices(
+    const CompactHitSpan &hits,
+    std::vector<uint32_t> &kept);
+  
+private:
+  /** the cleaning engine, which runs on the compact hits; long series are split into ranges, which are evaluated concurrently
+   * @param hits the time-ordered hits
+   * @param keep for each hit if it is kept or not
+   * @param connectivity the connectivity of a series holding the hits, if evaluated ahead
+   */
+  void EvaluateHits(
+    const CompactHitSpan &hits,
+    std::vector<uint8_t> &keep,
+    const HitConnectivity* connectivity =NULL) const;
+  /** evaluate a range of hits; the hits outside the range are read as far as the time residuals reach
+   * @param hits the time-ordered hits
+   * @param index the hits indexed by DOM
+   * @param connectivity the connectivity of a series holding the hits, if evaluated ahead
+   * @param positions the positions of the hits in that series
+   * @param begin first hit of the range
+   * @param end one past the last hit of the range
+   * @param keep for each hit if it is kept or not; only the range is written
+   */
+  void EvaluateRange(
+    const CompactHitSpan &hits,
+    const DOMHitIndex &index,
+    const HitConnectivity* connectivity,
+    const std::vector<size_t> &positions,
+    const size_t begin,
+    const size_t end,
+    std::vector<uint8_t> &keep) const;
+};
+
+///Cleans a continuous stream of hits, as they are read from the hitspool;
+/// a hit is decided as soon as no hit within its late time residual can arrive any more,
+/// by the very same criteria as HiveCleaning. The kept hits are emitted in time order
+class StreamingHiveCleaning {
+  SET_LOGGER("StreamingHiveCleaning");
+  
+protected://parameters
+  //========================
+  // Configurable Parameters
+  //========================
+  /// A parameter-set to run on; the time residuals need to be finite
+  HiveCleaning_ParameterSet params_;
+
+private: //properties
+  ///the undecided hits, preceded by the decided hits still within the early time residual of them; time-ordered
+  std::deque<AbsDAQHit> window_;
+  ///number of hits at the front of the window which are already decided
+  size_t n_decided_;
+  ///no hits earlier than this can be added any more
+  int64_t watermark_;
+  ///the decided hits which are kept, and have not yet been pulled
+  AbsDAQHitSet cleaned_;
+  
+public://methods
+  //================
+  // Main Interface
+  //================
+  /// Constructor from a ParameterSet
+  StreamingHiveCleaning(const HiveCleaning_ParameterSet& params);
+  
+  /** add a hit; hits can arrive in any order, but not before the time the stream has been advanced to
+   * @param h the hit to add
+   */
+  void AddHit(const AbsDAQHit &h);
+  /// add a compact hit, for callers holding them anyway; it is converted to an AbsDAQHit right away,
+  /// as the window of held hits is kept of AbsDAQHits
+  /// @param h the hit to add
+  void AddHit(const CompactDAQHit &h);
+  
+  /** advance the stream to this time, which decides all hits which are further in the past than the late time residual;
+   * no hits can be added before this time afterwards
+   * @param tick time in DAQ ticks
+   */
+  void AdvanceTime(const int64_t tick);
+  
+  /// decide all remaining hits, on the assumption that no more hits will be added
+  void Finalize();
+  
+  /// get the time until which all hits are decided; all hits which are pulled later are at or after this time
+  int64_t DecidedUntil() const;
+  
+  /// retrieve all kept hits which are decided
+  AbsDAQHitSet PullCleaned();
+  
+  /// number of hits which are held, either undecided or as past of undecided hits
+  size_t NumberOfHeldHits() const;
+  
+private:
+  /// decide the next undecided hit, which needs all hits within its late time residual to be present
+  void DecideNext();
+  /// drop the decided hits which are out of reach of the early time residual of all undecided and future hits
+  void Prune();
 };
 
 
@@ -88,4 +229,12 @@ AbsHitSet HiveCleaning::Clean(const AbsHitContainer& inhits) {
 };
 
 
+inline
+void StreamingHiveCleaning::AddHit(const CompactDAQHit& h)
+  {AddHit(h.ToAbsDAQHit());};
+
+inline
+size_t StreamingHiveCleaning::NumberOfHeldHits() const
+  {return window_.size();};
+
 #endif //HIVECLEANING_H
\ No newline at end of file
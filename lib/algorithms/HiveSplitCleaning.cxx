@@ -0,0 +1,96 @@
+/**
+ * \file HiveSplitCleaning.cxx
+ *
+ * (c) 2012 the IceCube Collaboration
+ *
+ * $Id: HiveSplitCleaning.cxx 99900 2013-02-26 10:10:43Z mzoll $
+ * \version $Revision: 99900 $
+ * \date $Date: 2013-02-26 11:10:43 +0100 (Tue, 26 Feb 2013) $
+ * \author Marcel Zoll <marcel.zoll@fysik.su.se>
+ */
+
+#include "IceHiveZ/algorithms/HiveSplitCleaning.h"
+
+#include <algorithm>
+#include <boost/foreach.hpp>
+#include <boost/make_shared.hpp>
+
+using namespace std;
+using namespace hivesplitter;
+
+
+//===============class HiveSplitCleaning=================================
+
+HiveSplitCleaning::HiveSplitCleaning(
+  const HiveSplitter_ParameterSet& hs_params,
+  const HiveCleaning_ParameterSet& hc_params) :
+  hs_params_(hs_params),
+  hc_params_(hc_params),
+  hiveSplitter_(hs_params),
+  hiveCleaning_(hc_params),
+  n_evaluations_(0)
+{
+  if (hs_params_.connectorBlock!=hc_params_.connectorBlock)
+    log_info("Splitting and cleaning are configured with different ConnectorBlocks; the connectivity is not shared");
+};
+
+double HiveSplitCleaning::Horizon() const {
+  //the splitter connects hits within the multiplicity time window of each other, the cleaning within its time residuals
+  return std::max(hs_params_.multiplicityTimeWindow,
+    std::max(hc_params_.max_tresidual_early, hc_params_.max_tresidual_late));
+};
+
+AbsHitSetSequence HiveSplitCleaning::SplitClean(
+  const AbsHitSet& hits,
+  std::vector<std::vector<uint8_t> >& keep)
+{
+  log_debug("Entering SplitClean()");
+  keep.clear();
+  n_evaluations_ = 0;
+
+  const CompactHitSeries chits = ToCompactHits(hits);
+  const bool shared = (hs_params_.connectorBlock==hc_params_.connectorBlock);
+  const HitConnectivity splitConnectivity(hs_params_.connectorBlock, chits,
+    shared ? Horizon() : hs_params_.multiplicityTimeWindow);
+
+  const AbsHitSetSequence subEvents = hiveSplitter_.Split(splitConnectivity);
+  log_debug_stream("Split into "<<subEvents.size()<<" subevents");
+
+  //the subevents are cleaned with the connectivity of the whole series, so pairs already evaluated by the splitter are not evaluated again
+  HitConnectivityPtr cleanConnectivity;
+  if (!shared)
+    cleanConnectivity = boost::make_shared<HitConnectivity>(hc_params_.connectorBlock, chits,
+      std::max(hc_params_.max_tresidual_early, hc_params_.max_tresidual_late));
+  const HitConnectivity& connectivity = shared ? splitConnectivity : *cleanConnectivity;
+
+  keep.resize(subEvents.size());
+  size_t k=0;
+  BOOST_FOREACH(const AbsHitSet& subEvent, subEvents) {
+    const CompactHitSeries csub = ToCompactHits(subEvent);
+    hiveCleaning_.Clean(ToSpan(csub), connectivity, keep[k++]);
+  }
+
+  n_evaluations_ = splitConnectivity.NumberOfEvaluations() + (shared ? 0 : cleanConnectivity->NumberOfEvaluations());
+  log_debug_stream("Evaluated "<<n_evaluations_<<" pairs of hits");
+  log_debug("Leaving SplitClean()");
+  return subEvents;
+};
+
+AbsHitSetSequence HiveSplitCleaning::SplitClean(const AbsHitSet& hits) {
+  std::vector<std::vector<uint8_t> > keep;
+  const AbsHitSetSequence subEvents = SplitClean(hits, keep);
+
+  AbsHitSetSequence cleanSubEvents;
+  size_t k=0;
+  BOOST_FOREACH(const AbsHitSet& subEvent, subEvents) {
+    AbsHitSet cleanSubEvent;
+    size_t i=0;
+    BOOST_FOREACH(const AbsHit& h, subEvent) {
+      if (keep[k][i++])
+        cleanSubEvent.insert(cleanSubEvent.end(), h);
+    }
+    cleanSubEvents.push_back(cleanSubEvent);
+    k++;
+  }
+  return cleanSubEvents;
+};
@@ -0,0 +1,88 @@
+/**
+ * \file HiveSplitCleaning.h
+ *
+ * (c) 2012 the IceCube Collaboration
+ *
+ * $Id: HiveSplitCleaning.h 99900 2013-02-26 10:10:43Z mzoll $
+ * \version $Revision: 99900 $
+ * \date $Date: 2013-02-26 11:10:43 +0100 (Tue, 26 Feb 2013) $
+ * \author Marcel Zoll <marcel.zoll@fysik.su.se>
+ *
+ * Splitting by HiveSplitter and cleaning of the subevents by HiveCleaning in one go
+ */
+
+#ifndef HIVESPLITCLEANING_H
+#define HIVESPLITCLEANING_H
+
+#include <vector>
+
+#include "IceHiveZ/algorithms/HiveSplitter.h"
+#include "IceHiveZ/algorithms/HiveCleaning.h"
+#include "IceHiveZ/internals/HitConnectivity.h"
+
+/** Splits a series of hits into subevents and cleans each subevent;
+ * the result is exactly that of HiveSplitter followed by HiveCleaning on each subevent.
+ * The connectivity of the pairs of hits is evaluated once for the whole series and shared by both,
+ * if they are configured with the same ConnectorBlock.
+ */
+class HiveSplitCleaning {
+  SET_LOGGER("HiveSplitCleaning");
+
+protected://parameters
+  //========================
+  // Configurable Parameters
+  //========================
+  /// PARAM: which are delivered to HiveSplitter
+  hivesplitter::HiveSplitter_ParameterSet hs_params_;
+  /// PARAM: which are delivered to HiveCleaning
+  HiveCleaning_ParameterSet hc_params_;
+
+private: //properties
+  ///most private HiveSplitter instance
+  HiveSplitter hiveSplitter_;
+  ///most private HiveCleaning instance
+  HiveCleaning hiveCleaning_;
+  ///number of evaluations of the ConnectorBlocks in the last call
+  uint64_t n_evaluations_;
+
+public://methods
+  //================
+  // Main Interface
+  //================
+  /// Constructor from the ParameterSets
+  HiveSplitCleaning(
+    const hivesplitter::HiveSplitter_ParameterSet& hs_params,
+    const HiveCleaning_ParameterSet& hc_params);
+
+  /** @brief ACTION
+   * @param hits the hits to process on
+   * @param keep for each subevent the decision of the cleaning for each of its hits, aligned with the subevent
+   * @return the subevents, as split
+   */
+  AbsHitSetSequence SplitClean(
+    const AbsHitSet& hits,
+    std::vector<std::vector<uint8_t> >& keep);
+
+  /** @brief ACTION
+   * @param hits the hits to process on
+   * @return the subevents, holding only the hits which are kept by the cleaning
+   */
+  AbsHitSetSequence SplitClean(const AbsHitSet& hits);
+
+  /// the number of evaluations of the ConnectorBlocks in the last call
+  uint64_t GetNumberOfEvaluations() const;
+
+  /// the time difference up to which pairs of hits are asked for by either algorithm
+  double Horizon() const;
+};
+
+
+//===========================================
+//============== IMPLEMENTATION =============
+//===========================================
+
+inline
+uint64_t HiveSplitCleaning::GetNumberOfEvaluations() const
+  {return n_evaluations_;};
+
+#endif //HIVESPLITCLEANING_H
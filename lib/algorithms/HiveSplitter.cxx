@@ -39,10 +39,13 @@ inline
 bool hivesplitter::detail::CausallyConnected(
   const AbsHit& h1,
   const AbsHit& h2,
-  const ConnectorBlockConstPtr& connectorBlock) 
+  const ConnectorBlockConstPtr& connectorBlock,
+  const HitConnectivity* connectivity) 
 {
   if (h1.GetTime() > h2.GetTime())
-    return CausallyConnected(h2, h1, connectorBlock); //recursive call to enforce timeorder at this point  
+    return CausallyConnected(h2, h1, connectorBlock, connectivity); //recursive call to enforce timeorder at this point  
+  if (connectivity)
+    return connectivity->Connected(h1, h2);
   return connectorBlock->Connected(h1, h2);
 }
 
@@ -85,8 +88,10 @@ bool hivesplitter::detail::CausallyOverlaps (
 };
 
 hivesplitter::detail::CausalCluster::CausalCluster(
-  const HiveSplitter_ParameterSet* p):
+  const HiveSplitter_ParameterSet* p,
+  const HitConnectivity* c):
   params(p),
+  connectivity(c),
   sync_time(-std::numeric_limits<Time>::infinity()),
   established(false)
 {};
@@ -131,13 +136,13 @@ bool hivesplitter::detail::CausalCluster::connectsTo(const AbsHit &h) const {
         continue;
       }
       if (dt > params->rejectTimeWindow // it rejects h, so not connected
-        || ! CausallyConnected(*it, h, params->connectorBlock)) // it cannnot even connect to h
+        || ! CausallyConnected(*it, h, params->connectorBlock, connectivity)) // it cannnot even connect to h
       {
         allConnected = false;
       }
     }
     
-    if (CausallyConnected(*it, h, params->connectorBlock)) { //not on the same DOM
+    if (CausallyConnected(*it, h, params->connectorBlock, connectivity)) { //not on the same DOM
       //try if h can connect to hits on other DOMs
       connectedDOMs.insert(it->GetDOMIndex()); // add to the number of connected DOMs
       if (connectedDOMs.size() >= params->multiplicity-1) // found enough connections
@@ -171,12 +176,12 @@ void hivesplitter::detail::CausalCluster::insertActiveHit(const AbsHit &h) {
 
 hivesplitter::detail::CausalCluster 
 hivesplitter::detail::CausalCluster::getSubCluster(const AbsHit &h) const {
-  CausalCluster newSubCluster(params);
+  CausalCluster newSubCluster(params, connectivity);
   
   if (! firstHitTimes.count(h.GetDOMIndex())) { //FAST short-cut
     //never seen this DOM being hit before; insert them all as long as they are causally conneted
     for (AbsHitSet::iterator it=active_hits.begin(), end=active_hits.end(); it!=end; ++it) {
-      if (CausallyConnected(*it, h, params->connectorBlock))
+      if (CausallyConnected(*it, h, params->connectorBlock, connectivity))
         newSubCluster.insertActiveHit(*it);
     }
   }
@@ -193,7 +198,7 @@ hivesplitter::detail::CausalCluster::getSubCluster(const AbsHit &h) const {
           continue;
         }
       }
-      if (CausallyConnected(*it, h, params->connectorBlock))
+      if (CausallyConnected(*it, h, params->connectorBlock, connectivity))
         newSubCluster.insertActiveHit(*it);
     }
   }
@@ -322,6 +327,7 @@ void hivesplitter::detail::CausalCluster::advanceInTime (
 using namespace hivesplitter::detail;
 
 HiveSplitter::HiveSplitter (const hivesplitter::HiveSplitter_ParameterSet& params):
+  connectivity_(NULL),
   params_(params)
 {
   if (params_.multiplicity<=0)
@@ -369,6 +375,20 @@ AbsHitSetSequence HiveSplitter::Split<AbsHitSet> (const AbsHitSet& inhits) {
   return subEvents_;
 };
 
+AbsHitSetSequence HiveSplitter::Split (const HitConnectivity& connectivity) {
+  if (connectivity.GetConnectorBlock()!=params_.connectorBlock)
+    log_fatal("The connectivity needs to be evaluated by the configured ConnectorBlock");
+  
+  AbsHitSet hs; //timesorted
+  BOOST_FOREACH(const CompactHit& h, connectivity.GetHits())
+    hs.insert(hs.end(), h.ToAbsHit());
+  
+  connectivity_ = &connectivity;
+  const AbsHitSetSequence subEvents = Split(hs);
+  connectivity_ = NULL;
+  return subEvents;
+};
+
 void HiveSplitter::AddHit (const AbsHit& h) {
   log_debug("Entering AddHit()");
   newClusters_.clear();
@@ -426,7 +446,7 @@ void HiveSplitter::AddHit (const AbsHit& h) {
 
   //if h was not added to any cluster, put it in a cluster by itself
   if (!addedToCluster) {
-    clusters_.push_back(CausalCluster(&params_));
+    clusters_.push_back(CausalCluster(&params_, connectivity_));
     clusters_.back().insertActiveHit(h);
   }
   log_debug("Leaving AddHit()");
@@ -458,7 +478,7 @@ bool HiveSplitter::AddHitToCluster (
   if (! c.getFirstHitTimes().count(h.GetDOMIndex())) { //FAST
     //never seen the DOM of h being hit before; check just causallyConnected
     for (; it!=end; ++it) {
-      if (CausallyConnected(*it, h, params_.connectorBlock)) {
+      if (CausallyConnected(*it, h, params_.connectorBlock, connectivity_)) {
         connectedDOMs.insert(it->GetDOMIndex());
         connectedHits.insert(connectedHits.begin(), *it);
         //exit condition
@@ -489,14 +509,14 @@ bool HiveSplitter::AddHitToCluster (
           continue;
         }
         
-        if ( CausallyConnected(*it, h, params_.connectorBlock))
+        if ( CausallyConnected(*it, h, params_.connectorBlock, connectivity_))
           connectedHits.insert(connectedHits.begin(), *it);
         else
           allConnected=false;
       }
       else {
         //not on the same DOM
-        if (CausallyConnected(*it, h, params_.connectorBlock)) { 
+        if (CausallyConnected(*it, h, params_.connectorBlock, connectivity_)) { 
           //try if h can connect to hits on other DOMs
           connectedDOMs.insert(it->GetDOMIndex()); // add to the number of connected DOMs
           connectedHits.insert(connectedHits.begin(), *it);
@@ -523,7 +543,7 @@ bool HiveSplitter::AddHitToCluster (
     return false;    
   }
   
-  CausalCluster newSubCluster(&params_);
+  CausalCluster newSubCluster(&params_, connectivity_);
   BOOST_FOREACH(const AbsHit& connectedHit, connectedHits)
     newSubCluster.insertActiveHit(connectedHit);
   newSubCluster.insertActiveHit(h); //insert the hit itself now
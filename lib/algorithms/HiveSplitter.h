@@ -23,6 +23,8 @@
 #include "ToolZ/OMKeyHash.h"
 #include "ToolZ/HitSorting.h"
 #include "IceHiveZ/internals/Connector.h"
+#include "IceHiveZ/internals/CompactHits.h"
+#include "IceHiveZ/internals/HitConnectivity.h"
 
 namespace hivesplitter {
   
@@ -54,11 +56,13 @@ namespace hivesplitter {
 //======================================
 namespace detail {
   
-  ///enforces timeorder in hits, which is important [h1 should be earlier than h2]
+  ///enforces timeorder in hits, which is important [h1 should be earlier than h2];
+  ///the connectivity is looked up, if it is provided
   bool CausallyConnected(
     const AbsHit& h1,
     const AbsHit& h2,
-    const ConnectorBlockConstPtr& connectorBlock);
+    const ConnectorBlockConstPtr& connectorBlock,
+    const HitConnectivity* connectivity =NULL);
   
   ///sufficent overlap in set1 and set2 by hits on 'multiplicity' many DOMs with 'multiplicityTimeWindow'
   bool CausallyOverlaps (
@@ -73,6 +77,8 @@ namespace detail {
   private: //param
     /// a major steering set of parameters
     const HiveSplitter_ParameterSet* params;
+    /// the connectivity of the hits which are split, if evaluated ahead
+    const HitConnectivity* connectivity;
     
   private: //properties
     ///the latest time to which this cluster is syncronized
@@ -93,7 +99,10 @@ namespace detail {
   public://methods
     ///constructor
     ///\param p the parameter set, which contains essential information when to connect hits
-    CausalCluster(const HiveSplitter_ParameterSet* p);
+    ///\param c the connectivity of the hits, if evaluated ahead
+    CausalCluster(
+      const HiveSplitter_ParameterSet* p,
+      const HitConnectivity* c =NULL);
     ///The active hits of this cluster has enough overlap with this hit, so that it should be considered connected
     ///\param h The hit to check
     bool connectsTo(const AbsHit &h) const;
@@ -157,6 +166,8 @@ private: //properties
   
   ///set of completed subevents which are in time-order (in every aspect)
   AbsHitSetSequence subEvents_;
+  ///the connectivity of the hits which are currently split, if evaluated ahead
+  const HitConnectivity* connectivity_;
 
 protected: //parameters
   //========================
@@ -183,6 +194,19 @@ public: //interface
   template <class AbsHitContainer>
   AbsHitSetSequence Split (const AbsHitContainer& inhits);
   
+  /** @brief ACTION; on compact hits, for callers holding them anyway:
+   * they are converted to AbsHits up front, as the causal clusters are kept of AbsHits
+   * @param hits the hits to process; need to be time-ordered
+   * @return a series of hits, which are the subevents (timeorder in sequence and in hit-order)
+   */
+  AbsHitSetSequence Split (const CompactHitSeries& inhits);
+  
+  /** @brief ACTION; with the connectivity of the hits evaluated ahead, e.g. shared with other algorithms
+   * @param connectivity the connectivity of the hits, which are split; needs to be evaluated by the configured ConnectorBlock
+   * @return a series of hits, which are the subevents (timeorder in sequence and in hit-order)
+   */
+  AbsHitSetSequence Split (const HitConnectivity& connectivity);
+  
   /// Get the time until which the result is static and no active hits are perculating in the algorithm/clusters
    hivesplitter::Time FinalizedUntil() const;
 
@@ -253,4 +277,13 @@ AbsHitSetSequence HiveSplitter::Split (const AbsHitContainer& inhits) {
   return subEvents_;
 };
 
+inline
+AbsHitSetSequence HiveSplitter::Split (const CompactHitSeries& inhits) {
+  AbsHitSet hs; //timesorted
+  BOOST_FOREACH(const CompactHit& h, inhits)
+    hs.insert(hs.end(), h.ToAbsHit());
+  
+  return Split(hs);
+};
+
 #endif
@@ -580,6 +580,14 @@ void HiveTrigger::PushEvents(const DAQTicks earliestTick) {
 }
 
 
+void HiveTrigger::PushCompleteEvents(const DAQTicks tick) {
+  //subevents can only grow by hits of the clusters in progress, or by hits yet to come
+  DAQTicks earliestUpcomingTime = tick;
+  BOOST_FOREACH(const CausalCluster &cluster, clusters_)
+    earliestUpcomingTime=std::min(earliestUpcomingTime,cluster.getEarliestTime());
+  PushEvents(earliestUpcomingTime);
+};
+
 void HiveTrigger::AdvanceTime(const DAQTicks ticks) {
   log_debug("Entering AdvanceTime()");
 
@@ -626,6 +634,15 @@ AbsDAQHitSetSequence HiveTrigger::PullSubEvents() {
 };
 
 
+DAQTicks HiveTrigger::EarliestPendingTick() const {
+  DAQTicks earliest = std::numeric_limits<DAQTicks>::max();
+  BOOST_FOREACH(const AbsDAQHitSet &set, partialSubEvents_)
+    earliest = std::min(earliest, set.begin()->GetDAQTicks());
+  BOOST_FOREACH(const CausalCluster &cluster, clusters_)
+    earliest = std::min(earliest, cluster.getEarliestTime());
+  return earliest;
+};
+
 DAQTicks HiveTrigger::FinalizedUntil() const {
   DAQTicks ticks_frombelow = std::numeric_limits<DAQTicks>::min();
   
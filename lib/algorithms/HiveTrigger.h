@@ -23,6 +23,7 @@
 #include "ToolZ/OMKeyHash.h"
 #include "ToolZ/HitSorting.h"
 #include "IceHiveZ/internals/Connector.h"
+#include "IceHiveZ/internals/CompactHits.h"
 
 namespace hivetrigger {
   
@@ -180,6 +181,10 @@ public: //interface
   hivetrigger::DAQTicks FinalizedUntil() const;
 //   hivetrigger::Time FinalizedUntil() const;
   
+  /// Get the time of the earliest hit still percolating in the clusters or partial subevents,
+  /// which can thereby still become part of a future subevent; the end of time if there is none
+  hivetrigger::DAQTicks EarliestPendingTick() const;
+  
   /// retrieve all finished SubEvents
   AbsDAQHitSetSequence PullSubEvents();
 
@@ -189,6 +194,10 @@ public: //interface
    * @param h the hit to add
    */
   void AddHit(const AbsDAQHit &h);
+  /// add a compact hit, for callers holding them anyway; it is converted to an AbsDAQHit right away,
+  /// as the causal clusters are kept of AbsDAQHits
+  /// @param h the hit to add
+  void AddHit(const CompactDAQHit &h);
 
 private:
   //================
@@ -218,6 +227,12 @@ public:
    */
   void PushEvents(const hivetrigger::DAQTicks earliestTick);
   void PushEvents(const hivetrigger::Time earliestTime);
+  /** Push all Subevents which can not grow anymore into the concluded Subevents,
+   * given that no hits before this time will be added; unlike the pushing on adding a subevent,
+   * this also pushes when there are no clusters left
+   * @param tick the time before which no hits will be added
+   */
+  void PushCompleteEvents(const hivetrigger::DAQTicks tick);
 
   /// advance the existing clusters to this time; no hits can be retrocatively inserted before this time
   /// \param time in DAQ ticks
@@ -258,4 +273,8 @@ inline
 void HiveTrigger::AdvanceTime(const hivetrigger::Time time)
   {return PushEvents(hivetrigger::NsToTicks(time));}
 
+inline
+void HiveTrigger::AddHit(const CompactDAQHit& h)
+  {AddHit(h.ToAbsDAQHit());};
+
 #endif
@@ -0,0 +1,309 @@
+/**
+ * \file ShardedHiveTrigger.cxx
+ *
+ * (c) 2012 the IceCube Collaboration
+ *
+ * $Id: ShardedHiveTrigger.cxx 99900 2013-02-26 10:10:43Z mzoll $
+ * \version $Revision: 99900 $
+ * \date $Date: 2013-02-26 11:10:43 +0100 (Tue, 26 Feb 2013) $
+ * \author Marcel Zoll <marcel.zoll@fysik.su.se>
+ */
+
+#include "IceHiveZ/algorithms/ShardedHiveTrigger.h"
+
+#include <algorithm>
+#include <limits>
+#include <boost/foreach.hpp>
+
+using namespace std;
+using namespace hivetrigger;
+using namespace hivetrigger::detail;
+
+//===============class ShardedHiveTrigger=================================
+
+ShardedHiveTrigger::ShardedHiveTrigger(
+  const HiveTrigger_ParameterSet& params,
+  const std::vector<unsigned>& coreRegion,
+  const unsigned haloDepth,
+  const unsigned nThreads) :
+  coreRegion_(coreRegion),
+  regions_(),
+  regionOffsets_(),
+  hiveTriggers_(),
+  pendingHits_(),
+  heldSubEvents_(),
+  subEvents_(),
+  advancedTo_(std::numeric_limits<DAQTicks>::min()),
+  workers_(),
+  workMutex_(),
+  workReady_(),
+  workDone_(),
+  workGeneration_(0),
+  workersBusy_(0),
+  workTick_(std::numeric_limits<DAQTicks>::min()),
+  nextRegion_(0),
+  workErrors_(),
+  stopWorkers_(false),
+  params_(params),
+  haloDepth_(haloDepth),
+  nThreads_(nThreads)
+{
+  if (!params_.connectorBlock)
+    log_fatal("Configure a ConnectorBlock");
+  if (coreRegion_.size()!=params_.connectorBlock->GetHashService()->HashSize())
+    log_fatal_stream("Need a core region for each of the "<<params_.connectorBlock->GetHashService()->HashSize()<<" DOMs, got "<<coreRegion_.size());
+
+  const size_t n_regions = coreRegion_.empty() ? 0 : *std::max_element(coreRegion_.begin(), coreRegion_.end())+1;
+  for (size_t r=0; r<n_regions; r++)
+    hiveTriggers_.push_back(new HiveTrigger(params_));
+  pendingHits_.resize(n_regions);
+  BuildRegions();
+
+  //the regions do not share anything, so each is run by exactly one thread; the calling thread is one of them
+  unsigned n_threads = (nThreads_ ? nThreads_ : std::thread::hardware_concurrency());
+  n_threads = std::max(1u, std::min<unsigned>(n_threads, n_regions));
+  workErrors_.resize(n_threads);
+  for (unsigned t=0; t+1<n_threads; t++)
+    workers_.push_back(std::thread(&ShardedHiveTrigger::RunWorker, this, t));
+  log_info_stream("Running HiveTrigger on "<<n_regions<<" regions on "<<n_threads<<" threads, reaching "<<haloDepth_<<" hops beyond their cores");
+};
+
+ShardedHiveTrigger::~ShardedHiveTrigger() {
+  {
+    std::lock_guard<std::mutex> lock(workMutex_);
+    stopWorkers_ = true;
+  }
+  workReady_.notify_all();
+  BOOST_FOREACH(std::thread& worker, workers_)
+    worker.join();
+  BOOST_FOREACH(HiveTrigger* hiveTrigger, hiveTriggers_)
+    delete hiveTrigger;
+};
+
+std::vector<unsigned> ShardedHiveTrigger::RegionsAroundCenters(
+  const CompactOMKeyHashServiceConstPtr& hasher,
+  const hive::CompiledHiveTopology& topology,
+  const std::vector<hive::StringNbr>& centers)
+{
+  if (centers.empty())
+    log_fatal("Need at least one center string");
+
+  std::vector<unsigned> coreRegion(hasher->HashSize(), 0);
+  for (CompactHash hash=0; hash<hasher->HashSize(); hash++) {
+    const hive::StringNbr string = hasher->OMKeyFromHash(hash).GetString();
+    int closest_ring = -1;
+    for (unsigned c=0; c<centers.size(); c++) {
+      const int ring = topology.WhichRing(centers[c], string);
+      if (ring>=0 && (closest_ring<0 || ring<closest_ring)) {
+        closest_ring = ring;
+        coreRegion[hash] = c;
+      }
+    }
+    if (closest_ring<0)
+      log_warn_stream("String "<<string<<" is not on any ring around the centers; put to the region of the first center");
+  }
+  return coreRegion;
+};
+
+void ShardedHiveTrigger::BuildRegions() {
+  const size_t n_doms = coreRegion_.size();
+  const Relation& related = *params_.connectorBlock->GetCumulativeSymRelation();
+
+  //every DOM reached from a core within the halo depth belongs to that region
+  std::vector<std::vector<unsigned> > domRegions(n_doms);
+  for (CompactHash hash=0; hash<n_doms; hash++)
+    domRegions[hash].push_back(coreRegion_[hash]);
+  for (unsigned hop=0; hop<haloDepth_; hop++) {
+    std::vector<std::vector<unsigned> > reached(domRegions);
+    for (CompactHash a=0; a<n_doms; a++) {
+      BOOST_FOREACH(const CompactHash b, related.RelatedSpan(a)) {
+        BOOST_FOREACH(const unsigned r, domRegions[a]) {
+          if (std::find(reached[b].begin(), reached[b].end(), r)==reached[b].end())
+            reached[b].push_back(r);
+        }
+      }
+    }
+    domRegions.swap(reached);
+  }
+
+  regions_.clear();
+  regionOffsets_.assign(1, 0);
+  size_t n_memberships = 0;
+  for (CompactHash hash=0; hash<n_doms; hash++) {
+    //the core stays first, the halos follow in order
+    std::sort(domRegions[hash].begin()+1, domRegions[hash].end());
+    regions_.insert(regions_.end(), domRegions[hash].begin(), domRegions[hash].end());
+    regionOffsets_.push_back(regions_.size());
+    n_memberships += domRegions[hash].size();
+  }
+  log_debug_stream("Each DOM belongs to "<<(n_doms ? double(n_memberships)/n_doms : 0.)<<" regions on average");
+};
+
+void ShardedHiveTrigger::AddHit(const AbsDAQHit &h) {
+  const size_t hash = h.GetDOMIndex();
+  for (size_t i=regionOffsets_[hash]; i<regionOffsets_[hash+1]; i++)
+    pendingHits_[regions_[i]].push_back(h);
+};
+
+void ShardedHiveTrigger::RunRegion(const size_t region, const DAQTicks tick) {
+  HiveTrigger& hiveTrigger = *hiveTriggers_[region];
+  BOOST_FOREACH(const AbsDAQHit& h, pendingHits_[region])
+    hiveTrigger.AddHit(h);
+  pendingHits_[region].clear();
+  hiveTrigger.AdvanceTime(tick);
+  //no hits come before the tick any more, so subevents ending before the clusters in progress are complete
+  hiveTrigger.PushCompleteEvents(tick);
+};
+
+void ShardedHiveTrigger::RunRegions(const size_t thread) {
+  try {
+    for (size_t region = nextRegion_.fetch_add(1); region<hiveTriggers_.size(); region = nextRegion_.fetch_add(1))
+      RunRegion(region, workTick_);
+  }
+  catch (...) {
+    workErrors_[thread] = std::current_exception();
+  }
+};
+
+void ShardedHiveTrigger::RunWorker(const size_t thread) {
+  uint64_t generation = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(workMutex_);
+      workReady_.wait(lock, [&]() {return stopWorkers_ || workGeneration_!=generation;});
+      if (stopWorkers_)
+        return;
+      generation = workGeneration_;
+    }
+    RunRegions(thread);
+    {
+      std::lock_guard<std::mutex> lock(workMutex_);
+      if (--workersBusy_==0)
+        workDone_.notify_one();
+    }
+  }
+};
+
+void ShardedHiveTrigger::AdvanceTime(const DAQTicks tick) {
+  log_debug("Entering AdvanceTime()");
+  advancedTo_ = std::max(advancedTo_, tick);
+
+  //hand the advance over to the workers, run regions alongside them, and wait for the last of them
+  {
+    std::lock_guard<std::mutex> lock(workMutex_);
+    workTick_ = tick;
+    nextRegion_ = 0;
+    workersBusy_ = workers_.size();
+    workGeneration_++;
+  }
+  workReady_.notify_all();
+  RunRegions(workers_.size());
+  {
+    std::unique_lock<std::mutex> lock(workMutex_);
+    workDone_.wait(lock, [&]() {return workersBusy_==0;});
+  }
+  std::exception_ptr error;
+  BOOST_FOREACH(std::exception_ptr& workError, workErrors_) {
+    if (workError && !error)
+      error = workError;
+    workError = std::exception_ptr();
+  }
+  if (error)
+    std::rethrow_exception(error);
+
+  //stitch in the order of the regions, so that the result does not depend on the threads;
+  // a held subevent can only be stitched to a future piece, if that holds a hit as early as its last one:
+  // future pieces hold hits still pending in any region, or hits added after this time
+  DAQTicks earliestTick = tick;
+  BOOST_FOREACH(HiveTrigger* hiveTrigger, hiveTriggers_) {
+    AbsDAQHitSetSequence regionSubEvents = hiveTrigger->PullSubEvents();
+    BOOST_FOREACH(AbsDAQHitSet& subEvent, regionSubEvents)
+      StitchSubEvent(subEvent);
+    earliestTick = std::min(earliestTick, hiveTrigger->EarliestPendingTick());
+  }
+  //at the end of time nothing can be stitched anymore
+  if (tick==std::numeric_limits<DAQTicks>::max())
+    earliestTick = tick;
+  PushEvents(earliestTick);
+  log_debug("Leaving AdvanceTime()");
+};
+
+void ShardedHiveTrigger::FinalizeSubEvents() {
+  AdvanceTime(std::numeric_limits<DAQTicks>::max());
+  PushEvents(std::numeric_limits<DAQTicks>::max());
+  assert(heldSubEvents_.empty());
+};
+
+void ShardedHiveTrigger::StitchSubEvent(AbsDAQHitSet& subEvent) {
+  const DAQTicks mtw = NsToTicks(params_.multiplicityTimeWindow);
+  //stitching can make the subevent overlap held ones it did not before, so go until nothing changes
+  bool stitched = true;
+  while (stitched) {
+    stitched = false;
+    AbsDAQHitSetList::iterator held = heldSubEvents_.begin();
+    while (held != heldSubEvents_.end()) {
+      const bool time_overlap = held->begin()->GetDAQTicks()<=subEvent.rbegin()->GetDAQTicks()
+        && subEvent.begin()->GetDAQTicks()<=held->rbegin()->GetDAQTicks();
+      //pieces of the same subevent seen by neighbouring regions share their hits in the halo
+      if (time_overlap
+        && (CausallyOverlaps(subEvent, *held, params_.mergeOverlap, mtw)
+          || std::includes(subEvent.begin(), subEvent.end(), held->begin(), held->end())
+          || std::includes(held->begin(), held->end(), subEvent.begin(), subEvent.end())))
+      {
+        subEvent.insert(held->begin(), held->end());
+        held = heldSubEvents_.erase(held);
+        stitched = true;
+      }
+      else
+        ++held;
+    }
+  }
+  heldSubEvents_.push_back(AbsDAQHitSet());
+  heldSubEvents_.back().swap(subEvent);
+};
+
+void ShardedHiveTrigger::PushEvents(const DAQTicks earliestTick) {
+  AbsDAQHitSetSequence finished;
+  AbsDAQHitSetList::iterator held = heldSubEvents_.begin();
+  while (held != heldSubEvents_.end()) {
+    if (held->rbegin()->GetDAQTicks() < earliestTick) {
+      finished.push_back(AbsDAQHitSet());
+      finished.back().swap(*held);
+      held = heldSubEvents_.erase(held);
+    }
+    else
+      ++held;
+  }
+  //regions finish their subevents in their own order; hand out the ones finished together ordered by their first hit
+  std::vector<AbsDAQHitSet*> ordered;
+  BOOST_FOREACH(AbsDAQHitSet& subEvent, finished)
+    ordered.push_back(&subEvent);
+  std::stable_sort(ordered.begin(), ordered.end(),
+    [](const AbsDAQHitSet* a, const AbsDAQHitSet* b) {return *a->begin() < *b->begin();});
+  BOOST_FOREACH(AbsDAQHitSet* subEvent, ordered) {
+    subEvents_.push_back(AbsDAQHitSet());
+    subEvents_.back().swap(*subEvent);
+  }
+};
+
+AbsDAQHitSetSequence ShardedHiveTrigger::PullSubEvents() {
+  AbsDAQHitSetSequence output;
+  output.swap(subEvents_);
+  return output;
+};
+
+DAQTicks ShardedHiveTrigger::FinalizedUntil() const {
+  //hits added after this will not be earlier than the time advanced to
+  DAQTicks ticks = advancedTo_;
+  //the hits still pending or held in clusters by any region can form or extend subevents
+  BOOST_FOREACH(const HiveTrigger* hiveTrigger, hiveTriggers_)
+    ticks = std::min(ticks, hiveTrigger->EarliestPendingTick());
+  BOOST_FOREACH(const std::vector<AbsDAQHit>& hits, pendingHits_) {
+    BOOST_FOREACH(const AbsDAQHit& h, hits)
+      ticks = std::min(ticks, h.GetDAQTicks());
+  }
+  //held subevents can still grow from their first hit on
+  BOOST_FOREACH(const AbsDAQHitSet& held, heldSubEvents_)
+    ticks = std::min(ticks, held.begin()->GetDAQTicks());
+  return ticks;
+};
@@ -0,0 +1,166 @@
+/**
+ * \file ShardedHiveTrigger.h
+ *
+ * (c) 2012 the IceCube Collaboration
+ *
+ * $Id: ShardedHiveTrigger.h 99900 2013-02-26 10:10:43Z mzoll $
+ * \version $Revision: 99900 $
+ * \date $Date: 2013-02-26 11:10:43 +0100 (Tue, 26 Feb 2013) $
+ * \author Marcel Zoll <marcel.zoll@fysik.su.se>
+ *
+ * HiveTrigger run independently on overlapping regions of the detector, with the subevents stitched back together
+ */
+
+#ifndef SHARDEDHIVETRIGGER_H
+#define SHARDEDHIVETRIGGER_H
+
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+
+#include "IceHiveZ/algorithms/HiveTrigger.h"
+#include "IceHiveZ/internals/Hive.h"
+
+/** Runs one HiveTrigger per region of the detector, each on its own thread, instead of one seeing every DOM.
+ * Every DOM belongs to the core of one region; a region also sees the DOMs related to its core by the ConnectorBlock,
+ * up to a number of hops, as a halo. Hits on a DOM are delivered to every region it belongs to.
+ * The subevents of the regions are stitched together where they pass CausallyOverlaps or one holds the other,
+ * as HiveTrigger does with its partial subevents; so subevents which fit into one region with its halo
+ * come out as from a single HiveTrigger, larger ones are stitched from their pieces.
+ */
+class ShardedHiveTrigger {
+  SET_LOGGER("ShardedHiveTrigger");
+private: //properties/internals
+  ///the core region of each DOM
+  std::vector<unsigned> coreRegion_;
+  ///the regions each DOM belongs to, core and halos; flat, indexed by regionOffsets_
+  std::vector<unsigned> regions_;
+  ///the first entry in regions_ of each DOM; holds one more entry than DOMs
+  std::vector<size_t> regionOffsets_;
+  ///one HiveTrigger per region
+  std::vector<HiveTrigger*> hiveTriggers_;
+  ///the hits added to each region since the last advance
+  std::vector<std::vector<AbsDAQHit> > pendingHits_;
+  ///the subevents of the regions not yet final; may still be stitched to others
+  AbsDAQHitSetList heldSubEvents_;
+  ///the stitched subevents which are final
+  AbsDAQHitSetSequence subEvents_;
+  ///the time last advanced to
+  hivetrigger::DAQTicks advancedTo_;
+  ///the threads running regions besides the calling one; they live as long as this and wait for each advance
+  std::vector<std::thread> workers_;
+  ///guards the hand over of an advance to the workers and back
+  std::mutex workMutex_;
+  ///signals the workers that an advance is to be run, or that they are to stop
+  std::condition_variable workReady_;
+  ///signals the calling thread that the last worker has run out of regions
+  std::condition_variable workDone_;
+  ///counts the advances handed to the workers
+  uint64_t workGeneration_;
+  ///the number of workers still running regions of this advance
+  size_t workersBusy_;
+  ///the time the regions are advanced to in this advance
+  hivetrigger::DAQTicks workTick_;
+  ///the next region to be run by any thread
+  std::atomic<size_t> nextRegion_;
+  ///the first error of each thread in this advance; the calling thread comes last
+  std::vector<std::exception_ptr> workErrors_;
+  ///tells the workers to stop
+  bool stopWorkers_;
+protected: //parameters
+  //========================
+  // Configurable Parameters
+  //========================
+  /// PARAM: A parameter-set to run on in every region
+  hivetrigger::HiveTrigger_ParameterSet params_;
+  /// PARAM: number of hops by the cumulative relation of the ConnectorBlock a region reaches beyond its core
+  unsigned haloDepth_;
+  /// PARAM: number of threads to run the regions on; 0 for as many as the hardware supports
+  unsigned nThreads_;
+
+public: //interface
+  //===================
+  // Interface
+  //===================
+  /** Constructor
+   * @param params the parameters of the HiveTrigger in every region
+   * @param coreRegion the core region of each DOM, indexed by its hash
+   * @param haloDepth number of hops by the cumulative relation of the ConnectorBlock a region reaches beyond its core
+   * @param nThreads number of threads to run the regions on; 0 for as many as the hardware supports
+   */
+  ShardedHiveTrigger(
+    const hivetrigger::HiveTrigger_ParameterSet& params,
+    const std::vector<unsigned>& coreRegion,
+    const unsigned haloDepth =1,
+    const unsigned nThreads =0);
+  /// Destructor
+  ~ShardedHiveTrigger();
+
+  /** partition the DOMs by their closest center string:
+   * each DOM goes to the region of the center on whose lowest ring its string is; ties go to the center given first
+   * @param hasher the hasher of the DOMs
+   * @param topology the rings around the center strings
+   * @param centers the center strings of the regions
+   * @return the core region of each DOM, indexed by its hash
+   */
+  static std::vector<unsigned> RegionsAroundCenters(
+    const CompactOMKeyHashServiceConstPtr& hasher,
+    const hive::CompiledHiveTopology& topology,
+    const std::vector<hive::StringNbr>& centers);
+
+  /// the number of regions
+  size_t NumberOfRegions() const;
+  /// the regions this DOM belongs to, core first
+  std::vector<unsigned> GetRegions(const CompactHash hash) const;
+
+  /// Get the time until which the result is static: no subevent to come holds a hit before it
+  hivetrigger::DAQTicks FinalizedUntil() const;
+  /// retrieve all finished SubEvents
+  AbsDAQHitSetSequence PullSubEvents();
+  /// add a hit; it is held until the next advance of time
+  void AddHit(const AbsDAQHit &h);
+  /// add a compact hit; it is converted at the edge
+  void AddHit(const CompactDAQHit &h);
+  /// run the regions on the hits added so far and advance them to this time; the regions are run in parallel
+  /// by the workers and the calling thread; an error of any of them is rethrown here
+  void AdvanceTime(const hivetrigger::DAQTicks tick);
+  /// pushes all hits through the regions and completes all subevents,
+  /// on the assumption that no more future hits will be added.
+  void FinalizeSubEvents();
+
+private:
+  ///find the regions of each DOM from the cores and the halos
+  void BuildRegions();
+  ///run this region on its pending hits, advance it and push out the subevents which can not grow any more
+  void RunRegion(const size_t region, const hivetrigger::DAQTicks tick);
+  ///run regions of this advance until there are none left; keep the first error as the one of this thread
+  void RunRegions(const size_t thread);
+  ///the loop of a worker: run regions of each advance handed over, until told to stop
+  void RunWorker(const size_t thread);
+  ///stitch a subevent of a region to the held ones it overlaps with
+  void StitchSubEvent(AbsDAQHitSet& subEvent);
+  ///move the held subevents which can not be stitched any more to the finished ones
+  void PushEvents(const hivetrigger::DAQTicks earliestTick);
+};
+
+
+//===========================================
+//============== IMPLEMENTATION =============
+//===========================================
+
+inline
+size_t ShardedHiveTrigger::NumberOfRegions() const
+  {return hiveTriggers_.size();};
+
+inline
+std::vector<unsigned> ShardedHiveTrigger::GetRegions(const CompactHash hash) const
+  {return std::vector<unsigned>(regions_.begin()+regionOffsets_.at(hash), regions_.begin()+regionOffsets_.at(hash+1));};
+
+inline
+void ShardedHiveTrigger::AddHit(const CompactDAQHit &h)
+  {AddHit(h.ToAbsDAQHit());};
+
+#endif //SHARDEDHIVETRIGGER_H
@@ -0,0 +1,412 @@
+/**
+ * \file BinaryIO.h
+ *
+ * (c) 2012 the IceCube Collaboration
+ *
+ * $Id: BinaryIO.h 99900 2013-02-26 10:10:43Z mzoll $
+ * \version $Revision: 99900 $
+ * \date $Date: 2013-02-26 11:10:43 +0100 (Tue, 26 Feb 2013) $
+ * \author Marcel Zoll <marcel.zoll@fysik.su.se>
+ *
+ * Minimal tools to write and read flat binary data in a defined (little-endian) byte order,
+ * while checksumming everything that passes through
+ */
+
+#ifndef BINARYIO_H
+#define BINARYIO_H
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <istream>
+#include <ostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <limits>
+#include <cstdio>
+#include <unistd.h>
+
+namespace binaryio {
+
+  ///is this machine storing numbers little-endian
+  bool IsLittleEndian();
+
+  //=================== CLASS Fnv1aHash ========================
+
+  ///The 64bit FNV-1a hash; used for checksums and fingerprints
+  class Fnv1aHash {
+  private:
+    ///the current state
+    uint64_t hash_;
+  public:
+    ///constructor; the FNV offset basis
+    Fnv1aHash();
+    ///digest these bytes
+    void Add(const void* data, const size_t size);
+    ///digest an arithmetic value in little-endian byte order
+    template <class T>
+    void AddValue(const T value);
+    ///digest a string including its length
+    void AddString(const std::string& s);
+    ///get the hash of everything digested so far
+    uint64_t Value() const;
+  };
+
+  //=================== CLASS BinaryWriter ========================
+
+  ///Writes values to a stream in little-endian byte order and checksums them
+  class BinaryWriter {
+  private:
+    ///the stream to write to
+    std::ostream& os_;
+    ///checksum of all bytes written
+    Fnv1aHash checksum_;
+    ///write these bytes
+    void WriteBytes(const void* data, const size_t size);
+  public:
+    ///constructor
+    BinaryWriter(std::ostream& os);
+    ///write an arithmetic value
+    template <class T>
+    void Write(const T value);
+    ///write a string, preceded by its length
+    void WriteString(const std::string& s);
+    ///write a vector of arithmetic values in bulk, preceded by its length
+    template <class T>
+    void WriteVector(const std::vector<T>& v);
+    ///write an array of arithmetic values in bulk, preceded by its length; reads back as a vector
+    template <class T>
+    void WriteArray(const T* data, const size_t n);
+    ///the checksum of all bytes written so far
+    uint64_t Checksum() const;
+    ///is the stream still good
+    bool Good() const;
+  };
+
+  //=================== CLASS BinaryReader ========================
+
+  ///Reads values from a stream in little-endian byte order and checksums them;
+  ///reading past the end or over corrupt data is not fatal, but signaled by Good()
+  class BinaryReader {
+  private:
+    ///the stream to read from
+    std::istream& is_;
+    ///checksum of all bytes read
+    Fnv1aHash checksum_;
+    ///did all reads succeed
+    bool good_;
+    ///read these bytes
+    void ReadBytes(void* data, const size_t size);
+    ///the bytes left to read in the stream; the largest number if it can not tell
+    uint64_t BytesLeft();
+  public:
+    ///constructor
+    BinaryReader(std::istream& is);
+    ///read an arithmetic value; zero if the read failed
+    template <class T>
+    T Read();
+    ///read a string, preceded by its length
+    std::string ReadString();
+    ///read a vector of arithmetic values in bulk, preceded by its length
+    ///\param maxSize vectors which claim to be longer, or longer than what is left in the stream, signal corrupt data
+    template <class T>
+    void ReadVector(std::vector<T>& v, const uint64_t maxSize=(uint64_t(1)<<32));
+    ///the checksum of all bytes read so far
+    uint64_t Checksum() const;
+    ///did all reads succeed so far
+    bool Good() const;
+    ///signal that the data read is not valid
+    void SetFailed();
+  };
+
+  //=================== standalone files ========================
+
+  /** write a file through a temporary file, which is renamed into place once complete,
+   * so that readers only ever see complete files, and processes which opened an older one keep using that
+   * \param path the file to write
+   * \param write puts the content; NOTE assumes signature 'bool operator()(std::ostream&)', returning if all was written
+   * \return true if written
+   */
+  template <class Content>
+  bool ReplaceFile(
+    const std::string& path,
+    const Content& write);
+
+  /** write a file holding a magic number, the content and a checksum over all of it; the file is replaced by ReplaceFile
+   * \param path the file to write
+   * \param magic identifies the type of content
+   * \param write puts the content; NOTE assumes signature 'void operator()(BinaryWriter&)'
+   * \return true if written
+   */
+  template <class Content>
+  bool WriteFile(
+    const std::string& path,
+    const uint32_t magic,
+    const Content& write);
+
+  /** read a file which has been written by WriteFile
+   * \param path the file to read
+   * \param magic the type of content expected
+   * \param read gets the content; NOTE assumes signature 'void operator()(BinaryReader&)'
+   * \return true if the file exists, holds this type of content and everything was read and checksummed successfully
+   */
+  template <class Content>
+  bool ReadFile(
+    const std::string& path,
+    const uint32_t magic,
+    const Content& read);
+
+  namespace detail {
+    ///reverse the byte order of a value in place
+    void SwapBytes(void* data, const size_t size);
+  }
+}
+
+
+//===========================================
+//============== IMPLEMENTATION =============
+//===========================================
+
+inline
+bool binaryio::IsLittleEndian() {
+  const uint16_t probe = 1;
+  return *reinterpret_cast<const uint8_t*>(&probe) == 1;
+};
+
+inline
+void binaryio::detail::SwapBytes(void* data, const size_t size) {
+  uint8_t* bytes = static_cast<uint8_t*>(data);
+  std::reverse(bytes, bytes+size);
+};
+
+//=================== CLASS Fnv1aHash ========================
+
+inline
+binaryio::Fnv1aHash::Fnv1aHash()
+: hash_(14695981039346656037ULL)
+{};
+
+inline
+void binaryio::Fnv1aHash::Add(const void* data, const size_t size) {
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  for (size_t i=0; i<size; i++) {
+    hash_ ^= bytes[i];
+    hash_ *= 1099511628211ULL;
+  }
+};
+
+template <class T>
+void binaryio::Fnv1aHash::AddValue(const T value) {
+  T v = value;
+  if (!IsLittleEndian())
+    detail::SwapBytes(&v, sizeof(T));
+  Add(&v, sizeof(T));
+};
+
+inline
+void binaryio::Fnv1aHash::AddString(const std::string& s) {
+  AddValue<uint64_t>(s.size());
+  Add(s.data(), s.size());
+};
+
+inline
+uint64_t binaryio::Fnv1aHash::Value() const
+  {return hash_;};
+
+//=================== CLASS BinaryWriter ========================
+
+inline
+binaryio::BinaryWriter::BinaryWriter(std::ostream& os)
+: os_(os)
+{};
+
+inline
+void binaryio::BinaryWriter::WriteBytes(const void* data, const size_t size) {
+  os_.write(static_cast<const char*>(data), size);
+  checksum_.Add(data, size);
+};
+
+template <class T>
+void binaryio::BinaryWriter::Write(const T value) {
+  T v = value;
+  if (!IsLittleEndian())
+    detail::SwapBytes(&v, sizeof(T));
+  WriteBytes(&v, sizeof(T));
+};
+
+inline
+void binaryio::BinaryWriter::WriteString(const std::string& s) {
+  Write<uint64_t>(s.size());
+  WriteBytes(s.data(), s.size());
+};
+
+template <class T>
+void binaryio::BinaryWriter::WriteVector(const std::vector<T>& v)
+  {WriteArray(v.data(), v.size());};
+
+template <class T>
+void binaryio::BinaryWriter::WriteArray(const T* data, const size_t n) {
+  Write<uint64_t>(n);
+  if (IsLittleEndian() || sizeof(T)==1) {
+    if (n)
+      WriteBytes(data, n*sizeof(T));
+  }
+  else {
+    for (size_t i=0; i<n; i++)
+      Write<T>(data[i]);
+  }
+};
+
+inline
+uint64_t binaryio::BinaryWriter::Checksum() const
+  {return checksum_.Value();};
+
+inline
+bool binaryio::BinaryWriter::Good() const
+  {return os_.good();};
+
+//=================== CLASS BinaryReader ========================
+
+inline
+binaryio::BinaryReader::BinaryReader(std::istream& is)
+: is_(is),
+  good_(true)
+{};
+
+inline
+void binaryio::BinaryReader::ReadBytes(void* data, const size_t size) {
+  if (!good_ || !is_.read(static_cast<char*>(data), size)) {
+    good_ = false;
+    memset(data, 0, size);
+    return;
+  }
+  checksum_.Add(data, size);
+};
+
+inline
+uint64_t binaryio::BinaryReader::BytesLeft() {
+  const std::streampos pos = is_.tellg();
+  if (pos==std::streampos(-1))
+    return std::numeric_limits<uint64_t>::max();
+  is_.seekg(0, std::ios::end);
+  const std::streampos end = is_.tellg();
+  is_.seekg(pos);
+  if (end==std::streampos(-1) || end<pos)
+    return std::numeric_limits<uint64_t>::max();
+  return uint64_t(end-pos);
+};
+
+template <class T>
+T binaryio::BinaryReader::Read() {
+  T v;
+  ReadBytes(&v, sizeof(T));
+  if (!IsLittleEndian())
+    detail::SwapBytes(&v, sizeof(T));
+  return v;
+};
+
+inline
+std::string binaryio::BinaryReader::ReadString() {
+  const uint64_t size = Read<uint64_t>();
+  if (size > (uint64_t(1)<<20)) {
+    good_ = false;
+    return std::string();
+  }
+  std::string s(size, '\0');
+  if (size)
+    ReadBytes(&s[0], size);
+  return s;
+};
+
+template <class T>
+void binaryio::BinaryReader::ReadVector(std::vector<T>& v, const uint64_t maxSize) {
+  const uint64_t size = Read<uint64_t>();
+  //the length is not checksummed yet, so it must not make us allocate more than the stream can fill
+  if (!good_ || size > maxSize || size > BytesLeft()/sizeof(T)) {
+    good_ = false;
+    v.clear();
+    return;
+  }
+  v.resize(size);
+  if (size==0)
+    return;
+  ReadBytes(&v[0], size*sizeof(T));
+  if (!IsLittleEndian() && sizeof(T)>1) {
+    for (size_t i=0; i<v.size(); i++)
+      detail::SwapBytes(&v[i], sizeof(T));
+  }
+};
+
+inline
+uint64_t binaryio::BinaryReader::Checksum() const
+  {return checksum_.Value();};
+
+inline
+bool binaryio::BinaryReader::Good() const
+  {return good_;};
+
+inline
+void binaryio::BinaryReader::SetFailed()
+  {good_ = false;};
+
+//=================== standalone files ========================
+
+template <class Content>
+bool binaryio::ReplaceFile(
+  const std::string& path,
+  const Content& write)
+{
+  std::ostringstream tmp_path;
+  tmp_path<<path<<".tmp"<<getpid();
+  {
+    std::ofstream ofs(tmp_path.str().c_str(), std::ios::binary | std::ios::trunc);
+    const bool written = write(static_cast<std::ostream&>(ofs));
+    ofs.flush();
+    if (!written || !ofs.good()) {
+      std::remove(tmp_path.str().c_str());
+      return false;
+    }
+  }
+  if (std::rename(tmp_path.str().c_str(), path.c_str())!=0) {
+    std::remove(tmp_path.str().c_str());
+    return false;
+  }
+  return true;
+};
+
+template <class Content>
+bool binaryio::WriteFile(
+  const std::string& path,
+  const uint32_t magic,
+  const Content& write)
+{
+  return ReplaceFile(path, [magic, &write](std::ostream& os) {
+    BinaryWriter writer(os);
+    writer.Write<uint32_t>(magic);
+    write(writer);
+    writer.Write<uint64_t>(writer.Checksum());
+    return writer.Good();
+  });
+};
+
+template <class Content>
+bool binaryio::ReadFile(
+  const std::string& path,
+  const uint32_t magic,
+  const Content& read)
+{
+  std::ifstream ifs(path.c_str(), std::ios::binary);
+  if (!ifs)
+    return false;
+  BinaryReader reader(ifs);
+  if (reader.Read<uint32_t>()!=magic)
+    return false;
+  read(reader);
+  const uint64_t checksum = reader.Checksum();
+  const uint64_t stored_checksum = reader.Read<uint64_t>();
+  return reader.Good() && checksum==stored_checksum;
+};
+
+#endif //BINARYIO_H
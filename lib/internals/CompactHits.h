@@ -0,0 +1,303 @@
+/**
+ * \file CompactHits.h
+ *
+ * (c) 2012 the IceCube Collaboration
+ *
+ * $Id: CompactHits.h 99900 2013-02-26 10:10:43Z mzoll $
+ * \version $Revision: 99900 $
+ * \date $Date: 2013-02-26 11:10:43 +0100 (Tue, 26 Feb 2013) $
+ * \author Marcel Zoll <marcel.zoll@fysik.su.se>
+ *
+ * Packed value-types of hits, which only carry what the algorithms need: a DOM index and a time;
+ * conversion to and from AbsHit and AbsDAQHit happens at the edges of the algorithms
+ */
+
+#ifndef COMPACTHITS_H
+#define COMPACTHITS_H
+
+#include <stdint.h>
+#include <vector>
+#include <ostream>
+#include <algorithm>
+
+#include <boost/range/iterator_range.hpp>
+
+#include "ToolZ/OMKeyHash.h"
+#include "ToolZ/Hitclasses.h"
+
+///the DOM index in its packed form; 32 bits hold the hash of any detector configuration
+typedef uint32_t PackedHash;
+
+//=================== CLASS CompactHit ========================
+
+/** A hit reduced to DOM index and time in ns, packed into 16 bytes;
+ * orders and compares exactly like the AbsHit it was created from
+ */
+class CompactHit {
+public: //properties
+  ///the time of the hit
+  double time_;
+  ///the index of the hit DOM
+  PackedHash dom_;
+public: //constructors
+  ///blank constructor
+  CompactHit();
+  ///constructor
+  CompactHit(const CompactHash dom, const double time);
+  ///conversion from the full hit
+  explicit CompactHit(const AbsHit& h);
+public: //methods
+  ///get the index of the hit DOM
+  CompactHash GetDOMIndex() const;
+  ///get the time of the hit
+  double GetTime() const;
+  ///get the time difference to that other hit: 'other.time - this.time'
+  double TimeDiff(const CompactHit& other) const;
+  ///conversion to the full hit
+  AbsHit ToAbsHit() const;
+  ///time order, ties broken by DOM index
+  bool operator<(const CompactHit& other) const;
+  bool operator==(const CompactHit& other) const;
+};
+
+///a time ordered series of compact hits
+typedef std::vector<CompactHit> CompactHitSeries;
+///a view onto contiguous compact hits, which are owned elsewhere
+typedef boost::iterator_range<const CompactHit*> CompactHitSpan;
+///view onto the whole series
+CompactHitSpan ToSpan(const CompactHitSeries& hits);
+
+std::ostream& operator<<(std::ostream& oss, const CompactHit& h);
+
+//=================== CLASS CompactDAQHit =====================
+
+/** A hit reduced to DOM index and time in DAQ ticks, packed into 16 bytes;
+ * orders and compares exactly like the AbsDAQHit it was created from
+ */
+class CompactDAQHit {
+public: //properties
+  ///the time of the hit in DAQ ticks
+  int64_t ticks_;
+  ///the index of the hit DOM
+  PackedHash dom_;
+public: //constructors
+  ///blank constructor
+  CompactDAQHit();
+  ///constructor
+  CompactDAQHit(const CompactHash dom, const int64_t ticks);
+  ///conversion from the full hit
+  explicit CompactDAQHit(const AbsDAQHit& h);
+public: //methods
+  ///get the index of the hit DOM
+  CompactHash GetDOMIndex() const;
+  ///get the time of the hit in DAQ ticks
+  int64_t GetDAQTicks() const;
+  ///get the time difference in ns to that other hit: 'other.time - this.time'
+  double TimeDiff(const CompactDAQHit& other) const;
+  ///conversion to the full hit
+  AbsDAQHit ToAbsDAQHit() const;
+  ///time order, ties broken by DOM index
+  bool operator<(const CompactDAQHit& other) const;
+  bool operator==(const CompactDAQHit& other) const;
+};
+
+///a time ordered series of compact DAQ hits
+typedef std::vector<CompactDAQHit> CompactDAQHitSeries;
+
+std::ostream& operator<<(std::ostream& oss, const CompactDAQHit& h);
+
+//=================== CLASS DOMHitIndex =======================
+
+/** The hits of a time ordered series grouped by DOM: for every DOM the positions of its hits in the series;
+ * as the positions are ascending, the hits of every DOM are in time order as well.
+ * Lets algorithms visit only the hits on the DOMs they are interested in
+ */
+class DOMHitIndex {
+public:
+  ///type of the positions in the series
+  typedef uint32_t Position;
+private:
+  ///for every DOM the first entry in positions_; holds hashSize+1 entries
+  std::vector<Position> offsets_;
+  ///the positions of the hits, grouped by DOM
+  std::vector<Position> positions_;
+public:
+  ///blank constructor
+  DOMHitIndex();
+  ///constructor; index this series of hits on a detector of this many DOMs
+  template <class CompactHitContainer>
+  DOMHitIndex(const CompactHitContainer& hits, const size_t hashSize);
+  ///the first position of a hit on this DOM
+  const Position* Begin(const CompactHash dom) const;
+  ///one past the last position of a hit on this DOM
+  const Position* End(const CompactHash dom) const;
+  ///the first position of a hit on this DOM, which is not before 'pos'
+  const Position* LowerBound(const CompactHash dom, const Position pos) const;
+};
+
+//=================== conversions =============================
+
+///convert a (time ordered) container of AbsHits into a series of compact hits, preserving the order
+template <class AbsHitContainer>
+CompactHitSeries ToCompactHits(const AbsHitContainer& hits);
+
+///convert a (time ordered) container of AbsDAQHits into a series of compact DAQ hits, preserving the order
+template <class AbsDAQHitContainer>
+CompactDAQHitSeries ToCompactDAQHits(const AbsDAQHitContainer& hits);
+
+
+//===========================================
+//============== IMPLEMENTATION =============
+//===========================================
+
+//=================== CLASS CompactHit ========================
+
+inline
+CompactHit::CompactHit()
+: time_(0.), dom_(0)
+{};
+
+inline
+CompactHit::CompactHit(const CompactHash dom, const double time)
+: time_(time), dom_(dom)
+{};
+
+inline
+CompactHit::CompactHit(const AbsHit& h)
+: time_(h.GetTime()), dom_(h.GetDOMIndex())
+{};
+
+inline
+CompactHash CompactHit::GetDOMIndex() const
+  {return dom_;};
+
+inline
+double CompactHit::GetTime() const
+  {return time_;};
+
+inline
+double CompactHit::TimeDiff(const CompactHit& other) const
+  {return other.time_-time_;};
+
+inline
+AbsHit CompactHit::ToAbsHit() const
+  {return AbsHit(dom_, time_);};
+
+inline
+bool CompactHit::operator<(const CompactHit& other) const
+  {return time_<other.time_ || (time_==other.time_ && dom_<other.dom_);};
+
+inline
+bool CompactHit::operator==(const CompactHit& other) const
+  {return time_==other.time_ && dom_==other.dom_;};
+
+inline
+CompactHitSpan ToSpan(const CompactHitSeries& hits)
+  {return CompactHitSpan(hits.data(), hits.data()+hits.size());};
+
+inline
+std::ostream& operator<<(std::ostream& oss, const CompactHit& h)
+  {return oss<<"CompactHit("<<h.dom_<<", "<<h.time_<<")";};
+
+//=================== CLASS CompactDAQHit =====================
+
+inline
+CompactDAQHit::CompactDAQHit()
+: ticks_(0), dom_(0)
+{};
+
+inline
+CompactDAQHit::CompactDAQHit(const CompactHash dom, const int64_t ticks)
+: ticks_(ticks), dom_(dom)
+{};
+
+inline
+CompactDAQHit::CompactDAQHit(const AbsDAQHit& h)
+: ticks_(h.GetDAQTicks()), dom_(h.GetDOMIndex())
+{};
+
+inline
+CompactHash CompactDAQHit::GetDOMIndex() const
+  {return dom_;};
+
+inline
+int64_t CompactDAQHit::GetDAQTicks() const
+  {return ticks_;};
+
+inline
+double CompactDAQHit::TimeDiff(const CompactDAQHit& other) const
+  {return (other.ticks_-ticks_)/10.;};
+
+inline
+AbsDAQHit CompactDAQHit::ToAbsDAQHit() const
+  {return AbsDAQHit(dom_, ticks_);};
+
+inline
+bool CompactDAQHit::operator<(const CompactDAQHit& other) const
+  {return ticks_<other.ticks_ || (ticks_==other.ticks_ && dom_<other.dom_);};
+
+inline
+bool CompactDAQHit::operator==(const CompactDAQHit& other) const
+  {return ticks_==other.ticks_ && dom_==other.dom_;};
+
+inline
+std::ostream& operator<<(std::ostream& oss, const CompactDAQHit& h)
+  {return oss<<"CompactDAQHit("<<h.dom_<<", "<<h.ticks_<<")";};
+
+//=================== CLASS DOMHitIndex =======================
+
+inline
+DOMHitIndex::DOMHitIndex()
+: offsets_(1, 0),
+  positions_()
+{};
+
+template <class CompactHitContainer>
+DOMHitIndex::DOMHitIndex(const CompactHitContainer& hits, const size_t hashSize)
+: offsets_(hashSize+1, 0),
+  positions_(hits.size())
+{
+  //counting sort by DOM; hits are visited in order, so positions stay ascending within each DOM
+  for (typename CompactHitContainer::const_iterator it=hits.begin(); it!=hits.end(); ++it)
+    offsets_[it->GetDOMIndex()+1]++;
+  for (size_t d=0; d<hashSize; d++)
+    offsets_[d+1] += offsets_[d];
+  std::vector<Position> fill(offsets_.begin(), offsets_.end()-1);
+  Position pos = 0;
+  for (typename CompactHitContainer::const_iterator it=hits.begin(); it!=hits.end(); ++it, ++pos)
+    positions_[fill[it->GetDOMIndex()]++] = pos;
+};
+
+inline
+const DOMHitIndex::Position* DOMHitIndex::Begin(const CompactHash dom) const
+  {return positions_.data()+offsets_[dom];};
+
+inline
+const DOMHitIndex::Position* DOMHitIndex::End(const CompactHash dom) const
+  {return positions_.data()+offsets_[dom+1];};
+
+inline
+const DOMHitIndex::Position* DOMHitIndex::LowerBound(const CompactHash dom, const Position pos) const
+  {return std::lower_bound(Begin(dom), End(dom), pos);};
+
+//=================== conversions =============================
+
+template <class AbsHitContainer>
+CompactHitSeries ToCompactHits(const AbsHitContainer& hits) {
+  CompactHitSeries chits;
+  chits.reserve(hits.size());
+  for (typename AbsHitContainer::const_iterator it=hits.begin(); it!=hits.end(); ++it)
+    chits.push_back(CompactHit(*it));
+  return chits;
+};
+
+template <class AbsDAQHitContainer>
+CompactDAQHitSeries ToCompactDAQHits(const AbsDAQHitContainer& hits) {
+  CompactDAQHitSeries chits;
+  chits.reserve(hits.size());
+  for (typename AbsDAQHitContainer::const_iterator it=hits.begin(); it!=hits.end(); ++it)
+    chits.push_back(CompactDAQHit(*it));
+  return chits;
+};
+
+#endif //COMPACTHITS_H
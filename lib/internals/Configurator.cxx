@@ -11,14 +11,12 @@
  */
 
 #include "IceHiveZ/internals/Configurator.h"
+#include "IceHiveZ/internals/ConnectorCache.h"
+#include "IceHiveZ/internals/ConnectorBlockImage.h"
 
-#define MULTITHREADING_ENABLED 0 //cannot be activated if a python object is hooked up at ::RelationConfig::ConnectFrom/To
-
-#if MULTITHREADING_ENABLED
-  #include <thread>         // std::thread
-  #include <mutex>          // std::mutex 
-  static std::mutex mtx; 
-#endif //MULTITHREADING_ENABLED
+#include <thread>
+#include <atomic>
+#include <exception>
   
 using namespace std;
 
@@ -49,12 +47,37 @@ std::string Configurator::GetName() const
 {return name_;};
 
 Connector Configurator::BuildConnector (
-  const HashedGeometryConstPtr& hashedGeo) const 
+  const HashedGeometryConstPtr& hashedGeo,
+  const unsigned maxThreads) const 
 {
   Connector con(name_, 
                 hashedGeo,
                 connectionConfig_->BuildConnection(hashedGeo),
-                relationConfig_->BuildRelation(hashedGeo));
+                relationConfig_->BuildRelation(hashedGeo, maxThreads));
+  return con;
+}
+
+Connector Configurator::BuildConnector (
+  const HashedGeometryConstPtr& hashedGeo,
+  const RelationPtr& relation) const 
+{
+  Connector con(name_, 
+                hashedGeo,
+                connectionConfig_->BuildConnection(hashedGeo),
+                relation);
+  return con;
+}
+
+Connector Configurator::BuildConnector (
+  const HashedGeometryConstPtr& hashedGeo,
+  const RelationPtr& relation,
+  const RelationPtr& symRelation) const 
+{
+  Connector con(name_, 
+                hashedGeo,
+                connectionConfig_->BuildConnection(hashedGeo),
+                relation,
+                symRelation);
   return con;
 }
 
@@ -64,9 +87,30 @@ bool AllTrue(const OMKey&) {
   return true;
 };
 
+/** hash all distances of the geometry up front, so there will be no conflicts later between threads filling it lazily;
+ * not needed if every relation carries the distances on its edges, as then the connectors never ask for them
+ */
+void HashDistancesUnlessCarried(
+  const HashedGeometryConstPtr& hashedGeo,
+  const std::vector<RelationPtr>& relations)
+{
+  BOOST_FOREACH(const RelationPtr& relation, relations) {
+    if (!relation || !relation->HasPayload()) {
+      //the geometry was just created by the caller, so it is still safe to modify it
+      boost::const_pointer_cast<DistanceService>(hashedGeo->GetDistService())->HashAllDistances();
+      return;
+    }
+  }
+};
+
 ConfiguratorBlock::ConfiguratorBlock()
 : config_list_(),
-  hashOMKeys_(AllTrue)
+  hashOMKeys_(AllTrue),
+  calibrationSamples_(1000),
+  calibrationTimeRange_(1000.),
+  nThreads_(0),
+  cacheDirectory_(),
+  imageFile_()
 {};
 
 void ConfiguratorBlock::AddConfigurator(const Configurator& hc) {
@@ -77,6 +121,14 @@ void ConfiguratorBlock::SetOMKeys(const boost::function<bool (const OMKey&)>& ha
   hashOMKeys_ = hashOMKeys;
 };
 
+void ConfiguratorBlock::SetCacheDirectory(const std::string& directory) {
+  cacheDirectory_ = directory;
+};
+
+void ConfiguratorBlock::SetImageFile(const std::string& path) {
+  imageFile_ = path;
+};
+
 ConnectorBlock ConfiguratorBlock::BuildConnectorBlock (
   const I3OMGeoMap& omgeo) const
 {
@@ -89,9 +141,8 @@ ConnectorBlock ConfiguratorBlock::BuildConnectorBlock (
   }
   const HashedGeometryConstPtr hashedGeo = boost::make_shared<const HashedGeometry>(omgeo, omkey_set);
   
-  ConnectorBlock cb(hashedGeo);
-  
-  //reorder the Configurator list so that the fastest evaluating Connectors are on top
+  //reorder the Configurator list so that the fastest evaluating Connectors are on top;
+  // the evaluation order is later refined by the ConnectorBlock from measured statistics
   ConfiguratorList config_list_sorted(config_list_.begin(), config_list_.end());
   struct desc_speed {
     bool operator() (const Configurator& lhs, const Configurator& rhs) const
@@ -99,63 +150,111 @@ ConnectorBlock ConfiguratorBlock::BuildConnectorBlock (
   };
   config_list_sorted.sort(desc_speed());
   
-#if MULTITHREADING_ENABLED
-  struct Configurator_BuildConnector_Wrapper {
-    ConnectorPtr con_; //return object of subcall
-    const Configurator& config_; // wrapped object
-    const HashedGeometryConstPtr hashedGeo_; //call parameter
-    
-    ///construct
-    Configurator_BuildConnector_Wrapper (
-      ConnectorPtr& con,
-      const Configurator& config,
-      const HashedGeometryConstPtr hashedGeo)
-    : con_(con),
-      config_(config),
-      hashedGeo_(hashedGeo),
-    {};
-    
-    /// parameterless call
-    void operator() () {
-      log_debug("BUILD");
-      ConnectorPtr con = boost::make_shared<Connector>(config_.BuildConnector(hashedGeo_));
-      log_debug("DONE");
-      con_ = con;
-    };
-  }; //Configurator_BuildConnector_Wrapper
-
-  //do the tedious hashing now, so there will be no I/O conflicts later between threads
-  hashedGeo.distService_->HashAllDistances();
+  std::vector<const Configurator*> configs;
+  BOOST_FOREACH(const Configurator& c, config_list_sorted)
+    configs.push_back(&c);
+  const size_t n_configs = configs.size();
   
-  //prepare some lists to store builders and their results
-  std::vector<ConnectorPtr> connector_list;
-  connector_list.reserve(config_list_sorted.size());
-  std::vector<std::thread*> connector_builders;
-  connector_builders.reserve(config_list_sorted.size());
+  //look up the relations in the image or cache; the key is the geometry and the configuration of all relations
+  std::vector<RelationPtr> relations(n_configs);
+  bool cacheable = !cacheDirectory_.empty() || !imageFile_.empty();
+  uint64_t cache_key = 0;
+  if (cacheable) {
+    binaryio::Fnv1aHash fingerprint = ConnectorCache::GeometryFingerprint(hashedGeo);
+    for (size_t i=0; i<n_configs && cacheable; i++) {
+      fingerprint.AddString(configs[i]->GetName());
+      cacheable = configs[i]->relationConfig_->Fingerprint(fingerprint, hashedGeo);
+    }
+    cache_key = fingerprint.Value();
+    if (!cacheable)
+      log_info("Configuration cannot be fingerprinted; not using the cache");
+  }
   
-  //spawn the threads
-  BOOST_FOREACH(const Configurator& config, config_list_sorted) {
-  //const Configurator& config = *config_list_sorted.begin(); {
-    ConnectorPtr conptr;
-    connector_list.push_back(conptr);
-    Configurator_BuildConnector_Wrapper wrap(hashedGeo);
-    log_info_stream("Spawn thread for "<<config.GetName());
-    connector_builders.push_back(new std::thread(wrap));
+  //the image holds all relations of the block, which are used in place and need no further building
+  if (cacheable && !imageFile_.empty()) {
+    const ConnectorBlockImageConstPtr image = ConnectorBlockImage::Map(imageFile_, cache_key, hashedGeo->GetHashService());
+    bool fits = image && image->NumberOfConnectors()==n_configs;
+    for (size_t i=0; fits && i<n_configs; i++)
+      fits = (image->GetName(i)==configs[i]->GetName());
+    if (fits) {
+      for (size_t i=0; i<n_configs; i++)
+        relations[i] = image->GetRelation(i);
+      HashDistancesUnlessCarried(hashedGeo, relations);
+      ConnectorBlock cb(hashedGeo, image->GetCumulativeRelation(), image->GetCumulativeSymRelation());
+      for (size_t i=0; i<n_configs; i++)
+        cb.AddConnector(boost::make_shared<Connector>(
+          configs[i]->BuildConnector(hashedGeo, relations[i], image->GetSymRelation(i))));
+      cb.Calibrate(calibrationSamples_, calibrationTimeRange_);
+      return cb;
+    }
   }
-
-  //join all treads and add up the results
-  for (size_t i=0; i< connector_builders.size(); i++) {
-    log_warn_stream("waiting"<<i);
-    connector_builders.at(i)->join();
-    log_warn_stream("waited"<<i);
-    //preserving order in list //NOTE also possible to do this asyncronous, I guess
-    cb.AddConnector(connector_list[i]);
+  
+  const bool cache_hit = cacheable && !cacheDirectory_.empty()
+    && ConnectorCache(cacheDirectory_).Load(cache_key, hashedGeo->GetHashService(), relations)
+    && relations.size()==n_configs;
+  if (cacheable && !cache_hit)
+    relations.assign(n_configs, RelationPtr());
+  
+  //relations still to be built need the distances anyway; loaded ones only if they do not carry them
+  HashDistancesUnlessCarried(hashedGeo, relations);
+  
+  //the threads are shared out: the connectors are built in parallel, each relation with its share of the rest
+  const unsigned n_budget = std::max(1u, nThreads_ ? nThreads_ : std::thread::hardware_concurrency());
+  const unsigned n_threads = std::max(1u, std::min<unsigned>(n_budget, n_configs));
+  const unsigned n_relation_threads = std::max(1u, n_budget/n_threads);
+  
+  //relations which cannot be built concurrently (e.g. by python predicates) are pre-evaluated here,
+  // so that only plain tables are handed to the threads; they have all the threads to themselves
+  for (size_t i=0; i<n_configs; i++) {
+    if (!relations[i] && ! configs[i]->relationConfig_->IsThreadSafe()) {
+      log_info_stream("Building Relation for "<<configs[i]->GetName()<<" serially");
+      relations[i] = configs[i]->relationConfig_->BuildRelation(hashedGeo, n_budget);
+    }
   }
-#else
-  BOOST_FOREACH(const Configurator& c, config_list_sorted) {
-    const ConnectorPtr con= boost::make_shared<Connector>(c.BuildConnector(hashedGeo));
-    cb.AddConnector(con);
+  
+  //task pool: every worker takes the next unbuilt connector; the results are stored by position
+  std::vector<ConnectorPtr> connectors(n_configs);
+  std::vector<std::exception_ptr> errors(n_configs);
+  std::atomic<size_t> next_task(0);
+  const auto worker = [&]() {
+    for (size_t i = next_task++; i<n_configs; i = next_task++) {
+      try {
+        const Configurator& c = *configs[i];
+        connectors[i] = boost::make_shared<Connector>(relations[i]
+          ? c.BuildConnector(hashedGeo, relations[i])
+          : c.BuildConnector(hashedGeo, n_relation_threads));
+      }
+      catch (...) {
+        errors[i] = std::current_exception();
+      }
+    }
   };
-#endif
+  
+  log_info_stream("Building "<<n_configs<<" Connectors with "<<n_threads<<" threads, each relation with up to "<<n_relation_threads);
+  std::vector<std::thread> workers;
+  for (unsigned t=1; t<n_threads; t++)
+    workers.push_back(std::thread(worker));
+  worker();
+  BOOST_FOREACH(std::thread& w, workers)
+    w.join();
+  
+  //preserving the order of the list
+  ConnectorBlock cb(hashedGeo);
+  for (size_t i=0; i<n_configs; i++) {
+    if (errors[i])
+      std::rethrow_exception(errors[i]);
+    cb.AddConnector(connectors[i]);
+  }
+  
+  if (cacheable && !cacheDirectory_.empty() && !cache_hit) {
+    std::vector<RelationConstPtr> built;
+    BOOST_FOREACH(const ConnectorPtr& c, connectors)
+      built.push_back(c->GetRelation());
+    ConnectorCache(cacheDirectory_).Store(cache_key, built);
+  }
+  if (cacheable && !imageFile_.empty())
+    ConnectorBlockImage::Write(imageFile_, cache_key, cb);
+  //the static speed ratings are only a first guess; measure the real cost and acceptance
+  cb.Calibrate(calibrationSamples_, calibrationTimeRange_);
   return cb;
 }
\ No newline at end of file
@@ -69,8 +69,26 @@ public: //interface
 
   /// Build the Connector from the configurations contained in this object
   ///\param hashedgeo hashed Detector geometry
+  ///\param maxThreads the budget of threads the Relation may be built with; 0 for no limit
   Connector BuildConnector (
-    const HashedGeometryConstPtr& hashedGeo) const;
+    const HashedGeometryConstPtr& hashedGeo,
+    const unsigned maxThreads =0) const;
+  
+  /// Build the Connector from the configurations contained in this object, but with a readily built Relation
+  ///\param hashedgeo hashed Detector geometry
+  ///\param relation the Relation built from the relation configuration
+  Connector BuildConnector (
+    const HashedGeometryConstPtr& hashedGeo,
+    const RelationPtr& relation) const;
+  
+  /// Build the Connector from the configurations contained in this object, but with a readily built Relation and its symmetric closure
+  ///\param hashedgeo hashed Detector geometry
+  ///\param relation the Relation built from the relation configuration
+  ///\param symRelation the symmetric closure of relation
+  Connector BuildConnector (
+    const HashedGeometryConstPtr& hashedGeo,
+    const RelationPtr& relation,
+    const RelationPtr& symRelation) const;
 };
 
 typedef boost::shared_ptr<Configurator> ConfiguratorPtr;
@@ -88,13 +106,29 @@ class ConfiguratorBlock {
 public:
   ///holds all sub configurators
   ConfiguratorList config_list_;
-  /// specify the OMKeys that should be hashed; a function of signature: bool (const OMKey&)
+  /// specify the OMKeys that should be hashed; a function of signature: bool (const OMKey&);
+  /// NOTE a change requires a complete rebuild; to follow changing bad-DOM lists use ConnectorBlock::UpdateDOMMask() instead
   boost::function<bool (const OMKey&)> hashOMKeys_;
+  /// PARAM: number of DOM pairs on which the evaluation order of the built connectors is calibrated; 0 to disable
+  size_t calibrationSamples_;
+  /// PARAM: range of time differences [ns] on which the built connectors are calibrated
+  double calibrationTimeRange_;
+  /// PARAM: number of threads the connectors are built with, shared with the building of their relations;
+  /// 0 for as many as the hardware supports, 1 to build serially
+  unsigned nThreads_;
+  /// PARAM: directory of the on-disk cache of built relations; empty to disable
+  std::string cacheDirectory_;
+  /// PARAM: file of a memory-mapped image of the built relations, which is shared by all processes mapping it; empty to disable
+  std::string imageFile_;
 public: //Setters/Manipulators
   /// add a sub-configurator
   void AddConfigurator(const Configurator& hc);
   /// set a set of OMKeys that are to be soelmny considered 
   void SetOMKeys(const boost::function<bool (const OMKey&)>& hashOMKeys);
+  /// use this directory to cache built relations, keyed by geometry and configuration; empty to disable
+  void SetCacheDirectory(const std::string& directory);
+  /// map the relations from this image file, if it fits the geometry and configuration, or write it after building; empty to disable
+  void SetImageFile(const std::string& path);
 public: //ctors
   ///constructor
   ConfiguratorBlock();
@@ -31,6 +31,46 @@ void Connection::Configure(const HashedGeometryConstPtr& hashedGeo)
 
 Connection::~Connection() {};
 
+bool Connection::IsSymmetric() const
+{ return false; };
+
+bool Connection::IsSymmetricAtEqualTime() const
+{ return IsSymmetric(); };
+
+bool Connection::AreConnected(
+  const CompactHit& h1,
+  const CompactHit& h2) const
+{ return AreConnected(h1.ToAbsHit(), h2.ToAbsHit()); };
+
+bool Connection::AreConnected(
+  const CompactDAQHit& h1,
+  const CompactDAQHit& h2) const
+{ return AreConnected(h1.ToAbsDAQHit(), h2.ToAbsDAQHit()); };
+
+bool Connection::AreConnectedByDistance(
+  const double,
+  const AbsHit& h1,
+  const AbsHit& h2) const
+{ return AreConnected(h1, h2); };
+
+bool Connection::AreConnectedByDistance(
+  const double,
+  const AbsDAQHit& h1,
+  const AbsDAQHit& h2) const
+{ return AreConnected(h1, h2); };
+
+bool Connection::AreConnectedByDistance(
+  const double dr,
+  const CompactHit& h1,
+  const CompactHit& h2) const
+{ return AreConnectedByDistance(dr, h1.ToAbsHit(), h2.ToAbsHit()); };
+
+bool Connection::AreConnectedByDistance(
+  const double dr,
+  const CompactDAQHit& h1,
+  const CompactDAQHit& h2) const
+{ return AreConnectedByDistance(dr, h1.ToAbsDAQHit(), h2.ToAbsDAQHit()); };
+
 
 //============== CLASS BoolConnection =====================
 
@@ -80,9 +120,46 @@ bool BoolConnection::AreConnected (
   return (connect_everything_);
 };    
 
+bool BoolConnection::AreConnectedByDistance (
+  const double dr,
+  const AbsHit& h1,
+  const AbsHit& h2) const
+{ return (connect_everything_); };
+
+bool BoolConnection::AreConnectedByDistance (
+  const double dr,
+  const AbsDAQHit& h1,
+  const AbsDAQHit& h2) const
+{ return (connect_everything_); };
+
+bool BoolConnection::AreConnected (
+  const CompactHit& h1,
+  const CompactHit& h2) const
+{ return (connect_everything_); };
+
+bool BoolConnection::AreConnected (
+  const CompactDAQHit& h1,
+  const CompactDAQHit& h2) const
+{ return (connect_everything_); };
+
+bool BoolConnection::AreConnectedByDistance (
+  const double dr,
+  const CompactHit& h1,
+  const CompactHit& h2) const
+{ return (connect_everything_); };
+
+bool BoolConnection::AreConnectedByDistance (
+  const double dr,
+  const CompactDAQHit& h1,
+  const CompactDAQHit& h2) const
+{ return (connect_everything_); };
+
 bool BoolConnection::CorrectlyConfigured() const
 { return true; };
 
+bool BoolConnection::IsSymmetric() const
+{ return true; };
+
 void BoolConnection::Configure(const HashedGeometryConstPtr& hashedGeo)
 {};
 
@@ -138,6 +215,9 @@ bool DeltaTimeConnection::CorrectlyConfigured() const
           && tresidual_late_>=0.);
 };
 
+bool DeltaTimeConnection::IsSymmetric() const
+{ return tresidual_early_==tresidual_late_; };
+
 //   if (isnan(tresidual_early_))
 //     log_error("tresidual_early is NAN; DeltaTimeConnection might not function as intended");
 //   if (isnan(tresidual_late_))
@@ -187,6 +267,9 @@ bool DynamicConnection::CorrectlyConfigured() const
             && speed_>=0.);
 };
 
+bool DynamicConnection::IsSymmetric() const
+{ return true; };
+
 //=========== CLASS PhotonDiffusionConnection ===========
 
 template<> const Connection::SpeedRating ConnectionBase<PhotonDiffusionConnection>::evalSpeedRating_(Connection::MEDIUM_SLOW);
@@ -330,6 +413,9 @@ bool PhotonDiffusionConnection::CorrectlyConfigured() const
             && min_pdfvalue_>=0. && min_pdfvalue_<1.);
 };
 
+bool PhotonDiffusionConnection::IsSymmetric() const
+{ return true; };
+
 //make all these objects serializable
 #if SERIALIZATION_ENABLED
   I3_SERIALIZABLE(Connection);
@@ -26,6 +26,8 @@ static const unsigned connection_version_ = 0;
 #include "ToolZ/DistanceService.h"
 #include "ToolZ/HashedGeometry.h"
 
+#include "IceHiveZ/internals/CompactHits.h"
+
 //forward declarations for serialization
 #if SERIALIZATION_ENABLED
 class BoolConnection;
@@ -93,7 +95,7 @@ public: //exposed subinterface
     MEDIUM_SLOW = 2,
     MEDIUM = 3, 
     MEDIUM_FAST = 4,
-    FAST = 4
+    FAST = 5
   };  
 private:  
 #if SERIALIZATION_ENABLED
@@ -136,9 +138,62 @@ public: //methods need to be overriden
   bool AreConnected (
     const AbsDAQHit& h1,
     const AbsDAQHit& h2) const =0;
+  ///Are two hits causally connected, if the distance between their DOMs is already known;
+  ///default: the distance is ignored and AreConnected is evaluated, which looks it up itself
+  ///\param dr the distance between the DOMs of the hits, e.g. from the payload of a RelationEdge
+  ///\param h1 the one hit
+  ///\param h2 the other hit
+  virtual
+  bool AreConnectedByDistance (
+    const double dr,
+    const AbsHit& h1,
+    const AbsHit& h2) const;
+  ///Are two hits causally connected, if the distance between their DOMs is already known (DAQ precision);
+  ///default: the distance is ignored and AreConnected is evaluated, which looks it up itself
+  ///\param dr the distance between the DOMs of the hits, e.g. from the payload of a RelationEdge
+  ///\param h1 the one hit
+  ///\param h2 the other hit
+  virtual
+  bool AreConnectedByDistance (
+    const double dr,
+    const AbsDAQHit& h1,
+    const AbsDAQHit& h2) const;
+  ///Are two compact hits causally connected; default: evaluated on the converted hits
+  ///\param h1 the one hit
+  ///\param h2 the other hit
+  virtual
+  bool AreConnected (
+    const CompactHit& h1,
+    const CompactHit& h2) const;
+  ///Are two compact hits causally connected (DAQ precision); default: evaluated on the converted hits
+  ///\param h1 the one hit
+  ///\param h2 the other hit
+  virtual
+  bool AreConnected (
+    const CompactDAQHit& h1,
+    const CompactDAQHit& h2) const;
+  ///Are two compact hits causally connected, if the distance between their DOMs is already known
+  virtual
+  bool AreConnectedByDistance (
+    const double dr,
+    const CompactHit& h1,
+    const CompactHit& h2) const;
+  ///Are two compact hits causally connected, if the distance between their DOMs is already known (DAQ precision)
+  virtual
+  bool AreConnectedByDistance (
+    const double dr,
+    const CompactDAQHit& h1,
+    const CompactDAQHit& h2) const;
   ///check if any derived class was provided with enough configuration to run correctly
   virtual 
   bool CorrectlyConfigured() const =0;
+  ///does AreConnected(h1, h2) always equal AreConnected(h2, h1); default: not known, thus false
+  virtual
+  bool IsSymmetric() const;
+  ///does AreConnected(h1, h2) equal AreConnected(h2, h1) at least if both hits have the same time;
+  ///default: if the connection is symmetric
+  virtual
+  bool IsSymmetricAtEqualTime() const;
 protected:
   ///configure this service with a hashedGeometry
   virtual
@@ -232,8 +287,37 @@ public: // implements this function
   bool AreConnected (
     const AbsDAQHit& h1,
     const AbsDAQHit& h2) const;
+  
+  bool AreConnectedByDistance (
+    const double dr,
+    const AbsHit& h1,
+    const AbsHit& h2) const;
+  
+  bool AreConnectedByDistance (
+    const double dr,
+    const AbsDAQHit& h1,
+    const AbsDAQHit& h2) const;
+  
+  bool AreConnected (
+    const CompactHit& h1,
+    const CompactHit& h2) const;
+  
+  bool AreConnected (
+    const CompactDAQHit& h1,
+    const CompactDAQHit& h2) const;
+  
+  bool AreConnectedByDistance (
+    const double dr,
+    const CompactHit& h1,
+    const CompactHit& h2) const;
+  
+  bool AreConnectedByDistance (
+    const double dr,
+    const CompactDAQHit& h1,
+    const CompactDAQHit& h2) const;
 public:    
   bool CorrectlyConfigured() const;  
+  bool IsSymmetric() const;
 public:  
   void Configure(const HashedGeometryConstPtr& hashedGeo);
 };
@@ -271,6 +355,36 @@ public: // implements this function
   bool AreConnected (
     const AbsDAQHit& h1,
     const AbsDAQHit& h2) const;
+  ///Are two hits causally connected; the distance is not looked up but passed
+  bool AreConnectedByDistance (
+    const double dr,
+    const AbsHit& h1,
+    const AbsHit& h2) const;
+  ///Are two hits causally connected; the distance is not looked up but passed (DAQ precision)
+  bool AreConnectedByDistance (
+    const double dr,
+    const AbsDAQHit& h1,
+    const AbsDAQHit& h2) const;
+  ///Are two compact hits causally connected
+  bool AreConnected (
+    const CompactHit& h1,
+    const CompactHit& h2) const;
+  ///Are two compact hits causally connected (DAQ precision)
+  bool AreConnected (
+    const CompactDAQHit& h1,
+    const CompactDAQHit& h2) const;
+  ///Are two compact hits causally connected; the distance is not looked up but passed
+  bool AreConnectedByDistance (
+    const double dr,
+    const CompactHit& h1,
+    const CompactHit& h2) const;
+  ///Are two compact hits causally connected; the distance is not looked up but passed (DAQ precision)
+  bool AreConnectedByDistance (
+    const double dr,
+    const CompactDAQHit& h1,
+    const CompactDAQHit& h2) const;
+  ///the distance is symmetric, so with dt=0 both directions are evaluated the same
+  bool IsSymmetricAtEqualTime() const;
 protected:
   // defines this function
   virtual
@@ -326,6 +440,9 @@ public:
 protected: //define these functions
   bool Causal(const double dr, const double dt) const;
   bool CorrectlyConfigured() const;
+public:
+  ///symmetric if the early and late windows are the same
+  bool IsSymmetric() const;
 };
 
 typedef boost::shared_ptr<DeltaTimeConnection> DeltaTimeConnectionPtr;
@@ -369,6 +486,9 @@ public:
 protected: //define these functions 
   bool Causal(const double dr, const double dt) const;
   bool CorrectlyConfigured() const;  
+public:
+  ///symmetric as only the absolute time difference is evaluated
+  bool IsSymmetric() const;
 };
 
 typedef boost::shared_ptr<DynamicConnection> DynamicConnectionPtr;
@@ -426,6 +546,9 @@ public:
 protected: //define these functions
   bool Causal(const double dr, const double dt) const;
   bool CorrectlyConfigured() const;
+public:
+  ///symmetric as only the absolute time difference is evaluated
+  bool IsSymmetric() const;
 private: //internal calls which are static
   //The pandel-function P is the ProbabilityDensityFunction of time-residual at a distant receiver
   //it's fixed parameter is the distance while the time shoudl be seen as teh running parameter
@@ -563,6 +686,62 @@ bool DTConnection<derived>::AreConnected (
   return Causal(dr, dt);    
 };
 
+template<class derived>
+bool DTConnection<derived>::AreConnectedByDistance(
+  const double dr,
+  const AbsHit& h1,
+  const AbsHit& h2) const 
+{
+  const double dt=h1.TimeDiff(h2);
+  return Causal(dr, dt);    
+};
+
+template<class derived>
+bool DTConnection<derived>::AreConnectedByDistance (
+  const double dr,
+  const AbsDAQHit& h1,
+  const AbsDAQHit& h2) const
+{
+  const double dt=h1.TimeDiff(h2);
+  return Causal(dr, dt);    
+};
+
+template<class derived>
+bool DTConnection<derived>::AreConnected(
+  const CompactHit& h1,
+  const CompactHit& h2) const 
+{
+  const double dr= distService_->GetDistance(h1.GetDOMIndex(), h2.GetDOMIndex());
+  return Causal(dr, h1.TimeDiff(h2));
+};
+
+template<class derived>
+bool DTConnection<derived>::AreConnected(
+  const CompactDAQHit& h1,
+  const CompactDAQHit& h2) const 
+{
+  const double dr= distService_->GetDistance(h1.GetDOMIndex(), h2.GetDOMIndex());
+  return Causal(dr, h1.TimeDiff(h2));
+};
+
+template<class derived>
+bool DTConnection<derived>::AreConnectedByDistance(
+  const double dr,
+  const CompactHit& h1,
+  const CompactHit& h2) const 
+{ return Causal(dr, h1.TimeDiff(h2)); };
+
+template<class derived>
+bool DTConnection<derived>::AreConnectedByDistance(
+  const double dr,
+  const CompactDAQHit& h1,
+  const CompactDAQHit& h2) const 
+{ return Causal(dr, h1.TimeDiff(h2)); };
+
+template<class derived>
+bool DTConnection<derived>::IsSymmetricAtEqualTime() const
+{ return true; };
+
 template<class derived>
 void DTConnection<derived>::Configure(
   const HashedGeometryConstPtr& hashedGeo)
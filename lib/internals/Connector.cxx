@@ -12,6 +12,9 @@
 #include "IceHiveZ/internals/Connector.h"
 
 #include <boost/foreach.hpp>
+#include <algorithm>
+#include <random>
+#include <set>
 
 using namespace indexmatrix;
 
@@ -25,7 +28,9 @@ Connector::Connector(
 : name_(name),
   hashedGeo_(hashedGeo),
   connection_(connection),
-  relation_(relation)
+  relation_(relation),
+  symRelation_(relation->IsSymmetric() ? relation : relation->SymmetricClosure()),
+  symmetricAtEqualTime_(connection->IsSymmetricAtEqualTime())
 {
   //check hasher against the hashers of subclasses
 //   if (!connection_->GetHasher())
@@ -41,6 +46,20 @@ Connector::Connector(
 //       <<&(*hasher_)<<" vs "<<&(*(relation_->GetHasher())));
 };
 
+Connector::Connector(
+  const std::string& name,
+  const HashedGeometryConstPtr& hashedGeo,
+  const ConnectionPtr& connection, 
+  const RelationPtr& relation,
+  const RelationPtr& symRelation)
+: name_(name),
+  hashedGeo_(hashedGeo),
+  connection_(connection),
+  relation_(relation),
+  symRelation_(symRelation),
+  symmetricAtEqualTime_(connection->IsSymmetricAtEqualTime())
+{};
+
 #if SERIALIZATION_ENABLED
   #ifdef SERIALIZATON_SUPPORT_ICECUBE
 I3_SERIALIZABLE(Connector);
@@ -55,17 +74,72 @@ BOOST_CLASS_EXPORT_IMPLEMENT(Connector);
 ConnectorBlock::ConnectorBlock(
   const HashedGeometryConstPtr& hashedGeo)
 : hashedGeo_(hashedGeo),
-  cumulativeRel_(boost::make_shared<Relation>(hashedGeo->GetHashService()))
+  cumulativeRel_(boost::make_shared<Relation>(hashedGeo->GetHashService())),
+  cumulativeSymRel_(boost::make_shared<Relation>(hashedGeo->GetHashService())),
+  connectorVec_(),
+  stats_(),
+  evalOrder_(0),
+  sampledQueries_(0),
+  joinCumulative_(true),
+  domEnabled_(),
+  ownsRelations_(false),
+  sampleInterval_(64),
+  reorderInterval_(1024)
+{};
+
+ConnectorBlock::ConnectorBlock(
+  const HashedGeometryConstPtr& hashedGeo,
+  const RelationPtr& cumulativeRel,
+  const RelationPtr& cumulativeSymRel)
+: hashedGeo_(hashedGeo),
+  cumulativeRel_(cumulativeRel),
+  cumulativeSymRel_(cumulativeSymRel),
+  connectorVec_(),
+  stats_(),
+  evalOrder_(0),
+  sampledQueries_(0),
+  joinCumulative_(false),
+  domEnabled_(),
+  ownsRelations_(false),
+  sampleInterval_(64),
+  reorderInterval_(1024)
 {};
 
 void ConnectorBlock::AddConnector (
-  const ConnectorPtr& c) 
+  const ConnectorPtr& connector) 
 {
-  log_info_stream("Adding Connector '"<<c->name_<<"' to ConnectorBlock";);
+  log_info_stream("Adding Connector '"<<connector->name_<<"' to ConnectorBlock";);
+  //once the block masks its relations, it does so on its own copies only
+  const ConnectorPtr c = ownsRelations_ ? DetachedCopy(connector) : connector;
   //probe if the Hasher-object is the same
   //FIXME make a consistency test
+  //the relations of the new connector follow the current mask
+  if (!domEnabled_.empty()) {
+    std::vector<CompactHash> disabled;
+    for (size_t h=0; h<domEnabled_.size(); h++) {
+      if (!domEnabled_[h])
+        disabled.push_back(h);
+    }
+    c->relation_->DisableDOMs(disabled);
+    c->symRelation_->DisableDOMs(disabled);
+  }
+  //the cumulative relation adopts the storage of the first connector added
+  if (joinCumulative_) {
+    if (connectorlist_.empty()) {
+      cumulativeRel_->ConvertStorage(c->relation_->GetStorageType());
+      cumulativeSymRel_->ConvertStorage(c->relation_->GetStorageType());
+    }
+    cumulativeRel_->Join(*(c->relation_));
+    cumulativeSymRel_->Join(*(c->symRelation_));
+  }
   connectorlist_.push_back(c);
-  cumulativeRel_->Join(*(c->relation_));
+  
+  //new connectors are evaluated last, until statistics say otherwise
+  const size_t index = connectorVec_.size();
+  connectorVec_.push_back(c);
+  stats_.push_back(ConnectorStatistics());
+  if (index<maxOrderedConnectors)
+    evalOrder_.Set(evalOrder_.Get() | (uint64_t(index)<<(4*index)));
 };
 
 ConnectorPtr 
@@ -77,10 +151,12 @@ ConnectorBlock::GetConnector(const int index) const
     return not_init;
   }
   if (index == -1) {
+    //the union of the symmetric closures is the symmetric closure of the union, which is held already
     return boost::make_shared<Connector>("cumulative",
                                          hashedGeo_,
                                          boost::make_shared<BoolConnection>(hashedGeo_, true),
-                                         cumulativeRel_);
+                                         cumulativeRel_,
+                                         cumulativeSymRel_);
   }
   else {
     ConnectorList::const_iterator connectorlist_iter = connectorlist_.begin(); //no indexing in lists :/
@@ -90,6 +166,175 @@ ConnectorBlock::GetConnector(const int index) const
   }
 };
 
+size_t ConnectorBlock::UpdateDOMMask(const boost::function<bool (const OMKey&)>& enabled) {
+  const CompactOMKeyHashServiceConstPtr hasher = GetHashService();
+  std::vector<CompactHash> disabling, enabling;
+  for (CompactHash h=0; h<hasher->HashSize(); ++h) {
+    const bool enable = enabled(hasher->OMKeyFromHash(h));
+    if (enable!=IsDOMEnabled(h))
+      (enable ? enabling : disabling).push_back(h);
+  }
+  if (disabling.empty() && enabling.empty())
+    return 0;
+  
+  //the relations can be shared with the caller, a cache or an image, which must not see the mask
+  if (!ownsRelations_)
+    DetachRelations();
+  
+  if (domEnabled_.empty())
+    domEnabled_.assign(hasher->HashSize(), 1);
+  BOOST_FOREACH(const CompactHash h, disabling)
+    domEnabled_[h] = 0;
+  BOOST_FOREACH(const CompactHash h, enabling)
+    domEnabled_[h] = 1;
+  
+  //every relation exactly once; the symmetric closure can be the relation itself
+  std::set<Relation*> relations;
+  relations.insert(cumulativeRel_.get());
+  relations.insert(cumulativeSymRel_.get());
+  BOOST_FOREACH(const ConnectorPtr& c, connectorlist_) {
+    relations.insert(c->relation_.get());
+    relations.insert(c->symRelation_.get());
+  }
+  BOOST_FOREACH(Relation* rel, relations) {
+    rel->DisableDOMs(disabling);
+    rel->EnableDOMs(enabling);
+  }
+  log_info_stream("Disabled "<<disabling.size()<<" and enabled "<<enabling.size()<<" DOMs");
+  return disabling.size()+enabling.size();
+};
+
+void ConnectorBlock::DetachRelations() {
+  const bool symmetric = (cumulativeSymRel_==cumulativeRel_);
+  cumulativeRel_ = boost::make_shared<Relation>(*cumulativeRel_);
+  cumulativeSymRel_ = symmetric ? cumulativeRel_ : boost::make_shared<Relation>(*cumulativeSymRel_);
+  BOOST_FOREACH(ConnectorPtr& c, connectorVec_)
+    c = DetachedCopy(c);
+  connectorlist_.assign(connectorVec_.begin(), connectorVec_.end());
+  ownsRelations_ = true;
+};
+
+ConnectorPtr ConnectorBlock::DetachedCopy(const ConnectorPtr& connector) {
+  const RelationPtr relation = boost::make_shared<Relation>(*connector->relation_);
+  const RelationPtr symRelation = (connector->symRelation_==connector->relation_)
+    ? relation : boost::make_shared<Relation>(*connector->symRelation_);
+  return boost::make_shared<Connector>(connector->name_, connector->hashedGeo_, connector->connection_, relation, symRelation);
+};
+
+void ConnectorBlock::Calibrate(
+  const size_t nSamples,
+  const double timeRange)
+{
+  if (connectorVec_.empty() || !nSamples)
+    return;
+  log_info_stream("Calibrating ConnectorBlock on "<<nSamples<<" samples");
+  
+  //draw related DOM pairs; the seed is fixed for reproducibility
+  const size_t size = GetHashService()->HashSize();
+  std::mt19937 rng(29);
+  std::uniform_int_distribution<size_t> dom_dist(0, size-1);
+  std::uniform_real_distribution<double> time_dist(-timeRange, timeRange);
+  
+  std::vector<std::pair<AbsHit, AbsHit> > samples;
+  samples.reserve(nSamples);
+  for (size_t attempt=0; samples.size()<nSamples && attempt<100*nSamples; attempt++) {
+    const CompactHash a = dom_dist(rng);
+    const CompactHash b = dom_dist(rng);
+    if (cumulativeRel_->AreRelated(a, b))
+      samples.push_back(std::make_pair(AbsHit(a, 0.), AbsHit(b, time_dist(rng))));
+  }
+  if (samples.empty()) {
+    log_warn("No related DOM pairs found to calibrate on");
+    return;
+  }
+  
+  //evaluate each connector on its own on the full sample
+  for (size_t i=0; i<connectorVec_.size(); i++) {
+    const Connector& connector = *connectorVec_[i];
+    size_t accepted = 0;
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (size_t j=0; j<samples.size(); j++)
+      accepted += connector.Connected(samples[j].first, samples[j].second);
+    const std::chrono::steady_clock::time_point stop = std::chrono::steady_clock::now();
+    
+    ConnectorStatistics& stats = stats_[i];
+    stats.calls_.Set(samples.size());
+    stats.accepted_.Set(accepted);
+    stats.timedCalls_.Set(samples.size());
+    stats.timedNs_.Set(std::chrono::duration_cast<std::chrono::nanoseconds>(stop-start).count());
+    log_debug_stream("Connector '"<<connector.GetName()<<"' costs "<<stats.CostPerCall()<<"ns and accepts "<<stats.AcceptanceRate());
+  }
+  ReorderByStatistics();
+};
+
+void ConnectorBlock::ReorderByStatistics() const
+{
+  const size_t n_connectors = std::min(connectorVec_.size(), maxOrderedConnectors);
+  
+  //for an OR-chain the expected cost is minimal if ordered by cost over acceptance rate;
+  // connectors without timing information are estimated by their speed rating,
+  // scaled to the cost the timed connectors have per step of speed rating
+  std::vector<double> ratedCosts(n_connectors);
+  double timedNsPerRating = 0.;
+  size_t n_timed = 0;
+  for (size_t i=0; i<n_connectors; i++) {
+    ratedCosts[i] = double(Connection::FAST+1-connectorVec_[i]->GetConnection()->GetSpeedRating());
+    const double cost = stats_[i].CostPerCall();
+    if (!std::isnan(cost)) {
+      timedNsPerRating += cost/ratedCosts[i];
+      n_timed++;
+    }
+  }
+  //with nothing timed all costs are in units of speed rating alike
+  const double nsPerRating = n_timed ? timedNsPerRating/n_timed : 1.;
+  
+  std::vector<std::pair<double, size_t> > scores;
+  for (size_t i=0; i<n_connectors; i++) {
+    double cost = stats_[i].CostPerCall();
+    if (std::isnan(cost))
+      cost = ratedCosts[i]*nsPerRating;
+    scores.push_back(std::make_pair(cost/stats_[i].AcceptanceRate(), i));
+  }
+  std::stable_sort(scores.begin(), scores.end());
+  
+  uint64_t order = 0;
+  for (size_t k=0; k<n_connectors; k++)
+    order |= uint64_t(scores[k].second)<<(4*k);
+  evalOrder_.Set(order);
+};
+
+std::vector<size_t> ConnectorBlock::GetEvaluationOrder() const
+{
+  std::vector<size_t> order;
+  //beyond the number of connectors which can be ordered, Connected() evaluates them all in the natural order
+  const bool ordered = (connectorVec_.size()<=maxOrderedConnectors);
+  const uint64_t packed = evalOrder_.Get();
+  for (size_t k=0; k<connectorVec_.size(); k++)
+    order.push_back(ordered ? ((packed>>(4*k)) & 0xF) : k);
+  return order;
+};
+
+void ConnectorBlock::HashDistancesUnlessCarried() const
+{
+  BOOST_FOREACH(const ConnectorPtr& connector, connectorVec_) {
+    if (!connector->GetRelation()->HasPayload()) {
+      boost::const_pointer_cast<DistanceService>(hashedGeo_->GetDistService())->HashAllDistances();
+      return;
+    }
+  }
+};
+
+//====================== STRUCT ConnectorStatistics ============
+
+double ConnectorStatistics::AcceptanceRate() const
+  {return (accepted_.Get()+1.)/(calls_.Get()+2.);};
+
+double ConnectorStatistics::CostPerCall() const
+{
+  const uint64_t n = timedCalls_.Get();
+  return n ? double(timedNs_.Get())/n : NAN;
+};
+
 #if SERIALIZATION_ENABLED
   I3_SERIALIZABLE(ConnectorBlock);
 #endif //SERIALIZATON_ENABLED  
\ No newline at end of file
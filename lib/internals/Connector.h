@@ -20,6 +20,11 @@ static const unsigned connector_version_ = 0;
 #include <list>
 #include <map>
 #include <iostream>
+#include <cmath>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
 #include <boost/make_shared.hpp>
 
 #include "dataclasses/I3Constants.h"
@@ -101,19 +106,33 @@ private:
   const ConnectionPtr connection_;
   ///the Relation for this Service
   const RelationPtr relation_;
+  ///the Relation evaluated for hits at equal times: the symmetric closure of relation_, or itself if symmetric
+  const RelationPtr symRelation_;
+  ///can the connection at equal times be evaluated in only one direction
+  const bool symmetricAtEqualTime_;
   
 public:
   ///constructor
+  ///NOTE the relation is not expected to change after construction
   Connector(
     const std::string& name,
     const HashedGeometryConstPtr& hashedGeo,
     const ConnectionPtr& connection, 
     const RelationPtr& relation);
+  ///constructor with the symmetric closure of the relation already at hand, e.g. mapped from an image
+  Connector(
+    const std::string& name,
+    const HashedGeometryConstPtr& hashedGeo,
+    const ConnectionPtr& connection, 
+    const RelationPtr& relation,
+    const RelationPtr& symRelation);
   
   std::string GetName() const;
   CompactOMKeyHashServiceConstPtr GetHashService() const;
   ConnectionPtr GetConnection() const;
   RelationPtr GetRelation() const;
+  ///get the relation evaluated for hits at equal times
+  RelationPtr GetSymRelation() const;
     
   /// Are Hits h1 and h2 connected by being related and connected to each other?
   template <class Hitclass>
@@ -127,6 +146,42 @@ typedef boost::shared_ptr<const Connector> ConnectorConstPtr;
   SERIALIZATION_CLASS_VERSION(Connector, connector_version_);
 #endif //SERIALIZATION_ENABLED
 
+//============ CLASS ConnectorStatistics ===========
+
+///a counter which can be updated concurrently, but still be copied along with the object holding it
+class StatCounter {
+private:
+  std::atomic<uint64_t> value_;
+public:
+  StatCounter(const uint64_t value=0);
+  StatCounter(const StatCounter& other);
+  StatCounter& operator=(const StatCounter& other);
+  ///get the value
+  uint64_t Get() const;
+  ///set the value
+  void Set(const uint64_t value);
+  ///add to the value
+  ///\return the value before adding
+  uint64_t Add(const uint64_t value=1);
+};
+
+///evaluation statistics of a Connector within a ConnectorBlock
+struct ConnectorStatistics {
+  ///number of evaluations
+  StatCounter calls_;
+  ///number of evaluations which found the hits connected
+  StatCounter accepted_;
+  ///number of evaluations which had their time taken
+  StatCounter timedCalls_;
+  ///the time taken by these evaluations in ns
+  StatCounter timedNs_;
+  
+  ///fraction of evaluations which found the hits connected; smoothed, so that it is never 0 or 1
+  double AcceptanceRate() const;
+  ///mean time taken per evaluation in ns; NAN if nothing was timed
+  double CostPerCall() const;
+};
+
 //============ CLASS ConnectorBlock ===========
 
 ///Holds a number of Connectors and and neccessary Services; is explicitly serializable
@@ -158,12 +213,42 @@ private: //property
   ///list of connectors, which are 
   ConnectorList connectorlist_;
   ///the cumulative of all the Connectors of the connectorlist
-  const RelationPtr cumulativeRel_;
+  RelationPtr cumulativeRel_;
+  ///the cumulative of the symmetric closures of all Connectors, evaluated for hits at equal times
+  RelationPtr cumulativeSymRel_;
+  ///the connectors in the order of the connectorlist, for indexed access
+  std::vector<ConnectorPtr> connectorVec_;
+  ///evaluation statistics for each connector, in the order of the connectorlist
+  mutable std::vector<ConnectorStatistics> stats_;
+  ///the order in which the connectors are evaluated; index into connectorVec_ packed by 4 bits per position
+  mutable StatCounter evalOrder_;
+  ///number of queries whose evaluation statistics were taken
+  mutable StatCounter sampledQueries_;
+  ///are the relations of added connectors joined into the cumulative relations; not if these are prebuilt
+  const bool joinCumulative_;
+  ///the validity mask: is the DOM at this index enabled; empty if all are
+  std::vector<uint8_t> domEnabled_;
+  ///are all relations copies of the block's own, which can be masked without touching the caller's, a cache's or an image's
+  bool ownsRelations_;
+  
+public: //parameters
+  /// PARAM: take evaluation statistics of every this many queries (per thread); must be a power of 2; 0 to disable
+  uint32_t sampleInterval_;
+  /// PARAM: reorder the connectors after every this many sampled queries; 0 to disable
+  uint64_t reorderInterval_;
+  /// the maximal number of connectors which are adaptively ordered
+  static const size_t maxOrderedConnectors = 16;
   
 public: //constructors
   /// blank constructor (need to fill this with AddConnector() calls)
   ConnectorBlock(
     const HashedGeometryConstPtr& hashedGeo);
+  /// constructor with the cumulative relations already built, e.g. mapped from an image;
+  /// the connectors added by AddConnector() need to be exactly those the cumulative relations have been built from
+  ConnectorBlock(
+    const HashedGeometryConstPtr& hashedGeo,
+    const RelationPtr& cumulativeRel,
+    const RelationPtr& cumulativeSymRel);
 
 public: //methods
   /// Add a Connector and add the Relation map to the cumRel Map
@@ -188,6 +273,50 @@ public: //methods
   ConnectorPtr GetConnector (const int index) const;
   ///Get the complete list of Relations  
   ConnectorList GetConnectorList() const;
+  ///get the cumulative relation of all connectors
+  RelationConstPtr GetCumulativeRelation() const;
+  ///get the cumulative of the symmetric closures of all connectors
+  RelationConstPtr GetCumulativeSymRelation() const;
+  
+  /** Measure cost and acceptance rate of each connector on a sample of related DOM pairs with random time differences;
+   * the result is used as the initial evaluation statistics and to order the connectors.
+   * The sample is drawn with a fixed seed, so the result is reproducible.
+   * @param nSamples the number of DOM pairs to draw
+   * @param timeRange the time differences are drawn uniformly from [-timeRange, timeRange]
+   */
+  void Calibrate(
+    const size_t nSamples,
+    const double timeRange);
+  /// order the evaluation of the connectors by the expected cost of the OR-chain:
+  /// ascending by cost per call over acceptance rate; NOTE can be called concurrently to Connected()
+  void ReorderByStatistics() const;
+  /// get the evaluation statistics of the connector at this index of the connectorlist
+  const ConnectorStatistics& GetStatistics(const size_t index) const;
+  /// get the order in which the connectors are evaluated, as indices into the connectorlist
+  std::vector<size_t> GetEvaluationOrder() const;
+  /** hash all distances of the geometry up front, so that threads calling Connected() concurrently do not fill them lazily;
+   * nothing is done if every relation carries the distances on its edges, as then the connectors never ask for them.
+   * NOTE must not be called concurrently to Connected()
+   */
+  void HashDistancesUnlessCarried() const;
+  
+  /** update the mask of enabled DOMs, e.g. from the bad-DOM list of a new detector status;
+   * disabled DOMs are not related to any other DOM in any of the relations, while the hashing stays untouched.
+   * Only the rows and columns of DOMs which change their state are touched, nothing is rebuilt.
+   * NOTE must not be called concurrently to Connected()
+   * @param enabled is the DOM enabled; a function of signature: bool (const OMKey&)
+   * @return the number of DOMs which changed their state
+   */
+  size_t UpdateDOMMask(const boost::function<bool (const OMKey&)>& enabled);
+  /// is this DOM enabled
+  bool IsDOMEnabled(const CompactHash h) const;
+private:
+  ///should the statistics be taken for this query
+  bool SampleQuery() const;
+  ///replace all relations by copies of the block's own, before they are masked
+  void DetachRelations();
+  ///a copy of the connector with copies of its relations; the symmetric closure stays the relation itself, if it was
+  static ConnectorPtr DetachedCopy(const ConnectorPtr& connector);
 };
 
 typedef boost::shared_ptr<ConnectorBlock> ConnectorBlockPtr;
@@ -261,21 +390,34 @@ inline
 RelationPtr Connector::GetRelation() const
 {return relation_;};
 
+inline 
+RelationPtr Connector::GetSymRelation() const
+{return symRelation_;};
+
 template <class Hitclass>
 bool Connector::Connected (
   const Hitclass& h1,
   const Hitclass& h2) const 
 {
-  bool related = relation_->AreRelated(h1.GetDOMIndex(), h2.GetDOMIndex());
-  bool connected = connection_->AreConnected(h1, h2);
-  if (h1.TimeDiff(h2)==0) { //NOTE this is probably unneccessary but required for generality
-    //if hits occure at the exact same time, also check the reverse connection
-    related |= relation_->AreRelated(h2.GetDOMIndex(), h1.GetDOMIndex());
-    connected |= connection_->AreConnected(h2, h1);
+  //if hits occure at the exact same time, both directions are evaluated:
+  // the relation by its symmetric closure, the connection only if it is not symmetric at equal times
+  const bool sametime = (h1.TimeDiff(h2)==0);
+  const Relation& rel = sametime ? *symRelation_ : *relation_;
+  
+  double dr;
+  if (! rel.RelatedDistance(h1.GetDOMIndex(), h2.GetDOMIndex(), dr)) {
+    log_debug_stream(name_<<": Hits are NOT connected");
+    return false;
   }
-  const bool con = related && connected;
-  log_debug_stream(name_<<": Hits are "<<(con ? "CONNECTED" : "NOT connected"));
-  return con;
+  //if known, the distance is read from the relation edge, which is looked up anyways
+  const bool use_edge = !std::isnan(dr);
+  
+  bool connected = use_edge ? connection_->AreConnectedByDistance(dr, h1, h2) : connection_->AreConnected(h1, h2);
+  if (!connected && sametime && !symmetricAtEqualTime_)
+    connected = use_edge ? connection_->AreConnectedByDistance(dr, h2, h1) : connection_->AreConnected(h2, h1);
+  
+  log_debug_stream(name_<<": Hits are "<<(connected ? "CONNECTED" : "NOT connected"));
+  return connected;
 };
 
 //========================== CLASS ConnectorBlock =========================
@@ -320,46 +462,52 @@ bool ConnectorBlock::Connected(
   const Hitclass& h2) const
 {
   log_debug("Evaluating Connected()");
-
-  bool any_relation = cumulativeRel_->AreRelated(h1.GetDOMIndex(), h2.GetDOMIndex());
   
-  if (h1.TimeDiff(h2)==0.) { //NOTE this is probably unneccessary but required for generality
-    //if hits occure at the exact same time, also check the reverse connection
-    any_relation |= cumulativeRel_->AreRelated(h2.GetDOMIndex(), h1.GetDOMIndex());
-    
-    ConnectorList::const_iterator connectorlist_iter=connectorlist_.begin();
-    const ConnectorList::const_iterator connectorlist_end=connectorlist_.end();
-    while (connectorlist_iter != connectorlist_end){
-      if ((*connectorlist_iter)->Connected(h1, h2)) {
-        log_debug_stream("Hits are CONNECTED; evaluation of connector "<<(*connectorlist_iter)->GetName());
-        return true;
-      }
-      if ((*connectorlist_iter)->Connected(h2, h1)) {
-        log_debug_stream("Hits are CONNECTED; evaluation of connector "<<(*connectorlist_iter)->GetName());
-        return true;
-      }
-      ++connectorlist_iter;
-    }
-  }
-  
-  if (! any_relation) {
+  //if hits occure at the exact same time, also the reverse connection is checked by the connectors;
+  // this is covered by the symmetric closure of the cumulative relation
+  const bool sametime = (h1.TimeDiff(h2)==0.);
+  const Relation& cumRel = sametime ? *cumulativeSymRel_ : *cumulativeRel_;
+
+  if (! cumRel.AreRelated(h1.GetDOMIndex(), h2.GetDOMIndex())) {
     // none of the connectionServices hold a connection for this particular pair of DOMs
     log_debug("Hits are NOT connected; evaluation of cumulative connector");
     return false;
   }
   
-  ConnectorList::const_iterator connectorlist_iter=connectorlist_.begin();
-  const ConnectorList::const_iterator connectorlist_end=connectorlist_.end();
-  while (connectorlist_iter != connectorlist_end){
-    if ((*connectorlist_iter)->Connected(h1, h2)) {
-      log_debug_stream("Hits are CONNECTED; evaluation of connector "<<(*connectorlist_iter)->GetName());
-      return true;
+  //evaluate the connectors in the order of the least expected cost
+  const size_t n_connectors = connectorVec_.size();
+  const bool ordered = (n_connectors<=maxOrderedConnectors);
+  const uint64_t order = evalOrder_.Get();
+  const bool sampled = SampleQuery();
+  
+  bool connected = false;
+  for (size_t k=0; k<n_connectors && !connected; k++) {
+    const size_t i = ordered ? ((order>>(4*k)) & 0xF) : k;
+    const Connector& connector = *connectorVec_[i];
+    
+    if (sampled) {
+      const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      connected = connector.Connected(h1, h2);
+      const std::chrono::steady_clock::time_point stop = std::chrono::steady_clock::now();
+      ConnectorStatistics& stats = stats_[i];
+      stats.calls_.Add();
+      stats.accepted_.Add(connected);
+      stats.timedCalls_.Add();
+      stats.timedNs_.Add(std::chrono::duration_cast<std::chrono::nanoseconds>(stop-start).count());
     }
-    ++connectorlist_iter;
+    else
+      connected = connector.Connected(h1, h2);
+    
+    if (connected)
+      log_debug_stream("Hits are CONNECTED; evaluation of connector "<<connector.GetName());
   }
+  
+  if (sampled && reorderInterval_ && (sampledQueries_.Add()+1)%reorderInterval_==0)
+    ReorderByStatistics();
 
-  log_debug_stream("Hits are NOT connected; evaluation of all connectors");
-  return false;
+  if (!connected)
+    log_debug_stream("Hits are NOT connected; evaluation of all connectors");
+  return connected;
 };
 
 
@@ -402,4 +550,60 @@ ConnectorBlock::GetConnectorList() const {
   return connectorlist_;
 };
 
+inline
+bool ConnectorBlock::IsDOMEnabled(const CompactHash h) const
+  {return domEnabled_.empty() || domEnabled_[h];};
+
+inline
+RelationConstPtr
+ConnectorBlock::GetCumulativeRelation() const {
+  return cumulativeRel_;
+};
+
+inline
+RelationConstPtr
+ConnectorBlock::GetCumulativeSymRelation() const {
+  return cumulativeSymRel_;
+};
+
+inline
+bool ConnectorBlock::SampleQuery() const {
+  if (!sampleInterval_)
+    return false;
+  static thread_local uint32_t query_count = 0;
+  return ((++query_count) & (sampleInterval_-1))==0;
+};
+
+inline
+const ConnectorStatistics& ConnectorBlock::GetStatistics(const size_t index) const
+  {return stats_.at(index);};
+
+//========================== CLASS StatCounter =========================
+
+inline
+StatCounter::StatCounter(const uint64_t value)
+: value_(value)
+{};
+
+inline
+StatCounter::StatCounter(const StatCounter& other)
+: value_(other.Get())
+{};
+
+inline
+StatCounter& StatCounter::operator=(const StatCounter& other)
+  {Set(other.Get()); return *this;};
+
+inline
+uint64_t StatCounter::Get() const
+  {return value_.load(std::memory_order_relaxed);};
+
+inline
+void StatCounter::Set(const uint64_t value)
+  {value_.store(value, std::memory_order_relaxed);};
+
+inline
+uint64_t StatCounter::Add(const uint64_t value)
+  {return value_.fetch_add(value, std::memory_order_relaxed);};
+
 #endif //HIVECONNECTIONSERVICE_H
@@ -0,0 +1,141 @@
+/**
+ * \file ConnectorBlockImage.cxx
+ *
+ * (c) 2012 the IceCube Collaboration
+ *
+ * $Id: ConnectorBlockImage.cxx 99900 2013-02-26 10:10:43Z mzoll $
+ * \version $Revision: 99900 $
+ * \date $Date: 2013-02-26 11:10:43 +0100 (Tue, 26 Feb 2013) $
+ * \author Marcel Zoll <marcel.zoll@fysik.su.se>
+ *
+ */
+
+#include "IceHiveZ/internals/ConnectorBlockImage.h"
+
+
+#include <boost/foreach.hpp>
+
+using namespace std;
+
+///magic number in front of every image file
+static const uint32_t connectorblockimage_magic_ = 0x4D484943; // "CIHM"
+
+ConnectorBlockImage::ConnectorBlockImage()
+: names_(),
+  relations_(),
+  symRelations_(),
+  cumulativeRel_(),
+  cumulativeSymRel_()
+{};
+
+bool ConnectorBlockImage::Write(
+  const std::string& path,
+  const uint64_t key,
+  const ConnectorBlock& cb)
+{
+  if (!binaryio::IsLittleEndian()) {
+    log_warn("Images can only be used in place on little-endian machines; not writing one");
+    return false;
+  }
+  const CompactOMKeyHashServiceConstPtr hasher = cb.GetHashService();
+  const ConnectorBlock::ConnectorList connectors = cb.GetConnectorList();
+
+  //put the complete file in place in one step; processes which have mapped an older file keep using that one
+  const bool written = binaryio::ReplaceFile(path, [&](std::ostream& os) {
+    mappedimage::ImageWriter writer(os);
+    writer.Write<uint32_t>(connectorblockimage_magic_);
+    writer.Write<uint32_t>(connectorblockimage_version_);
+    writer.Write<uint64_t>(key);
+    writer.Write<uint32_t>(hasher->HashSize());
+    writer.Write<uint32_t>(connectors.size());
+
+    //the hash mapping, against which the hasher is verified
+    std::vector<int32_t> strings;
+    std::vector<uint32_t> oms;
+    for (CompactHash h=0; h<hasher->HashSize(); ++h) {
+      const OMKey omkey = hasher->OMKeyFromHash(h);
+      strings.push_back(omkey.GetString());
+      oms.push_back(omkey.GetOM());
+    }
+    writer.WriteArray(strings.data(), strings.size());
+    writer.WriteArray(oms.data(), oms.size());
+
+    cb.GetCumulativeRelation()->WriteImage(writer);
+    cb.GetCumulativeSymRelation()->WriteImage(writer);
+    BOOST_FOREACH(const ConnectorPtr& c, connectors) {
+      writer.WriteString(c->GetName());
+      const bool symmetric = (c->GetSymRelation()==c->GetRelation());
+      writer.Write<uint32_t>(symmetric);
+      c->GetRelation()->WriteImage(writer);
+      if (!symmetric)
+        c->GetSymRelation()->WriteImage(writer);
+      writer.Align();
+    }
+    writer.Write<uint32_t>(connectorblockimage_magic_);
+    return writer.Good();
+  });
+  if (!written) {
+    log_warn_stream("Could not write image "<<path);
+    return false;
+  }
+  log_info_stream("Wrote image of "<<connectors.size()<<" Connectors to "<<path);
+  return true;
+};
+
+ConnectorBlockImageConstPtr ConnectorBlockImage::Map(
+  const std::string& path,
+  const uint64_t key,
+  const CompactOMKeyHashServiceConstPtr& hasher)
+{
+  if (!binaryio::IsLittleEndian())
+    return ConnectorBlockImageConstPtr();
+  const mappedimage::MappedFileConstPtr file = mappedimage::MappedFile::Open(path);
+  if (!file) {
+    log_info_stream("No image "<<path);
+    return ConnectorBlockImageConstPtr();
+  }
+
+  mappedimage::ImageReader reader(file);
+  const uint32_t magic = reader.Read<uint32_t>();
+  const uint32_t version = reader.Read<uint32_t>();
+  const uint64_t stored_key = reader.Read<uint64_t>();
+  const uint32_t hash_size = reader.Read<uint32_t>();
+  const uint32_t n_connectors = reader.Read<uint32_t>();
+  if (!reader.Good() || magic!=connectorblockimage_magic_ || version!=connectorblockimage_version_
+    || stored_key!=key || hash_size!=hasher->HashSize())
+  {
+    log_warn_stream("Image "<<path<<" is not valid or does not fit; ignored");
+    return ConnectorBlockImageConstPtr();
+  }
+
+  //the DOMs have to be hashed exactly as when written
+  const mappedimage::SharedArray<int32_t> strings = reader.ReadArray<int32_t>();
+  const mappedimage::SharedArray<uint32_t> oms = reader.ReadArray<uint32_t>();
+  bool fits = reader.Good() && strings.size()==hash_size && oms.size()==hash_size;
+  for (CompactHash h=0; fits && h<hash_size; ++h) {
+    const OMKey omkey = hasher->OMKeyFromHash(h);
+    fits = (strings[h]==omkey.GetString() && oms[h]==omkey.GetOM());
+  }
+  if (!fits) {
+    log_warn_stream("Image "<<path<<" does not fit the hashing of the DOMs; ignored");
+    return ConnectorBlockImageConstPtr();
+  }
+
+  boost::shared_ptr<ConnectorBlockImage> image(new ConnectorBlockImage());
+  image->cumulativeRel_ = Relation::MapImage(reader, hasher);
+  image->cumulativeSymRel_ = Relation::MapImage(reader, hasher);
+  for (uint32_t i=0; i<n_connectors && reader.Good(); i++) {
+    image->names_.push_back(reader.ReadString());
+    const bool symmetric = reader.Read<uint32_t>();
+    image->relations_.push_back(Relation::MapImage(reader, hasher));
+    image->symRelations_.push_back(symmetric ? image->relations_.back() : Relation::MapImage(reader, hasher));
+    reader.Align();
+  }
+  const uint32_t end_magic = reader.Read<uint32_t>();
+  if (!reader.Good() || end_magic!=connectorblockimage_magic_) {
+    log_warn_stream("Image "<<path<<" is corrupt; ignored");
+    return ConnectorBlockImageConstPtr();
+  }
+  log_info_stream("Mapped image of "<<n_connectors<<" Connectors from "<<path);
+  return image;
+};
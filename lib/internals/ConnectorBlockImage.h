@@ -0,0 +1,120 @@
+/**
+ * \file ConnectorBlockImage.h
+ *
+ * (c) 2012 the IceCube Collaboration
+ *
+ * $Id: ConnectorBlockImage.h 99900 2013-02-26 10:10:43Z mzoll $
+ * \version $Revision: 99900 $
+ * \date $Date: 2013-02-26 11:10:43 +0100 (Tue, 26 Feb 2013) $
+ * \author Marcel Zoll <marcel.zoll@fysik.su.se>
+ *
+ * A flat binary image of the Relations of a built ConnectorBlock, which is memory-mapped and used in place
+ */
+
+#ifndef CONNECTORBLOCKIMAGE_H
+#define CONNECTORBLOCKIMAGE_H
+
+#include <string>
+#include <vector>
+
+#include "ToolZ/OMKeyHash.h"
+#include "IceHiveZ/internals/MappedImage.h"
+#include "IceHiveZ/internals/Relation.h"
+#include "IceHiveZ/internals/Connector.h"
+
+///version of the format of the image files
+static const uint32_t connectorblockimage_version_ = 1;
+
+/** The Relations of a ConnectorBlock in one flat, relocatable file:
+ * the hash mapping of the DOMs, the cumulative relations and for every connector its relation and symmetric closure,
+ * all with their edge payload. The file is mapped read-only and the relations use it in place;
+ * all processes mapping the same file share one copy of it in the page cache.
+ * When mapping, nothing is copied; only the hash mapping and the compressed rows are verified, so that no lookup can go astray.
+ * Files are written to a temporary file first and then renamed into place,
+ * so that concurrent jobs only ever see complete files.
+ */
+class ConnectorBlockImage {
+  SET_LOGGER("ConnectorBlockImage");
+private:
+  ///names of the connectors
+  std::vector<std::string> names_;
+  ///relations of the connectors
+  std::vector<RelationPtr> relations_;
+  ///symmetric closures of the relations of the connectors; the relation itself if it is symmetric
+  std::vector<RelationPtr> symRelations_;
+  ///the cumulative relation
+  RelationPtr cumulativeRel_;
+  ///the cumulative of the symmetric closures
+  RelationPtr cumulativeSymRel_;
+  ///blank constructor
+  ConnectorBlockImage();
+public:
+  /** write the image of this ConnectorBlock; failures are not fatal, but reported
+   * \param path the file to write
+   * \param key a fingerprint of the geometry and configuration the block has been built from
+   * \param cb the ConnectorBlock
+   * \return true if written
+   */
+  static bool Write(
+    const std::string& path,
+    const uint64_t key,
+    const ConnectorBlock& cb);
+
+  /** map an image
+   * \param path the file to map
+   * \param key the fingerprint the image needs to have been written with
+   * \param hasher the hasher the relations are adressed by; needs to hash the DOMs as the written one
+   * \return the image, or a null pointer if the file does not exist, is corrupt or does not fit
+   */
+  static boost::shared_ptr<const ConnectorBlockImage> Map(
+    const std::string& path,
+    const uint64_t key,
+    const CompactOMKeyHashServiceConstPtr& hasher);
+
+  ///number of connectors held
+  size_t NumberOfConnectors() const;
+  ///name of the connector at this index
+  const std::string& GetName(const size_t index) const;
+  ///the relation of the connector at this index;
+  ///NOTE the relation is a view into the mapped file; any modification makes a private copy of it
+  RelationPtr GetRelation(const size_t index) const;
+  ///the symmetric closure of the relation of the connector at this index
+  RelationPtr GetSymRelation(const size_t index) const;
+  ///the cumulative relation of all connectors
+  RelationPtr GetCumulativeRelation() const;
+  ///the cumulative of the symmetric closures of all connectors
+  RelationPtr GetCumulativeSymRelation() const;
+};
+
+typedef boost::shared_ptr<const ConnectorBlockImage> ConnectorBlockImageConstPtr;
+
+
+//===========================================
+//============== IMPLEMENTATION =============
+//===========================================
+
+inline
+size_t ConnectorBlockImage::NumberOfConnectors() const
+  {return names_.size();};
+
+inline
+const std::string& ConnectorBlockImage::GetName(const size_t index) const
+  {return names_.at(index);};
+
+inline
+RelationPtr ConnectorBlockImage::GetRelation(const size_t index) const
+  {return relations_.at(index);};
+
+inline
+RelationPtr ConnectorBlockImage::GetSymRelation(const size_t index) const
+  {return symRelations_.at(index);};
+
+inline
+RelationPtr ConnectorBlockImage::GetCumulativeRelation() const
+  {return cumulativeRel_;};
+
+inline
+RelationPtr ConnectorBlockImage::GetCumulativeSymRelation() const
+  {return cumulativeSymRel_;};
+
+#endif //CONNECTORBLOCKIMAGE_H
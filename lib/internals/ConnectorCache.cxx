@@ -0,0 +1,119 @@
+/**
+ * \file ConnectorCache.cxx
+ *
+ * (c) 2012 the IceCube Collaboration
+ *
+ * $Id: ConnectorCache.cxx 99900 2013-02-26 10:10:43Z mzoll $
+ * \version $Revision: 99900 $
+ * \date $Date: 2013-02-26 11:10:43 +0100 (Tue, 26 Feb 2013) $
+ * \author Marcel Zoll <marcel.zoll@fysik.su.se>
+ *
+ */
+
+#include "IceHiveZ/internals/ConnectorCache.h"
+
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+
+#include <boost/foreach.hpp>
+
+using namespace std;
+
+///magic number in front of every cache file
+static const uint32_t connectorcache_magic_ = 0x5A484943; // "CIHZ"
+
+ConnectorCache::ConnectorCache(const std::string& directory)
+: directory_(directory)
+{};
+
+binaryio::Fnv1aHash ConnectorCache::GeometryFingerprint(const HashedGeometryConstPtr& hashedGeo) {
+  binaryio::Fnv1aHash hash;
+  hash.AddValue(connectorcache_version_);
+  const CompactOMKeyHashServiceConstPtr hasher = hashedGeo->GetHashService();
+  const PositionServiceConstPtr posService = hashedGeo->GetPosService();
+  hash.AddValue<uint64_t>(hasher->HashSize());
+  for (CompactHash h=0; h<hasher->HashSize(); ++h) {
+    const OMKey omkey = hasher->OMKeyFromHash(h);
+    const I3Position& pos = posService->GetPosition(h);
+    hash.AddValue<int32_t>(omkey.GetString());
+    hash.AddValue<uint32_t>(omkey.GetOM());
+    hash.AddValue(pos.GetX());
+    hash.AddValue(pos.GetY());
+    hash.AddValue(pos.GetZ());
+  }
+  return hash;
+};
+
+std::string ConnectorCache::FilePath(const uint64_t key) const {
+  std::ostringstream path;
+  path<<directory_<<"/connectorblock_"<<std::hex<<std::setw(16)<<std::setfill('0')<<key<<".bin";
+  return path.str();
+};
+
+bool ConnectorCache::Load(
+  const uint64_t key,
+  const CompactOMKeyHashServiceConstPtr& hasher,
+  std::vector<RelationPtr>& relations) const
+{
+  relations.clear();
+  const std::string path = FilePath(key);
+  std::ifstream ifs(path.c_str(), std::ios::binary);
+  if (!ifs) {
+    log_info_stream("No cache entry "<<path);
+    return false;
+  }
+  
+  binaryio::BinaryReader reader(ifs);
+  const uint32_t magic = reader.Read<uint32_t>();
+  const uint32_t version = reader.Read<uint32_t>();
+  const uint64_t stored_key = reader.Read<uint64_t>();
+  if (!reader.Good() || magic!=connectorcache_magic_ || version!=connectorcache_version_ || stored_key!=key) {
+    log_warn_stream("Cache entry "<<path<<" is not valid; ignored");
+    return false;
+  }
+  
+  const uint32_t n_relations = reader.Read<uint32_t>();
+  for (uint32_t i=0; i<n_relations && reader.Good(); i++) {
+    const RelationPtr rel = Relation::ReadBinary(reader, hasher);
+    //a relation of another version, or inconsistent with itself, leaves the reader good
+    if (!rel) {
+      log_warn_stream("Cache entry "<<path<<" holds a Relation which can not be read; ignored");
+      relations.clear();
+      return false;
+    }
+    relations.push_back(rel);
+  }
+  
+  const uint64_t checksum = reader.Checksum();
+  const uint64_t stored_checksum = reader.Read<uint64_t>();
+  if (!reader.Good() || checksum!=stored_checksum) {
+    log_warn_stream("Cache entry "<<path<<" is corrupt; ignored");
+    relations.clear();
+    return false;
+  }
+  log_info_stream("Loaded "<<n_relations<<" Relations from cache entry "<<path);
+  return true;
+};
+
+bool ConnectorCache::Store(
+  const uint64_t key,
+  const std::vector<RelationConstPtr>& relations) const
+{
+  const std::string path = FilePath(key);
+  //the complete file is put in place in one step
+  const bool written = binaryio::WriteFile(path, connectorcache_magic_,
+    [key, &relations](binaryio::BinaryWriter& writer) {
+      writer.Write<uint32_t>(connectorcache_version_);
+      writer.Write<uint64_t>(key);
+      writer.Write<uint32_t>(relations.size());
+      BOOST_FOREACH(const RelationConstPtr& rel, relations)
+        rel->WriteBinary(writer);
+    });
+  if (!written) {
+    log_warn_stream("Could not write cache entry "<<path);
+    return false;
+  }
+  log_info_stream("Stored "<<relations.size()<<" Relations to cache entry "<<path);
+  return true;
+};
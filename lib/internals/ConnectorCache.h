@@ -0,0 +1,74 @@
+/**
+ * \file ConnectorCache.h
+ *
+ * (c) 2012 the IceCube Collaboration
+ *
+ * $Id: ConnectorCache.h 99900 2013-02-26 10:10:43Z mzoll $
+ * \version $Revision: 99900 $
+ * \date $Date: 2013-02-26 11:10:43 +0100 (Tue, 26 Feb 2013) $
+ * \author Marcel Zoll <marcel.zoll@fysik.su.se>
+ *
+ * A content-addressed on-disk cache for the Relations of a built ConnectorBlock
+ */
+
+#ifndef CONNECTORCACHE_H
+#define CONNECTORCACHE_H
+
+#include <string>
+#include <vector>
+
+#include "ToolZ/OMKeyHash.h"
+#include "ToolZ/HashedGeometry.h"
+#include "IceHiveZ/internals/BinaryIO.h"
+#include "IceHiveZ/internals/Relation.h"
+
+///version of the layout of the cache files around the relations
+static const uint32_t connectorcache_layout_version_ = 1;
+///version of the format of the cache files; part of every key. It changes with the format the relations are stored in,
+/// so that entries holding relations of an earlier format are not valid anymore
+static const uint32_t connectorcache_version_ = (connectorcache_layout_version_<<16) | relation_binary_version_;
+
+/** Stores the Relations of the Connectors of a ConnectorBlock in a directory, one file per key;
+ * the key is a fingerprint over the hashed geometry and the configuration the relations are built from.
+ * Files are written to a temporary file first and then renamed into place,
+ * so that concurrent jobs sharing a directory only ever see complete files.
+ * Any file which cannot be read, is corrupt or does not fit is treated as a miss.
+ */
+class ConnectorCache {
+  SET_LOGGER("ConnectorCache");
+private:
+  ///the directory holding the cache files
+  std::string directory_;
+public:
+  ///constructor
+  ///\param directory the directory holding the cache files; needs to exist
+  ConnectorCache(const std::string& directory);
+  
+  ///start a fingerprint with the format version and the hashed geometry: DOMs and their positions
+  static binaryio::Fnv1aHash GeometryFingerprint(const HashedGeometryConstPtr& hashedGeo);
+  
+  ///the file which holds the entry of this key
+  std::string FilePath(const uint64_t key) const;
+  
+  /** load the relations stored under this key
+   * \param key the fingerprint
+   * \param hasher the hasher the relations are adressed by
+   * \param relations filled with the relations in the order they have been stored
+   * \return true if found and read without errors
+   */
+  bool Load(
+    const uint64_t key,
+    const CompactOMKeyHashServiceConstPtr& hasher,
+    std::vector<RelationPtr>& relations) const;
+  
+  /** store these relations under this key; failures are not fatal, but reported
+   * \param key the fingerprint
+   * \param relations the relations to store
+   * \return true if stored
+   */
+  bool Store(
+    const uint64_t key,
+    const std::vector<RelationConstPtr>& relations) const;
+};
+
+#endif //CONNECTORCACHE_H
@@ -0,0 +1,59 @@
+/**
+ * \file HitConnectivity.cxx
+ *
+ * (c) 2012 the IceCube Collaboration
+ *
+ * $Id: HitConnectivity.cxx 99900 2013-02-26 10:10:43Z mzoll $
+ * \version $Revision: 99900 $
+ * \date $Date: 2013-02-26 11:10:43 +0100 (Tue, 26 Feb 2013) $
+ * \author Marcel Zoll <marcel.zoll@fysik.su.se>
+ *
+ */
+
+#include "IceHiveZ/internals/HitConnectivity.h"
+
+#include <limits>
+
+using namespace std;
+
+const size_t HitConnectivity::npos;
+const size_t HitConnectivity::maxPairs;
+
+HitConnectivity::HitConnectivity(
+  const ConnectorBlockConstPtr& connectorBlock,
+  const CompactHitSeries& hits,
+  const double horizon)
+: connectorBlock_(connectorBlock),
+  hits_(hits),
+  first_(hits.size(), 0),
+  offsets_(hits.size()+1, 0),
+  states_(),
+  evaluations_(0)
+{
+  if (hits_.size()>=std::numeric_limits<uint32_t>::max())
+    log_fatal("Too many hits to be held");
+
+  //the window of hits within the horizon [first, last) only moves forward
+  const size_t n_hits = hits_.size();
+  size_t first = 0;
+  size_t last = 0;
+  for (size_t i=0; i<n_hits; i++) {
+    while (first<i && !(hits_[first].TimeDiff(hits_[i])<=horizon))
+      ++first;
+    last = std::max(last, i+1);
+    while (last<n_hits && hits_[i].TimeDiff(hits_[last])<=horizon)
+      ++last;
+    first_[i] = first;
+    offsets_[i+1] = offsets_[i]+(last-first);
+  }
+
+  if (offsets_[n_hits]>maxPairs) {
+    log_warn_stream("Too many pairs of hits within "<<horizon<<"ns of each other to remember ("<<offsets_[n_hits]<<"); evaluating each time");
+    std::fill(offsets_.begin(), offsets_.end(), 0);
+    return;
+  }
+  states_.reset(new std::atomic<uint8_t>[offsets_[n_hits]]);
+  for (uint64_t p=0; p<offsets_[n_hits]; p++)
+    states_[p].store(0, std::memory_order_relaxed);
+  log_debug_stream("Remembering "<<offsets_[n_hits]<<" pairs of "<<n_hits<<" hits");
+};
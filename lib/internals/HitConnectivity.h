@@ -0,0 +1,140 @@
+/**
+ * \file HitConnectivity.h
+ *
+ * (c) 2012 the IceCube Collaboration
+ *
+ * $Id: HitConnectivity.h 99900 2013-02-26 10:10:43Z mzoll $
+ * \version $Revision: 99900 $
+ * \date $Date: 2013-02-26 11:10:43 +0100 (Tue, 26 Feb 2013) $
+ * \author Marcel Zoll <marcel.zoll@fysik.su.se>
+ *
+ * The connectivity of the pairs of hits in one series, evaluated once and shared by the algorithms running on it
+ */
+
+#ifndef HITCONNECTIVITY_H
+#define HITCONNECTIVITY_H
+
+#include <stdint.h>
+#include <vector>
+#include <atomic>
+#include <memory>
+
+#include "IceHiveZ/internals/Connector.h"
+#include "IceHiveZ/internals/CompactHits.h"
+
+/** Remembers for the hits of one time-ordered series whether they are connected by a ConnectorBlock:
+ * each ordered pair of hits within the horizon of each other is evaluated at most once,
+ * however often and by whichever algorithm it is asked for; pairs further apart are evaluated each time.
+ * Pairs are evaluated lazily, as they are asked for; concurrent queries are safe.
+ */
+class HitConnectivity {
+  SET_LOGGER("HitConnectivity");
+public:
+  ///a position which is not in the series
+  static const size_t npos = size_t(-1);
+  ///at most this many pairs are remembered; beyond that, every pair is evaluated each time
+  static const size_t maxPairs = size_t(1)<<26;
+private:
+  ///the ConnectorBlock evaluating the pairs
+  const ConnectorBlockConstPtr connectorBlock_;
+  ///the time-ordered hits
+  const CompactHitSeries hits_;
+  ///for each hit the position of the first hit within the horizon
+  std::vector<uint32_t> first_;
+  ///for each hit the first entry in states_ of its pairs; holds one more entry than hits
+  std::vector<uint64_t> offsets_;
+  ///state of each pair: 0 not yet evaluated, 1 not connected, 2 connected
+  std::unique_ptr<std::atomic<uint8_t>[]> states_;
+  ///number of evaluations of the ConnectorBlock
+  mutable std::atomic<uint64_t> evaluations_;
+public:
+  /** constructor
+   * @param connectorBlock the ConnectorBlock evaluating the pairs
+   * @param hits the hits; need to be time-ordered
+   * @param horizon pairs of hits up to this time apart are remembered
+   */
+  HitConnectivity(
+    const ConnectorBlockConstPtr& connectorBlock,
+    const CompactHitSeries& hits,
+    const double horizon);
+
+  ///the hits of the series
+  const CompactHitSeries& GetHits() const;
+  ///the ConnectorBlock evaluating the pairs
+  ConnectorBlockConstPtr GetConnectorBlock() const;
+  ///the position of this hit in the series, or npos
+  size_t Find(const CompactHit& h) const;
+
+  ///are these hits connected, as ConnectorBlock::Connected(hits[i], hits[j])
+  ///\param i position of the one hit
+  ///\param j position of the other hit
+  bool Connected(const size_t i, const size_t j) const;
+  ///are these hits connected; hits which are not in the series are evaluated each time
+  bool Connected(const CompactHit& h1, const CompactHit& h2) const;
+  ///are these hits connected; hits which are not in the series are evaluated each time
+  bool Connected(const AbsHit& h1, const AbsHit& h2) const;
+
+  ///number of times the ConnectorBlock has been evaluated
+  uint64_t NumberOfEvaluations() const;
+};
+
+typedef boost::shared_ptr<HitConnectivity> HitConnectivityPtr;
+typedef boost::shared_ptr<const HitConnectivity> HitConnectivityConstPtr;
+
+
+//===========================================
+//============== IMPLEMENTATION =============
+//===========================================
+
+inline
+const CompactHitSeries& HitConnectivity::GetHits() const
+  {return hits_;};
+
+inline
+ConnectorBlockConstPtr HitConnectivity::GetConnectorBlock() const
+  {return connectorBlock_;};
+
+inline
+size_t HitConnectivity::Find(const CompactHit& h) const {
+  const CompactHitSeries::const_iterator it = std::lower_bound(hits_.begin(), hits_.end(), h);
+  return (it!=hits_.end() && *it==h) ? size_t(it-hits_.begin()) : npos;
+};
+
+inline
+bool HitConnectivity::Connected(const size_t i, const size_t j) const {
+  const uint64_t width = offsets_[i+1]-offsets_[i];
+  if (j<first_[i] || j-first_[i]>=width) {
+    evaluations_.fetch_add(1, std::memory_order_relaxed);
+    return connectorBlock_->Connected(hits_[i], hits_[j]);
+  }
+  //concurrent evaluations of the same pair store the same state
+  std::atomic<uint8_t>& state = states_[offsets_[i]+(j-first_[i])];
+  const uint8_t known = state.load(std::memory_order_relaxed);
+  if (known)
+    return known==2;
+  evaluations_.fetch_add(1, std::memory_order_relaxed);
+  const bool connected = connectorBlock_->Connected(hits_[i], hits_[j]);
+  state.store(connected ? 2 : 1, std::memory_order_relaxed);
+  return connected;
+};
+
+inline
+bool HitConnectivity::Connected(const CompactHit& h1, const CompactHit& h2) const {
+  const size_t i = Find(h1);
+  const size_t j = (i==npos) ? npos : Find(h2);
+  if (j==npos) {
+    evaluations_.fetch_add(1, std::memory_order_relaxed);
+    return connectorBlock_->Connected(h1, h2);
+  }
+  return Connected(i, j);
+};
+
+inline
+bool HitConnectivity::Connected(const AbsHit& h1, const AbsHit& h2) const
+  {return Connected(CompactHit(h1), CompactHit(h2));};
+
+inline
+uint64_t HitConnectivity::NumberOfEvaluations() const
+  {return evaluations_.load(std::memory_order_relaxed);};
+
+#endif //HITCONNECTIVITY_H
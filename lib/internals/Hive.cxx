@@ -12,9 +12,11 @@
 #include "IceHiveZ/internals/Hive.h"
 
 #include <algorithm>
+#include <limits>
 
 #include <boost/assign/list_of.hpp>
 #include <boost/foreach.hpp>
+#include <boost/make_shared.hpp>
 
 #include <iostream>
 #include <boost/lexical_cast.hpp>
@@ -22,6 +24,9 @@
 using namespace std;
 using namespace hive;
 
+///magic number in front of every standalone HiveTopology file
+static const uint32_t hive_file_magic_ = 0x54564948; // "HIVT"
+
 //================= class DOMHoneyComb ===================
 
 StringRings::StringRings(const StringNbr center) :
@@ -242,6 +247,140 @@ HiveTopology::FromDump(std::istream& iss) {
 };
 
 
+//============ CLASS CompiledHiveTopology ==========
+
+CompiledHiveTopology::CompiledHiveTopology(const HiveTopology& ht)
+: nStrings_(0),
+  rings_(),
+  centerOffsets_(),
+  ringOffsets_(),
+  ringStrings_()
+{
+  //the dimension is given by the largest string number named anywhere
+  BOOST_FOREACH(const StringRingRegister::value_type &entry, ht.register_) {
+    for (unsigned ring = 0; ring<= entry.second.GetNRings(); ring++) {
+      BOOST_FOREACH(const StringNbr& s, entry.second.GetRing(ring))
+        nStrings_ = std::max<size_t>(nStrings_, s+1);
+    }
+  }
+  
+  rings_.assign(nStrings_*nStrings_, -1);
+  centerOffsets_.assign(nStrings_+1, 0);
+  for (StringNbr center=0; center<nStrings_; center++) {
+    centerOffsets_[center] = ringOffsets_.size();
+    const StringRingRegister::const_iterator honey = ht.register_.find(center);
+    if (honey==ht.register_.end())
+      continue;
+    if (honey->second.GetNRings() > unsigned(std::numeric_limits<int8_t>::max()))
+      log_fatal_stream("String "<<center<<" has more rings than can be compiled");
+    for (unsigned ring = 0; ring<= honey->second.GetNRings(); ring++) {
+      ringOffsets_.push_back(ringStrings_.size());
+      BOOST_FOREACH(const StringNbr& s, honey->second.GetRing(ring)) {
+        ringStrings_.push_back(s);
+        //the innermost ring wins, as in the search of StringRings::WhichRing()
+        int8_t& entry = rings_[center*nStrings_+s];
+        if (entry==-1)
+          entry = ring;
+      }
+    }
+  }
+  centerOffsets_[nStrings_] = ringOffsets_.size();
+  ringOffsets_.push_back(ringStrings_.size());
+};
+
+std::pair<const StringNbr*, const StringNbr*> CompiledHiveTopology::GetRing(
+  const StringNbr center,
+  const unsigned ringnbr) const
+{
+  if (! HoldsCenterString(center) || ringnbr>GetNRings(center))
+    return std::make_pair((const StringNbr*)NULL, (const StringNbr*)NULL);
+  const uint32_t ring = centerOffsets_[center]+ringnbr;
+  const StringNbr* strings = ringStrings_.data();
+  return std::make_pair(strings+ringOffsets_[ring], strings+ringOffsets_[ring+1]);
+};
+
+void HiveTopology::WriteBinary(binaryio::BinaryWriter& writer) const {
+  //the rings of all centers are flattened: the number of rings of each center, the size of each ring and all strings
+  std::vector<uint32_t> centers, n_rings, ring_sizes, strings;
+  BOOST_FOREACH(const StringRingRegister::value_type &entry, register_) {
+    centers.push_back(entry.first);
+    n_rings.push_back(entry.second.GetNRings());
+    for (unsigned ring = 1; ring<= entry.second.GetNRings(); ring++) {
+      const Ring strs = entry.second.GetRing(ring);
+      ring_sizes.push_back(strs.size());
+      strings.insert(strings.end(), strs.begin(), strs.end());
+    }
+  }
+  writer.Write<uint32_t>(hive_binary_version_);
+  writer.WriteVector(centers);
+  writer.WriteVector(n_rings);
+  writer.WriteVector(ring_sizes);
+  writer.WriteVector(strings);
+};
+
+HiveTopologyPtr HiveTopology::ReadBinary(binaryio::BinaryReader& reader) {
+  const uint32_t version = reader.Read<uint32_t>();
+  if (!reader.Good() || version!=hive_binary_version_) {
+    log_warn_stream("Cannot read HiveTopology of binary version "<<version);
+    reader.SetFailed();
+    return HiveTopologyPtr();
+  }
+  std::vector<uint32_t> centers, n_rings, ring_sizes, strings;
+  reader.ReadVector(centers);
+  reader.ReadVector(n_rings);
+  reader.ReadVector(ring_sizes);
+  reader.ReadVector(strings);
+  
+  //verify that the flat arrays add up before anything is indexed by them
+  bool consistent = reader.Good() && centers.size()==n_rings.size();
+  uint64_t n_ring_total = 0, n_string_total = 0;
+  for (size_t c=0; consistent && c<n_rings.size(); c++)
+    n_ring_total += n_rings[c];
+  consistent = consistent && n_ring_total==ring_sizes.size();
+  for (size_t r=0; consistent && r<ring_sizes.size(); r++)
+    n_string_total += ring_sizes[r];
+  consistent = consistent && n_string_total==strings.size();
+  if (!consistent) {
+    log_warn("HiveTopology read is corrupt");
+    reader.SetFailed();
+    return HiveTopologyPtr();
+  }
+  
+  HiveTopologyPtr ht = boost::make_shared<HiveTopology>();
+  std::vector<uint32_t>::const_iterator ring_size = ring_sizes.begin();
+  std::vector<uint32_t>::const_iterator string = strings.begin();
+  for (size_t c=0; c<centers.size(); c++) {
+    std::vector<Ring> rings(n_rings[c]);
+    BOOST_FOREACH(Ring& ring, rings) {
+      ring.insert(string, string+*ring_size);
+      string += *ring_size;
+      ++ring_size;
+    }
+    ht->register_.insert(std::make_pair(centers[c], StringRings(centers[c], rings)));
+  }
+  return ht;
+};
+
+bool HiveTopology::Save(const std::string& path) const {
+  const bool written = binaryio::WriteFile(path, hive_file_magic_,
+    [this](binaryio::BinaryWriter& writer) {WriteBinary(writer);});
+  if (!written)
+    log_warn_stream("Could not write HiveTopology to "<<path);
+  return written;
+};
+
+HiveTopologyPtr HiveTopology::Load(const std::string& path) {
+  HiveTopologyPtr ht;
+  const bool read = binaryio::ReadFile(path, hive_file_magic_,
+    [&ht](binaryio::BinaryReader& reader) {ht = ReadBinary(reader);});
+  if (!read) {
+    log_warn_stream("Could not read HiveTopology from "<<path);
+    return HiveTopologyPtr();
+  }
+  return ht;
+};
+
+
 std::ostream& operator<< (std::ostream& oss, const HiveTopology& ht) {
   return oss<<ht.Dump();
 }
@@ -17,12 +17,18 @@
 static const unsigned hive_version_ = 0;
 
 #include <cstdlib>
+#include <stdint.h>
 #include <vector>
 #include <set>
 #include <map>
 
 #include "icetray/OMKey.h"
 
+#include "IceHiveZ/internals/BinaryIO.h"
+
+///version of the flat binary format of the HiveTopology
+static const uint32_t hive_binary_version_ = 1;
+
 //forward declaration for serialization
 #if SERIALIZATION_ENABLED
 namespace hive {
@@ -147,10 +153,13 @@ namespace hive {
   typedef std::map<StringNbr, StringRings> StringRingRegister;
 
   
+  class CompiledHiveTopology;
+  
   // ================ CLASS HiveTopology ========================
   
   ///complex type that holds all magic information associated
   class HiveTopology{
+    friend class CompiledHiveTopology;
   #if SERIALIZATION_ENABLED
     friend class SERIALIZATION_NS::access;
     
@@ -217,12 +226,80 @@ namespace hive {
     std::string Dump() const;
     /// Dump an entire hive in to a stream object
     std::ostream& Dump(std::ostream& oss) const;
+    
+    /// write in the flat binary format; all rings are written as a few flat arrays
+    void WriteBinary(binaryio::BinaryWriter& writer) const;
+    /** read the flat binary format, which has been written by WriteBinary
+     * \return the topology or a null pointer if the data is corrupt
+     */
+    static boost::shared_ptr<HiveTopology> ReadBinary(binaryio::BinaryReader& reader);
+    /// save to a standalone binary file
+    /// \return true if written
+    bool Save(const std::string& path) const;
+    /** load a standalone binary file, which has been written by Save
+     * \return the topology or a null pointer if the file does not exist, is not a HiveTopology or is corrupt
+     */
+    static boost::shared_ptr<HiveTopology> Load(const std::string& path);
   };
   
   typedef boost::shared_ptr<HiveTopology> HiveTopologyPtr;
   typedef boost::shared_ptr<const HiveTopology> HiveTopologyConstPtr;
   
   std::ostream& operator<< (std::ostream& oss, const HiveTopology& ht);
+  
+  
+  // ================ CLASS CompiledHiveTopology ========================
+  
+  /** The rings of a HiveTopology compiled into flat arrays, once, for fast lookups:
+   * the ring of every pair of strings is held in a dense matrix indexed by the string numbers,
+   * so that finding it is a single load; the strings of every ring are held in one flat list.
+   * NOTE the compiled form does not follow later changes to the HiveTopology it was compiled from
+   */
+  class CompiledHiveTopology {
+  private:
+    /// strings are adressed by their number [0...nStrings_)
+    size_t nStrings_;
+    /// the ring of each pair of strings [center*nStrings_+string]; -1 if not registered
+    std::vector<int8_t> rings_;
+    /// index of the first ring of each center into ringOffsets_ [center...center+1); both equal if not a center
+    std::vector<uint32_t> centerOffsets_;
+    /// index of the first string of each ring into ringStrings_
+    std::vector<uint32_t> ringOffsets_;
+    /// the strings of all rings, ordered by center, ring and string
+    std::vector<StringNbr> ringStrings_;
+    
+  public:
+    /// Compile this HiveTopology
+    explicit CompiledHiveTopology(const HiveTopology& ht);
+    
+    /// strings can be adressed [0...NStrings())
+    size_t NStrings() const;
+    
+    /// Does this object hold information of this string?
+    bool HoldsCenterString(const StringNbr string) const;
+    
+    /** @brief Which ring is this on?; same result as HiveTopology::WhichRing()
+      * @param center the center from which the ring should be found
+      * @param string the string to locate on any ring
+      * @return 0, if it is the center;
+      * n, if it is on ring n;
+      * -1, if string is not registered;
+      */
+    int WhichRing(const StringNbr center,
+                  const StringNbr string) const;
+    
+    /// get the number of rings around this center; 0 if only the center or not registered
+    unsigned GetNRings(const StringNbr center) const;
+    
+    /** @brief get the strings on the ring [ringnbr] around [center], ordered by number
+     * @return the first and one past the last string; an empty range if there is no such ring
+     */
+    std::pair<const StringNbr*, const StringNbr*> GetRing(
+      const StringNbr center,
+      const unsigned ringnbr) const;
+  };
+  
+  typedef boost::shared_ptr<const CompiledHiveTopology> CompiledHiveTopologyConstPtr;
 };
 
 #if SERIALIZATION_ENABLED
@@ -309,4 +386,31 @@ inline
 bool hive::HiveTopology::HoldsCenterString(const StringNbr string) const
   { return bool(register_.count(string)); };
   
+//=========================== CLASS CompiledHiveTopology ====================
+
+inline
+size_t hive::CompiledHiveTopology::NStrings() const
+  { return nStrings_; };
+
+inline
+bool hive::CompiledHiveTopology::HoldsCenterString(const StringNbr string) const
+  { return string<nStrings_ && centerOffsets_[string]!=centerOffsets_[string+1]; };
+
+inline
+int hive::CompiledHiveTopology::WhichRing(
+  const StringNbr center,
+  const StringNbr string) const
+{
+  if (center>=nStrings_ || string>=nStrings_)
+    return -1;
+  return rings_[center*nStrings_+string];
+};
+
+inline
+unsigned hive::CompiledHiveTopology::GetNRings(const StringNbr center) const {
+  if (! HoldsCenterString(center))
+    return 0;
+  return centerOffsets_[center+1]-centerOffsets_[center]-1;
+};
+  
 #endif //HIVE_H
@@ -0,0 +1,49 @@
+/**
+ * \file MappedImage.cxx
+ *
+ * (c) 2012 the IceCube Collaboration
+ *
+ * $Id: MappedImage.cxx 99900 2013-02-26 10:10:43Z mzoll $
+ * \version $Revision: 99900 $
+ * \date $Date: 2013-02-26 11:10:43 +0100 (Tue, 26 Feb 2013) $
+ * \author Marcel Zoll <marcel.zoll@fysik.su.se>
+ *
+ */
+
+#include "IceHiveZ/internals/MappedImage.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace mappedimage;
+
+//=================== CLASS MappedFile ========================
+
+MappedFile::MappedFile(void* data, const size_t size)
+: data_(data),
+  size_(size)
+{};
+
+MappedFile::~MappedFile() {
+  munmap(data_, size_);
+};
+
+MappedFileConstPtr MappedFile::Open(const std::string& path) {
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd<0)
+    return MappedFileConstPtr();
+  struct stat st;
+  if (fstat(fd, &st)!=0 || st.st_size<=0) {
+    close(fd);
+    return MappedFileConstPtr();
+  }
+  const size_t size = st.st_size;
+  void* data = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  //the mapping stays valid after the descriptor is closed
+  close(fd);
+  if (data==MAP_FAILED)
+    return MappedFileConstPtr();
+  return MappedFileConstPtr(new MappedFile(data, size));
+};
@@ -0,0 +1,445 @@
+/**
+ * \file MappedImage.h
+ *
+ * (c) 2012 the IceCube Collaboration
+ *
+ * $Id: MappedImage.h 99900 2013-02-26 10:10:43Z mzoll $
+ * \version $Revision: 99900 $
+ * \date $Date: 2013-02-26 11:10:43 +0100 (Tue, 26 Feb 2013) $
+ * \author Marcel Zoll <marcel.zoll@fysik.su.se>
+ *
+ * Tools to write flat, relocatable binary images and to use them in place from a read-only memory mapping:
+ * every array in an image is aligned, so that it can be adressed directly where it has been mapped
+ */
+
+#ifndef MAPPEDIMAGE_H
+#define MAPPEDIMAGE_H
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <ostream>
+#include <algorithm>
+#include <boost/shared_ptr.hpp>
+
+#include "IceHiveZ/internals/BinaryIO.h"
+
+namespace mappedimage {
+
+  ///the alignment of every array within an image
+  static const size_t imageAlignment = 8;
+
+  //=================== CLASS MappedFile ========================
+
+  ///A file mapped read-only into memory; the mapping is released with the object.
+  ///Mappings of the same file are shared between all processes through the page cache
+  class MappedFile {
+  private:
+    ///begin of the mapping
+    void* data_;
+    ///size of the mapping
+    size_t size_;
+    ///constructor
+    MappedFile(void* data, const size_t size);
+    ///not copyable
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+  public:
+    ///destructor; unmaps
+    ~MappedFile();
+    ///map this file
+    ///\return the mapping or a null pointer if the file cannot be mapped
+    static boost::shared_ptr<const MappedFile> Open(const std::string& path);
+    ///begin of the mapped data; aligned to the page size
+    const char* Data() const;
+    ///size of the mapped data
+    size_t Size() const;
+  };
+
+  typedef boost::shared_ptr<const MappedFile> MappedFileConstPtr;
+
+  //=================== CLASS SharedArray ========================
+
+  /** A read-only array, which either owns its elements or is a view into memory held by someone else,
+   * e.g. a MappedFile; the backing memory is kept alive as long as the view exists.
+   * Modification through Mutable() makes a private copy of a view first (copy-on-write),
+   * so that shared memory is never written to
+   */
+  template <class T>
+  class SharedArray {
+  private:
+    ///the elements, if owned
+    std::vector<T> owned_;
+    ///the elements, if a view; NULL if owned
+    const T* view_;
+    ///number of elements, if a view
+    size_t viewSize_;
+    ///keeps the memory of the view alive
+    boost::shared_ptr<const void> backing_;
+  public:
+    typedef T value_type;
+    typedef const T* const_iterator;
+
+    ///blank constructor
+    SharedArray();
+    ///constructor of this many owned elements of this value
+    SharedArray(const size_t n, const T& value=T());
+    ///constructor owning a copy of this vector
+    SharedArray(const std::vector<T>& v);
+    ///constructor of a view
+    ///\param data the first element
+    ///\param n the number of elements
+    ///\param backing holds the memory the elements are located in
+    SharedArray(const T* data, const size_t n, const boost::shared_ptr<const void>& backing);
+
+    size_t size() const;
+    bool empty() const;
+    const T* data() const;
+    const T& operator[](const size_t i) const;
+    const_iterator begin() const;
+    const_iterator end() const;
+    const T& front() const;
+    const T& back() const;
+    ///drop all elements
+    void clear();
+
+    ///is this a view into memory held by someone else
+    bool IsView() const;
+    ///get the elements for modification; a view is copied into owned elements first
+    std::vector<T>& Mutable();
+    ///copy the elements into a vector
+    std::vector<T> ToVector() const;
+  };
+
+  //=================== CLASS ImageWriter ========================
+
+  ///Writes an image to a stream: values in little-endian byte order and arrays aligned within the stream;
+  ///NOTE images are only written and mapped on little-endian machines, where they can be used in place
+  class ImageWriter {
+  private:
+    ///the stream to write to
+    std::ostream& os_;
+    ///number of bytes written
+    uint64_t pos_;
+    ///write these bytes
+    void WriteBytes(const void* data, const size_t size);
+  public:
+    ///constructor
+    ImageWriter(std::ostream& os);
+    ///write an arithmetic value
+    template <class T>
+    void Write(const T value);
+    ///write a string, preceded by its length
+    void WriteString(const std::string& s);
+    ///write an array of arithmetic values, preceded by its length; the elements are aligned
+    template <class T>
+    void WriteArray(const T* data, const size_t n);
+    ///pad with zeros up to the next alignment
+    void Align();
+    ///number of bytes written so far
+    uint64_t Position() const;
+    ///is the stream still good
+    bool Good() const;
+  };
+
+  //=================== CLASS ImageReader ========================
+
+  ///Walks through an image in memory and hands out its arrays as views in place;
+  ///reading past the end or misaligned data is not fatal, but signaled by Good()
+  class ImageReader {
+  private:
+    ///begin of the image
+    const char* data_;
+    ///size of the image
+    size_t size_;
+    ///current position
+    size_t pos_;
+    ///did all reads succeed
+    bool good_;
+    ///keeps the memory of the image alive
+    boost::shared_ptr<const void> backing_;
+    ///advance over this many bytes
+    ///\return the position before advancing, or NULL if there are not as many bytes left
+    const char* Advance(const size_t size);
+  public:
+    ///constructor
+    ///\param data begin of the image; needs to be aligned
+    ///\param size size of the image
+    ///\param backing holds the memory of the image
+    ImageReader(const char* data, const size_t size, const boost::shared_ptr<const void>& backing);
+    ///constructor reading a mapped file
+    ImageReader(const MappedFileConstPtr& file);
+    ///read an arithmetic value; zero if the read failed
+    template <class T>
+    T Read();
+    ///read a string, preceded by its length
+    std::string ReadString();
+    ///get a view on the next array
+    ///\param maxSize arrays which claim to be longer signal corrupt data
+    template <class T>
+    SharedArray<T> ReadArray(const uint64_t maxSize=(uint64_t(1)<<32));
+    ///skip to the next alignment
+    void Align();
+    ///did all reads succeed so far
+    bool Good() const;
+    ///signal that the data read is not valid
+    void SetFailed();
+    ///the number of bytes not yet read
+    size_t Remaining() const;
+  };
+}
+
+
+//===========================================
+//============== IMPLEMENTATION =============
+//===========================================
+
+//=================== CLASS MappedFile ========================
+
+inline
+const char* mappedimage::MappedFile::Data() const
+  {return static_cast<const char*>(data_);};
+
+inline
+size_t mappedimage::MappedFile::Size() const
+  {return size_;};
+
+//=================== CLASS SharedArray ========================
+
+template <class T>
+mappedimage::SharedArray<T>::SharedArray()
+: owned_(), view_(NULL), viewSize_(0), backing_()
+{};
+
+template <class T>
+mappedimage::SharedArray<T>::SharedArray(const size_t n, const T& value)
+: owned_(n, value), view_(NULL), viewSize_(0), backing_()
+{};
+
+template <class T>
+mappedimage::SharedArray<T>::SharedArray(const std::vector<T>& v)
+: owned_(v), view_(NULL), viewSize_(0), backing_()
+{};
+
+template <class T>
+mappedimage::SharedArray<T>::SharedArray(
+  const T* data,
+  const size_t n,
+  const boost::shared_ptr<const void>& backing)
+: owned_(), view_(data), viewSize_(n), backing_(backing)
+{};
+
+template <class T>
+size_t mappedimage::SharedArray<T>::size() const
+  {return view_ ? viewSize_ : owned_.size();};
+
+template <class T>
+bool mappedimage::SharedArray<T>::empty() const
+  {return size()==0;};
+
+template <class T>
+const T* mappedimage::SharedArray<T>::data() const
+  {return view_ ? view_ : owned_.data();};
+
+template <class T>
+const T& mappedimage::SharedArray<T>::operator[](const size_t i) const
+  {return data()[i];};
+
+template <class T>
+typename mappedimage::SharedArray<T>::const_iterator mappedimage::SharedArray<T>::begin() const
+  {return data();};
+
+template <class T>
+typename mappedimage::SharedArray<T>::const_iterator mappedimage::SharedArray<T>::end() const
+  {return data()+size();};
+
+template <class T>
+const T& mappedimage::SharedArray<T>::front() const
+  {return data()[0];};
+
+template <class T>
+const T& mappedimage::SharedArray<T>::back() const
+  {return data()[size()-1];};
+
+template <class T>
+void mappedimage::SharedArray<T>::clear() {
+  owned_.clear();
+  view_ = NULL;
+  viewSize_ = 0;
+  backing_.reset();
+};
+
+template <class T>
+bool mappedimage::SharedArray<T>::IsView() const
+  {return view_!=NULL;};
+
+template <class T>
+std::vector<T>& mappedimage::SharedArray<T>::Mutable() {
+  if (view_) {
+    owned_.assign(view_, view_+viewSize_);
+    view_ = NULL;
+    viewSize_ = 0;
+    backing_.reset();
+  }
+  return owned_;
+};
+
+template <class T>
+std::vector<T> mappedimage::SharedArray<T>::ToVector() const
+  {return std::vector<T>(begin(), end());};
+
+//=================== CLASS ImageWriter ========================
+
+inline
+mappedimage::ImageWriter::ImageWriter(std::ostream& os)
+: os_(os),
+  pos_(0)
+{};
+
+inline
+void mappedimage::ImageWriter::WriteBytes(const void* data, const size_t size) {
+  os_.write(static_cast<const char*>(data), size);
+  pos_ += size;
+};
+
+template <class T>
+void mappedimage::ImageWriter::Write(const T value) {
+  T v = value;
+  if (!binaryio::IsLittleEndian())
+    binaryio::detail::SwapBytes(&v, sizeof(T));
+  WriteBytes(&v, sizeof(T));
+};
+
+inline
+void mappedimage::ImageWriter::WriteString(const std::string& s) {
+  Write<uint64_t>(s.size());
+  WriteBytes(s.data(), s.size());
+  Align();
+};
+
+template <class T>
+void mappedimage::ImageWriter::WriteArray(const T* data, const size_t n) {
+  Align();
+  Write<uint64_t>(n);
+  if (binaryio::IsLittleEndian() || sizeof(T)==1) {
+    if (n)
+      WriteBytes(data, n*sizeof(T));
+  }
+  else {
+    for (size_t i=0; i<n; i++)
+      Write<T>(data[i]);
+  }
+  Align();
+};
+
+inline
+void mappedimage::ImageWriter::Align() {
+  static const char zeros[imageAlignment] = {0};
+  const size_t pad = (imageAlignment - pos_%imageAlignment) % imageAlignment;
+  if (pad)
+    WriteBytes(zeros, pad);
+};
+
+inline
+uint64_t mappedimage::ImageWriter::Position() const
+  {return pos_;};
+
+inline
+bool mappedimage::ImageWriter::Good() const
+  {return os_.good();};
+
+//=================== CLASS ImageReader ========================
+
+inline
+mappedimage::ImageReader::ImageReader(
+  const char* data,
+  const size_t size,
+  const boost::shared_ptr<const void>& backing)
+: data_(data),
+  size_(size),
+  pos_(0),
+  good_(reinterpret_cast<uintptr_t>(data)%imageAlignment==0),
+  backing_(backing)
+{};
+
+inline
+mappedimage::ImageReader::ImageReader(const MappedFileConstPtr& file)
+: data_(file ? file->Data() : NULL),
+  size_(file ? file->Size() : 0),
+  pos_(0),
+  good_(file.get()!=NULL),
+  backing_(file)
+{};
+
+inline
+const char* mappedimage::ImageReader::Advance(const size_t size) {
+  if (!good_ || size > size_-pos_) {
+    good_ = false;
+    return NULL;
+  }
+  const char* at = data_+pos_;
+  pos_ += size;
+  return at;
+};
+
+template <class T>
+T mappedimage::ImageReader::Read() {
+  T v = T();
+  const char* at = Advance(sizeof(T));
+  if (!at)
+    return v;
+  memcpy(&v, at, sizeof(T));
+  if (!binaryio::IsLittleEndian())
+    binaryio::detail::SwapBytes(&v, sizeof(T));
+  return v;
+};
+
+inline
+std::string mappedimage::ImageReader::ReadString() {
+  const uint64_t size = Read<uint64_t>();
+  if (size > (uint64_t(1)<<20)) {
+    good_ = false;
+    return std::string();
+  }
+  const char* at = Advance(size);
+  Align();
+  return at ? std::string(at, size) : std::string();
+};
+
+template <class T>
+mappedimage::SharedArray<T> mappedimage::ImageReader::ReadArray(const uint64_t maxSize) {
+  Align();
+  const uint64_t n = Read<uint64_t>();
+  //only the native byte order can be used in place
+  if (!good_ || n > maxSize || (!binaryio::IsLittleEndian() && sizeof(T)>1)) {
+    good_ = false;
+    return SharedArray<T>();
+  }
+  const char* at = Advance(n*sizeof(T));
+  Align();
+  if (!at)
+    return SharedArray<T>();
+  return SharedArray<T>(reinterpret_cast<const T*>(at), n, backing_);
+};
+
+inline
+void mappedimage::ImageReader::Align() {
+  const size_t pad = (imageAlignment - pos_%imageAlignment) % imageAlignment;
+  if (pad)
+    Advance(std::min(pad, size_-pos_));
+};
+
+inline
+bool mappedimage::ImageReader::Good() const
+  {return good_;};
+
+inline
+void mappedimage::ImageReader::SetFailed()
+  {good_ = false;};
+
+inline
+size_t mappedimage::ImageReader::Remaining() const
+  {return size_-pos_;};
+
+#endif //MAPPEDIMAGE_H
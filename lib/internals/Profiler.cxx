@@ -0,0 +1,117 @@
+/**
+ * \file Profiler.cxx
+ *
+ * (c) 2012 the IceCube Collaboration
+ *
+ * $Id: Profiler.cxx 99900 2013-02-26 10:10:43Z mzoll $
+ * \version $Revision: 99900 $
+ * \date $Date: 2013-02-26 11:10:43 +0100 (Tue, 26 Feb 2013) $
+ * \author Marcel Zoll <marcel.zoll@fysik.su.se>
+ *
+ */
+
+#include "IceHiveZ/internals/Profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <iomanip>
+
+using namespace std;
+
+const unsigned LatencyHistogram::subBits;
+const size_t LatencyHistogram::nBuckets;
+
+//========================== CLASS LatencyHistogram =========================
+
+LatencyHistogram::LatencyHistogram()
+: counts_(nBuckets, 0),
+  total_(0),
+  max_(0)
+{};
+
+void LatencyHistogram::Merge(const LatencyHistogram& other) {
+  for (size_t b=0; b<nBuckets; b++)
+    counts_[b] += other.counts_[b];
+  total_ += other.total_;
+  max_ = std::max(max_, other.max_);
+};
+
+void LatencyHistogram::Reset() {
+  std::fill(counts_.begin(), counts_.end(), 0);
+  total_ = 0;
+  max_ = 0;
+};
+
+uint64_t LatencyHistogram::Quantile(const double q) const {
+  if (total_==0)
+    return 0;
+  //the rank of the value at this quantile, counting from 1
+  const uint64_t rank = std::max<uint64_t>(1, uint64_t(std::ceil(std::min(std::max(q, 0.), 1.)*total_)));
+  uint64_t seen = 0;
+  for (size_t b=0; b<nBuckets; b++) {
+    seen += counts_[b];
+    if (seen>=rank)
+      //the middle of the bucket, but never beyond what was seen
+      return std::min(max_, LowerEdge(b)+Width(b)/2);
+  }
+  return max_;
+};
+
+//========================== CLASS SamplingProfiler =========================
+
+SamplingProfiler::SamplingProfiler(
+  const std::vector<std::string>& names,
+  const uint32_t sampleInterval)
+: names_(names),
+  histograms_(names.size()),
+  ticks_(names.size(), 0),
+  mask_(0),
+  enabled_(false),
+  startCycles_(ReadCycleCounter()),
+  startTime_(std::chrono::steady_clock::now())
+{
+  SetSampleInterval(sampleInterval);
+};
+
+void SamplingProfiler::SetSampleInterval(const uint32_t sampleInterval) {
+  enabled_ = (sampleInterval!=0);
+  uint64_t interval = 1;
+  while (interval<sampleInterval)
+    interval <<= 1;
+  mask_ = interval-1;
+};
+
+double SamplingProfiler::NsPerCycle() const {
+  const uint64_t cycles = ReadCycleCounter()-startCycles_;
+  const int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now()-startTime_).count();
+  if (cycles==0 || ns<=0)
+    return 1.;
+  return double(ns)/double(cycles);
+};
+
+void SamplingProfiler::Reset() {
+  for (size_t s=0; s<names_.size(); s++) {
+    histograms_[s].Reset();
+    ticks_[s] = 0;
+  }
+};
+
+std::string SamplingProfiler::Report() const {
+  const double nsPerCycle = NsPerCycle();
+  std::ostringstream report;
+  report<<std::fixed<<std::setprecision(1);
+  for (size_t s=0; s<names_.size(); s++) {
+    const LatencyHistogram& histogram = histograms_[s];
+    if (s>0)
+      report<<std::endl;
+    report<<names_[s]<<": "<<ticks_[s]<<" calls, "<<histogram.Count()<<" sampled";
+    if (histogram.Count()==0)
+      continue;
+    report<<"; p50 "<<histogram.Quantile(0.5)*nsPerCycle<<"ns"
+          <<", p99 "<<histogram.Quantile(0.99)*nsPerCycle<<"ns"
+          <<", p999 "<<histogram.Quantile(0.999)*nsPerCycle<<"ns"
+          <<", max "<<histogram.Max()*nsPerCycle<<"ns";
+  }
+  return report.str();
+};
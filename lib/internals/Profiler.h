@@ -0,0 +1,215 @@
+/**
+ * \file Profiler.h
+ *
+ * (c) 2012 the IceCube Collaboration
+ *
+ * $Id: Profiler.h 99900 2013-02-26 10:10:43Z mzoll $
+ * \version $Revision: 99900 $
+ * \date $Date: 2013-02-26 11:10:43 +0100 (Tue, 26 Feb 2013) $
+ * \author Marcel Zoll <marcel.zoll@fysik.su.se>
+ *
+ * Lightweight instrumentation of the hot paths: a cycle counter, sampled every so many calls,
+ * feeding log-scale latency histograms per stage
+ */
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <chrono>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+///read the cycle counter: the time stamp counter where there is one, else the steady clock in ns;
+///only differences of readings on the same thread are meaningful
+uint64_t ReadCycleCounter();
+
+/** A histogram of latencies with buckets on a logarithmic scale:
+ * values below 2^subBits are held exactly, above that every power of two is split into 2^subBits buckets,
+ * so that any quantile is known to within 2^-subBits of its value.
+ * Not safe for concurrent use.
+ */
+class LatencyHistogram {
+public:
+  ///number of bits resolving each power of two
+  static const unsigned subBits = 3;
+  ///number of buckets covering the full range of uint64_t
+  static const size_t nBuckets = size_t(64-subBits+1)<<subBits;
+private:
+  ///the count in each bucket
+  std::vector<uint64_t> counts_;
+  ///the total count
+  uint64_t total_;
+  ///the largest value added
+  uint64_t max_;
+public:
+  ///constructor
+  LatencyHistogram();
+  ///add a value
+  void Add(const uint64_t value);
+  ///add all the values of another histogram
+  void Merge(const LatencyHistogram& other);
+  ///forget all values
+  void Reset();
+  ///number of values added
+  uint64_t Count() const;
+  ///the largest value added
+  uint64_t Max() const;
+  ///the value at this quantile, to within the resolution of the buckets; 0 if empty
+  ///\param q the quantile in [0,1]
+  uint64_t Quantile(const double q) const;
+
+  ///the bucket holding this value
+  static size_t BucketOf(const uint64_t value);
+  ///the smallest value falling in this bucket
+  static uint64_t LowerEdge(const size_t bucket);
+  ///the number of values falling in this bucket
+  static uint64_t Width(const size_t bucket);
+};
+
+/** Times named stages of a hot path by reading the cycle counter around every so many calls;
+ * each stage keeps a LatencyHistogram of its sampled calls.
+ * Cycles are converted to ns by the rate the cycle counter has advanced against the steady clock since construction.
+ * Not safe for concurrent use.
+ */
+class SamplingProfiler {
+private:
+  ///the names of the stages
+  std::vector<std::string> names_;
+  ///the latencies in cycles of each stage
+  std::vector<LatencyHistogram> histograms_;
+  ///the calls of each stage so far
+  std::vector<uint64_t> ticks_;
+  ///every call where (tick & mask_)==0 is sampled
+  uint64_t mask_;
+  ///if calls are sampled at all
+  bool enabled_;
+  ///reading of the cycle counter at construction
+  uint64_t startCycles_;
+  ///reading of the steady clock at construction
+  std::chrono::steady_clock::time_point startTime_;
+public:
+  /** constructor
+   * @param names the names of the stages, identified by their position
+   * @param sampleInterval sample every this many calls of each stage; rounded up to a power of two; 0 to disable
+   */
+  SamplingProfiler(
+    const std::vector<std::string>& names,
+    const uint32_t sampleInterval =64);
+  ///sample every this many calls of each stage; rounded up to a power of two; 0 to disable
+  void SetSampleInterval(const uint32_t sampleInterval);
+  ///every how many calls of each stage are sampled; 0 if disabled
+  uint64_t GetSampleInterval() const;
+  ///count a call of this stage and tell if it is to be timed
+  bool Sample(const size_t stage);
+  ///record the time taken by a sampled call of this stage
+  ///\param cycles difference of two readings of ReadCycleCounter()
+  void Record(const size_t stage, const uint64_t cycles);
+  ///number of stages
+  size_t NumberOfStages() const;
+  ///the name of this stage
+  const std::string& GetName(const size_t stage) const;
+  ///the latencies in cycles of this stage
+  const LatencyHistogram& GetHistogram(const size_t stage) const;
+  ///number of calls of this stage, sampled or not
+  uint64_t GetCalls(const size_t stage) const;
+  ///ns per cycle of the cycle counter, as measured since construction
+  double NsPerCycle() const;
+  ///forget all samples and calls
+  void Reset();
+  ///one line per stage with its calls, samples and p50, p99, p999 and max latency in ns
+  std::string Report() const;
+};
+
+
+//===========================================
+//============== IMPLEMENTATION =============
+//===========================================
+
+inline
+uint64_t ReadCycleCounter() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+};
+
+//========================== CLASS LatencyHistogram =========================
+
+inline
+void LatencyHistogram::Add(const uint64_t value) {
+  counts_[BucketOf(value)]++;
+  total_++;
+  if (value>max_)
+    max_ = value;
+};
+
+inline
+uint64_t LatencyHistogram::Count() const
+  {return total_;};
+
+inline
+uint64_t LatencyHistogram::Max() const
+  {return max_;};
+
+inline
+size_t LatencyHistogram::BucketOf(const uint64_t value) {
+  if (value < (uint64_t(1)<<subBits))
+    return size_t(value);
+  const unsigned msb = 63-__builtin_clzll(value);
+  const unsigned shift = msb-subBits;
+  return (size_t(shift+1)<<subBits) + size_t((value>>shift) & ((uint64_t(1)<<subBits)-1));
+};
+
+inline
+uint64_t LatencyHistogram::LowerEdge(const size_t bucket) {
+  if (bucket < (size_t(1)<<subBits))
+    return bucket;
+  const unsigned shift = unsigned(bucket>>subBits)-1;
+  return ((uint64_t(1)<<subBits) + (bucket & ((size_t(1)<<subBits)-1))) << shift;
+};
+
+inline
+uint64_t LatencyHistogram::Width(const size_t bucket) {
+  if (bucket < (size_t(1)<<subBits))
+    return 1;
+  return uint64_t(1) << (unsigned(bucket>>subBits)-1);
+};
+
+//========================== CLASS SamplingProfiler =========================
+
+inline
+uint64_t SamplingProfiler::GetSampleInterval() const
+  {return enabled_ ? mask_+1 : 0;};
+
+inline
+bool SamplingProfiler::Sample(const size_t stage)
+  {return enabled_ && ((ticks_[stage]++ & mask_)==0);};
+
+inline
+void SamplingProfiler::Record(const size_t stage, const uint64_t cycles)
+  {histograms_[stage].Add(cycles);};
+
+inline
+size_t SamplingProfiler::NumberOfStages() const
+  {return names_.size();};
+
+inline
+const std::string& SamplingProfiler::GetName(const size_t stage) const
+  {return names_.at(stage);};
+
+inline
+const LatencyHistogram& SamplingProfiler::GetHistogram(const size_t stage) const
+  {return histograms_.at(stage);};
+
+inline
+uint64_t SamplingProfiler::GetCalls(const size_t stage) const
+  {return ticks_.at(stage);};
+
+#endif //PROFILER_H
@@ -11,47 +11,1012 @@
 
 #include "IceHiveZ/internals/Relation.h"
 
+#include <numeric>
+#include <thread>
+#include <atomic>
+
 #include <boost/foreach.hpp>
 
 using namespace indexmatrix;
 
+///magic number in front of every standalone Relation file
+static const uint32_t relation_file_magic_ = 0x424C4552; // "RELB"
+
+//=================== CLASS SparseRelationMap =========
+
+const size_t SparseRelationMap::npos = size_t(-1);
+
+SparseRelationMap::SparseRelationMap()
+: rowOffsets_(1, 0),
+  columns_()
+{};
+
+SparseRelationMap::SparseRelationMap(
+  const size_t size,
+  const bool setall)
+: rowOffsets_(size+1, 0),
+  columns_()
+{
+  if (setall) {
+    //every row is the same; fill the first one and copy it in bulk
+    std::vector<Index>& rowOffsets = rowOffsets_.Mutable();
+    std::vector<Index>& columns = columns_.Mutable();
+    columns.resize(size*size);
+    std::iota(columns.begin(), columns.begin()+size, Index(0));
+    for (size_t a=1; a<size; a++)
+      std::copy(columns.begin(), columns.begin()+size, columns.begin()+a*size);
+    for (size_t a=0; a<size; a++)
+      rowOffsets[a+1] = (a+1)*size;
+  }
+};
+
+SparseRelationMap::SparseRelationMap(
+  const size_t size,
+  const AsymmetricIndexMatrix_Bool& dense)
+: rowOffsets_(size+1, 0),
+  columns_()
+{
+  std::vector<Index>& rowOffsets = rowOffsets_.Mutable();
+  std::vector<Index>& columns = columns_.Mutable();
+  for (size_t a=0; a<size; a++) {
+    for (size_t b=0; b<size; b++) {
+      if (dense.Get(a,b))
+        columns.push_back(b);
+    }
+    rowOffsets[a+1] = columns.size();
+  }
+};
+
+SparseRelationMap::SparseRelationMap(
+  const IndexArray& rowOffsets,
+  const IndexArray& columns)
+: rowOffsets_(rowOffsets),
+  columns_(columns)
+{
+  if (rowOffsets_.empty())
+    rowOffsets_.Mutable().push_back(0);
+};
+
+bool SparseRelationMap::IsConsistent(
+  const IndexArray& rowOffsets,
+  const IndexArray& columns,
+  const size_t size)
+{
+  if (rowOffsets.size()!=size+1 || rowOffsets.front()!=0 || rowOffsets.back()!=columns.size())
+    return false;
+  for (size_t a=0; a<size; a++) {
+    if (rowOffsets[a]>rowOffsets[a+1])
+      return false;
+    for (size_t i=rowOffsets[a]; i<rowOffsets[a+1]; i++) {
+      if (columns[i]>=size || (i!=rowOffsets[a] && columns[i-1]>=columns[i]))
+        return false;
+    }
+  }
+  return true;
+};
+
+size_t SparseRelationMap::Set(
+  const size_t a,
+  const size_t b,
+  const bool value)
+{
+  const Index* row_begin = RowBegin(a);
+  const Index* row_end = RowEnd(a);
+  const Index* pos = std::lower_bound(row_begin, row_end, Index(b));
+  const bool present = (pos!=row_end && *pos==b);
+  
+  if (value==present)
+    return npos;
+  
+  const size_t position = pos-columns_.data();
+  std::vector<Index>& columns = columns_.Mutable();
+  if (value)
+    columns.insert(columns.begin()+position, b);
+  else
+    columns.erase(columns.begin()+position);
+  
+  std::vector<Index>& rowOffsets = rowOffsets_.Mutable();
+  for (size_t r=a+1; r<rowOffsets.size(); r++) {
+    if (value)
+      rowOffsets[r]++;
+    else
+      rowOffsets[r]--;
+  }
+  return position;
+};
+
+void SparseRelationMap::AppendRow(const std::vector<Index>& cols) {
+  std::vector<Index>& columns = columns_.Mutable();
+  columns.insert(columns.end(), cols.begin(), cols.end());
+  rowOffsets_.Mutable().push_back(columns.size());
+};
+
+void SparseRelationMap::SetRow(const size_t a, const std::vector<Index>& cols) {
+  std::vector<Index>& rowOffsets = rowOffsets_.Mutable();
+  std::vector<Index>& columns = columns_.Mutable();
+  const size_t n_old = rowOffsets[a+1]-rowOffsets[a];
+  const std::vector<Index>::iterator begin = columns.begin()+rowOffsets[a];
+  if (cols.size()<=n_old) {
+    std::copy(cols.begin(), cols.end(), begin);
+    columns.erase(begin+cols.size(), begin+n_old);
+  }
+  else {
+    std::copy(cols.begin(), cols.begin()+n_old, begin);
+    columns.insert(begin+n_old, cols.begin()+n_old, cols.end());
+  }
+  const Index shift = Index(cols.size())-Index(n_old); //unsigned wrap-around does the subtraction as well
+  for (size_t r=a+1; r<rowOffsets.size(); r++)
+    rowOffsets[r] += shift;
+};
+
+AsymmetricIndexMatrix_Bool SparseRelationMap::ToDense() const {
+  AsymmetricIndexMatrix_Bool dense(Size(), false);
+  for (size_t a=0; a<Size(); a++) {
+    for (const Index* iter=RowBegin(a); iter!=RowEnd(a); ++iter)
+      dense.Set(a, *iter, true);
+  }
+  return dense;
+};
+
+
 //=================== CLASS Relation =========
 
 Relation::Relation(
   const CompactOMKeyHashServiceConstPtr& hasher,
   const AsymmetricIndexMatrix_Bool& relationMap)
 : hasher_(hasher),
-  relationMap_(relationMap)
+  storage_(DENSE),
+  relationMap_(relationMap),
+  sparseMap_(),
+  payload_(NO_PAYLOAD)
 {};
 
 Relation::Relation(
   const CompactOMKeyHashServiceConstPtr& hasher,
-  const bool setall) 
+  const SparseRelationMap& sparseMap)
 : hasher_(hasher),
-  relationMap_(hasher->HashSize(), setall)
-{};
+  storage_(SPARSE),
+  relationMap_(0),
+  sparseMap_(sparseMap),
+  payload_(NO_PAYLOAD)
+{
+  if (sparseMap_.Size()!=hasher_->HashSize())
+    log_fatal("SparseRelationMap does not match the size of the hasher");
+};
 
 Relation::Relation(
   const CompactOMKeyHashServiceConstPtr& hasher,
-  const boost::function<bool (const OMKey&, const OMKey&)> predicate)
+  const bool setall,
+  const StorageType storage) 
 : hasher_(hasher),
-  relationMap_(hasher->HashSize(), Relation::PredicateTranslator(hasher, predicate))
-{};
+  storage_(storage),
+  relationMap_((storage==DENSE) ? hasher->HashSize() : 0, setall),
+  sparseMap_(),
+  payload_(NO_PAYLOAD)
+{
+  if (storage_==SPARSE)
+    sparseMap_ = SparseRelationMap(hasher_->HashSize(), setall);
+};
+
+Relation::Relation(
+  const CompactOMKeyHashServiceConstPtr& hasher,
+  const boost::function<bool (const OMKey&, const OMKey&)> predicate,
+  const StorageType storage)
+: hasher_(hasher),
+  storage_(storage),
+  relationMap_(0),
+  sparseMap_(),
+  payload_(NO_PAYLOAD)
+{
+  PredicateRelated(predicate);
+};
+
+void Relation::ConvertStorage(const StorageType storage) {
+  if (storage==storage_)
+    return;
+  
+  //keep the payload of all edges; it is read out in the old and put back in the new indexing
+  std::vector<std::pair<std::pair<CompactHash, CompactHash>, RelationEdge> > edges;
+  if (payload_!=NO_PAYLOAD) {
+    for (size_t a=0; a<hasher_->HashSize(); a++) {
+      BOOST_FOREACH(const CompactHash b, RelatedSpan(a))
+        edges.push_back(std::make_pair(std::make_pair(CompactHash(a), b), GetEdge(a,b)));
+    }
+  }
+  
+  if (storage==SPARSE) {
+    sparseMap_ = SparseRelationMap(hasher_->HashSize(), relationMap_);
+    relationMap_ = AsymmetricIndexMatrix_Bool(0);
+  }
+  else {
+    relationMap_ = sparseMap_.ToDense();
+    sparseMap_ = SparseRelationMap();
+  }
+  storage_ = storage;
+  
+  if (payload_!=NO_PAYLOAD) {
+    edgeDistance_.clear();
+    edgeDz_.clear();
+    edgeRing_.clear();
+    ResizePayload((storage_==DENSE) ? hasher_->HashSize()*hasher_->HashSize() : sparseMap_.NumberOfEntries());
+    for (size_t i=0; i<edges.size(); i++)
+      SetEdge(edges[i].first.first, edges[i].first.second, edges[i].second);
+  }
+};
+
+const AsymmetricIndexMatrix_Bool& Relation::GetRelationMap() const {
+  if (storage_!=DENSE)
+    log_fatal("Relation is not stored DENSE; no relationMap available");
+  return relationMap_;
+};
+
+const SparseRelationMap& Relation::GetSparseRelationMap() const {
+  if (storage_!=SPARSE)
+    log_fatal("Relation is not stored SPARSE; no sparse relationMap available");
+  return sparseMap_;
+};
+
+void Relation::Join(const Relation& r) //FIXME check congruence hashers
+{
+  if (storage_==DENSE && r.storage_==DENSE && (payload_==NO_PAYLOAD || r.payload_==NO_PAYLOAD)) {
+    relationMap_ |= r.relationMap_;
+    return;
+  }
+  if (storage_==DENSE) {
+    for (size_t a=0; a<hasher_->HashSize(); a++) {
+      BOOST_FOREACH(const CompactHash b, r.RelatedSpan(a)) {
+        if (payload_!=NO_PAYLOAD && r.payload_!=NO_PAYLOAD && !relationMap_.Get(a,b))
+          SetEdge(a, b, r.GetEdge(a,b));
+        relationMap_.Set(a, b, true);
+      }
+    }
+    return;
+  }
+  //merge row by row into a new compressed map; edges already held keep their payload
+  SparseRelationMap joined(0);
+  std::vector<RelationEdge> joinedEdges;
+  std::vector<SparseRelationMap::Index> row;
+  for (size_t a=0; a<hasher_->HashSize(); a++) {
+    row.clear();
+    const SparseRelationMap::Index* iter = sparseMap_.RowBegin(a);
+    const SparseRelationMap::Index* const end = sparseMap_.RowEnd(a);
+    RelatedRange other = r.RelatedSpan(a);
+    RelatedIterator other_iter = other.begin();
+    while (iter!=end || other_iter!=other.end()) {
+      if (other_iter==other.end() || (iter!=end && *iter<=*other_iter)) {
+        if (other_iter!=other.end() && *iter==*other_iter)
+          ++other_iter;
+        if (payload_!=NO_PAYLOAD)
+          joinedEdges.push_back(PayloadAt(iter-sparseMap_.GetColumns().data()));
+        row.push_back(*iter);
+        ++iter;
+      }
+      else {
+        if (payload_!=NO_PAYLOAD)
+          joinedEdges.push_back(r.GetEdge(a, *other_iter));
+        row.push_back(*other_iter);
+        ++other_iter;
+      }
+    }
+    joined.AppendRow(row);
+  }
+  sparseMap_ = joined;
+  if (payload_!=NO_PAYLOAD) {
+    edgeDistance_.clear();
+    edgeDz_.clear();
+    edgeRing_.clear();
+    ResizePayload(joinedEdges.size());
+    for (size_t i=0; i<joinedEdges.size(); i++)
+      SetPayloadAt(i, joinedEdges[i]);
+  }
+};
+
+void Relation::Intersect(const Relation& r) //FIXME check congruence hashers
+{
+  if (storage_==DENSE && r.storage_==DENSE) {
+    relationMap_ &= r.relationMap_;
+    return;
+  }
+  if (storage_==DENSE) {
+    for (size_t a=0; a<hasher_->HashSize(); a++) {
+      for (size_t b=0; b<hasher_->HashSize(); b++) {
+        if (relationMap_.Get(a,b) && !r.AreRelated(a,b))
+          relationMap_.Set(a, b, false);
+      }
+    }
+    return;
+  }
+  //only keep the entries of each compressed row that are also held by the other
+  SparseRelationMap intersected(0);
+  std::vector<RelationEdge> keptEdges;
+  std::vector<SparseRelationMap::Index> row;
+  for (size_t a=0; a<hasher_->HashSize(); a++) {
+    row.clear();
+    for (const SparseRelationMap::Index* iter=sparseMap_.RowBegin(a); iter!=sparseMap_.RowEnd(a); ++iter) {
+      if (r.AreRelated(a, *iter)) {
+        row.push_back(*iter);
+        if (payload_!=NO_PAYLOAD)
+          keptEdges.push_back(PayloadAt(iter-sparseMap_.GetColumns().data()));
+      }
+    }
+    intersected.AppendRow(row);
+  }
+  sparseMap_ = intersected;
+  if (payload_!=NO_PAYLOAD) {
+    edgeDistance_.clear();
+    edgeDz_.clear();
+    edgeRing_.clear();
+    ResizePayload(keptEdges.size());
+    for (size_t i=0; i<keptEdges.size(); i++)
+      SetPayloadAt(i, keptEdges[i]);
+  }
+};
 
 bool Relation::AreRelated(const OMKey& a, const OMKey& b) const
 {
   if (!hasher_)  
     log_fatal("no hasher set to perform this operation");
-  return relationMap_.Get(hasher_->HashFromOMKey(a), hasher_->HashFromOMKey(b));
+  return AreRelated(hasher_->HashFromOMKey(a), hasher_->HashFromOMKey(b));
 };
   
 void Relation::SetRelated(const OMKey& a, const OMKey& b, const bool value) 
 {
   if (!hasher_)  
     log_fatal("no hasher set to perform this operation");
-  relationMap_.Set(hasher_->HashFromOMKey(a), hasher_->HashFromOMKey(b), value);
+  SetRelated(hasher_->HashFromOMKey(a), hasher_->HashFromOMKey(b), value);
+};
+
+template <class RowFunction>
+void Relation::FillRows(
+  const RowFunction& rowFunction,
+  const unsigned nThreads)
+{
+  const size_t size = hasher_->HashSize();
+  unsigned n_threads = (nThreads ? nThreads : std::thread::hardware_concurrency());
+  n_threads = std::max<unsigned>(1, std::min<size_t>(n_threads, size));
+  
+  //the rows are evaluated block by block: the workers pick up chunks of rows within the block until all are done,
+  // then the block is put in place in order; this bounds the memory held aside
+  const size_t chunk_size = 32;
+  const size_t block_size = chunk_size*n_threads*4;
+  std::vector<std::vector<CompactHash> > rows(block_size);
+  
+  SparseRelationMap sparse(0);
+  if (storage_==DENSE)
+    relationMap_ = AsymmetricIndexMatrix_Bool(size, false);
+  std::vector<SparseRelationMap::Index> cols;
+  //the edges held aside belong to the relation which is replaced; the disabled DOMs stay disabled
+  const bool masked = !domEnabled_.empty();
+  disabledEdges_.clear();
+  
+  for (size_t block_begin=0; block_begin<size; block_begin+=block_size) {
+    const size_t block_end = std::min(block_begin+block_size, size);
+    
+    std::atomic<size_t> next_row(block_begin);
+    const auto worker = [&]() {
+      for (size_t begin = next_row.fetch_add(chunk_size); begin<block_end; begin = next_row.fetch_add(chunk_size)) {
+        for (size_t a=begin; a<std::min(begin+chunk_size, block_end); a++) {
+          std::vector<CompactHash>& related = rows[a-block_begin];
+          related.clear();
+          rowFunction(CompactHash(a), related);
+        }
+      }
+    };
+    std::vector<std::thread> workers;
+    for (unsigned t=1; t<n_threads; t++)
+      workers.push_back(std::thread(worker));
+    worker();
+    BOOST_FOREACH(std::thread& w, workers)
+      w.join();
+    
+    for (size_t a=block_begin; a<block_end; a++) {
+      std::vector<CompactHash>& related = rows[a-block_begin];
+      if (!std::is_sorted(related.begin(), related.end())) {
+        std::sort(related.begin(), related.end());
+        related.erase(std::unique(related.begin(), related.end()), related.end());
+      }
+      if (!related.empty() && related.back()>=size)
+        log_fatal_stream("Row "<<a<<" holds an index beyond the HashSize "<<related.back());
+      if (masked) {
+        //edges from or to disabled DOMs are held aside, as if they had been disabled after the fill
+        size_t n_kept = 0;
+        for (size_t i=0; i<related.size(); i++) {
+          if (domEnabled_[a] && domEnabled_[related[i]])
+            related[n_kept++] = related[i];
+          else
+            disabledEdges_.push_back(std::make_pair(std::make_pair(CompactHash(a), related[i]), RelationEdge()));
+        }
+        related.resize(n_kept);
+      }
+      if (storage_==DENSE) {
+        BOOST_FOREACH(const CompactHash b, related)
+          relationMap_.Set(a, b, true);
+      }
+      else {
+        cols.assign(related.begin(), related.end());
+        sparse.AppendRow(cols);
+      }
+    }
+  }
+  if (storage_==SPARSE)
+    sparseMap_ = sparse;
+  ResetPayload();
+};
+
+void Relation::SetAllRelated()
+{
+  if (storage_==SPARSE)
+    sparseMap_ = SparseRelationMap(hasher_->HashSize(), true);
+  else
+    relationMap_ = AsymmetricIndexMatrix_Bool(hasher_->HashSize(), true);
+  ResetPayload();
+};
+
+void Relation::SetNoneRelated()
+{
+  if (storage_==SPARSE)
+    sparseMap_ = SparseRelationMap(hasher_->HashSize(), false);
+  else
+    relationMap_ = AsymmetricIndexMatrix_Bool(hasher_->HashSize(), false);
+  ResetPayload();
+};
+
+void Relation::SetRowRelated(
+  const CompactHash a,
+  const bool value)
+{
+  const size_t size = hasher_->HashSize();
+  if (storage_==DENSE) {
+    for (size_t b=0; b<size; b++)
+      relationMap_.Set(a, b, value);
+    return;
+  }
+  
+  std::vector<SparseRelationMap::Index> cols;
+  if (value) {
+    cols.resize(size);
+    std::iota(cols.begin(), cols.end(), SparseRelationMap::Index(0));
+  }
+  if (payload_!=NO_PAYLOAD) {
+    //edges which are kept keep their payload
+    std::vector<RelationEdge> edges;
+    BOOST_FOREACH(const SparseRelationMap::Index b, cols)
+      edges.push_back(GetEdge(a, b));
+    const size_t pos = sparseMap_.RowBegin(a)-sparseMap_.GetColumns().data();
+    ReplacePayload(pos, sparseMap_.RowEnd(a)-sparseMap_.RowBegin(a), edges);
+  }
+  sparseMap_.SetRow(a, cols);
+};
+
+void Relation::PredicateRelated(
+  const boost::function<bool (const OMKey&, const OMKey&)>& callobj,
+  const unsigned nThreads)
+{
+  //the OMKeys are looked up once, not for every pair
+  const size_t size = hasher_->HashSize();
+  std::vector<OMKey> omkeys(size);
+  for (size_t h=0; h<size; h++)
+    omkeys[h] = hasher_->OMKeyFromHash(h);
+  
+  FillRows([&callobj, &omkeys, size](const CompactHash a, std::vector<CompactHash>& related) {
+    const OMKey& omkey_a = omkeys[a];
+    for (size_t b=0; b<size; b++) {
+      if (callobj(omkey_a, omkeys[b]))
+        related.push_back(b);
+    }
+  }, nThreads);
+};
+
+void Relation::PredicateRelatedRows(
+  const RowPredicate& rowPredicate,
+  const unsigned nThreads)
+{ FillRows(rowPredicate, nThreads); };
+
+size_t Relation::NumberOfRelated() const
+{
+  if (storage_==SPARSE)
+    return sparseMap_.NumberOfEntries();
+  size_t n=0;
+  for (size_t a=0; a<hasher_->HashSize(); a++) {
+    for (size_t b=0; b<hasher_->HashSize(); b++)
+      n += relationMap_.Get(a,b);
+  }
+  return n;
+};
+
+bool Relation::IsSymmetric() const
+{
+  for (size_t a=0; a<hasher_->HashSize(); a++) {
+    BOOST_FOREACH(const CompactHash b, RelatedSpan(a)) {
+      if (!AreRelated(b, a))
+        return false;
+    }
+  }
+  return true;
+};
+
+RelationPtr Relation::Transposed() const
+{
+  const size_t size = hasher_->HashSize();
+  RelationPtr transposed;
+  
+  if (storage_==DENSE) {
+    transposed = boost::make_shared<Relation>(hasher_, false, DENSE);
+    for (size_t a=0; a<size; a++) {
+      BOOST_FOREACH(const CompactHash b, RelatedSpan(a))
+        transposed->relationMap_.Set(b, a, true);
+    }
+  }
+  else {
+    //count the entries per column, which become the rows
+    std::vector<SparseRelationMap::Index> rowOffsets(size+1, 0);
+    const SparseRelationMap::IndexArray& columns = sparseMap_.GetColumns();
+    for (size_t i=0; i<columns.size(); i++)
+      rowOffsets[columns[i]+1]++;
+    for (size_t r=0; r<size; r++)
+      rowOffsets[r+1] += rowOffsets[r];
+    //distribute; as the rows are processed in order, the new rows come out sorted
+    std::vector<SparseRelationMap::Index> fill(rowOffsets.begin(), rowOffsets.end()-1);
+    std::vector<SparseRelationMap::Index> transColumns(columns.size());
+    for (size_t a=0; a<size; a++) {
+      for (const SparseRelationMap::Index* iter=sparseMap_.RowBegin(a); iter!=sparseMap_.RowEnd(a); ++iter)
+        transColumns[fill[*iter]++] = a;
+    }
+    transposed = boost::make_shared<Relation>(hasher_,
+      SparseRelationMap(SparseRelationMap::IndexArray(rowOffsets), SparseRelationMap::IndexArray(transColumns)));
+  }
+  
+  if (payload_!=NO_PAYLOAD) {
+    transposed->EnablePayload(payload_);
+    for (size_t a=0; a<size; a++) {
+      BOOST_FOREACH(const CompactHash b, RelatedSpan(a)) {
+        RelationEdge edge = GetEdge(a, b);
+        edge.dz = -edge.dz;
+        transposed->SetEdge(b, a, edge);
+      }
+    }
+  }
+  return transposed;
+};
+
+RelationPtr Relation::SymmetricClosure() const
+{
+  RelationPtr closure = boost::make_shared<Relation>(*this);
+  closure->Join(*Transposed());
+  return closure;
+};
+
+void Relation::EnablePayload(const PayloadType payload) {
+  if (payload<=payload_)
+    return;
+  payload_ = payload;
+  ResizePayload((storage_==DENSE) ? hasher_->HashSize()*hasher_->HashSize() : sparseMap_.NumberOfEntries());
+};
+
+void Relation::SetEdge(
+  const CompactHash a,
+  const CompactHash b,
+  const RelationEdge& edge)
+{
+  if (payload_==NO_PAYLOAD)
+    log_fatal("No payload enabled for this Relation");
+  const size_t pos = EdgeIndex(a,b);
+  if (pos==SparseRelationMap::npos)
+    log_fatal("Cannot set the payload of DOMs that are not related");
+  SetPayloadAt(pos, edge);
+};
+
+void Relation::ResetPayload() {
+  if (payload_==NO_PAYLOAD)
+    return;
+  edgeDistance_.clear();
+  edgeDz_.clear();
+  edgeRing_.clear();
+  ResizePayload((storage_==DENSE) ? hasher_->HashSize()*hasher_->HashSize() : sparseMap_.NumberOfEntries());
+};
+
+void Relation::ResizePayload(const size_t n) {
+  edgeDistance_.Mutable().resize(n, NAN);
+  if (payload_==GEOMETRY) {
+    edgeDz_.Mutable().resize(n, NAN);
+    edgeRing_.Mutable().resize(n, -1);
+  }
+};
+
+void Relation::InsertPayload(const size_t pos) {
+  std::vector<float>& distance = edgeDistance_.Mutable();
+  distance.insert(distance.begin()+pos, NAN);
+  if (payload_==GEOMETRY) {
+    std::vector<float>& dz = edgeDz_.Mutable();
+    std::vector<int8_t>& ring = edgeRing_.Mutable();
+    dz.insert(dz.begin()+pos, NAN);
+    ring.insert(ring.begin()+pos, -1);
+  }
+};
+
+void Relation::ErasePayload(const size_t pos) {
+  std::vector<float>& distance = edgeDistance_.Mutable();
+  distance.erase(distance.begin()+pos);
+  if (payload_==GEOMETRY) {
+    std::vector<float>& dz = edgeDz_.Mutable();
+    std::vector<int8_t>& ring = edgeRing_.Mutable();
+    dz.erase(dz.begin()+pos);
+    ring.erase(ring.begin()+pos);
+  }
+};
+
+void Relation::ReplacePayload(
+  const size_t pos,
+  const size_t n_old,
+  const std::vector<RelationEdge>& edges)
+{
+  std::vector<float>& distance = edgeDistance_.Mutable();
+  distance.erase(distance.begin()+pos, distance.begin()+pos+n_old);
+  distance.insert(distance.begin()+pos, edges.size(), NAN);
+  if (payload_==GEOMETRY) {
+    std::vector<float>& dz = edgeDz_.Mutable();
+    std::vector<int8_t>& ring = edgeRing_.Mutable();
+    dz.erase(dz.begin()+pos, dz.begin()+pos+n_old);
+    dz.insert(dz.begin()+pos, edges.size(), NAN);
+    ring.erase(ring.begin()+pos, ring.begin()+pos+n_old);
+    ring.insert(ring.begin()+pos, edges.size(), -1);
+  }
+  for (size_t i=0; i<edges.size(); i++)
+    SetPayloadAt(pos+i, edges[i]);
+};
+
+RelationEdge Relation::PayloadAt(const size_t pos) const {
+  if (payload_==GEOMETRY)
+    return RelationEdge(edgeDistance_[pos], edgeDz_[pos], edgeRing_[pos]);
+  return RelationEdge(edgeDistance_[pos]);
+};
+
+void Relation::SetPayloadAt(const size_t pos, const RelationEdge& edge) {
+  edgeDistance_.Mutable()[pos] = edge.distance;
+  if (payload_==GEOMETRY) {
+    edgeDz_.Mutable()[pos] = edge.dz;
+    edgeRing_.Mutable()[pos] = edge.ring;
+  }
 };
 
+void Relation::WriteBinary(binaryio::BinaryWriter& writer) const {
+  writer.Write<uint32_t>(relation_binary_version_);
+  writer.Write<uint8_t>(storage_);
+  writer.Write<uint8_t>(payload_);
+  
+  //the rows are written compressed, the payload in the same order
+  const SparseRelationMap sparse = (storage_==SPARSE) ? sparseMap_ : SparseRelationMap(hasher_->HashSize(), relationMap_);
+  writer.WriteArray(sparse.GetRowOffsets().data(), sparse.GetRowOffsets().size());
+  writer.WriteArray(sparse.GetColumns().data(), sparse.GetColumns().size());
+  
+  if (payload_!=NO_PAYLOAD && storage_==SPARSE) {
+    writer.WriteArray(edgeDistance_.data(), edgeDistance_.size());
+    if (payload_==GEOMETRY) {
+      writer.WriteArray(edgeDz_.data(), edgeDz_.size());
+      writer.WriteArray(edgeRing_.data(), edgeRing_.size());
+    }
+  }
+  else if (payload_!=NO_PAYLOAD) {
+    std::vector<float> distance, dz;
+    std::vector<int8_t> ring;
+    for (size_t a=0; a<sparse.Size(); a++) {
+      for (const SparseRelationMap::Index* b=sparse.RowBegin(a); b!=sparse.RowEnd(a); ++b) {
+        const RelationEdge edge = PayloadAt(EdgeIndex(a, *b));
+        distance.push_back(edge.distance);
+        dz.push_back(edge.dz);
+        ring.push_back(edge.ring);
+      }
+    }
+    writer.WriteVector(distance);
+    if (payload_==GEOMETRY) {
+      writer.WriteVector(dz);
+      writer.WriteVector(ring);
+    }
+  }
+  
+  //the mask and the edges held aside, so that the disabled DOMs can be enabled again after loading
+  writer.WriteVector(domEnabled_);
+  std::vector<uint32_t> from, to;
+  std::vector<float> distance, dz;
+  std::vector<int8_t> ring;
+  for (size_t i=0; i<disabledEdges_.size(); i++) {
+    from.push_back(disabledEdges_[i].first.first);
+    to.push_back(disabledEdges_[i].first.second);
+    distance.push_back(disabledEdges_[i].second.distance);
+    dz.push_back(disabledEdges_[i].second.dz);
+    ring.push_back(disabledEdges_[i].second.ring);
+  }
+  writer.WriteVector(from);
+  writer.WriteVector(to);
+  writer.WriteVector(distance);
+  writer.WriteVector(dz);
+  writer.WriteVector(ring);
+};
+
+RelationPtr Relation::ReadBinary(
+  binaryio::BinaryReader& reader,
+  const CompactOMKeyHashServiceConstPtr& hasher)
+{
+  const uint32_t version = reader.Read<uint32_t>();
+  const uint8_t storage = reader.Read<uint8_t>();
+  const uint8_t payload = reader.Read<uint8_t>();
+  if (!reader.Good() || version!=relation_binary_version_ || storage>SPARSE || payload>GEOMETRY) {
+    log_warn_stream("Cannot read Relation of binary version "<<version);
+    reader.SetFailed();
+    return RelationPtr();
+  }
+  
+  SparseRelationMap::IndexArray rowOffsets, columns;
+  reader.ReadVector(rowOffsets.Mutable());
+  reader.ReadVector(columns.Mutable());
+  //verify that the rows are consistent and fit the hasher, so that no lookup can go astray
+  if (!reader.Good() || !SparseRelationMap::IsConsistent(rowOffsets, columns, hasher->HashSize())) {
+    log_warn("Relation read is corrupt or does not fit the hasher");
+    reader.SetFailed();
+    return RelationPtr();
+  }
+  
+  RelationPtr rel = boost::make_shared<Relation>(hasher, SparseRelationMap(rowOffsets, columns));
+  if (payload!=NO_PAYLOAD) {
+    rel->payload_ = PayloadType(payload);
+    reader.ReadVector(rel->edgeDistance_.Mutable());
+    if (payload==GEOMETRY) {
+      reader.ReadVector(rel->edgeDz_.Mutable());
+      reader.ReadVector(rel->edgeRing_.Mutable());
+    }
+    const size_t n_edges = columns.size();
+    if (!reader.Good() || rel->edgeDistance_.size()!=n_edges
+      || (payload==GEOMETRY && (rel->edgeDz_.size()!=n_edges || rel->edgeRing_.size()!=n_edges)))
+    {
+      log_warn("Relation payload read is corrupt");
+      reader.SetFailed();
+      return RelationPtr();
+    }
+  }
+  
+  reader.ReadVector(rel->domEnabled_);
+  std::vector<uint32_t> from, to;
+  std::vector<float> distance, dz;
+  std::vector<int8_t> ring;
+  reader.ReadVector(from);
+  reader.ReadVector(to);
+  reader.ReadVector(distance);
+  reader.ReadVector(dz);
+  reader.ReadVector(ring);
+  const size_t n_disabled = from.size();
+  bool mask_fits = (rel->domEnabled_.empty() || rel->domEnabled_.size()==hasher->HashSize())
+    && to.size()==n_disabled && distance.size()==n_disabled && dz.size()==n_disabled && ring.size()==n_disabled;
+  for (size_t i=0; mask_fits && i<n_disabled; i++)
+    mask_fits = (from[i]<hasher->HashSize() && to[i]<hasher->HashSize());
+  if (!reader.Good() || !mask_fits) {
+    log_warn("Relation mask read is corrupt");
+    reader.SetFailed();
+    return RelationPtr();
+  }
+  for (size_t i=0; i<n_disabled; i++)
+    rel->disabledEdges_.push_back(std::make_pair(std::make_pair(CompactHash(from[i]), CompactHash(to[i])), RelationEdge(distance[i], dz[i], ring[i])));
+  
+  rel->ConvertStorage(StorageType(storage));
+  return rel;
+};
+
+bool Relation::Save(const std::string& path) const {
+  const bool written = binaryio::WriteFile(path, relation_file_magic_,
+    [this](binaryio::BinaryWriter& writer) {WriteBinary(writer);});
+  if (!written)
+    log_warn_stream("Could not write Relation to "<<path);
+  return written;
+};
+
+RelationPtr Relation::Load(
+  const std::string& path,
+  const CompactOMKeyHashServiceConstPtr& hasher)
+{
+  RelationPtr rel;
+  const bool read = binaryio::ReadFile(path, relation_file_magic_,
+    [&rel, &hasher](binaryio::BinaryReader& reader) {rel = ReadBinary(reader, hasher);});
+  if (!read) {
+    log_warn_stream("Could not read Relation from "<<path);
+    return RelationPtr();
+  }
+  return rel;
+};
+
+void Relation::WriteImage(mappedimage::ImageWriter& writer) const {
+  writer.Write<uint32_t>(relation_image_version_);
+  writer.Write<uint32_t>(payload_);
+  
+  //the rows are written compressed, the payload in the same order
+  const SparseRelationMap sparse = (storage_==SPARSE) ? sparseMap_ : SparseRelationMap(hasher_->HashSize(), relationMap_);
+  writer.WriteArray(sparse.GetRowOffsets().data(), sparse.GetRowOffsets().size());
+  writer.WriteArray(sparse.GetColumns().data(), sparse.GetColumns().size());
+  
+  if (payload_==NO_PAYLOAD)
+    return;
+  std::vector<float> distance, dz;
+  std::vector<int8_t> ring;
+  for (size_t a=0; a<sparse.Size(); a++) {
+    for (const SparseRelationMap::Index* b=sparse.RowBegin(a); b!=sparse.RowEnd(a); ++b) {
+      const RelationEdge edge = PayloadAt(EdgeIndex(a, *b));
+      distance.push_back(edge.distance);
+      dz.push_back(edge.dz);
+      ring.push_back(edge.ring);
+    }
+  }
+  writer.WriteArray(distance.data(), distance.size());
+  if (payload_==GEOMETRY) {
+    writer.WriteArray(dz.data(), dz.size());
+    writer.WriteArray(ring.data(), ring.size());
+  }
+};
+
+RelationPtr Relation::MapImage(
+  mappedimage::ImageReader& reader,
+  const CompactOMKeyHashServiceConstPtr& hasher)
+{
+  const uint32_t version = reader.Read<uint32_t>();
+  const uint32_t payload = reader.Read<uint32_t>();
+  if (!reader.Good() || version!=relation_image_version_ || payload>GEOMETRY) {
+    log_warn_stream("Cannot map Relation of image version "<<version);
+    reader.SetFailed();
+    return RelationPtr();
+  }
+  
+  const SparseRelationMap::IndexArray rowOffsets = reader.ReadArray<SparseRelationMap::Index>();
+  const SparseRelationMap::IndexArray columns = reader.ReadArray<SparseRelationMap::Index>();
+  //the rows are used in place, so they have to be verified as when read
+  if (!reader.Good() || !SparseRelationMap::IsConsistent(rowOffsets, columns, hasher->HashSize())) {
+    log_warn("Relation mapped is corrupt or does not fit the hasher");
+    reader.SetFailed();
+    return RelationPtr();
+  }
+  
+  RelationPtr rel = boost::make_shared<Relation>(hasher, SparseRelationMap(rowOffsets, columns));
+  if (payload!=NO_PAYLOAD) {
+    rel->payload_ = PayloadType(payload);
+    rel->edgeDistance_ = reader.ReadArray<float>();
+    if (payload==GEOMETRY) {
+      rel->edgeDz_ = reader.ReadArray<float>();
+      rel->edgeRing_ = reader.ReadArray<int8_t>();
+    }
+    const size_t n_edges = columns.size();
+    if (!reader.Good() || rel->edgeDistance_.size()!=n_edges
+      || (payload==GEOMETRY && (rel->edgeDz_.size()!=n_edges || rel->edgeRing_.size()!=n_edges)))
+    {
+      log_warn("Relation payload mapped is corrupt");
+      reader.SetFailed();
+      return RelationPtr();
+    }
+  }
+  return rel;
+};
+
+bool Relation::IsMapped() const {
+  return sparseMap_.GetRowOffsets().IsView() || sparseMap_.GetColumns().IsView()
+    || edgeDistance_.IsView() || edgeDz_.IsView() || edgeRing_.IsView();
+};
+
+void Relation::DisableDOMs(const std::vector<CompactHash>& doms) {
+  const size_t size = hasher_->HashSize();
+  if (domEnabled_.empty())
+    domEnabled_.assign(size, 1);
+  //the DOMs which become disabled now
+  std::vector<uint8_t> disabling(size, 0);
+  std::vector<CompactHash> disabled;
+  BOOST_FOREACH(const CompactHash h, doms) {
+    if (domEnabled_[h] && !disabling[h]) {
+      disabling[h] = 1;
+      disabled.push_back(h);
+    }
+  }
+  if (disabled.empty())
+    return;
+  
+  if (storage_==DENSE) {
+    //clear the rows and the columns of the affected DOMs
+    BOOST_FOREACH(const CompactHash d, disabled) {
+      for (size_t x=0; x<size; x++) {
+        if (relationMap_.Get(d,x)) {
+          disabledEdges_.push_back(std::make_pair(std::make_pair(d, CompactHash(x)), GetEdge(d,x)));
+          relationMap_.Set(d, x, false);
+        }
+        if (relationMap_.Get(x,d)) {
+          disabledEdges_.push_back(std::make_pair(std::make_pair(CompactHash(x), d), GetEdge(x,d)));
+          relationMap_.Set(x, d, false);
+        }
+      }
+    }
+  }
+  else {
+    //one pass over the compressed rows; unaffected entries are copied as they are
+    SparseRelationMap kept(0);
+    std::vector<RelationEdge> keptEdges;
+    std::vector<SparseRelationMap::Index> row;
+    for (size_t a=0; a<size; a++) {
+      row.clear();
+      for (const SparseRelationMap::Index* iter=sparseMap_.RowBegin(a); iter!=sparseMap_.RowEnd(a); ++iter) {
+        const RelationEdge edge = (payload_!=NO_PAYLOAD) ? PayloadAt(iter-sparseMap_.GetColumns().data()) : RelationEdge();
+        if (disabling[a] || disabling[*iter])
+          disabledEdges_.push_back(std::make_pair(std::make_pair(CompactHash(a), CompactHash(*iter)), edge));
+        else {
+          row.push_back(*iter);
+          if (payload_!=NO_PAYLOAD)
+            keptEdges.push_back(edge);
+        }
+      }
+      kept.AppendRow(row);
+    }
+    sparseMap_ = kept;
+    if (payload_!=NO_PAYLOAD) {
+      edgeDistance_.clear();
+      edgeDz_.clear();
+      edgeRing_.clear();
+      ResizePayload(keptEdges.size());
+      for (size_t i=0; i<keptEdges.size(); i++)
+        SetPayloadAt(i, keptEdges[i]);
+    }
+  }
+  BOOST_FOREACH(const CompactHash d, disabled)
+    domEnabled_[d] = 0;
+};
+
+void Relation::EnableDOMs(const std::vector<CompactHash>& doms) {
+  if (domEnabled_.empty())
+    return;
+  bool changed = false;
+  BOOST_FOREACH(const CompactHash h, doms) {
+    changed |= !domEnabled_[h];
+    domEnabled_[h] = 1;
+  }
+  if (!changed)
+    return;
+  
+  //take back the edges of which both ends are enabled now; in order, so that they can be filled in row by row
+  std::vector<std::pair<std::pair<CompactHash, CompactHash>, RelationEdge> > restored, held;
+  for (size_t i=0; i<disabledEdges_.size(); i++) {
+    const std::pair<CompactHash, CompactHash>& ab = disabledEdges_[i].first;
+    if (domEnabled_[ab.first] && domEnabled_[ab.second])
+      restored.push_back(disabledEdges_[i]);
+    else
+      held.push_back(disabledEdges_[i]);
+  }
+  disabledEdges_.swap(held);
+  if (restored.empty())
+    return;
+  struct EdgeOrder {
+    bool operator()(
+      const std::pair<std::pair<CompactHash, CompactHash>, RelationEdge>& lhs,
+      const std::pair<std::pair<CompactHash, CompactHash>, RelationEdge>& rhs) const
+    {return lhs.first<rhs.first;};
+  };
+  std::sort(restored.begin(), restored.end(), EdgeOrder());
+  
+  //the restored edges are joined in; they are disjoint to the held ones, so they keep their payload
+  const size_t size = hasher_->HashSize();
+  SparseRelationMap restoredMap(0);
+  std::vector<SparseRelationMap::Index> row;
+  size_t i = 0;
+  for (size_t a=0; a<size; a++) {
+    row.clear();
+    for (; i<restored.size() && restored[i].first.first==a; i++)
+      row.push_back(restored[i].first.second);
+    restoredMap.AppendRow(row);
+  }
+  Relation restoredRel(hasher_, restoredMap);
+  if (payload_!=NO_PAYLOAD) {
+    restoredRel.EnablePayload(payload_);
+    for (size_t e=0; e<restored.size(); e++)
+      restoredRel.SetPayloadAt(e, restored[e].second);
+  }
+  Join(restoredRel);
+  
+  if (std::find(domEnabled_.begin(), domEnabled_.end(), 0)==domEnabled_.end())
+    domEnabled_.clear();
+};
+
+size_t Relation::NumberOfDisabledDOMs() const
+  {return std::count(domEnabled_.begin(), domEnabled_.end(), 0);};
+
 #if SERIALIZATION_ENABLED
   I3_SERIALIZABLE(Relation);
-#endif //SERIALIZATON_ENABLED  
+#endif //SERIALIZATON_ENABLED
@@ -14,6 +14,11 @@
 
 #include <list>
 #include <map>
+#include <vector>
+#include <iterator>
+#include <algorithm>
+#include <cmath>
+#include <stdint.h>
 #include <boost/make_shared.hpp>
 
 #include "dataclasses/I3Constants.h"
@@ -25,8 +30,15 @@
 #include "ToolZ/Hitclasses.h"
 #include "ToolZ/IndexMatrix.h"
 
+#include "IceHiveZ/internals/BinaryIO.h"
+#include "IceHiveZ/internals/MappedImage.h"
+
 #include "IceHiveZ/__SERIALIZATION.h"
-static const unsigned relation_version_ = 0;
+static const unsigned relation_version_ = 2;
+///version of the flat binary format written by Relation::WriteBinary
+static const uint32_t relation_binary_version_ = 2;
+///version of the image format written by Relation::WriteImage
+static const uint32_t relation_image_version_ = 1;
 
 //forward declarations for serialization
 #if SERIALIZATION_ENABLED
@@ -47,6 +59,95 @@ namespace SERIALIZATION_NS_BASE { namespace serialization {
 }};
 #endif //SERIALIZATION_ENABLED
 
+//=================== STRUCT RelationEdge =========
+
+///Geometric information that can be attached to every edge a->b of a Relation,
+///so that it is at hand where the relation is looked up
+struct RelationEdge {
+  ///distance between the two DOMs; NAN if not known
+  float distance;
+  ///z-offset of DOM b relative to DOM a; NAN if not known
+  float dz;
+  ///the ring the string of DOM b has around the string of DOM a; -1 if not known
+  int8_t ring;
+  
+  ///constructor; nothing known
+  RelationEdge();
+  ///constructor
+  RelationEdge(const float d, const float z=NAN, const int8_t r=-1);
+};
+
+//=================== CLASS SparseRelationMap =========
+
+/** A compressed sparse-row (CSR) storage of a relation between DOMs:
+ * for every row 'a' the sorted list of column indices 'b' for which a->b holds.
+ * Memory scales with the number of set relations instead of HashSize()^2;
+ * lookups are a binary search within one row.
+ * NOTE setting single relations requires to shift the trailing entries and is therefore slow;
+ * build the relation in dense storage and convert or fill it row by row instead.
+ * The storage can be a view into a mapped image, which is copied on the first modification
+ */
+class SparseRelationMap {
+public:
+  ///type used to store column indices and row offsets
+  typedef uint32_t Index;
+  ///the storage of indices; owned or a view into a mapped image
+  typedef mappedimage::SharedArray<Index> IndexArray;
+private:
+  ///offsets into columns_ at which each row begins; holds HashSize()+1 entries
+  IndexArray rowOffsets_;
+  ///the column indices of each row, sorted within the row
+  IndexArray columns_;
+public:
+  ///blank constructor
+  SparseRelationMap();
+  ///constructor for a map of this many rows; with all or none relations set
+  SparseRelationMap(const size_t size, const bool setall=false);
+  ///constructor from a dense map of this size
+  SparseRelationMap(const size_t size, const indexmatrix::AsymmetricIndexMatrix_Bool& dense);
+  
+  ///number of rows (and columns)
+  size_t Size() const;
+  ///number of set relations
+  size_t NumberOfEntries() const;
+  ///get the relation between these indices
+  bool Get(const size_t a, const size_t b) const;
+  ///set the relation between these indices
+  ///\return the position in the compressed storage that was inserted or erased; npos if nothing changed
+  size_t Set(const size_t a, const size_t b, const bool value);
+  ///find the position of this relation in the compressed storage
+  ///\return the position or npos if not related
+  size_t Find(const size_t a, const size_t b) const;
+  ///signals an invalid position
+  static const size_t npos;
+  ///the first entry in the row of 'a'
+  const Index* RowBegin(const size_t a) const;
+  ///one past the last entry in the row of 'a'
+  const Index* RowEnd(const size_t a) const;
+  ///append the next row; rows have to be appended in order on a map constructed with size 0
+  ///\param cols the sorted column indices of this row
+  void AppendRow(const std::vector<Index>& cols);
+  ///replace the row of 'a' by these entries
+  ///\param cols the sorted column indices of this row
+  void SetRow(const size_t a, const std::vector<Index>& cols);
+  ///convert into a dense map
+  indexmatrix::AsymmetricIndexMatrix_Bool ToDense() const;
+  
+  ///direct access to the raw storage, e.g. for serialization
+  const IndexArray& GetRowOffsets() const;
+  const IndexArray& GetColumns() const;
+  ///construct directly from the raw storage; no checks on consistency are performed
+  SparseRelationMap(
+    const IndexArray& rowOffsets,
+    const IndexArray& columns);
+  ///check that raw storage is consistent for a map of this many rows:
+  ///the rows are in order and hold sorted column indices within range, so that no lookup can go astray
+  static bool IsConsistent(
+    const IndexArray& rowOffsets,
+    const IndexArray& columns,
+    const size_t size);
+};
+
 ///Facilitates the access and interpretation of a indexMatrix as the connection between DOMs
 class Relation {
   SET_LOGGER("Relation");
@@ -68,50 +169,81 @@ class Relation {
   template<class Archive>
     void serialize(Archive & ar, const unsigned int version);
 #endif //SERIALIZATION_ENABLED
+public:
+  ///the backends in which the relation can be stored
+  enum StorageType {
+    DENSE = 0, ///< a bitmap of HashSize()^2 bits; fast to set and to look up
+    SPARSE = 1 ///< compressed sparse rows; small and fast to iterate neighbours
+  };
+  
+  ///which information is carried on the edges of the relation
+  enum PayloadType {
+    NO_PAYLOAD = 0, ///< nothing
+    DISTANCE = 1, ///< the distance between the DOMs
+    GEOMETRY = 2 ///< the distance, z-offset and ring between the DOMs
+  };
+  
+  class RelatedIterator;
+  class RelatedRange;
+  
 private:
   ///the hasher that is used to adress the relation Map
   const CompactOMKeyHashServiceConstPtr hasher_;
-  ///a relation map that can be evaluated with domIndexes
+  ///the backend which is currently in use
+  StorageType storage_;
+  ///a relation map that can be evaluated with domIndexes; only in use for DENSE storage
   indexmatrix::AsymmetricIndexMatrix_Bool relationMap_;
+  ///a relation map in compressed rows; only in use for SPARSE storage
+  SparseRelationMap sparseMap_;
+  ///the payload carried on the edges
+  PayloadType payload_;
+  ///edge distances; indexed as a*HashSize()+b for DENSE, by position in the compressed rows for SPARSE
+  mappedimage::SharedArray<float> edgeDistance_;
+  ///edge z-offsets; same indexing, only in use for GEOMETRY payload
+  mappedimage::SharedArray<float> edgeDz_;
+  ///edge rings; same indexing, only in use for GEOMETRY payload
+  mappedimage::SharedArray<int8_t> edgeRing_;
+  ///the validity mask: is the DOM at this index enabled; empty if all are
+  std::vector<uint8_t> domEnabled_;
+  ///the edges of disabled DOMs, held aside with their payload until the DOMs are enabled again
+  std::vector<std::pair<std::pair<CompactHash, CompactHash>, RelationEdge> > disabledEdges_;
 
-private: //utility classes
-  /** utility for predicate
-   */
-  struct PredicateTranslator {
-    const CompactOMKeyHashServiceConstPtr hasher_;
-    const boost::function<bool (const OMKey&, const OMKey&)> predicate_;
-    
-    PredicateTranslator(
-      const CompactOMKeyHashServiceConstPtr& hasher,
-      const boost::function<bool (const OMKey&, const OMKey&)>& predicate)
-    : hasher_(hasher),
-      predicate_(predicate)
-    {};
-    
-    bool operator() (const unsigned& first, const unsigned& second) {
-      return predicate_(hasher_->OMKeyFromHash(first), hasher_->OMKeyFromHash(second));
-    };
-  }; //redicateTranslator
+public:
+  ///a row-wise predicate: fill 'related' with all indices 'b' that 'a' is related to, in ascending order;
+  ///'related' is handed in empty
+  typedef boost::function<void (const CompactHash a, std::vector<CompactHash>& related)> RowPredicate;
 
 public: //methods
   ///Create a blank relationMap adressed by this Hasher
   Relation(
     const CompactOMKeyHashServiceConstPtr& hasher,
-    const bool setall = false);
+    const bool setall = false,
+    const StorageType storage = DENSE);
   /// constructor with predicate
   Relation(
     const CompactOMKeyHashServiceConstPtr& hasher,
-    const boost::function<bool (const OMKey&, const OMKey&)> predicate);
+    const boost::function<bool (const OMKey&, const OMKey&)> predicate,
+    const StorageType storage = DENSE);
   /// constructor by copying a relationMap
   Relation(
     const CompactOMKeyHashServiceConstPtr& hasher,
     const indexmatrix::AsymmetricIndexMatrix_Bool& relationMap);
+  /// constructor by copying a sparse relationMap
+  Relation(
+    const CompactOMKeyHashServiceConstPtr& hasher,
+    const SparseRelationMap& sparseMap);
   
 public: //methods
   ///get the hasher
   CompactOMKeyHashServiceConstPtr GetHasher() const;
-  ///get the relationMap
+  ///get the backend this relation is stored in
+  StorageType GetStorageType() const;
+  ///convert the relation into this storage backend; no-op if already stored so
+  void ConvertStorage(const StorageType storage);
+  ///get the relationMap; NOTE only available for DENSE storage
   const indexmatrix::AsymmetricIndexMatrix_Bool& GetRelationMap() const;
+  ///get the sparse relationMap; NOTE only available for SPARSE storage
+  const SparseRelationMap& GetSparseRelationMap() const;
   
   /// if any of both are set, set the new one
   void Join(const Relation& r);
@@ -137,13 +269,191 @@ public: //methods
     const OMKey& a,
     const OMKey& b,
     const bool value);
-  ///set all OMKeys to be related
+  ///set all OMKeys to be related; the storage is filled in bulk
   void SetAllRelated();
-  ///set all OMKeys to be related
+  ///set no OMKeys to be related; the storage is filled in bulk
   void SetNoneRelated();
-  ///set the relation by predication;
-  ///NOTE assums function like object supports signature 'bool operator()(OMKey, OMKey)'
-  void PredicateRelated(const boost::function<bool (const OMKey&, const OMKey&)>& callobj);
+  ///set or unset all relations from 'a' at once
+  void SetRowRelated(
+    const CompactHash a,
+    const bool value);
+  /** set the relation by predication; the relation is rebuilt row by row
+   * NOTE assums function like object supports signature 'bool operator()(OMKey, OMKey)'
+   * \param callobj the predicate
+   * \param nThreads number of threads the rows are evaluated with; 0 for as many as the hardware supports.
+   *   NOTE anything but 1 requires the predicate to be callable concurrently
+   * Disabled DOMs stay disabled: their relations are evaluated, but held aside until they are enabled again
+   */
+  void PredicateRelated(
+    const boost::function<bool (const OMKey&, const OMKey&)>& callobj,
+    const unsigned nThreads=1);
+  /** set the relation by a row-wise predicate, which is called once for every row;
+   * same as PredicateRelated() otherwise
+   */
+  void PredicateRelatedRows(
+    const RowPredicate& rowPredicate,
+    const unsigned nThreads=1);
+  
+  ///call 'f(b)' for every index 'b' that 'a' is related to, in ascending order;
+  ///NOTE assumes function like object supports signature 'void operator()(CompactHash)'
+  template <class Functor>
+  void ForEachRelated(const CompactHash a, Functor f) const;
+  ///get the range of all indices 'b' that 'a' is related to, in ascending order
+  RelatedRange RelatedSpan(const CompactHash a) const;
+  ///count the number of relations that are set
+  size_t NumberOfRelated() const;
+  
+  ///does a->b always imply b->a
+  bool IsSymmetric() const;
+  ///get the transposed relation, holding b->a for every a->b, in the same storage;
+  ///payload is carried over with the z-offset inverted
+  boost::shared_ptr<Relation> Transposed() const;
+  ///get the symmetric closure of this relation, holding a->b and b->a for every a->b, in the same storage;
+  ///edges already held keep their payload
+  boost::shared_ptr<Relation> SymmetricClosure() const;
+  
+  ///attach a payload of this type to every edge; already attached information is kept where possible
+  ///NOTE for DENSE storage this allocates HashSize()^2 entries, prefer SPARSE storage
+  void EnablePayload(const PayloadType payload);
+  ///get the type of payload attached to the edges
+  PayloadType GetPayloadType() const;
+  ///is there any payload attached to the edges
+  bool HasPayload() const;
+  ///set the payload of an existing edge a->b; NOTE not related DOMs carry no edge in SPARSE storage
+  void SetEdge(
+    const CompactHash a,
+    const CompactHash b,
+    const RelationEdge& edge);
+  ///get the payload of the edge a->b
+  ///\return the edge; as not known if there is no edge or no payload
+  RelationEdge GetEdge(
+    const CompactHash a,
+    const CompactHash b) const;
+  ///get the relation between two OMKeyHashes and the distance carried by their edge in one lookup
+  ///\param dr set to the distance carried by the edge, NAN if not known; only set if related
+  ///\return true if related
+  bool RelatedDistance(
+    const CompactHash a,
+    const CompactHash b,
+    double& dr) const;
+  
+  ///write this relation in the flat binary format; always written as compressed rows
+  void WriteBinary(binaryio::BinaryWriter& writer) const;
+  ///read a relation in the flat binary format, which has been written by WriteBinary
+  ///\param reader reader positioned at the start of the relation
+  ///\param hasher the hasher the relation is adressed by; needs to be of the same size as the written one
+  ///\return the relation or a null pointer if the data is corrupt or does not fit the hasher
+  static boost::shared_ptr<Relation> ReadBinary(
+    binaryio::BinaryReader& reader,
+    const CompactOMKeyHashServiceConstPtr& hasher);
+  ///save to a standalone binary file
+  ///\return true if written
+  bool Save(const std::string& path) const;
+  ///load a standalone binary file, which has been written by Save
+  ///\param path the file to read
+  ///\param hasher the hasher the relation is adressed by; needs to be of the same size as the written one
+  ///\return the relation or a null pointer if the file does not exist, is not a Relation, is corrupt or does not fit the hasher
+  static boost::shared_ptr<Relation> Load(
+    const std::string& path,
+    const CompactOMKeyHashServiceConstPtr& hasher);
+  
+  ///write this relation into an image, which can be used in place when mapped; always written as compressed rows
+  void WriteImage(mappedimage::ImageWriter& writer) const;
+  /** get a relation which uses an image in place, which has been written by WriteImage;
+   * the relation is stored SPARSE and is read-only in the sense that any modification makes a private copy
+   * \param reader reader positioned at the start of the relation in the image
+   * \param hasher the hasher the relation is adressed by; needs to be of the same size as the written one
+   * \return the relation or a null pointer if the data is corrupt or does not fit the hasher
+   */
+  static boost::shared_ptr<Relation> MapImage(
+    mappedimage::ImageReader& reader,
+    const CompactOMKeyHashServiceConstPtr& hasher);
+  ///is this relation (partially) a view into a mapped image
+  bool IsMapped() const;
+  
+  /** disable these DOMs: all relations from and to them are taken out and held aside, so that they can be enabled again;
+   * the hashing stays untouched. Only the rows and columns of the affected DOMs are touched;
+   * already disabled DOMs are skipped
+   */
+  void DisableDOMs(const std::vector<CompactHash>& doms);
+  /** enable these DOMs again: the relations held aside are restored, where the DOM on the other end is enabled as well;
+   * already enabled DOMs are skipped
+   */
+  void EnableDOMs(const std::vector<CompactHash>& doms);
+  ///is this DOM enabled
+  bool IsDOMEnabled(const CompactHash h) const;
+  ///number of DOMs which are disabled
+  size_t NumberOfDisabledDOMs() const;
+
+private: //bulk construction
+  ///rebuild the relation from these rows; the rows are evaluated by 'nThreads' workers and put in place in order;
+  ///the relations from and to disabled DOMs are held aside instead
+  ///NOTE assumes function like object supports signature 'void operator()(CompactHash, std::vector<CompactHash>&)'
+  template <class RowFunction>
+  void FillRows(
+    const RowFunction& rowFunction,
+    const unsigned nThreads);
+
+private: //payload bookkeeping
+  ///position of the payload of edge a->b, npos if none
+  size_t EdgeIndex(const CompactHash a, const CompactHash b) const;
+  ///(re)size the payload to this many edges, filling new ones as not known
+  void ResizePayload(const size_t n);
+  ///drop all payload information, after the structure of the relation has been rebuilt
+  void ResetPayload();
+  ///insert a not known payload at this position
+  void InsertPayload(const size_t pos);
+  ///erase the payload at this position
+  void ErasePayload(const size_t pos);
+  ///replace this many entries of payload at this position by these
+  void ReplacePayload(
+    const size_t pos,
+    const size_t n_old,
+    const std::vector<RelationEdge>& edges);
+  ///get the payload at this position
+  RelationEdge PayloadAt(const size_t pos) const;
+  ///set the payload at this position
+  void SetPayloadAt(const size_t pos, const RelationEdge& edge);
+};
+
+///forward-iterates over the indices related to a row, regardless of the storage backend
+class Relation::RelatedIterator
+: public std::iterator<std::forward_iterator_tag, CompactHash, std::ptrdiff_t, const CompactHash*, CompactHash> {
+  friend class Relation;
+private:
+  ///the relation iterated over
+  const Relation* rel_;
+  ///the row which is iterated
+  size_t row_;
+  ///the position: column for DENSE, position in the compressed row for SPARSE
+  size_t pos_;
+  ///constructor; advances to the first related entry at or after this position
+  RelatedIterator(const Relation* rel, const size_t row, const size_t pos);
+  ///move forward to the next set bit if DENSE
+  void Seek();
+public:
+  CompactHash operator*() const;
+  RelatedIterator& operator++();
+  RelatedIterator operator++(int);
+  bool operator==(const RelatedIterator& o) const;
+  bool operator!=(const RelatedIterator& o) const;
+};
+
+///a begin/end-pair of RelatedIterators, which can be used in range-based for loops
+class Relation::RelatedRange {
+  friend class Relation;
+public:
+  typedef RelatedIterator iterator;
+  typedef RelatedIterator const_iterator;
+private:
+  RelatedIterator begin_;
+  RelatedIterator end_;
+  RelatedRange(const RelatedIterator& b, const RelatedIterator& e);
+public:
+  RelatedIterator begin() const;
+  RelatedIterator end() const;
+  ///is the range empty
+  bool empty() const;
 };
 
 typedef boost::shared_ptr<Relation> RelationPtr;
@@ -175,7 +485,24 @@ inline void save_construct_data(
   const unsigned int version)
 {
   ar << SERIALIZATION_NS::make_nvp("Hasher", t->hasher_);
-  ar << SERIALIZATION_NS::make_nvp("relationmap",t->relationMap_);
+  const int storage = t->storage_;
+  ar << SERIALIZATION_NS::make_nvp("storage", storage);
+  if (t->storage_ == Relation::DENSE)
+    ar << SERIALIZATION_NS::make_nvp("relationmap",t->relationMap_);
+  else {
+    const std::vector<SparseRelationMap::Index> rowOffsets = t->sparseMap_.GetRowOffsets().ToVector();
+    const std::vector<SparseRelationMap::Index> columns = t->sparseMap_.GetColumns().ToVector();
+    ar << SERIALIZATION_NS::make_nvp("rowoffsets",rowOffsets);
+    ar << SERIALIZATION_NS::make_nvp("columns",columns);
+  }
+  const int payload = t->payload_;
+  ar << SERIALIZATION_NS::make_nvp("payload", payload);
+  const std::vector<float> edgeDistance = t->edgeDistance_.ToVector();
+  const std::vector<float> edgeDz = t->edgeDz_.ToVector();
+  const std::vector<int8_t> edgeRing = t->edgeRing_.ToVector();
+  ar << SERIALIZATION_NS::make_nvp("edgeDistance", edgeDistance);
+  ar << SERIALIZATION_NS::make_nvp("edgeDz", edgeDz);
+  ar << SERIALIZATION_NS::make_nvp("edgeRing", edgeRing);
 };
 
 template<class Archive>
@@ -186,76 +513,265 @@ inline void load_construct_data(
 {
   CompactOMKeyHashServiceConstPtr hasher;
   ar >> SERIALIZATION_NS::make_nvp("Hasher", hasher); //const_cast<CompactOMKeyHashServiceConstPtr>(hasher_)
-  indexmatrix::AsymmetricIndexMatrix_Bool relationMap(hasher->HashSize());
-  ar >> SERIALIZATION_NS::make_nvp("relationmap",relationMap);
-  
-  ::new(t) Relation(hasher, relationMap);
+  int storage = Relation::DENSE;
+  if (version>0)
+    ar >> SERIALIZATION_NS::make_nvp("storage", storage);
+  if (storage == Relation::DENSE) {
+    indexmatrix::AsymmetricIndexMatrix_Bool relationMap(hasher->HashSize());
+    ar >> SERIALIZATION_NS::make_nvp("relationmap",relationMap);
+    ::new(t) Relation(hasher, relationMap);
+  }
+  else {
+    std::vector<SparseRelationMap::Index> rowOffsets, columns;
+    ar >> SERIALIZATION_NS::make_nvp("rowoffsets",rowOffsets);
+    ar >> SERIALIZATION_NS::make_nvp("columns",columns);
+    ::new(t) Relation(hasher, SparseRelationMap(SparseRelationMap::IndexArray(rowOffsets), SparseRelationMap::IndexArray(columns)));
+  }
+  if (version>1) {
+    int payload;
+    ar >> SERIALIZATION_NS::make_nvp("payload", payload);
+    t->payload_ = Relation::PayloadType(payload);
+    ar >> SERIALIZATION_NS::make_nvp("edgeDistance", t->edgeDistance_.Mutable());
+    ar >> SERIALIZATION_NS::make_nvp("edgeDz", t->edgeDz_.Mutable());
+    ar >> SERIALIZATION_NS::make_nvp("edgeRing", t->edgeRing_.Mutable());
+  }
 };
 }} // namespace ...
 #endif //SERIALIZATION_ENABLED
 
+//=================== STRUCT RelationEdge =========
+
+inline
+RelationEdge::RelationEdge()
+: distance(NAN), dz(NAN), ring(-1)
+{};
+
+inline
+RelationEdge::RelationEdge(const float d, const float z, const int8_t r)
+: distance(d), dz(z), ring(r)
+{};
+
+//=================== CLASS SparseRelationMap =========
+
+inline
+size_t SparseRelationMap::Size() const
+  {return rowOffsets_.size()-1;};
+
+inline
+size_t SparseRelationMap::NumberOfEntries() const
+  {return columns_.size();};
+
+inline
+const SparseRelationMap::Index* SparseRelationMap::RowBegin(const size_t a) const
+  {return columns_.data()+rowOffsets_[a];};
+
+inline
+const SparseRelationMap::Index* SparseRelationMap::RowEnd(const size_t a) const
+  {return columns_.data()+rowOffsets_[a+1];};
+
+inline
+bool SparseRelationMap::Get(const size_t a, const size_t b) const
+  {return std::binary_search(RowBegin(a), RowEnd(a), Index(b));};
+
+inline
+size_t SparseRelationMap::Find(const size_t a, const size_t b) const {
+  const Index* end = RowEnd(a);
+  const Index* pos = std::lower_bound(RowBegin(a), end, Index(b));
+  if (pos==end || *pos!=b)
+    return npos;
+  return pos-columns_.data();
+};
+
+inline
+const SparseRelationMap::IndexArray& SparseRelationMap::GetRowOffsets() const
+  {return rowOffsets_;};
+
+inline
+const SparseRelationMap::IndexArray& SparseRelationMap::GetColumns() const
+  {return columns_;};
+
+
+//=================== CLASS Relation =========
+
 inline 
 CompactOMKeyHashServiceConstPtr 
 Relation::GetHasher() const
   {return hasher_;};
 
 inline
-const indexmatrix::AsymmetricIndexMatrix_Bool& 
-Relation::GetRelationMap() const
-  {return relationMap_;};
-
-inline
-void Relation::Join(const Relation& r) //FIXME check congruence hashers
-  {relationMap_ |= r.relationMap_;};
-  
-inline
-void Relation::Intersect(const Relation& r)  //FIXME check congruence hashers
-  {relationMap_ &= r.relationMap_;};
+Relation::StorageType Relation::GetStorageType() const
+  {return storage_;};
 
 inline
 bool Relation::AreRelated
   (const CompactHash a,
   const CompactHash b) const 
-{return relationMap_.Get(a,b);};
+{
+  if (storage_==DENSE)
+    return relationMap_.Get(a,b);
+  return sparseMap_.Get(a,b);
+};
 
 inline
 void Relation::SetRelated(
   const CompactHash a,
   const CompactHash b,
   const bool value)
-{relationMap_.Set(a,b,value);};
-
-inline
-void Relation::SetAllRelated()
 {
-  for (size_t i=0; i<hasher_->HashSize(); i++) {   
-    for (size_t j=i; j<hasher_->HashSize(); j++) {
-      SetRelated(i, j, true);
-      SetRelated(j, i, true);
+  if (storage_==DENSE)
+    relationMap_.Set(a,b,value);
+  else {
+    const size_t pos = sparseMap_.Set(a,b,value);
+    if (payload_!=NO_PAYLOAD && pos!=SparseRelationMap::npos) {
+      if (value)
+        InsertPayload(pos);
+      else
+        ErasePayload(pos);
     }
   }
 };
 
 inline
-void Relation::SetNoneRelated()
+Relation::PayloadType Relation::GetPayloadType() const
+  {return payload_;};
+
+inline
+bool Relation::IsDOMEnabled(const CompactHash h) const
+  {return domEnabled_.empty() || domEnabled_[h];};
+
+inline
+bool Relation::HasPayload() const
+  {return payload_!=NO_PAYLOAD;};
+
+inline
+size_t Relation::EdgeIndex(const CompactHash a, const CompactHash b) const {
+  if (storage_==DENSE)
+    return a*hasher_->HashSize()+b;
+  return sparseMap_.Find(a,b);
+};
+
+inline
+RelationEdge Relation::GetEdge(
+  const CompactHash a,
+  const CompactHash b) const
+{
+  if (payload_==NO_PAYLOAD || !AreRelated(a,b))
+    return RelationEdge();
+  return PayloadAt(EdgeIndex(a,b));
+};
+
+inline
+bool Relation::RelatedDistance(
+  const CompactHash a,
+  const CompactHash b,
+  double& dr) const
+{
+  if (storage_==DENSE) {
+    if (!relationMap_.Get(a,b))
+      return false;
+    dr = (payload_==NO_PAYLOAD) ? NAN : edgeDistance_[a*hasher_->HashSize()+b];
+    return true;
+  }
+  const size_t pos = sparseMap_.Find(a,b);
+  if (pos==SparseRelationMap::npos)
+    return false;
+  dr = (payload_==NO_PAYLOAD) ? NAN : edgeDistance_[pos];
+  return true;
+};
+
+template <class Functor>
+void Relation::ForEachRelated(const CompactHash a, Functor f) const
 {
-  for (size_t i=0; i<hasher_->HashSize(); i++) {   
-    for (size_t j=i; j<hasher_->HashSize(); j++) {
-      SetRelated(i, j, false);
-      SetRelated(j, i, false);
+  if (storage_==DENSE) {
+    const size_t size = hasher_->HashSize();
+    for (size_t b=0; b<size; b++) {
+      if (relationMap_.Get(a,b))
+        f(CompactHash(b));
     }
   }
+  else {
+    const SparseRelationMap::Index* iter = sparseMap_.RowBegin(a);
+    const SparseRelationMap::Index* const end = sparseMap_.RowEnd(a);
+    for (; iter!=end; ++iter)
+      f(CompactHash(*iter));
+  }
+};
+
+
+//=================== CLASS Relation::RelatedIterator =========
+
+inline
+Relation::RelatedIterator::RelatedIterator(const Relation* rel, const size_t row, const size_t pos)
+: rel_(rel), row_(row), pos_(pos)
+  {Seek();};
+
+inline
+void Relation::RelatedIterator::Seek() {
+  if (rel_->storage_==DENSE) {
+    const size_t size = rel_->hasher_->HashSize();
+    while (pos_<size && !rel_->relationMap_.Get(row_, pos_))
+      ++pos_;
+  }
 };
 
 inline
-void Relation::PredicateRelated(const boost::function<bool (const OMKey&, const OMKey&)>& callobj) 
+CompactHash Relation::RelatedIterator::operator*() const {
+  if (rel_->storage_==DENSE)
+    return CompactHash(pos_);
+  return CompactHash(rel_->sparseMap_.GetColumns()[pos_]);
+};
+
+inline
+Relation::RelatedIterator& Relation::RelatedIterator::operator++() {
+  ++pos_;
+  Seek();
+  return *this;
+};
+
+inline
+Relation::RelatedIterator Relation::RelatedIterator::operator++(int) {
+  RelatedIterator tmp(*this);
+  ++(*this);
+  return tmp;
+};
+
+inline
+bool Relation::RelatedIterator::operator==(const RelatedIterator& o) const
+  {return pos_==o.pos_ && row_==o.row_ && rel_==o.rel_;};
+
+inline
+bool Relation::RelatedIterator::operator!=(const RelatedIterator& o) const
+  {return !(*this==o);};
+
+
+//=================== CLASS Relation::RelatedRange =========
+
+inline
+Relation::RelatedRange::RelatedRange(const RelatedIterator& b, const RelatedIterator& e)
+: begin_(b), end_(e)
+{};
+
+inline
+Relation::RelatedIterator Relation::RelatedRange::begin() const
+  {return begin_;};
+
+inline
+Relation::RelatedIterator Relation::RelatedRange::end() const
+  {return end_;};
+
+inline
+bool Relation::RelatedRange::empty() const
+  {return begin_==end_;};
+
+inline
+Relation::RelatedRange Relation::RelatedSpan(const CompactHash a) const
 {
-  for (size_t i=0; i<hasher_->HashSize(); i++) {   
-    for (size_t j=i; j<hasher_->HashSize(); j++) {
-      SetRelated(i, j, callobj(hasher_->OMKeyFromHash(i),hasher_->OMKeyFromHash(j)));
-      SetRelated(j, i, callobj(hasher_->OMKeyFromHash(j),hasher_->OMKeyFromHash(i)));
-    }
+  if (storage_==DENSE) {
+    const size_t size = hasher_->HashSize();
+    return RelatedRange(RelatedIterator(this, a, 0), RelatedIterator(this, a, size));
   }
+  const SparseRelationMap::IndexArray& offsets = sparseMap_.GetRowOffsets();
+  return RelatedRange(RelatedIterator(this, a, offsets[a]), RelatedIterator(this, a, offsets[a+1]));
 };
 
 #endif //RELATION_H
@@ -13,19 +13,71 @@
 #include "IceHiveZ/internals/RelationConfig.h"
 
 #include <cmath>
+#include <algorithm>
+#include <thread>
+#include <atomic>
 
-#define MULTITHREADING_ENABLED 0
+using namespace std;
 
-#if MULTITHREADING_ENABLED
-  #include <thread>         // std::thread
-  #include <mutex>          // std::mutex
+//===================== CLASS RelationConfig ==================
 
-  static std::mutex mtx;
-#endif //MULTITHREADING_ENABLED
+RelationConfig::RelationConfig()
+: storage_(Relation::DENSE),
+  payload_(Relation::NO_PAYLOAD)
+{};
 
-using namespace std;
+RelationConfig::~RelationConfig()
+{};
 
-//===================== CLASS RelationConfig ==================
+RelationPtr RelationConfig::BuildRelation (
+  const HashedGeometryConstPtr& hashedGeo,
+  const unsigned) const
+{ return BuildRelation(hashedGeo); };
+
+void RelationConfig::AttachPayload(
+  Relation& rel,
+  const HashedGeometryConstPtr& hashedGeo) const
+{
+  if (payload_==Relation::NO_PAYLOAD)
+    return;
+  
+  rel.EnablePayload(payload_);
+  const CompactOMKeyHashServiceConstPtr hasher = hashedGeo->GetHashService();
+  const DistanceServiceConstPtr distService = hashedGeo->GetDistService();
+  const PositionServiceConstPtr posService = hashedGeo->GetPosService();
+  
+  for (CompactHash a=0; a<hasher->HashSize(); a++) {
+    BOOST_FOREACH(const CompactHash b, rel.RelatedSpan(a)) {
+      RelationEdge edge(distService->GetDistance(a,b));
+      if (payload_==Relation::GEOMETRY) {
+        edge.dz = posService->GetPosition(b).GetZ() - posService->GetPosition(a).GetZ();
+        edge.ring = EdgeRing(hasher->OMKeyFromHash(a), hasher->OMKeyFromHash(b));
+      }
+      rel.SetEdge(a, b, edge);
+    }
+  }
+};
+
+int RelationConfig::EdgeRing(
+  const OMKey& omkey_A,
+  const OMKey& omkey_B) const
+{ return -1; };
+
+bool RelationConfig::IsThreadSafe() const
+{ return false; };
+
+bool RelationConfig::Fingerprint(
+  binaryio::Fnv1aHash& hash,
+  const HashedGeometryConstPtr& hashedGeo) const
+{ return false; };
+
+namespace {
+  /// is the function object empty or a plain function, which does not call into any foreign objects (e.g. python)
+  template <class Signature>
+  bool IsPlainFunction(const boost::function<Signature>& f) {
+    return f.empty() || f.template target<Signature*>();
+  };
+}
 
 //================ CLASS SimpleRelationConfig ==================
 
@@ -36,7 +88,14 @@ SimpleRelationConfig::SimpleRelationConfig(
 
 RelationPtr SimpleRelationConfig::BuildRelation (
   const HashedGeometryConstPtr& hashedGeo) const
-{ return boost::make_shared<Relation>(hashedGeo->GetHashService(), callobj_); };
+{
+  RelationPtr rs = boost::make_shared<Relation>(hashedGeo->GetHashService(), callobj_, storage_);
+  AttachPayload(*rs, hashedGeo);
+  return rs;
+};
+
+bool SimpleRelationConfig::IsThreadSafe() const
+{ return IsPlainFunction(callobj_); };
 
 
 //===================== STRUCT LimitPairs ==================
@@ -74,11 +133,18 @@ HiveRelationConfig::LimitPair HiveRelationConfig::RingLimits::GetLimitsOnRing(co
 
 HiveRelationConfig::HiveRelationConfig(
   const hive::HiveTopologyConstPtr hivetopo)
-: hivetopo_(hivetopo)
+: hivetopo_(hivetopo),
+  nThreads_(0),
+  compiledtopo_(hivetopo ? boost::make_shared<const hive::CompiledHiveTopology>(*hivetopo) : hive::CompiledHiveTopologyConstPtr())
 {};
   
 RelationPtr HiveRelationConfig::BuildRelation (
   const HashedGeometryConstPtr& hashedGeo) const   
+{ return BuildRelation(hashedGeo, 0); };
+
+RelationPtr HiveRelationConfig::BuildRelation (
+  const HashedGeometryConstPtr& hashedGeo,
+  const unsigned maxThreads) const
 {
   //verify helper objects
   if (!hivetopo_)
@@ -86,87 +152,173 @@ RelationPtr HiveRelationConfig::BuildRelation (
     
   const CompactOMKeyHashServiceConstPtr hasher = hashedGeo->GetHashService();
   const PositionServiceConstPtr posService = hashedGeo->GetPosService();
-  
-  //Start the map creation process
-  RelationPtr rs = boost::make_shared<Relation>(hasher, false);
+  const CompactHash n_doms = hasher->HashSize();
   
   log_info("Constructing Relation from HiveRelationConfig");
-  //Construct the relation map:
-  // For this fill the boolmap with all connections that can be made, but never reset them!
   
-  using namespace hive;
+  //evaluate the configured predicates up front and in this thread only,
+  // as they might be hooked up to objects (e.g. python) which cannot be called concurrently
+  DOMProperties doms;
+  doms.from_.resize(n_doms);
+  doms.stringIndex_.resize(n_doms);
+  doms.z_.resize(n_doms);
   
-  //NOTE as the following loops are static, they can in principle be multithreaded
-  // however the access and manipulation of the result-type (Relation->IndexMap->boost::dynamic_bitset)
-  // might not neccessarily be thread-save
+  std::map<unsigned, size_t> string_index;
+  std::vector<unsigned> strings;
+  for (CompactHash h=0; h<n_doms; ++h) {
+    const OMKey omkey = hasher->OMKeyFromHash(h);
+    const unsigned string = omkey.GetString();
+    if (string_index.insert(std::make_pair(string, strings.size())).second) {
+      strings.push_back(string);
+      doms.stringDOMs_.push_back(std::vector<StringDOM>());
+    }
+    doms.from_[h] = connectFrom_(omkey) && compiledtopo_->HoldsCenterString(string);
+    doms.stringIndex_[h] = string_index[string];
+    doms.z_[h] = posService->GetPosition(h).GetZ();
+    if (connectTo_(omkey)) {
+      const StringDOM sd = {doms.z_[h], h};
+      doms.stringDOMs_[doms.stringIndex_[h]].push_back(sd);
+    }
+  }
+  BOOST_FOREACH(std::vector<StringDOM>& sds, doms.stringDOMs_)
+    std::sort(sds.begin(), sds.end());
   
-  //===== LOOP A: ConnectFrom =====
-  for (unsigned matrix_x=0; matrix_x<hasher->HashSize(); ++matrix_x) {
-    const OMKey omkey_A = hasher->OMKeyFromHash(matrix_x);
-    log_debug_stream("====Fill next row === : "<<matrix_x<<":"<<omkey_A);
-
-    if (! connectFrom_(omkey_A))
-      continue;
-
-    const unsigned center_string = omkey_A.GetString();
-    if (! hivetopo_->HoldsCenterString(center_string))
+  //the ring only depends on the pair of strings; evaluate it once for each pair,
+  // and exclude all pairs which can never be related
+  doms.nStrings_ = strings.size();
+  doms.rings_.assign(doms.nStrings_*doms.nStrings_, -1);
+  for (size_t c=0; c<doms.nStrings_; c++) {
+    if (! compiledtopo_->HoldsCenterString(strings[c]))
       continue;
-
-    const I3Position& pos_A = posService->GetPosition(matrix_x);
-    const double z_A(pos_A.GetZ());
-
-    //===== LOOP B : ConnectTo=====
-    for (unsigned matrix_y=0; matrix_y<hasher->HashSize(); ++matrix_y) {
-      const OMKey omkey_B = hasher->OMKeyFromHash(matrix_y);
-      log_debug_stream("Looking for " << omkey_A << " and " << omkey_B);
-      
-      if (selfconnect_ && matrix_x==matrix_y) {
-        rs->SetRelated(matrix_x, matrix_y, true);
-        continue;
-      }
-      
-      if (! connectTo_(omkey_B))
+    for (size_t l=0; l<doms.nStrings_; l++) {
+      const int ring = compiledtopo_->WhichRing(strings[c], strings[l]);
+      if (ring == -1 || ring > ringLimits_.NRings()) //not in the ring indexing range or too far away
         continue;
-       
-      const unsigned lookup_string = omkey_B.GetString();
-
-      //Analyse the Ring relation between the srings of the two DOMs
-      const int ring = hivetopo_->WhichRing(center_string, lookup_string);
-      if (ring == -1) {//not in the ring indexing range
-        log_trace("Not included in ring index range");
+      const LimitPair& limits = ringLimits_.GetLimitsOnRing(ring);
+      if (std::isnan(limits.minus_) || std::isnan(limits.plus_)) //not configured rings
         continue;
-      }
-      log_trace_stream("Looking for " << omkey_A << " and " << omkey_B << " ring "<<ring << " max"<<ringLimits_.NRings());
+      doms.rings_[c*doms.nStrings_+l] = ring;
+    }
+  }
+  
+  //the rows are built by the workers, which pick up chunks of rows until all are done;
+  // each row is written by exactly one worker
+  std::vector<std::vector<CompactHash> > rows(n_doms);
+  
+  //within a pool of other builds, only the share of the threads left to this one is taken
+  unsigned n_threads = (nThreads_ ? nThreads_ : std::thread::hardware_concurrency());
+  if (maxThreads)
+    n_threads = std::min(n_threads, maxThreads);
+  n_threads = std::max(1u, std::min<unsigned>(n_threads, n_doms));
+  
+  const CompactHash chunk_size = 32;
+  std::atomic<CompactHash> next_row(0);
+  const auto worker = [&]() {
+    for (CompactHash begin = next_row.fetch_add(chunk_size); begin<n_doms; begin = next_row.fetch_add(chunk_size))
+      BuildRows(doms, begin, std::min<CompactHash>(begin+chunk_size, n_doms), rows);
+  };
+  
+  log_debug_stream("Building rows with "<<n_threads<<" threads");
+  std::vector<std::thread> workers;
+  for (unsigned t=1; t<n_threads; t++)
+    workers.push_back(std::thread(worker));
+  worker();
+  BOOST_FOREACH(std::thread& w, workers)
+    w.join();
+  
+  //Construct the relation map:
+  // fill the boolmap with all connections that can be made, but never reset them!
+  RelationPtr rs = boost::make_shared<Relation>(hasher, false);
+  for (CompactHash matrix_x=0; matrix_x<n_doms; ++matrix_x) {
+    BOOST_FOREACH(const CompactHash matrix_y, rows[matrix_x]) {
+      rs->SetRelated(matrix_x, matrix_y, true);
+      if (mutuallyconnect_)
+        rs->SetRelated(matrix_y, matrix_x, true);
+    }
+  }
+  //the relation is filled in dense storage, where setting single entries is cheap
+  rs->ConvertStorage(storage_);
+  AttachPayload(*rs, hashedGeo);
+  log_info("DONE Constructing RelationMap");
+  log_debug("Leaving BuildDistanceMap()");
+  
+  return rs;
+};
 
-      if (ring > ringLimits_.NRings()) {
-        log_trace_stream("Ring "<<ring<<" too far away; max Ringlimits "<<ringLimits_.NRings());
+void HiveRelationConfig::BuildRows(
+  const DOMProperties& doms,
+  const CompactHash begin,
+  const CompactHash end,
+  std::vector<std::vector<CompactHash> >& rows) const
+{
+  //===== LOOP A: ConnectFrom =====
+  for (CompactHash matrix_x=begin; matrix_x<end; ++matrix_x) {
+    if (! doms.from_[matrix_x])
+      continue;
+    
+    std::vector<CompactHash>& row = rows[matrix_x];
+    if (selfconnect_)
+      row.push_back(matrix_x);
+    
+    const std::vector<int>::const_iterator rings = doms.rings_.begin()+doms.stringIndex_[matrix_x]*doms.nStrings_;
+    //compare the depth-difference to the limits with the very same expression as the limit check
+    const double z_A = doms.z_[matrix_x];
+    const auto below = [z_A](const StringDOM& sd, const double minus) {return sd.z_-z_A < minus;};
+    const auto above = [z_A](const double plus, const StringDOM& sd) {return plus < sd.z_-z_A;};
+    
+    //===== LOOP B : ConnectTo; all strings on a configured ring =====
+    for (size_t l=0; l<doms.nStrings_; l++) {
+      const int ring = rings[l];
+      if (ring == -1)
         continue;
-      }
       
-      const I3Position& pos_B = posService->GetPosition(matrix_y);
-      const double z_B(pos_B.GetZ());
-        
-      const double& minusLimit = ringLimits_.GetLimitsOnRing(ring).minus_;
-      const double& plusLimit = ringLimits_.GetLimitsOnRing(ring).plus_;
-      log_trace_stream("ring "<< ring << " z_A "<< z_A << " z_B " << z_B << " ringlimit- " <<minusLimit<< " ringlimit+ " <<plusLimit);
-
-      const double zdist_AB = z_B-z_A;
-      if (std::isnan(minusLimit) && std::isnan(plusLimit)) {
-        log_trace("Not configured rings");
-      }
-      else if (minusLimit<= zdist_AB && zdist_AB <= plusLimit) {
-        rs->SetRelated(matrix_x, matrix_y, true);
-        if (mutuallyconnect_)
-          rs->SetRelated(matrix_y, matrix_x, true);
-        log_trace("DOMs are connected");
-      }
-      else {
-        log_trace("Not included in ring limits");
+      //the DOMs are ordered by depth, so the ones within the limits form a contiguous range
+      const LimitPair& limits = ringLimits_.limitPairs_[ring];
+      const std::vector<StringDOM>& sds = doms.stringDOMs_[l];
+      const std::vector<StringDOM>::const_iterator first = std::lower_bound(sds.begin(), sds.end(), limits.minus_, below);
+      const std::vector<StringDOM>::const_iterator last = std::upper_bound(first, sds.end(), limits.plus_, above);
+      for (std::vector<StringDOM>::const_iterator sd=first; sd!=last; ++sd) {
+        if (!(selfconnect_ && sd->hash_==matrix_x))
+          row.push_back(sd->hash_);
       }
     } //LOOP_B
+    std::sort(row.begin(), row.end());
   } //LOOP_A
-  log_info("DONE Constructing RelationMap");
-  log_debug("Leaving BuildDistanceMap()");
+};
+
+bool HiveRelationConfig::IsThreadSafe() const
+{ return IsPlainFunction(connectFrom_) && IsPlainFunction(connectTo_); };
+
+bool HiveRelationConfig::Fingerprint(
+  binaryio::Fnv1aHash& hash,
+  const HashedGeometryConstPtr& hashedGeo) const
+{
+  if (!hivetopo_)
+    return false;
   
-  return rs;
+  hash.AddString("HiveRelationConfig");
+  hash.AddValue<uint8_t>(storage_);
+  hash.AddValue<uint8_t>(payload_);
+  hash.AddValue<uint8_t>(selfconnect_);
+  hash.AddValue<uint8_t>(mutuallyconnect_);
+  hash.AddValue<uint64_t>(ringLimits_.limitPairs_.size());
+  BOOST_FOREACH(const LimitPair& lp, ringLimits_.limitPairs_) {
+    hash.AddValue(lp.minus_);
+    hash.AddValue(lp.plus_);
+  }
+  hash.AddString(hivetopo_->Dump());
+  
+  //the predicates are only known by their outcome; evaluate them on all DOMs
+  const CompactOMKeyHashServiceConstPtr hasher = hashedGeo->GetHashService();
+  for (CompactHash h=0; h<hasher->HashSize(); ++h) {
+    const OMKey omkey = hasher->OMKeyFromHash(h);
+    hash.AddValue<uint8_t>(connectFrom_.empty() ? 2 : connectFrom_(omkey));
+    hash.AddValue<uint8_t>(connectTo_.empty() ? 2 : connectTo_(omkey));
+  }
+  return true;
 };
+
+int HiveRelationConfig::EdgeRing(
+  const OMKey& omkey_A,
+  const OMKey& omkey_B) const
+{ return compiledtopo_->WhichRing(omkey_A.GetString(), omkey_B.GetString()); };
@@ -41,10 +41,50 @@ static const unsigned relationconfig_version_ = 0;
  */
 class RelationConfig {
 public:
+  /// PARAM: the storage backend of the built Relation; SPARSE for large and thinly related detectors
+  Relation::StorageType storage_;
+  /// PARAM: the payload attached to the edges of the built Relation
+  Relation::PayloadType payload_;
+public:
+  /// constructor
+  RelationConfig();
+  /// destructor
+  virtual ~RelationConfig();
   /// Build a Relation from the information in the derived class
   virtual 
   RelationPtr BuildRelation (
     const HashedGeometryConstPtr& hashedGeo) const=0;
+  /// Build a Relation, with no more than this many threads of its own; default: BuildRelation(hashedGeo)
+  /// \param hashedGeo the hashed geometry
+  /// \param maxThreads the budget of threads; 0 for no limit
+  virtual 
+  RelationPtr BuildRelation (
+    const HashedGeometryConstPtr& hashedGeo,
+    const unsigned maxThreads) const;
+  /// can BuildRelation be called concurrently with other work;
+  /// not the case if the configuration calls into objects like python callables; default: false
+  virtual
+  bool IsThreadSafe() const;
+  /** digest everything that determines the Relation built on this geometry into a fingerprint;
+   * equal fingerprints promise equal Relations
+   * \param hash the fingerprint to digest into
+   * \param hashedGeo the geometry the relation would be built on
+   * \return false if the configuration cannot be fingerprinted; default: false
+   */
+  virtual
+  bool Fingerprint(
+    binaryio::Fnv1aHash& hash,
+    const HashedGeometryConstPtr& hashedGeo) const;
+protected:
+  /// attach the configured payload to all edges of this relation
+  void AttachPayload(
+    Relation& rel,
+    const HashedGeometryConstPtr& hashedGeo) const;
+  /// the ring between the strings of these DOMs as recorded on the edges; -1 if not known
+  virtual
+  int EdgeRing(
+    const OMKey& omkey_A,
+    const OMKey& omkey_B) const;
 };
 
 typedef boost::shared_ptr<RelationConfig> RelationConfigPtr;
@@ -65,7 +105,10 @@ public: //ctor
   SimpleRelationConfig(
     boost::function<bool (const OMKey&, const OMKey&)> callobj);
 public:
+  using RelationConfig::BuildRelation;
   RelationPtr BuildRelation (const HashedGeometryConstPtr& hashedGeo) const;
+  /// thread-safe if the call object is a plain function
+  bool IsThreadSafe() const;
 };
 
 typedef boost::shared_ptr<SimpleRelationConfig> SimpleRelationConfigPtr;
@@ -155,6 +198,8 @@ public:
   bool selfconnect_;
   /// PARAM: Connect these DOMs mutually; A->B => B->A 
   bool mutuallyconnect_;
+  /// PARAM: number of threads the relation is built with; 0 for as many as the hardware supports or the budget allows
+  unsigned nThreads_;
 
 public: //interface
   /// Constructor 
@@ -170,6 +215,59 @@ public: //interface
    */
   RelationPtr BuildRelation (
     const HashedGeometryConstPtr& hashedGeo) const;
+  /// Build the relation with no more than maxThreads threads, or nThreads_ if that is less; 0 for no limit
+  RelationPtr BuildRelation (
+    const HashedGeometryConstPtr& hashedGeo,
+    const unsigned maxThreads) const;
+  /// thread-safe if connectFrom_ and connectTo_ are plain functions
+  bool IsThreadSafe() const;
+  /// fingerprinted by the parameters, the topology and the DOMs selected by connectFrom_ and connectTo_
+  bool Fingerprint(
+    binaryio::Fnv1aHash& hash,
+    const HashedGeometryConstPtr& hashedGeo) const;
+protected:
+  int EdgeRing(
+    const OMKey& omkey_A,
+    const OMKey& omkey_B) const;
+private:
+  /// the rings of hivetopo_, compiled once for lookups
+  hive::CompiledHiveTopologyConstPtr compiledtopo_;
+  /// a DOM on a string, which can be connected to
+  struct StringDOM {
+    /// the depth of the DOM
+    double z_;
+    /// the index of the DOM
+    CompactHash hash_;
+    /// order by depth
+    bool operator<(const StringDOM& other) const;
+  };
+  /// the DOMs and strings as seen by the construction; evaluated once before any rows are built
+  struct DOMProperties {
+    /// the DOM can be connected from
+    std::vector<bool> from_;
+    /// index of the string of the DOM into the strings-tables
+    std::vector<size_t> stringIndex_;
+    /// the depth of the DOM
+    std::vector<double> z_;
+    /// number of strings
+    size_t nStrings_;
+    /// the ring between each pair of strings [center*nStrings_+lookup]; -1 if the strings can never be related
+    std::vector<int> rings_;
+    /// per string the DOMs which can be connected to, ordered by depth
+    std::vector<std::vector<StringDOM> > stringDOMs_;
+  };
+  /** find all DOMs, which the DOMs in rows [begin, end) are related to;
+   * can be called concurrently for disjoint row ranges
+   * \param doms the properties of all DOMs
+   * \param begin first row
+   * \param end one past the last row
+   * \param rows holds for each row the related DOMs in ascending order
+   */
+  void BuildRows(
+    const DOMProperties& doms,
+    const CompactHash begin,
+    const CompactHash end,
+    std::vector<std::vector<CompactHash> >& rows) const;
 };
 
 typedef boost::shared_ptr<HiveRelationConfig> HiveRelationConfigPtr;
@@ -195,6 +293,12 @@ bool HiveRelationConfig::LimitPair::Within(const double val) const
   {return minus_ <= val && val <= plus_;};
 
   
+//====================== CLASS HiveRelationConfig ========================
+
+inline
+bool HiveRelationConfig::StringDOM::operator<(const StringDOM& other) const
+  {return z_<other.z_ || (z_==other.z_ && hash_<other.hash_);};
+
 //====================== CLASS RingLimits ========================
 #ifdef SERIARIALIZATION_ENABLED
 template<class Archive>
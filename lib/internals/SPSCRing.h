@@ -0,0 +1,143 @@
+/**
+ * \file SPSCRing.h
+ *
+ * (c) 2012 the IceCube Collaboration
+ *
+ * $Id: SPSCRing.h 99900 2013-02-26 10:10:43Z mzoll $
+ * \version $Revision: 99900 $
+ * \date $Date: 2013-02-26 11:10:43 +0100 (Tue, 26 Feb 2013) $
+ * \author Marcel Zoll <marcel.zoll@fysik.su.se>
+ *
+ * A bounded lock-free ring buffer connecting exactly one producing and one consuming thread
+ */
+
+#ifndef SPSCRING_H
+#define SPSCRING_H
+
+#include <stdint.h>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <chrono>
+
+/** A bounded first-in-first-out queue between one producer and one consumer thread, without locks:
+ * the producer only ever writes the tail, the consumer only ever writes the head.
+ * Items are copied in and out; the capacity is rounded up to a power of two.
+ */
+template<class T>
+class SPSCRing {
+private:
+  ///the slots holding the items
+  std::vector<T> slots_;
+  ///capacity-1, as the capacity is a power of two
+  const size_t mask_;
+  ///keeps head_ and tail_ on cache lines of their own, so that the two threads do not contend for them
+  char padFront_[64];
+  ///number of items popped so far; written by the consumer only
+  std::atomic<size_t> head_;
+  char padMiddle_[64];
+  ///number of items pushed so far; written by the producer only
+  std::atomic<size_t> tail_;
+  char padBack_[64];
+
+  ///round up to the next power of two
+  static size_t RoundUp(const size_t capacity);
+  ///wait a bit longer each time nothing could be done: spin, then yield, then sleep
+  static void Backoff(unsigned& attempts);
+public:
+  ///constructor
+  ///\param capacity the number of items which can be held; rounded up to a power of two
+  SPSCRing(const size_t capacity);
+  ///the number of items which can be held
+  size_t Capacity() const;
+  ///is the ring empty; only exact for the consumer
+  bool Empty() const;
+  ///push an item, if there is space; only to be called by the producer
+  bool TryPush(const T& item);
+  ///pop an item, if there is one; only to be called by the consumer
+  bool TryPop(T& item);
+  ///push an item, waiting as long as the ring is full; only to be called by the producer
+  void Push(const T& item);
+  ///pop an item, waiting as long as the ring is empty; only to be called by the consumer
+  void Pop(T& item);
+};
+
+
+//===========================================
+//============== IMPLEMENTATION =============
+//===========================================
+
+template<class T>
+size_t SPSCRing<T>::RoundUp(const size_t capacity) {
+  size_t c = 1;
+  while (c<capacity)
+    c <<= 1;
+  return c;
+};
+
+template<class T>
+void SPSCRing<T>::Backoff(unsigned& attempts) {
+  attempts++;
+  if (attempts<64)
+    return;
+  if (attempts<1024)
+    std::this_thread::yield();
+  else
+    std::this_thread::sleep_for(std::chrono::microseconds(50));
+};
+
+template<class T>
+SPSCRing<T>::SPSCRing(const size_t capacity)
+: slots_(RoundUp(capacity)),
+  mask_(slots_.size()-1),
+  head_(0),
+  tail_(0)
+{};
+
+template<class T>
+inline
+size_t SPSCRing<T>::Capacity() const
+  {return slots_.size();};
+
+template<class T>
+inline
+bool SPSCRing<T>::Empty() const
+  {return head_.load(std::memory_order_acquire)==tail_.load(std::memory_order_acquire);};
+
+template<class T>
+inline
+bool SPSCRing<T>::TryPush(const T& item) {
+  const size_t tail = tail_.load(std::memory_order_relaxed);
+  if (tail-head_.load(std::memory_order_acquire)>mask_)
+    return false;
+  slots_[tail & mask_] = item;
+  tail_.store(tail+1, std::memory_order_release);
+  return true;
+};
+
+template<class T>
+inline
+bool SPSCRing<T>::TryPop(T& item) {
+  const size_t head = head_.load(std::memory_order_relaxed);
+  if (head==tail_.load(std::memory_order_acquire))
+    return false;
+  item = slots_[head & mask_];
+  head_.store(head+1, std::memory_order_release);
+  return true;
+};
+
+template<class T>
+void SPSCRing<T>::Push(const T& item) {
+  unsigned attempts = 0;
+  while (!TryPush(item))
+    Backoff(attempts);
+};
+
+template<class T>
+void SPSCRing<T>::Pop(T& item) {
+  unsigned attempts = 0;
+  while (!TryPop(item))
+    Backoff(attempts);
+};
+
+#endif //SPSCRING_H
@@ -0,0 +1,91 @@
+/**
+ * \file TriggerWindowMerger.cxx
+ *
+ * (c) 2012 the IceCube Collaboration
+ *
+ * $Id: TriggerWindowMerger.cxx 99900 2013-02-26 10:10:43Z mzoll $
+ * \version $Revision: 99900 $
+ * \date $Date: 2013-02-26 11:10:43 +0100 (Tue, 26 Feb 2013) $
+ * \author Marcel Zoll <marcel.zoll@fysik.su.se>
+ *
+ */
+
+#include "IceHiveZ/internals/TriggerWindowMerger.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "icetray/I3Logging.h"
+
+using namespace std;
+using namespace hitspooltrigger;
+
+TriggerWindowMerger::TriggerWindowMerger(
+  const hitspooltime::DAQTicks prePadding,
+  const hitspooltime::DAQTicks postPadding)
+: windows_()
+{
+  SetPadding(prePadding, postPadding);
+};
+
+void TriggerWindowMerger::SetPadding(
+  const hitspooltime::DAQTicks prePadding,
+  const hitspooltime::DAQTicks postPadding)
+{
+  if (prePadding<0 || postPadding<0)
+    log_fatal("The padding of readout windows can not be negative");
+  prePadding_ = prePadding;
+  postPadding_ = postPadding;
+};
+
+void TriggerWindowMerger::Insert(const TriggerWindow& trigger) {
+  hitspooltime::DAQTicks start = trigger.start-prePadding_;
+  hitspooltime::DAQTicks end = trigger.end+postPadding_;
+
+  //the held windows are disjoint, so only the one starting before can reach into the new one from below
+  WindowMap::iterator first = windows_.upper_bound(start);
+  if (first!=windows_.begin()) {
+    WindowMap::iterator before = first; --before;
+    if (before->second>=start)
+      first = before;
+  }
+  //all windows starting within the new one are swallowed by it
+  WindowMap::iterator last = first;
+  while (last!=windows_.end() && last->first<=end) {
+    start = std::min(start, last->first);
+    end = std::max(end, last->second);
+    ++last;
+  }
+  windows_.erase(first, last);
+  windows_.insert(last, WindowMap::value_type(start, end));
+};
+
+void TriggerWindowMerger::Release(
+  const hitspooltime::DAQTicks finalizedUntil,
+  std::vector<TriggerWindow>& released)
+{
+  //a trigger to come starts at finalizedUntil at the earliest, so its readout window at finalizedUntil-prePadding_;
+  // held windows ending before that can not be overlapped anymore; as they are disjoint, their ends are ordered too
+  WindowMap::iterator window = windows_.begin();
+  while (window!=windows_.end() && window->second+prePadding_ < finalizedUntil) {
+    released.push_back(TriggerWindow(window->first, window->second));
+    ++window;
+  }
+  windows_.erase(windows_.begin(), window);
+};
+
+void TriggerWindowMerger::Flush(std::vector<TriggerWindow>& released) {
+  for (WindowMap::const_iterator window=windows_.begin(); window!=windows_.end(); ++window)
+    released.push_back(TriggerWindow(window->first, window->second));
+  windows_.clear();
+};
+
+hitspooltime::DAQTicks TriggerWindowMerger::FinalizedUntil(const hitspooltime::DAQTicks finalizedUntil) const {
+  hitspooltime::DAQTicks until = finalizedUntil;
+  //the ends of time are not padded
+  if (until!=std::numeric_limits<hitspooltime::DAQTicks>::min() && until!=std::numeric_limits<hitspooltime::DAQTicks>::max())
+    until -= prePadding_;
+  if (!windows_.empty())
+    until = std::min(until, windows_.begin()->first);
+  return until;
+};
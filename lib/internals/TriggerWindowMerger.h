@@ -0,0 +1,90 @@
+/**
+ * \file TriggerWindowMerger.h
+ *
+ * (c) 2012 the IceCube Collaboration
+ *
+ * $Id: TriggerWindowMerger.h 99900 2013-02-26 10:10:43Z mzoll $
+ * \version $Revision: 99900 $
+ * \date $Date: 2013-02-26 11:10:43 +0100 (Tue, 26 Feb 2013) $
+ * \author Marcel Zoll <marcel.zoll@fysik.su.se>
+ *
+ * Merging of overlapping readout windows of triggers, as they come in
+ */
+
+#ifndef TRIGGERWINDOWMERGER_H
+#define TRIGGERWINDOWMERGER_H
+
+#include <map>
+#include <vector>
+
+#include "hitspool-reader/HitSpoolTrigger.h"
+
+/** Holds the readout windows of triggers as disjoint intervals, ordered by their start:
+ * a new window is padded and merged with all windows it overlaps at the cost of a lookup in the ordered map
+ * plus one erase per window merged, independent of how many windows are held.
+ * Windows are held until no window to come can overlap them anymore, so that triggers are never released split.
+ */
+class TriggerWindowMerger {
+private:
+  ///the disjoint windows, held as start -> end; windows overlap if they share any tick
+  typedef std::map<hitspooltime::DAQTicks, hitspooltime::DAQTicks> WindowMap;
+  WindowMap windows_;
+  ///the readout window is opened this many ticks before the start of a trigger
+  hitspooltime::DAQTicks prePadding_;
+  ///the readout window is closed this many ticks after the end of a trigger
+  hitspooltime::DAQTicks postPadding_;
+public:
+  /** constructor
+   * @param prePadding open the readout window this many ticks before the start of a trigger
+   * @param postPadding close the readout window this many ticks after the end of a trigger
+   */
+  TriggerWindowMerger(
+    const hitspooltime::DAQTicks prePadding =0,
+    const hitspooltime::DAQTicks postPadding =0);
+  ///set the padding of the windows inserted from now on
+  void SetPadding(
+    const hitspooltime::DAQTicks prePadding,
+    const hitspooltime::DAQTicks postPadding);
+  ///the ticks the readout window is opened before the start of a trigger
+  hitspooltime::DAQTicks GetPrePadding() const;
+  ///the ticks the readout window is closed after the end of a trigger
+  hitspooltime::DAQTicks GetPostPadding() const;
+
+  ///pad the window of a trigger and merge it with all held windows it overlaps
+  void Insert(const hitspooltrigger::TriggerWindow& trigger);
+  /** release all windows which no trigger to come can overlap anymore, in the order of their start
+   * @param finalizedUntil triggers to come start at or after this time
+   * @param released the released windows are appended here
+   */
+  void Release(
+    const hitspooltime::DAQTicks finalizedUntil,
+    std::vector<hitspooltrigger::TriggerWindow>& released);
+  ///release all windows, in the order of their start
+  void Flush(std::vector<hitspooltrigger::TriggerWindow>& released);
+  /** until when the released windows are final: windows to come are opened no earlier than the padded time,
+   * and the held ones can still grow from their start on
+   * @param finalizedUntil triggers to come start at or after this time
+   */
+  hitspooltime::DAQTicks FinalizedUntil(const hitspooltime::DAQTicks finalizedUntil) const;
+  ///the number of windows held
+  size_t Size() const;
+};
+
+
+//===========================================
+//============== IMPLEMENTATION =============
+//===========================================
+
+inline
+hitspooltime::DAQTicks TriggerWindowMerger::GetPrePadding() const
+  {return prePadding_;};
+
+inline
+hitspooltime::DAQTicks TriggerWindowMerger::GetPostPadding() const
+  {return postPadding_;};
+
+inline
+size_t TriggerWindowMerger::Size() const
+  {return windows_.size();};
+
+#endif //TRIGGERWINDOWMERGER_H
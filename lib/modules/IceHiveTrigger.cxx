@@ -19,116 +19,541 @@
 #include "dataclasses/I3MapOMKeyMask.h"
 #include "dataclasses/physics/I3EventHeader.h"
 
+#include <algorithm>
+#include <limits>
+#include <boost/foreach.hpp>
+
 using namespace hivetrigger;
 using namespace HitSorting;
 
 //===============class IceHiveTrigger=================================
 
+const char* const IceHiveTrigger::stageNames[IceHiveTrigger::N_STAGES] =
+  {"Eat", "EatBatch", "HiveCleaning", "HiveTrigger", "AdvanceTime"};
+
 IceHiveTrigger::IceHiveTrigger(
   const HiveTrigger_ParameterSet& ht_params,
   const size_t minEventSize):
   //parameter sets for subordinated modules
   ht_params_(ht_params),
-  minEventSize_(0), 
+  minEventSize_(minEventSize),
+  autoAdvanceStep_(0),
+  latencyTarget_(0),
   //bookkeeping
   n_hits_in_(0),
   n_triggers_(0),
+  n_hits_cleaned_(0),
+  n_late_hits_(0),
+  latestTick_(std::numeric_limits<hitspooltime::DAQTicks>::min()),
+  advancedTo_(std::numeric_limits<hitspooltime::DAQTicks>::min()),
+  profiler_(std::vector<std::string>(stageNames, stageNames+N_STAGES)),
   //initialize services
   hashService_(),
+  domHashTable_(),
+  minString_(0),
+  omStride_(0),
   //initialize the splitter algorithms
-  hiveTrigger_(nullptr)
+  hiveTrigger_(nullptr),
+  hiveCleaning_(nullptr),
+  merger_(),
+  triggerAdvancedTo_(std::numeric_limits<hitspooltime::DAQTicks>::min()),
+  //run on one thread until asked otherwise
+  pipelined_(false),
+  finalizedUntil_(0),
+  pendingAdvances_(0),
+  errorReceived_(false),
+  triggerStageError_(),
+  mergeStageError_()
 {
   log_debug("Creating IceHiveTrigger instance");
     //configuration needs to be done during init  
   hashService_ = ht_params_.connectorBlock->GetHashService();
+  BuildDOMHashTable();
   hiveTrigger_ = new HiveTrigger( ht_params_ );
   log_info("This is IceHiveTrigger!");
   
   log_debug("Leaving Init()");
 }
 
+IceHiveTrigger::IceHiveTrigger(
+  const HiveTrigger_ParameterSet& ht_params,
+  const HiveCleaning_ParameterSet& hc_params,
+  const size_t minEventSize):
+  //parameter sets for subordinated modules
+  ht_params_(ht_params),
+  minEventSize_(minEventSize),
+  hc_params_(hc_params),
+  autoAdvanceStep_(0),
+  latencyTarget_(0),
+  //bookkeeping
+  n_hits_in_(0),
+  n_triggers_(0),
+  n_hits_cleaned_(0),
+  n_late_hits_(0),
+  latestTick_(std::numeric_limits<hitspooltime::DAQTicks>::min()),
+  advancedTo_(std::numeric_limits<hitspooltime::DAQTicks>::min()),
+  profiler_(std::vector<std::string>(stageNames, stageNames+N_STAGES)),
+  //initialize services
+  hashService_(),
+  domHashTable_(),
+  minString_(0),
+  omStride_(0),
+  //initialize the splitter algorithms
+  hiveTrigger_(nullptr),
+  hiveCleaning_(nullptr),
+  merger_(),
+  triggerAdvancedTo_(std::numeric_limits<hitspooltime::DAQTicks>::min()),
+  //run on one thread until asked otherwise
+  pipelined_(false),
+  finalizedUntil_(0),
+  pendingAdvances_(0),
+  errorReceived_(false),
+  triggerStageError_(),
+  mergeStageError_()
+{
+  log_debug("Creating IceHiveTrigger instance");
+  hashService_ = ht_params_.connectorBlock->GetHashService();
+  BuildDOMHashTable();
+  hiveTrigger_ = new HiveTrigger( ht_params_ );
+  hiveCleaning_ = new StreamingHiveCleaning( hc_params_ );
+  log_info("This is IceHiveTrigger, cleaning the hits first!");
+  
+  log_debug("Leaving Init()");
+}
+
 
 IceHiveTrigger::~IceHiveTrigger() {
+  StopPipeline();
   if (hiveTrigger_!=NULL)
     delete hiveTrigger_;
+  if (hiveCleaning_!=NULL)
+    delete hiveCleaning_;
   
   log_debug("Entering Finish()");
   
   log_notice_stream("Processed "<<n_hits_in_<<" hits producing "<<n_triggers_<<" triggers");
-  
-  I3RUsagePtr totalRUsage = totRUsageEatTimer_.GetTotalRUsage();
-  log_notice(
-      "%lu calls to Feed: %s, %.2fus per launch, %.2fms per trigger",
-      n_hits_in_,
-      convertI3RUsageToString(*totalRUsage).c_str(),
-      (n_hits_in_ ? totalRUsage->wallclocktime/I3Units::microsecond/n_hits_in_ : 0),
-      (n_triggers_ ? totalRUsage->wallclocktime/I3Units::millisecond/n_triggers_ : 0));
-  
-  totalRUsage = totRUsageHiveTriggerTimer_.GetTotalRUsage();
-  log_notice(
-      "%lu calls to HiveTrigger: %s, %.2fus per launch, %.2fms per trigger",
-      n_hits_in_,
-      convertI3RUsageToString(*totalRUsage).c_str(),
-      (n_hits_in_ ? totalRUsage->wallclocktime/I3Units::microsecond/n_hits_in_ : 0),
-      (n_triggers_ ? totalRUsage->wallclocktime/I3Units::millisecond/n_triggers_ : 0));
+  if (hiveCleaning_!=NULL)
+    log_notice_stream("Cleaning passed on "<<n_hits_cleaned_<<" of "<<n_hits_in_<<" hits");
+  if (n_late_hits_)
+    log_warn_stream(n_late_hits_<<" hits arrived after time had been advanced beyond them, and were dropped");
+  log_notice_stream("Latencies, every "<<profiler_.GetSampleInterval()<<"th call sampled:"<<std::endl<<profiler_.Report());
 }
 
-hitspooltime::DAQTicks IceHiveTrigger::FinalizedUntil() const
-  {return hiveTrigger_->FinalizedUntil();};
+hitspooltime::DAQTicks IceHiveTrigger::FinalizedUntil() const {
+  //the algorithms are busy on their own threads
+  if (pipelined_)
+    return finalizedUntil_;
+  return merger_.FinalizedUntil(AlgorithmsFinalizedUntil());
+};
+
+hitspooltime::DAQTicks IceHiveTrigger::AlgorithmsFinalizedUntil() const {
+  //hits still held by the cleaning are not delivered before the time HiveTrigger has been advanced to,
+  // and the hits HiveTrigger still holds in clusters or partial subevents can extend or form triggers from the earliest on
+  return std::min<hivetrigger::DAQTicks>(triggerAdvancedTo_, hiveTrigger_->EarliestPendingTick());
+};
 
 void IceHiveTrigger::Eat(const OMKey& dom, const I3DOMLaunch& launch, const hitspooltime::DAQTicks DAQTime) {
-  totRUsageEatTimer_.Start();
   n_hits_in_++;
+  if (DropLate(DAQTime))
+    return;
+  //only every so many launches are timed, so that the timing does not distort what it times
+  const bool sampled = profiler_.Sample(EAT_STAGE);
+  const uint64_t start = sampled ? ReadCycleCounter() : 0;
   //convert to an easier to transport object
-  AbsDAQHit h(hashService_->HashFromOMKey(dom), DAQTime);
+  AbsDAQHit h(HashOf(dom), DAQTime);
   
   //turn the cank
-  totRUsageHiveTriggerTimer_.Start();
-  hiveTrigger_->AddHit(h);
-  totRUsageHiveTriggerTimer_.Stop();
-  totRUsageEatTimer_.Stop();
-//   CollectTriggers();
+  if (pipelined_) {
+    const PipelineItem item = {PipelineItem::HIT, h.GetDOMIndex(), DAQTime, DAQTime};
+    PushToPipeline(item);
+    //nothing comes back but in answer to an advance
+    if (pendingAdvances_) {
+      DrainPipeline();
+      ThrowPipelineError();
+    }
+  }
+  else if (hiveCleaning_!=NULL) {
+    const bool sampledCleaning = profiler_.Sample(CLEANING_STAGE);
+    const uint64_t startCleaning = sampledCleaning ? ReadCycleCounter() : 0;
+    hiveCleaning_->AddHit(h);
+    if (sampledCleaning)
+      profiler_.Record(CLEANING_STAGE, ReadCycleCounter()-startCleaning);
+  }
+  else {
+    const bool sampledTrigger = profiler_.Sample(TRIGGER_STAGE);
+    const uint64_t startTrigger = sampledTrigger ? ReadCycleCounter() : 0;
+    hiveTrigger_->AddHit(h);
+    if (sampledTrigger)
+      profiler_.Record(TRIGGER_STAGE, ReadCycleCounter()-startTrigger);
+  }
+  if (sampled)
+    profiler_.Record(EAT_STAGE, ReadCycleCounter()-start);
+  WatchHit(DAQTime);
+};
+
+void IceHiveTrigger::EatBatch(const LaunchBlock& launches) {
+  const bool sampled = profiler_.Sample(EATBATCH_STAGE);
+  const uint64_t start = sampled ? ReadCycleCounter() : 0;
+  n_hits_in_ += launches.size();
+  
+  //turn the cank in one go; time is advanced by itself between the launches exactly where it would be eating them one by one
+  if (pipelined_) {
+    BOOST_FOREACH(const LaunchTime& launch, launches) {
+      if (DropLate(launch.second))
+        continue;
+      const PipelineItem item = {PipelineItem::HIT, HashOf(launch.first), launch.second, launch.second};
+      PushToPipeline(item);
+      WatchHit(launch.second);
+    }
+    if (pendingAdvances_) {
+      DrainPipeline();
+      ThrowPipelineError();
+    }
+  }
+  else if (hiveCleaning_!=NULL) {
+    BOOST_FOREACH(const LaunchTime& launch, launches) {
+      if (DropLate(launch.second))
+        continue;
+      hiveCleaning_->AddHit(AbsDAQHit(HashOf(launch.first), launch.second));
+      WatchHit(launch.second);
+    }
+  }
+  else {
+    BOOST_FOREACH(const LaunchTime& launch, launches) {
+      if (DropLate(launch.second))
+        continue;
+      hiveTrigger_->AddHit(AbsDAQHit(HashOf(launch.first), launch.second));
+      WatchHit(launch.second);
+    }
+  }
+  if (sampled)
+    profiler_.Record(EATBATCH_STAGE, ReadCycleCounter()-start);
+};
+
+void IceHiveTrigger::SetAutoAdvance(
+  const hitspooltime::DAQTicks step,
+  const hitspooltime::DAQTicks latencyTarget)
+{
+  if (step<0 || latencyTarget<0)
+    log_fatal("Step and latency target can not be negative");
+  autoAdvanceStep_ = step;
+  latencyTarget_ = latencyTarget;
+  if (autoAdvanceStep_>0)
+    log_info_stream("Advancing every "<<autoAdvanceStep_<<" ticks, trailing the latest hit by "<<latencyTarget_<<" ticks");
+};
+
+void IceHiveTrigger::SetReadoutPadding(
+  const hitspooltime::DAQTicks prePadding,
+  const hitspooltime::DAQTicks postPadding)
+{
+  if (pipelined_)
+    log_fatal("Set the readout padding before starting the pipeline");
+  merger_.SetPadding(prePadding, postPadding);
+  log_info_stream("Opening readout windows "<<prePadding<<" ticks before and closing them "<<postPadding<<" ticks after each trigger");
+};
+
+void IceHiveTrigger::BuildDOMHashTable() {
+  const size_t hash_size = hashService_->HashSize();
+  if (hash_size==0)
+    return;
+  int maxString = std::numeric_limits<int>::min();
+  minString_ = std::numeric_limits<int>::max();
+  omStride_ = 0;
+  for (CompactHash h=0; h<hash_size; h++) {
+    const OMKey omkey = hashService_->OMKeyFromHash(h);
+    minString_ = std::min(minString_, omkey.GetString());
+    maxString = std::max(maxString, omkey.GetString());
+    omStride_ = std::max(omStride_, omkey.GetOM()+1);
+  }
+  const size_t table_size = size_t(int64_t(maxString)-minString_+1)*omStride_;
+  if (table_size>maxDOMHashTableSize) {
+    log_warn_stream("DOMs are spread too wide to be looked up in a table ("<<table_size<<" entries); using the hasher");
+    omStride_ = 0;
+    return;
+  }
+  domHashTable_.assign(table_size, -1);
+  for (CompactHash h=0; h<hash_size; h++) {
+    const OMKey omkey = hashService_->OMKeyFromHash(h);
+    domHashTable_[size_t(omkey.GetString()-minString_)*omStride_+omkey.GetOM()] = h;
+  }
+  log_debug_stream("Looking up "<<hash_size<<" DOMs in a table of "<<domHashTable_.size());
 };
 
 void IceHiveTrigger::AdvanceTime(const hitspooltime::DAQTicks DAQTime) {
-  hiveTrigger_->AdvanceTime((hivetrigger::DAQTicks)DAQTime);
-  CollectTriggers();
+  advancedTo_ = std::max(advancedTo_, DAQTime);
+  const bool sampled = profiler_.Sample(ADVANCE_STAGE);
+  const uint64_t start = sampled ? ReadCycleCounter() : 0;
+  if (!pipelined_) {
+    AdvanceAlgorithms(DAQTime);
+    CollectTriggers();
+  }
+  else {
+    //the advance travels through all stages behind the hits eaten before it; it is taken in once it comes back,
+    // which is waited for only at the end of time
+    const PipelineItem advance = {PipelineItem::ADVANCE, 0, DAQTime, DAQTime};
+    PushToPipeline(advance);
+    pendingAdvances_++;
+    if (DAQTime==std::numeric_limits<hitspooltime::DAQTicks>::max())
+      SyncPipeline();
+    else {
+      DrainPipeline();
+      ThrowPipelineError();
+    }
+  }
+  if (sampled)
+    profiler_.Record(ADVANCE_STAGE, ReadCycleCounter()-start);
+};
+
+void IceHiveTrigger::AdvanceAlgorithms(const hitspooltime::DAQTicks DAQTime) {
+  hivetrigger::DAQTicks triggerTime = DAQTime;
+  if (hiveCleaning_!=NULL) {
+    hiveCleaning_->AdvanceTime((hivetrigger::DAQTicks)DAQTime);
+    DeliverCleanedHits();
+    //the hits still held by the cleaning are delivered later, but none of them before the time it has decided until
+    triggerTime = std::min<hivetrigger::DAQTicks>(DAQTime, hiveCleaning_->DecidedUntil());
+  }
+  hiveTrigger_->AdvanceTime(triggerTime);
+  //subevents which can not grow anymore are pushed out, also if no clusters are left to do so
+  hiveTrigger_->PushCompleteEvents(triggerTime);
+  triggerAdvancedTo_ = std::max<hitspooltime::DAQTicks>(triggerAdvancedTo_, triggerTime);
+};
+
+void IceHiveTrigger::DeliverCleanedHits() {
+  const AbsDAQHitSet cleaned = hiveCleaning_->PullCleaned();
+  n_hits_cleaned_ += cleaned.size();
+  
+  BOOST_FOREACH(const AbsDAQHit& h, cleaned) {
+    //the profiler is not to be touched by the threads of the pipeline
+    const bool sampled = !pipelined_ && profiler_.Sample(TRIGGER_STAGE);
+    const uint64_t start = sampled ? ReadCycleCounter() : 0;
+    hiveTrigger_->AddHit(h);
+    if (sampled)
+      profiler_.Record(TRIGGER_STAGE, ReadCycleCounter()-start);
+  }
 };
 
 void IceHiveTrigger::CollectTriggers() {
   log_debug("CollectTriggers()");
   using namespace hitspooltrigger;
   
-  AbsDAQHitSetSequence ht_subEvents = hiveTrigger_->PullSubEvents();
-  
-  AbsDAQHitSetSequence::const_iterator subEvent = ht_subEvents.begin();
-  while (subEvent!= ht_subEvents.end()) {
-    if (subEvent->size()>=minEventSize_)
-      waitingTriggers_.insert(TriggerWindow(subEvent->begin()->GetDAQTicks(), subEvent->rbegin()->GetDAQTicks()));
-    subEvent = ht_subEvents.erase(subEvent);
+  const AbsDAQHitSetSequence ht_subEvents = hiveTrigger_->PullSubEvents();
+  BOOST_FOREACH(const AbsDAQHitSet& subEvent, ht_subEvents) {
+    if (subEvent.size()>=minEventSize_)
+      merger_.Insert(TriggerWindow(subEvent.begin()->GetDAQTicks(), subEvent.rbegin()->GetDAQTicks()));
   }
   
-  //merge all overlapping triggers
-  if (waitingTriggers_.empty()) {
+  //only windows nothing to come can overlap are pushed out, so that no trigger is ever split
+  std::vector<TriggerWindow> finished;
+  merger_.Release(AlgorithmsFinalizedUntil(), finished);
+  BOOST_FOREACH(const TriggerWindow& tw, finished)
+    triggerQueue_.push(tw);
+  n_triggers_ += finished.size();
+};
+
+//============== the pipeline ==============
+
+void IceHiveTrigger::StartPipeline(const size_t ringCapacity) {
+  if (pipelined_) {
+    log_warn("The pipeline is already running");
     return;
   }
+  log_info_stream("Running the stages on their own threads, connected by rings of "<<ringCapacity);
+  finalizedUntil_ = merger_.FinalizedUntil(AlgorithmsFinalizedUntil());
+  pendingAdvances_ = 0;
+  errorReceived_ = false;
+  hitRing_.reset(new SPSCRing<PipelineItem>(ringCapacity));
+  windowRing_.reset(new SPSCRing<PipelineItem>(ringCapacity));
+  triggerRing_.reset(new SPSCRing<PipelineItem>(ringCapacity));
+  pipelined_ = true;
+  triggerThread_ = std::thread(&IceHiveTrigger::RunTriggerStage, this);
+  mergeThread_ = std::thread(&IceHiveTrigger::RunMergeStage, this);
+};
 
-  TriggerSet::const_iterator work = waitingTriggers_.begin();
-  TriggerSet::const_iterator next = waitingTriggers_.begin(); ++next;
-  while (next != waitingTriggers_.end()) {
-    if (work->overlaps(*next)) {
-      const TriggerWindow tw(work->start, next->end);
-      next=waitingTriggers_.erase(next);
-      work=waitingTriggers_.erase(work);
-      work=waitingTriggers_.insert(work, tw);
+void IceHiveTrigger::StopPipeline() {
+  if (!pipelined_)
+    return;
+  //the stop travels through all stages, each of them quits after passing it on;
+  // what comes back before it is still taken in, so that no stage waits on a full ring
+  const PipelineItem stop = {PipelineItem::STOP, 0, 0, 0};
+  PushToPipeline(stop);
+  PipelineItem item;
+  for (triggerRing_->Pop(item); item.kind!=PipelineItem::STOP; triggerRing_->Pop(item))
+    ReceiveFromPipeline(item);
+  triggerThread_.join();
+  mergeThread_.join();
+  pipelined_ = false;
+  log_debug("Stopped the pipeline");
+};
+
+void IceHiveTrigger::SyncPipeline() {
+  if (!pipelined_)
+    return;
+  PipelineItem item;
+  while (pendingAdvances_) {
+    triggerRing_->Pop(item);
+    ReceiveFromPipeline(item);
+  }
+  ThrowPipelineError();
+};
+
+void IceHiveTrigger::PushToPipeline(const PipelineItem& item) {
+  //the stages may wait on the feeding thread to take in what they have sent back
+  while (!hitRing_->TryPush(item)) {
+    if (!DrainPipeline())
+      std::this_thread::yield();
+  }
+};
+
+bool IceHiveTrigger::DrainPipeline() {
+  bool received = false;
+  PipelineItem item;
+  while (triggerRing_->TryPop(item)) {
+    ReceiveFromPipeline(item);
+    received = true;
+  }
+  return received;
+};
+
+void IceHiveTrigger::ReceiveFromPipeline(const PipelineItem& item) {
+  switch (item.kind) {
+    case PipelineItem::WINDOW:
+      triggerQueue_.push(hitspooltrigger::TriggerWindow(item.start, item.end));
+      n_triggers_++;
+      break;
+    case PipelineItem::MARKER:
+      finalizedUntil_ = item.start;
+      pendingAdvances_--;
+      break;
+    default: //ERROR
+      errorReceived_ = true;
+      pendingAdvances_--;
+  }
+};
+
+void IceHiveTrigger::ThrowPipelineError() {
+  if (!errorReceived_)
+    return;
+  errorReceived_ = false;
+  std::rethrow_exception(triggerStageError_ ? triggerStageError_ : mergeStageError_);
+};
+
+void IceHiveTrigger::ForwardSubEvents() {
+  const AbsDAQHitSetSequence subEvents = hiveTrigger_->PullSubEvents();
+  BOOST_FOREACH(const AbsDAQHitSet& subEvent, subEvents) {
+    if (subEvent.size()>=minEventSize_) {
+      const PipelineItem window = {PipelineItem::WINDOW, 0, subEvent.begin()->GetDAQTicks(), subEvent.rbegin()->GetDAQTicks()};
+      windowRing_->Push(window);
     }
-    else {
-      triggerQueue_.push(*work);
-      work = waitingTriggers_.erase(work);
-      ++next;
+  }
+};
+
+void IceHiveTrigger::RunTriggerStage() {
+  size_t n_unpulled = 0;
+  bool failed = false;
+  PipelineItem item;
+  for (;;) {
+    hitRing_->Pop(item);
+    if (item.kind==PipelineItem::STOP) {
+      windowRing_->Push(item);
+      return;
+    }
+    if (!failed) {
+      try {
+        switch (item.kind) {
+          case PipelineItem::HIT: {
+            const AbsDAQHit h(item.hash, item.start);
+            if (hiveCleaning_!=NULL)
+              hiveCleaning_->AddHit(h);
+            else
+              hiveTrigger_->AddHit(h);
+            //the finished subevents are passed on early, so that the merging stage is kept busy
+            if (++n_unpulled==pipelinePullInterval) {
+              ForwardSubEvents();
+              n_unpulled = 0;
+            }
+            break;
+          }
+          default: { //ADVANCE
+            AdvanceAlgorithms(item.start);
+            ForwardSubEvents();
+            n_unpulled = 0;
+            const PipelineItem marker = {PipelineItem::MARKER, 0, AlgorithmsFinalizedUntil(), 0};
+            windowRing_->Push(marker);
+          }
+        }
+        continue;
+      }
+      catch (...) {
+        //the algorithms are left in no state to go on; the feeding thread rethrows this at the next advance
+        triggerStageError_ = std::current_exception();
+        failed = true;
+      }
+    }
+    //once failed, the hits are dropped and each advance is answered by an error instead of a marker
+    if (item.kind==PipelineItem::ADVANCE) {
+      const PipelineItem error = {PipelineItem::ERROR, 0, item.start, 0};
+      windowRing_->Push(error);
+    }
+  }
+};
+
+void IceHiveTrigger::RunMergeStage() {
+  std::vector<hitspooltrigger::TriggerWindow> finished;
+  bool failed = false;
+  PipelineItem item;
+  for (;;) {
+    windowRing_->Pop(item);
+    if (item.kind==PipelineItem::STOP) {
+      triggerRing_->Push(item);
+      return;
+    }
+    if (item.kind==PipelineItem::ERROR) {
+      //the trigger stage has failed; the error takes the place of the marker
+      triggerRing_->Push(item);
+      continue;
+    }
+    if (!failed) {
+      try {
+        switch (item.kind) {
+          case PipelineItem::WINDOW:
+            merger_.Insert(hitspooltrigger::TriggerWindow(item.start, item.end));
+            break;
+          default: { //MARKER
+            //release exactly at the advances of time, as it is done when running on one thread
+            finished.clear();
+            merger_.Release(item.start, finished);
+            BOOST_FOREACH(const hitspooltrigger::TriggerWindow& tw, finished) {
+              const PipelineItem window = {PipelineItem::WINDOW, 0, tw.start, tw.end};
+              triggerRing_->Push(window);
+            }
+            item.start = merger_.FinalizedUntil(item.start);
+            triggerRing_->Push(item);
+          }
+        }
+        continue;
+      }
+      catch (...) {
+        mergeStageError_ = std::current_exception();
+        failed = true;
+      }
+    }
+    //once failed, the windows are dropped and each marker is answered by an error
+    if (item.kind==PipelineItem::MARKER) {
+      const PipelineItem error = {PipelineItem::ERROR, 0, item.start, 0};
+      triggerRing_->Push(error);
     }
   }
 };
 
-void IceHiveTrigger::ReportState() const {};
+void IceHiveTrigger::ReportState() const {
+  log_notice_stream("Processed "<<n_hits_in_<<" hits producing "<<n_triggers_<<" triggers; final until "<<FinalizedUntil());
+  if (!pipelined_)
+    log_notice_stream(merger_.Size()<<" readout windows are waiting to be final");
+  log_notice_stream("Advanced to "<<advancedTo_<<", watermark at "<<Watermark()<<"; "<<n_late_hits_<<" hits arrived late and were dropped");
+  if (hiveCleaning_!=NULL && !pipelined_)
+    log_notice_stream("Cleaning passed on "<<n_hits_cleaned_<<" hits and holds "<<hiveCleaning_->NumberOfHeldHits());
+  else if (hiveCleaning_!=NULL)
+    log_notice_stream("Cleaning passed on "<<n_hits_cleaned_<<" hits");
+  log_notice_stream("Latencies, every "<<profiler_.GetSampleInterval()<<"th call sampled:"<<std::endl<<profiler_.Report());
+};
 
@@ -14,11 +14,21 @@
 #ifndef ICEHIVETRIGGER_H
 #define ICEHIVETRIGGER_H
 
+#include <vector>
+#include <utility>
+#include <limits>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <exception>
 #include <boost/make_shared.hpp>
 
 #include "IceHiveZ/algorithms/HiveTrigger.h"
+#include "IceHiveZ/algorithms/HiveCleaning.h"
 
-#include "ToolZ/I3RUsageTimer.h"
+#include "IceHiveZ/internals/Profiler.h"
+#include "IceHiveZ/internals/SPSCRing.h"
+#include "IceHiveZ/internals/TriggerWindowMerger.h"
 
 #include "hitspool-reader/HitSpoolTrigger.h"
 
@@ -34,25 +44,97 @@ protected://parameters
   hivetrigger::HiveTrigger_ParameterSet ht_params_;
   /// PARAM: Minimal size on an subEvent to be considered as a Trigger
   size_t minEventSize_;
+  ///PARAM: which are delivered to the cleaning in front of HiveTrigger, if any
+  HiveCleaning_ParameterSet hc_params_;
+  /// PARAM: advance by itself each time the watermark has moved on by this many ticks; 0 to advance only when asked to
+  hitspooltime::DAQTicks autoAdvanceStep_;
+  /// PARAM: the watermark trails the latest hit by this many ticks; hits arriving later than that are out of order
+  hitspooltime::DAQTicks latencyTarget_;
                   
 private: //bookkeeping  
   //hits processed
   uint64_t n_hits_in_;
   //triggers produced
   uint64_t n_triggers_;
-  //stopwatch
-  I3RUsageTimer totRUsageEatTimer_;
-  //stopwatch for splitter
-  I3RUsageTimer totRUsageHiveTriggerTimer_;
+  //hits passed on by the cleaning; counted by the trigger stage, if pipelined
+  std::atomic<uint64_t> n_hits_cleaned_;
+  //hits which arrived before the time already advanced to, and were dropped
+  uint64_t n_late_hits_;
+  //time of the latest hit
+  hitspooltime::DAQTicks latestTick_;
+  //the time last advanced to
+  hitspooltime::DAQTicks advancedTo_;
+  ///the stages timed by the profiler
+  enum Stage {EAT_STAGE, EATBATCH_STAGE, CLEANING_STAGE, TRIGGER_STAGE, ADVANCE_STAGE, N_STAGES};
+  ///the names of the stages, in that order
+  static const char* const stageNames[N_STAGES];
+  ///times every so many calls of each stage
+  SamplingProfiler profiler_;
 
 private: //properties and methods related to configuration
   /// a global hasher to translate OMKeys to Hashes and vice versa
   CompactOMKeyHashServiceConstPtr hashService_;
+  /// the hash of each DOM, indexed by (string-minString_)*omStride_+om; -1 if the DOM is not hashed
+  std::vector<int32_t> domHashTable_;
+  /// the lowest string number in domHashTable_
+  int minString_;
+  /// number of entries per string in domHashTable_
+  unsigned omStride_;
+  /// the table of DOM hashes is not held beyond this many entries
+  static const size_t maxDOMHashTableSize = size_t(1)<<22;
   //facilitate the splitting
   ///most private HiveSplitter instance
   HiveTrigger* hiveTrigger_;
-  /// holds all waiting triggerWindows; are merged and eventually pushed out
-  hitspooltrigger::TriggerSet waitingTriggers_;
+  ///most private streaming cleaning in front of HiveTrigger; NULL if hits are not cleaned
+  StreamingHiveCleaning* hiveCleaning_;
+  /// holds the padded readout windows of the waiting triggers merged; they are pushed out once nothing can overlap them anymore
+  TriggerWindowMerger merger_;
+  /// the time HiveTrigger was last advanced to
+  hitspooltime::DAQTicks triggerAdvancedTo_;
+
+private: //the pipeline
+  ///what is passed between the stages of the pipeline
+  struct PipelineItem {
+    ///an ERROR takes the place of the MARKER of an advance once a stage has failed
+    enum Kind {HIT, ADVANCE, WINDOW, MARKER, ERROR, STOP};
+    Kind kind;
+    ///the hash of a HIT
+    CompactHash hash;
+    ///the time of a HIT, the time to ADVANCE to, the start of a WINDOW or the time a MARKER is final until
+    hitspooltime::DAQTicks start;
+    ///the end of a WINDOW
+    hitspooltime::DAQTicks end;
+  };
+  ///the stages run on their own threads
+  bool pipelined_;
+  ///carries hashed hits and advances of time from the feeding thread to the trigger stage
+  std::unique_ptr<SPSCRing<PipelineItem> > hitRing_;
+  ///carries trigger windows and markers from the trigger stage to the merging stage
+  std::unique_ptr<SPSCRing<PipelineItem> > windowRing_;
+  ///carries merged trigger windows and markers from the merging stage back to the feeding thread
+  std::unique_ptr<SPSCRing<PipelineItem> > triggerRing_;
+  ///runs HiveCleaning and HiveTrigger
+  std::thread triggerThread_;
+  ///merges the trigger windows
+  std::thread mergeThread_;
+  ///until when the triggers are final, as of the last advance come back through the pipeline
+  hitspooltime::DAQTicks finalizedUntil_;
+  ///the advances sent into the pipeline, which have not come back yet
+  size_t pendingAdvances_;
+  ///an advance has come back as an ERROR, which is not yet rethrown
+  bool errorReceived_;
+  ///what the trigger stage has thrown; set before it answers the first advance with an ERROR
+  std::exception_ptr triggerStageError_;
+  ///what the merging stage has thrown; set before it answers the first advance with an ERROR
+  std::exception_ptr mergeStageError_;
+  ///the trigger stage passes on the finished subevents every this many hits
+  static const size_t pipelinePullInterval = 1024;
+  
+public: //types
+  ///a launch reduced to what the trigger needs: the DOM and the time
+  typedef std::pair<OMKey, hitspooltime::DAQTicks> LaunchTime;
+  ///a block of launches, in the order they would be eaten one by one
+  typedef std::vector<LaunchTime> LaunchBlock;
   
 public: //methods
   //================
@@ -62,22 +144,147 @@ public: //methods
   IceHiveTrigger(
     const hivetrigger::HiveTrigger_ParameterSet& ht_params,
     const size_t minEventSize =1);
+  /// Constructor: clean the hits before they are delivered to HiveTrigger;
+  /// the hits are held back by the late time residual of the cleaning
+  IceHiveTrigger(
+    const hivetrigger::HiveTrigger_ParameterSet& ht_params,
+    const HiveCleaning_ParameterSet& hc_params,
+    const size_t minEventSize =1);
   /// Destructor
   virtual ~IceHiveTrigger();
-  ///tell until which time the set of triggers is final
+  ///tell until which time the set of triggers is final; if pipelined, as of the advances come back so far
   hitspooltime::DAQTicks FinalizedUntil() const;
+  ///consumate a block of launches in one go, as if eaten one by one; the block is timed as a whole
+  void EatBatch(const LaunchBlock& launches);
+  ///time every this many calls of each stage; rounded up to a power of two; 0 to disable
+  void SetSampleInterval(const uint32_t sampleInterval);
+  ///the latencies of the stages sampled so far
+  const SamplingProfiler& GetProfiler() const;
+  /// report internal state of IceHive, including the latencies of the stages so far
+  void ReportState() const;
+  /** run decoding and hashing, HiveTrigger and the merging of trigger windows on their own threads from now on,
+   * connected by lock-free rings; the triggers are identical to running them one after the other.
+   * Only the feeding thread is timed by the profiler then.
+   * Advances of time do not wait for the stages: the triggers, and until when they are final, are taken in
+   * as the advances come back, whenever hits are eaten or time is advanced; all of them at the end of time.
+   * Anything thrown by the stages is rethrown on the feeding thread as the advances come back, from then on.
+   * @param ringCapacity the number of items each ring can hold
+   */
+  void StartPipeline(const size_t ringCapacity =size_t(1)<<16);
+  ///are the stages run on their own threads
+  bool IsPipelined() const;
+  ///wait for all advances of time to come back through the pipeline; then the triggers are as if run on one thread
+  void SyncPipeline();
+  /** advance by itself, following a low watermark which trails the latest hit by the latency target:
+   * each time it has moved on by the step, time is advanced to it and the triggers are collected;
+   * triggers are out at most latency target plus step after their last hit
+   * @param step advance each time the watermark has moved on by this many ticks; 0 to advance only when asked to
+   * @param latencyTarget the watermark trails the latest hit by this many ticks;
+   *   hits arriving later than that can come after time has been advanced beyond them, and are dropped as late
+   */
+  void SetAutoAdvance(
+    const hitspooltime::DAQTicks step,
+    const hitspooltime::DAQTicks latencyTarget);
+  ///the low watermark: the time of the latest hit less the latency target
+  hitspooltime::DAQTicks Watermark() const;
+  /** open the readout window of each trigger earlier and close it later;
+   * triggers whose padded windows overlap are merged into one
+   * @param prePadding open the readout window this many ticks before the first hit of a trigger
+   * @param postPadding close the readout window this many ticks after the last hit of a trigger
+   */
+  void SetReadoutPadding(
+    const hitspooltime::DAQTicks prePadding,
+    const hitspooltime::DAQTicks postPadding);
 private:
+  ///fill the table to look up the hashes of DOMs
+  void BuildDOMHashTable();
+  ///the hash of this DOM, looked up in the table
+  CompactHash HashOf(const OMKey& dom) const;
   ///consumate the hit and do something with it
   void Eat(const OMKey& dom, const I3DOMLaunch& launch, const hitspooltime::DAQTicks DAQTime);
   ///collect all the triggers the deep deep hidden places
   void CollectTriggers();
+  ///advance the cleaning, if any, and HiveTrigger to this time
+  void AdvanceAlgorithms(const hitspooltime::DAQTicks DAQTime);
+  ///until when the algorithms have finalized their output
+  hitspooltime::DAQTicks AlgorithmsFinalizedUntil() const;
+  ///pass the windows of the finished subevents of HiveTrigger on to the merging stage
+  void ForwardSubEvents();
+  ///the trigger stage of the pipeline, run by triggerThread_
+  void RunTriggerStage();
+  ///the merging stage of the pipeline, run by mergeThread_
+  void RunMergeStage();
+  ///stop the threads of the pipeline
+  void StopPipeline();
+  ///push into the pipeline, taking in what comes back while it is full
+  void PushToPipeline(const PipelineItem& item);
+  ///take in everything that has come back from the pipeline, without waiting; tell if there was anything
+  bool DrainPipeline();
+  ///take in an item come back from the pipeline
+  void ReceiveFromPipeline(const PipelineItem& item);
+  ///rethrow what a stage has thrown, if an advance has come back as an ERROR
+  void ThrowPipelineError();
+  ///deliver the hits the cleaning has kept to HiveTrigger
+  void DeliverCleanedHits();
   /// advance this to this time
   void AdvanceTime(const hitspooltime::DAQTicks DAQTime);
-  /// report internal state of IceHive
-  void ReportState() const;
+  ///note the time of an arriving hit, and advance by itself if the watermark has moved on far enough
+  void WatchHit(const hitspooltime::DAQTicks DAQTime);
+  ///count a hit as late and tell to drop it, if time has been advanced beyond it already
+  bool DropLate(const hitspooltime::DAQTicks DAQTime);
 };
 
 typedef boost::shared_ptr<IceHiveTrigger> IceHiveTriggerPtr;
 typedef boost::shared_ptr<const IceHiveTrigger> IceHiveTriggerConstPtr;
 
+
+//===========================================
+//============== IMPLEMENTATION =============
+//===========================================
+
+inline
+void IceHiveTrigger::SetSampleInterval(const uint32_t sampleInterval)
+  {profiler_.SetSampleInterval(sampleInterval);};
+
+inline
+const SamplingProfiler& IceHiveTrigger::GetProfiler() const
+  {return profiler_;};
+
+inline
+bool IceHiveTrigger::IsPipelined() const
+  {return pipelined_;};
+
+inline
+hitspooltime::DAQTicks IceHiveTrigger::Watermark() const
+  {return (latestTick_==std::numeric_limits<hitspooltime::DAQTicks>::min()) ? latestTick_ : latestTick_-latencyTarget_;};
+
+inline
+void IceHiveTrigger::WatchHit(const hitspooltime::DAQTicks DAQTime) {
+  if (DAQTime>latestTick_)
+    latestTick_ = DAQTime;
+  //the difference is taken unsigned, as the times can be as far apart as the ends of time
+  const hitspooltime::DAQTicks watermark = Watermark();
+  if (autoAdvanceStep_>0 && watermark>advancedTo_ && uint64_t(watermark)-uint64_t(advancedTo_)>=uint64_t(autoAdvanceStep_))
+    AdvanceTime(watermark);
+};
+
+inline
+bool IceHiveTrigger::DropLate(const hitspooltime::DAQTicks DAQTime) {
+  //the triggers up to there are final, and the cleaning can not take the hit anymore
+  if (DAQTime>=advancedTo_)
+    return false;
+  n_late_hits_++;
+  return true;
+};
+
+inline
+CompactHash IceHiveTrigger::HashOf(const OMKey& dom) const {
+  const unsigned string_index = unsigned(dom.GetString()-minString_);
+  const size_t index = size_t(string_index)*omStride_+dom.GetOM();
+  if (dom.GetOM()<omStride_ && index<domHashTable_.size() && domHashTable_[index]>=0)
+    return domHashTable_[index];
+  //anything not in the table is up to the hasher
+  return hashService_->HashFromOMKey(dom);
+};
+
 #endif
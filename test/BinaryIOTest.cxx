@@ -0,0 +1,56 @@
+/**
+ * \file BinaryIOTest.cxx
+ *
+ * (c) 2013 the IceCube Collaboration
+ *
+ * $Id: BinaryIOTest.cxx 148312 2016-07-11 17:41:28Z mzoll $
+ * \version $Revision: 148312 $
+ * \date $Date: 2016-07-11 19:41:28 +0200 (mån, 11 jul 2016) $
+ * \author mzoll <marcel.zoll@fysik.su.se>
+ *
+ * Unit test to test the reading and writing of flat binary data
+ */
+
+#include <I3Test.h>
+
+#include "IceHiveZ/internals/BinaryIO.h"
+
+#include <sstream>
+
+using namespace binaryio;
+
+TEST_GROUP(BinaryIO);
+
+TEST(Write_Read) {
+  std::stringstream ss;
+  BinaryWriter writer(ss);
+  writer.Write<uint32_t>(42);
+  writer.WriteString("hive");
+  writer.WriteVector(std::vector<uint64_t>(3, 7));
+  ENSURE(writer.Good());
+
+  BinaryReader reader(ss);
+  ENSURE_EQUAL(reader.Read<uint32_t>(), 42u);
+  ENSURE_EQUAL(reader.ReadString(), std::string("hive"));
+  std::vector<uint64_t> v;
+  reader.ReadVector(v);
+  ENSURE_EQUAL(v.size(), 3u);
+  ENSURE_EQUAL(v[2], 7u);
+  ENSURE(reader.Good());
+  ENSURE_EQUAL(reader.Checksum(), writer.Checksum(), "Everything passing through is checksummed alike");
+};
+
+TEST(Oversized_Length) {
+  //a corrupt length field claiming 2^31 values of 8 bytes, followed by only a few bytes
+  std::stringstream ss;
+  BinaryWriter writer(ss);
+  writer.Write<uint64_t>(uint64_t(1)<<31);
+  writer.Write<uint64_t>(1);
+  writer.Write<uint64_t>(2);
+
+  BinaryReader reader(ss);
+  std::vector<uint64_t> v;
+  reader.ReadVector(v);
+  ENSURE(!reader.Good(), "A length beyond the end of the stream is corrupt");
+  ENSURE(v.empty(), "Nothing is allocated for it");
+};
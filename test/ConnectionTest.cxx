@@ -99,6 +99,67 @@ TEST(DeltaTimeConnection) {
 
 #include "dataclasses/I3Constants.h"
 
+TEST(Symmetry) {
+  ENSURE(BoolConnection(hashedGeo, true).IsSymmetric());
+  
+  DeltaTimeConnection dtc(hashedGeo, 10., 100.);
+  ENSURE(! dtc.IsSymmetric());
+  ENSURE(dtc.IsSymmetricAtEqualTime());
+  dtc.tresidual_early_ = 100.;
+  ENSURE(dtc.IsSymmetric());
+  
+  DynamicConnection dc(hashedGeo);
+  ENSURE(dc.IsSymmetric());
+  
+  //at equal times DTConnections can not tell the direction
+  dtc.tresidual_early_ = 0.;
+  dtc.tresidual_late_ = 0.;
+  ENSURE_EQUAL(dtc.AreConnected(AbsHit(0, 0.), AbsHit(1, 0.)), dtc.AreConnected(AbsHit(1, 0.), AbsHit(0, 0.)));
+};
+
+
+TEST(CompactHits) {
+  DeltaTimeConnection dtc(hashedGeo, 10., 100.);
+  BoolConnection bc(hashedGeo, true);
+  const Connection& base = bc;
+  
+  const double times[] = {-200., -10., -5., 0., 0.5, 99., 100., 101.};
+  for (size_t i=0; i<sizeof(times)/sizeof(double); i++) {
+    const AbsHit h1(0, 0.), h2(1, times[i]);
+    const AbsDAQHit d1(0, 0), d2(1, (int64_t)(times[i]*10));
+    ENSURE_EQUAL(dtc.AreConnected(CompactHit(h1), CompactHit(h2)), dtc.AreConnected(h1, h2));
+    ENSURE_EQUAL(dtc.AreConnected(CompactDAQHit(d1), CompactDAQHit(d2)), dtc.AreConnected(d1, d2));
+    ENSURE_EQUAL(dtc.AreConnectedByDistance(1., CompactHit(h1), CompactHit(h2)), dtc.AreConnectedByDistance(1., h1, h2));
+    ENSURE(base.AreConnected(CompactHit(h1), CompactHit(h2)));
+  }
+  
+  //the compact hits are packed
+  ENSURE(sizeof(CompactHit)<=16);
+  ENSURE(sizeof(CompactDAQHit)<=16);
+};
+
+
+///a connection from outside, implementing only what it always had to
+class SameDOMConnection : public Connection {
+public:
+  SameDOMConnection(const HashedGeometryConstPtr& hashedGeo) : Connection(hashedGeo) {};
+  bool AreConnected (const AbsHit& h1, const AbsHit& h2) const
+    {return h1.GetDOMIndex()==h2.GetDOMIndex();};
+  bool AreConnected (const AbsDAQHit& h1, const AbsDAQHit& h2) const
+    {return h1.GetDOMIndex()==h2.GetDOMIndex();};
+  bool CorrectlyConfigured() const {return true;};
+  SpeedRating GetSpeedRating() const {return FAST;};
+};
+
+TEST(ByDistance_Default) {
+  const SameDOMConnection sdc(hashedGeo);
+  //the distance is not known to it, so it is left to AreConnected
+  ENSURE(sdc.AreConnectedByDistance(0., AbsHit(0, 0.), AbsHit(0, 10.)));
+  ENSURE(! sdc.AreConnectedByDistance(0., AbsHit(0, 0.), AbsHit(1, 0.)));
+  ENSURE(sdc.AreConnectedByDistance(0., AbsDAQHit(2, 0), AbsDAQHit(2, 100)));
+  ENSURE(sdc.AreConnectedByDistance(0., CompactDAQHit(AbsDAQHit(2, 0)), CompactDAQHit(AbsDAQHit(2, 100))));
+};
+
 TEST(PhotonDiffusionConnection) {
   PhotonDiffusionConnection pdc(hashedGeo);
   
@@ -0,0 +1,130 @@
+/**
+ * \file ConnectorBlockImageTest.cxx
+ *
+ * (c) 2013 the IceCube Collaboration
+ *
+ * $Id: ConnectorBlockImageTest.cxx 148312 2016-07-11 17:41:28Z mzoll $
+ * \version $Revision: 148312 $
+ * \date $Date: 2016-07-11 19:41:28 +0200 (mån, 11 jul 2016) $
+ * \author mzoll <marcel.zoll@fysik.su.se>
+ *
+ * Unit test to test the memory-mapped image of a ConnectorBlock
+ */
+
+#include <I3Test.h>
+
+#include "IceHiveZ/internals/ConnectorBlockImage.h"
+
+#include "ToolZ/IC86Topology.h"
+
+#include <cstdio>
+#include <fstream>
+#include <boost/foreach.hpp>
+
+#include "TestHelpers.h"
+
+TEST_GROUP(ConnectorBlockImage);
+
+const I3GeometryConstPtr geometry = boost::make_shared<const I3Geometry>(IC86Topology::Build_IC86_Geometry());
+const HashedGeometryConstPtr hashedGeo = boost::make_shared<const HashedGeometry>(geometry->omgeo);
+
+///DOMs are related to the DOMs closely below on the same string; not symmetric
+struct SameStringBelow {
+  bool operator()(const OMKey& a, const OMKey& b) const
+  { return a.GetString()==b.GetString() && b.GetOM()>a.GetOM() && b.GetOM()-a.GetOM()<=3; };
+};
+
+///DOMs are related if on neighbouring strings; symmetric
+struct NeighbourStrings {
+  bool operator()(const OMKey& a, const OMKey& b) const
+  { return std::abs(a.GetString()-b.GetString())==1; };
+};
+
+TEST(Write_Map) {
+  const CompactOMKeyHashServiceConstPtr hasher = hashedGeo->GetHashService();
+  const std::string path = std::string(P_tmpdir)+"/connectorblockimage_test.bin";
+  std::remove(path.c_str());
+
+  const RelationPtr below = boost::make_shared<Relation>(hasher, SameStringBelow(), Relation::SPARSE);
+  below->EnablePayload(Relation::GEOMETRY);
+  for (CompactHash a=0; a<hasher->HashSize(); a++) {
+    BOOST_FOREACH(const CompactHash b, below->RelatedSpan(a))
+      below->SetEdge(a, b, RelationEdge(float(a+b), float(b)-float(a), int8_t(0)));
+  }
+  const RelationPtr neighbours = boost::make_shared<Relation>(hasher, NeighbourStrings(), Relation::DENSE);
+
+  ConnectorBlock cb(hashedGeo);
+  cb.AddConnector(boost::make_shared<Connector>("below", hashedGeo, boost::make_shared<BoolConnection>(hashedGeo, true), below));
+  cb.AddConnector(boost::make_shared<Connector>("neighbours", hashedGeo, boost::make_shared<BoolConnection>(hashedGeo, true), neighbours));
+
+  ENSURE(! ConnectorBlockImage::Map(path, 42, hasher), "No image written yet");
+  ENSURE(ConnectorBlockImage::Write(path, 42, cb));
+  ENSURE(! ConnectorBlockImage::Map(path, 43, hasher), "The key has to fit");
+
+  const ConnectorBlockImageConstPtr image = ConnectorBlockImage::Map(path, 42, hasher);
+  ENSURE(image);
+  ENSURE_EQUAL(image->NumberOfConnectors(), 2u);
+  ENSURE_EQUAL(image->GetName(0), std::string("below"));
+  ENSURE_EQUAL(image->GetName(1), std::string("neighbours"));
+  ENSURE(image->GetSymRelation(1)==image->GetRelation(1), "A symmetric relation is its own closure");
+
+  //the relations are used in place and hold the same as the originals, including the payload
+  const ConnectorBlock::ConnectorList connectors = cb.GetConnectorList();
+  size_t index = 0;
+  BOOST_FOREACH(const ConnectorPtr& c, connectors) {
+    const RelationPtr mapped = image->GetRelation(index);
+    const RelationPtr mappedSym = image->GetSymRelation(index);
+    ENSURE(mapped->IsMapped());
+    ENSURE_EQUAL(mapped->GetStorageType(), Relation::SPARSE);
+    ENSURE_EQUAL(mapped->GetPayloadType(), c->GetRelation()->GetPayloadType());
+    ENSURE_EQUAL(mapped->NumberOfRelated(), c->GetRelation()->NumberOfRelated());
+    ENSURE_EQUAL(mappedSym->NumberOfRelated(), c->GetSymRelation()->NumberOfRelated());
+    for (CompactHash a=0; a<hasher->HashSize(); a+=5) {
+      for (CompactHash b=0; b<hasher->HashSize(); b++) {
+        ENSURE_EQUAL(mapped->AreRelated(a, b), c->GetRelation()->AreRelated(a, b));
+        ENSURE_EQUAL(mappedSym->AreRelated(a, b), c->GetSymRelation()->AreRelated(a, b));
+        const RelationEdge edge = mapped->GetEdge(a, b);
+        const RelationEdge orig = c->GetRelation()->GetEdge(a, b);
+        ENSURE(edge.distance==orig.distance || (std::isnan(edge.distance) && std::isnan(orig.distance)));
+        ENSURE_EQUAL(edge.ring, orig.ring);
+      }
+    }
+    index++;
+  }
+  ENSURE_EQUAL(image->GetCumulativeRelation()->NumberOfRelated(), cb.GetCumulativeRelation()->NumberOfRelated());
+  ENSURE_EQUAL(image->GetCumulativeSymRelation()->NumberOfRelated(), cb.GetCumulativeSymRelation()->NumberOfRelated());
+
+  //a block assembled from the image connects the same hits
+  ConnectorBlock mappedCb(hashedGeo, image->GetCumulativeRelation(), image->GetCumulativeSymRelation());
+  for (size_t i=0; i<image->NumberOfConnectors(); i++)
+    mappedCb.AddConnector(boost::make_shared<Connector>(image->GetName(i), hashedGeo,
+      boost::make_shared<BoolConnection>(hashedGeo, true), image->GetRelation(i), image->GetSymRelation(i)));
+  for (CompactHash a=0; a<hasher->HashSize(); a+=3) {
+    for (CompactHash b=0; b<hasher->HashSize(); b++) {
+      ENSURE_EQUAL(mappedCb.Connected(AbsHit(a, 0.), AbsHit(b, 10.)), cb.Connected(AbsHit(a, 0.), AbsHit(b, 10.)));
+      ENSURE_EQUAL(mappedCb.Connected(AbsHit(a, 0.), AbsHit(b, 0.)), cb.Connected(AbsHit(a, 0.), AbsHit(b, 0.)));
+    }
+  }
+
+  //modification makes a private copy, the image stays untouched
+  const RelationPtr modified = image->GetRelation(0);
+  const CompactHash a = 0;
+  const CompactHash b = hasher->HashSize()-1;
+  ENSURE(! modified->AreRelated(a, b));
+  modified->SetRelated(a, b, true);
+  ENSURE(modified->AreRelated(a, b));
+  ENSURE(! modified->IsMapped());
+  const ConnectorBlockImageConstPtr remapped = ConnectorBlockImage::Map(path, 42, hasher);
+  ENSURE(remapped);
+  ENSURE(! remapped->GetRelation(0)->AreRelated(a, b), "The image is never written to");
+
+  //a truncated image is not mapped
+  {
+    std::ifstream ifs(path.c_str(), std::ios::binary);
+    const std::string content((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    std::ofstream ofs(path.c_str(), std::ios::binary | std::ios::trunc);
+    ofs.write(content.data(), content.size()/2);
+  }
+  ENSURE(! ConnectorBlockImage::Map(path, 42, hasher), "Truncated images are not mapped");
+  std::remove(path.c_str());
+};
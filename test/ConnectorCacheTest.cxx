@@ -0,0 +1,73 @@
+/**
+ * \file ConnectorCacheTest.cxx
+ *
+ * (c) 2013 the IceCube Collaboration
+ *
+ * $Id: ConnectorCacheTest.cxx 148312 2016-07-11 17:41:28Z mzoll $
+ * \version $Revision: 148312 $
+ * \date $Date: 2016-07-11 19:41:28 +0200 (mån, 11 jul 2016) $
+ * \author mzoll <marcel.zoll@fysik.su.se>
+ *
+ * Unit test to test the on-disk cache of relations
+ */
+
+#include <I3Test.h>
+
+#include "IceHiveZ/internals/ConnectorCache.h"
+
+#include "ToolZ/IC86Topology.h"
+
+#include <cstdio>
+#include <fstream>
+#include <unistd.h>
+
+#include "TestHelpers.h"
+
+TEST_GROUP(ConnectorCache);
+
+const I3GeometryConstPtr geometry = boost::make_shared<const I3Geometry>(IC86Topology::Build_IC86_Geometry());
+const HashedGeometryConstPtr hashedGeo = boost::make_shared<const HashedGeometry>(geometry->omgeo);
+
+///DOMs are related if close on the same string
+struct SameStringClose {
+  bool operator()(const OMKey& a, const OMKey& b) const
+  { return a.GetString()==b.GetString() && std::abs(int(a.GetOM())-int(b.GetOM()))<=3; };
+};
+
+TEST(Store_Load) {
+  const std::string directory = P_tmpdir;
+  ConnectorCache cache(directory);
+  
+  const uint64_t key = ConnectorCache::GeometryFingerprint(hashedGeo).Value();
+  ENSURE_EQUAL(key, ConnectorCache::GeometryFingerprint(hashedGeo).Value(), "Fingerprints are reproducible");
+  std::remove(cache.FilePath(key).c_str());
+  
+  std::vector<RelationPtr> loaded;
+  ENSURE(! cache.Load(key, hashedGeo->GetHashService(), loaded), "Nothing stored yet");
+  
+  std::vector<RelationConstPtr> stored;
+  stored.push_back(boost::make_shared<Relation>(hashedGeo->GetHashService(), SameStringClose(), Relation::SPARSE));
+  stored.push_back(boost::make_shared<Relation>(hashedGeo->GetHashService(), true));
+  ENSURE(cache.Store(key, stored));
+  
+  ENSURE(cache.Load(key, hashedGeo->GetHashService(), loaded));
+  ENSURE_EQUAL(loaded.size(), stored.size());
+  for (size_t r=0; r<stored.size(); r++) {
+    ENSURE_EQUAL(loaded[r]->GetStorageType(), stored[r]->GetStorageType());
+    ENSURE_EQUAL(loaded[r]->NumberOfRelated(), stored[r]->NumberOfRelated());
+    for (CompactHash a=0; a<hashedGeo->GetHashService()->HashSize(); a+=7) {
+      for (CompactHash b=0; b<hashedGeo->GetHashService()->HashSize(); b++)
+        ENSURE_EQUAL(loaded[r]->AreRelated(a, b), stored[r]->AreRelated(a, b));
+    }
+  }
+  
+  //a damaged entry is a miss
+  {
+    std::fstream fs(cache.FilePath(key).c_str(), std::ios::in | std::ios::out | std::ios::binary);
+    fs.seekp(100);
+    fs.put('\xff');
+  }
+  ENSURE(! cache.Load(key, hashedGeo->GetHashService(), loaded), "Corrupt entries are not loaded");
+  ENSURE(loaded.empty());
+  std::remove(cache.FilePath(key).c_str());
+};
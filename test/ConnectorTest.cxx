@@ -51,6 +51,118 @@ TEST(Connector){
   ConnectorPtr con_0 =connectorBlock->GetConnector(0);
 
   ENSURE_EQUAL(con_cum->Connected(one, two), con_0->Connected(one, two));
+  ENSURE(con_cum->GetSymRelation()==connectorBlock->GetCumulativeSymRelation(), "The cumulative connector uses the symmetric closure held by the block");
+};
+
+
+TEST(Adaptive_Order){
+  ConnectorBlockPtr connectorBlock = boost::make_shared<ConnectorBlock>(hashedGeo);
+  connectorBlock->AddConnector(boost::make_shared<Connector>("ConnectNone",
+                                                            hashedGeo,
+                                                            boost::make_shared<BoolConnection>(hashedGeo, false),
+                                                            boost::make_shared<Relation>(hashedGeo->GetHashService(), true)));
+  connectorBlock->AddConnector(boost::make_shared<Connector>("ConnectAll",
+                                                            hashedGeo,
+                                                            boost::make_shared<BoolConnection>(hashedGeo, true),
+                                                            boost::make_shared<Relation>(hashedGeo->GetHashService(), true)));
+  //initially evaluated in the order of adding
+  ENSURE_EQUAL(connectorBlock->GetEvaluationOrder().at(0), (size_t)0);
+  
+  //the connector accepting everything is evaluated first after calibration
+  connectorBlock->Calibrate(100, 1000.);
+  ENSURE_EQUAL(connectorBlock->GetEvaluationOrder().at(0), (size_t)1);
+  ENSURE_EQUAL(connectorBlock->GetStatistics(0).accepted_.Get(), (uint64_t)0);
+  ENSURE_EQUAL(connectorBlock->GetStatistics(1).accepted_.Get(), (uint64_t)100);
+  
+  //the result does not depend on the order
+  ENSURE(connectorBlock->Connected(AbsHit(0, 0.), AbsHit(1, 10.)));
+};
+
+TEST(Untimed_Cost_By_SpeedRating){
+  ConnectorBlockPtr connectorBlock = boost::make_shared<ConnectorBlock>(hashedGeo);
+  connectorBlock->AddConnector(boost::make_shared<Connector>("Timed",
+                                                            hashedGeo,
+                                                            boost::make_shared<BoolConnection>(hashedGeo, true),
+                                                            boost::make_shared<Relation>(hashedGeo->GetHashService(), true)));
+  connectorBlock->AddConnector(boost::make_shared<Connector>("Untimed",
+                                                            hashedGeo,
+                                                            boost::make_shared<BoolConnection>(hashedGeo, true),
+                                                            boost::make_shared<Relation>(hashedGeo->GetHashService(), true)));
+  //every query is timed, the order is only changed when asked for
+  connectorBlock->sampleInterval_ = 1;
+  connectorBlock->reorderInterval_ = 0;
+  //the first one accepts every pair, so the second one never runs
+  for (size_t i=0; i<100; i++)
+    ENSURE(connectorBlock->Connected(AbsHit(0, 0.), AbsHit(1, 10.)));
+  ENSURE_EQUAL(connectorBlock->GetStatistics(0).timedCalls_.Get(), (uint64_t)100);
+  ENSURE_EQUAL(connectorBlock->GetStatistics(1).timedCalls_.Get(), (uint64_t)0);
+  connectorBlock->ReorderByStatistics();
+  //of equal speed rating, the untimed one is estimated as costly, but accepts less as far as known
+  ENSURE_EQUAL(connectorBlock->GetEvaluationOrder().at(0), (size_t)0, "Untimed connectors are not taken as free");
+};
+
+TEST(Natural_Order_Beyond_Max){
+  ConnectorBlockPtr connectorBlock = boost::make_shared<ConnectorBlock>(hashedGeo);
+  connectorBlock->AddConnector(boost::make_shared<Connector>("ConnectNone",
+                                                            hashedGeo,
+                                                            boost::make_shared<BoolConnection>(hashedGeo, false),
+                                                            boost::make_shared<Relation>(hashedGeo->GetHashService(), true)));
+  for (size_t i=1; i<=ConnectorBlock::maxOrderedConnectors; i++)
+    connectorBlock->AddConnector(boost::make_shared<Connector>("ConnectAll",
+                                                              hashedGeo,
+                                                              boost::make_shared<BoolConnection>(hashedGeo, true),
+                                                              boost::make_shared<Relation>(hashedGeo->GetHashService(), true)));
+  //the statistics would put the first connector last, but there are too many connectors to be ordered
+  connectorBlock->Calibrate(100, 1000.);
+  const std::vector<size_t> order = connectorBlock->GetEvaluationOrder();
+  ENSURE_EQUAL(order.size(), ConnectorBlock::maxOrderedConnectors+1);
+  for (size_t k=0; k<order.size(); k++)
+    ENSURE_EQUAL(order[k], k, "Evaluated in the order of adding");
+};
+
+///DOMs on string 21 are bad
+bool NotOnString21(const OMKey& omkey)
+  {return omkey.GetString()!=21;};
+
+///no DOM is bad
+bool AllGood(const OMKey&)
+  {return true;};
+
+TEST(DOM_Mask){
+  const CompactOMKeyHashServiceConstPtr hasher = hashedGeo->GetHashService();
+  ConnectorBlockPtr connectorBlock = boost::make_shared<ConnectorBlock>(hashedGeo);
+  const RelationPtr shared = boost::make_shared<Relation>(hasher, true, Relation::SPARSE);
+  connectorBlock->AddConnector(boost::make_shared<Connector>("ConnectAll",
+                                                            hashedGeo,
+                                                            boost::make_shared<BoolConnection>(hashedGeo, true),
+                                                            shared));
+  const CompactHash bad = hasher->HashFromOMKey(OMKey(21,30));
+  const CompactHash good = hasher->HashFromOMKey(OMKey(22,30));
+  const size_t n_related = connectorBlock->GetCumulativeRelation()->NumberOfRelated();
+  ENSURE(connectorBlock->Connected(AbsHit(bad, 0.), AbsHit(good, 10.)));
+  
+  //masking takes out the rows and columns of the bad DOMs, the hashing stays the same
+  ENSURE_EQUAL(connectorBlock->UpdateDOMMask(NotOnString21), (size_t)60);
+  ENSURE(! connectorBlock->IsDOMEnabled(bad));
+  ENSURE(connectorBlock->IsDOMEnabled(good));
+  ENSURE(! connectorBlock->Connected(AbsHit(bad, 0.), AbsHit(good, 10.)));
+  ENSURE(! connectorBlock->Connected(AbsHit(good, 0.), AbsHit(bad, 10.)));
+  ENSURE(connectorBlock->Connected(AbsHit(good, 0.), AbsHit(good+1, 10.)));
+  ENSURE_EQUAL(connectorBlock->UpdateDOMMask(NotOnString21), (size_t)0);
+  ENSURE_EQUAL(shared->NumberOfDisabledDOMs(), 0u, "The relation handed in is not masked, but a copy of it");
+  ENSURE(shared->AreRelated(bad, good));
+  
+  //connectors added later follow the mask
+  connectorBlock->AddConnector(boost::make_shared<Connector>("ConnectAllToo",
+                                                            hashedGeo,
+                                                            boost::make_shared<BoolConnection>(hashedGeo, true),
+                                                            boost::make_shared<Relation>(hasher, true, Relation::DENSE)));
+  ENSURE(! connectorBlock->Connected(AbsHit(bad, 0.), AbsHit(good, 10.)));
+  
+  //unmasking restores everything
+  ENSURE_EQUAL(connectorBlock->UpdateDOMMask(AllGood), (size_t)60);
+  ENSURE(connectorBlock->Connected(AbsHit(bad, 0.), AbsHit(good, 10.)));
+  ENSURE_EQUAL(connectorBlock->GetCumulativeRelation()->NumberOfRelated(), n_related);
 };
 
 
@@ -0,0 +1,77 @@
+/**
+ * \file HitConnectivityTest.cxx
+ *
+ * (c) 2013 the IceCube Collaboration
+ *
+ * $Id: HitConnectivityTest.cxx 148312 2016-07-11 17:41:28Z mzoll $
+ * \version $Revision: 148312 $
+ * \date $Date: 2016-07-11 19:41:28 +0200 (mån, 11 jul 2016) $
+ * \author mzoll <marcel.zoll@fysik.su.se>
+ *
+ * Unit test to test the shared connectivity of the pairs of hits of a series
+ */
+
+#include <I3Test.h>
+
+#include "IceHiveZ/internals/HitConnectivity.h"
+
+#include "ToolZ/IC86Topology.h"
+
+#include <boost/make_shared.hpp>
+#include <boost/foreach.hpp>
+
+#include "TestHelpers.h"
+
+TEST_GROUP(HitConnectivity);
+
+const I3GeometryConstPtr geometry = boost::make_shared<const I3Geometry>(IC86Topology::Build_IC86_Geometry());
+const HashedGeometryConstPtr hashedGeo = boost::make_shared<const HashedGeometry>(geometry->omgeo);
+
+///DOMs are related to the DOMs closely below on the same string; not symmetric
+struct SameStringBelow {
+  bool operator()(const OMKey& a, const OMKey& b) const
+  { return a.GetString()==b.GetString() && b.GetOM()>a.GetOM() && b.GetOM()-a.GetOM()<=3; };
+};
+
+TEST(Remembers_Pairs) {
+  const CompactOMKeyHashServiceConstPtr hasher = hashedGeo->GetHashService();
+  const ConnectorBlockPtr cb = boost::make_shared<ConnectorBlock>(hashedGeo);
+  cb->AddConnector(boost::make_shared<Connector>("SameStringBelow",
+                                                 hashedGeo,
+                                                 boost::make_shared<DeltaTimeConnection>(hashedGeo, 100., 150.),
+                                                 boost::make_shared<Relation>(hasher, SameStringBelow(), Relation::SPARSE)));
+
+  CompactHitSeries hits = GenerateRandomHits(400, hasher->HashSize()/40, 20000, 10., 99);
+  hits.erase(std::unique(hits.begin(), hits.end()), hits.end());
+
+  const double horizon = 200.;
+  const HitConnectivity connectivity(cb, hits, horizon);
+  ENSURE_EQUAL(connectivity.NumberOfEvaluations(), 0u, "Pairs are evaluated as they are asked for");
+  ENSURE_EQUAL(connectivity.Find(hits[17]), 17u);
+  ENSURE_EQUAL(connectivity.Find(CompactHit(0, -1.)), HitConnectivity::npos);
+
+  //every pair is evaluated as by the ConnectorBlock, the ones within the horizon only once
+  size_t n_within=0;
+  size_t n_connected=0;
+  for (int pass=0; pass<2; pass++) {
+    for (size_t i=0; i<hits.size(); i++) {
+      for (size_t j=0; j<hits.size(); j++) {
+        const bool connected = connectivity.Connected(i, j);
+        ENSURE_EQUAL(connected, cb->Connected(hits[i], hits[j]));
+        ENSURE_EQUAL(connectivity.Connected(hits[i].ToAbsHit(), hits[j].ToAbsHit()), connected);
+        if (pass==0 && std::abs(hits[i].TimeDiff(hits[j]))<=horizon) {
+          n_within++;
+          n_connected += connected;
+        }
+      }
+    }
+  }
+  ENSURE(n_connected>0);
+  const size_t n_pairs = hits.size()*hits.size();
+  ENSURE_EQUAL(connectivity.NumberOfEvaluations(), uint64_t(n_within + 4*(n_pairs-n_within)),
+    "Pairs within the horizon are evaluated once");
+
+  //hits which are not part of the series are evaluated directly
+  const CompactHit outsider(1, -5.);
+  ENSURE_EQUAL(connectivity.Connected(outsider, hits[0]), cb->Connected(outsider, hits[0]));
+};
@@ -71,3 +71,212 @@ TEST(HiveCleaning) {
   //everything should be disconnected, so no hits written out
   ENSURE_EQUAL(cleanHits.size(), hits.size(), "Cleaned Series has the same size, as nothing should be cleaned away");
 };
+
+TEST(Compact_Equals_AbsHit) {
+  //a short series of hits on a few DOMs, some of them isolated in time
+  AbsHitSet hits;
+  const double times[] = {0., 5., 5., 12., 40., 41., 100., 300., 305., 305.};
+  for (size_t i=0; i<sizeof(times)/sizeof(double); i++)
+    hits.insert(AbsHit(i%4, times[i]));
+  
+  HiveCleaning_ParameterSet hc_param_set;
+  hc_param_set.multiplicity = 2;
+  hc_param_set.max_tresidual_early = 50.;
+  hc_param_set.max_tresidual_late = 50.;
+  hc_param_set.connectorBlock = boost::make_shared<ConnectorBlock>(hashedGeo);
+  hc_param_set.connectorBlock->AddConnector(boost::make_shared<Connector>("ConnectClose",
+                                                                          hashedGeo,
+                                                                          boost::make_shared<DeltaTimeConnection>(hashedGeo, 10., 10.),
+                                                                          boost::make_shared<Relation>(hashedGeo->GetHashService(), true)));
+  HiveCleaning hiveCleaning( hc_param_set );
+  
+  const AbsHitSet cleanHits = hiveCleaning.Clean(hits);
+  const CompactHitSeries cleanCompactHits = hiveCleaning.Clean(ToCompactHits(hits));
+  
+  ENSURE(cleanHits.size()<hits.size(), "Isolated hits are cleaned away");
+  ENSURE_EQUAL(cleanCompactHits.size(), cleanHits.size(), "Same number of hits is kept");
+  size_t i=0;
+  BOOST_FOREACH(const AbsHit& h, cleanHits) {
+    ENSURE(CompactHit(h)==cleanCompactHits[i], "Same hits are kept");
+    ENSURE(cleanCompactHits[i].ToAbsHit()==h, "Conversion is exact");
+    i++;
+  }
+};
+
+///DOMs are related to the DOMs closely above on the same string; not symmetric
+struct CloseAbove {
+  const CompactOMKeyHashServiceConstPtr hasher_;
+  CloseAbove(const CompactOMKeyHashServiceConstPtr& hasher) : hasher_(hasher) {};
+  bool operator()(const OMKey& a, const OMKey& b) const
+    {return a.GetString()==b.GetString() && a.GetOM()>b.GetOM() && a.GetOM()-b.GetOM()<=3;};
+};
+
+///the number of connected hits within the time residuals, visiting all of them
+size_t CountConnected(
+  const ConnectorBlock& cb,
+  const CompactHitSeries& hits,
+  const size_t i,
+  const double early,
+  const double late)
+{
+  size_t n=0;
+  for (size_t j=0; j<hits.size(); j++) {
+    if (j<i && hits[i].GetTime()-hits[j].GetTime()<=early)
+      n += cb.Connected(hits[i], hits[j]);
+    if (j>=i && hits[j].GetTime()-hits[i].GetTime()<=late)
+      n += cb.Connected(hits[j], hits[i]);
+  }
+  return n;
+};
+
+TEST(Indexed_Equals_Scan) {
+  const CompactOMKeyHashServiceConstPtr hasher = hashedGeo->GetHashService();
+  
+  //hits on a few strings, some of them at equal times
+  const CompactHitSeries hits = GenerateRandomHits(3000, hasher->HashSize()/20, 200000, 10., 12345, 7);
+  
+  const Relation::StorageType storages[] = {Relation::DENSE, Relation::SPARSE};
+  BOOST_FOREACH(const Relation::StorageType storage, storages) {
+    HiveCleaning_ParameterSet hc_param_set;
+    hc_param_set.max_tresidual_early = 200.;
+    hc_param_set.max_tresidual_late = 300.;
+    hc_param_set.connectorBlock = boost::make_shared<ConnectorBlock>(hashedGeo);
+    hc_param_set.connectorBlock->AddConnector(boost::make_shared<Connector>("CloseAbove",
+                                                                            hashedGeo,
+                                                                            boost::make_shared<DeltaTimeConnection>(hashedGeo, 100., 150.),
+                                                                            boost::make_shared<Relation>(hasher, CloseAbove(hasher), storage)));
+    for (unsigned multiplicity=0; multiplicity<=3; multiplicity++) {
+      hc_param_set.multiplicity = multiplicity;
+      CompactHitSeries expected;
+      for (size_t i=0; i<hits.size(); i++) {
+        if (CountConnected(*hc_param_set.connectorBlock, hits, i, 200., 300.)>=multiplicity)
+          expected.push_back(hits[i]);
+      }
+      ENSURE(expected.size()<hits.size() || multiplicity==0);
+      
+      //the series is long enough to be split into ranges, which are cleaned concurrently
+      const unsigned threads[] = {1, 3};
+      BOOST_FOREACH(const unsigned n_threads, threads) {
+        hc_param_set.nThreads = n_threads;
+        HiveCleaning hiveCleaning( hc_param_set );
+        const CompactHitSeries cleanHits = hiveCleaning.Clean(hits);
+        ENSURE_EQUAL(cleanHits.size(), expected.size(), "Same number of hits is kept");
+        for (size_t i=0; i<std::min(cleanHits.size(), expected.size()); i++)
+          ENSURE(cleanHits[i]==expected[i], "Same hits are kept");
+      }
+    }
+  }
+};
+
+TEST(Mask_And_Indices) {
+  const CompactOMKeyHashServiceConstPtr hasher = hashedGeo->GetHashService();
+  
+  const CompactHitSeries hits = GenerateRandomHits(2000, hasher->HashSize()/20, 100000, 10., 777);
+  
+  HiveCleaning_ParameterSet hc_param_set;
+  hc_param_set.multiplicity = 1;
+  hc_param_set.max_tresidual_early = 200.;
+  hc_param_set.max_tresidual_late = 300.;
+  hc_param_set.connectorBlock = boost::make_shared<ConnectorBlock>(hashedGeo);
+  hc_param_set.connectorBlock->AddConnector(boost::make_shared<Connector>("CloseAbove",
+                                                                          hashedGeo,
+                                                                          boost::make_shared<DeltaTimeConnection>(hashedGeo, 100., 150.),
+                                                                          boost::make_shared<Relation>(hasher, CloseAbove(hasher), Relation::SPARSE)));
+  HiveCleaning hiveCleaning( hc_param_set );
+  const CompactHitSeries expected = hiveCleaning.Clean(hits);
+  ENSURE(! expected.empty() && expected.size()<hits.size());
+  
+  //the mask is aligned with the hits, the indices point to the kept ones
+  std::vector<uint8_t> keep(5, 1);
+  hiveCleaning.Clean(ToSpan(hits), keep);
+  ENSURE_EQUAL(keep.size(), hits.size(), "The mask is aligned with the hits");
+  std::vector<uint32_t> kept;
+  hiveCleaning.CleanIndices(ToSpan(hits), kept);
+  ENSURE_EQUAL(kept.size(), expected.size(), "Same number of hits is kept");
+  size_t n_kept=0;
+  for (size_t i=0; i<hits.size(); i++) {
+    if (keep[i]) {
+      ENSURE(n_kept<expected.size() && hits[i]==expected[n_kept], "Same hits are kept");
+      ENSURE_EQUAL(kept[n_kept], i, "Same hits are listed");
+      n_kept++;
+    }
+  }
+  ENSURE_EQUAL(n_kept, expected.size());
+  
+  //a span onto part of the series cleans exactly as a copy of it
+  const CompactHitSpan part(hits.data()+500, hits.data()+1500);
+  const CompactHitSeries partCopy(part.begin(), part.end());
+  const CompactHitSeries expectedPart = hiveCleaning.Clean(partCopy);
+  hiveCleaning.CleanIndices(part, kept);
+  ENSURE_EQUAL(kept.size(), expectedPart.size());
+  for (size_t i=0; i<std::min(kept.size(), expectedPart.size()); i++)
+    ENSURE(part[kept[i]]==expectedPart[i], "Same hits are kept from the span");
+  
+  //the mask of an AbsHitSet is aligned with the set
+  AbsHitSet absHits;
+  BOOST_FOREACH(const CompactHit& h, hits)
+    absHits.insert(h.ToAbsHit());
+  const AbsHitSet expectedAbs = hiveCleaning.Clean(absHits);
+  hiveCleaning.Clean(absHits, keep);
+  ENSURE_EQUAL(keep.size(), absHits.size());
+  AbsHitSet masked;
+  size_t i=0;
+  BOOST_FOREACH(const AbsHit& h, absHits) {
+    if (keep[i++])
+      masked.insert(masked.end(), h);
+  }
+  ENSURE(masked==expectedAbs, "The mask selects the same hits");
+};
+
+TEST(Streaming_Equals_Batch) {
+  const CompactOMKeyHashServiceConstPtr hasher = hashedGeo->GetHashService();
+  
+  //hits at full nanoseconds, so that the times are exact in both precisions; some of them at equal times
+  CompactHitSeries hits = GenerateRandomHits(3000, hasher->HashSize()/20, 20000, 1., 54321, 7);
+  hits.erase(std::unique(hits.begin(), hits.end()), hits.end());
+  
+  HiveCleaning_ParameterSet hc_param_set;
+  hc_param_set.max_tresidual_early = 200.;
+  hc_param_set.max_tresidual_late = 300.;
+  hc_param_set.connectorBlock = boost::make_shared<ConnectorBlock>(hashedGeo);
+  hc_param_set.connectorBlock->AddConnector(boost::make_shared<Connector>("CloseAbove",
+                                                                          hashedGeo,
+                                                                          boost::make_shared<DeltaTimeConnection>(hashedGeo, 100., 150.),
+                                                                          boost::make_shared<Relation>(hasher, CloseAbove(hasher), Relation::SPARSE)));
+  for (unsigned multiplicity=0; multiplicity<=3; multiplicity++) {
+    hc_param_set.multiplicity = multiplicity;
+    HiveCleaning hiveCleaning( hc_param_set );
+    const CompactHitSeries expected = hiveCleaning.Clean(hits);
+    ENSURE(expected.size()<hits.size() || multiplicity==0);
+    ENSURE(! expected.empty());
+    
+    //feed the hits slightly out of order, advancing the stream behind them and pulling in between
+    StreamingHiveCleaning streaming( hc_param_set );
+    CompactDAQHitSeries cleanHits;
+    int64_t decided = std::numeric_limits<int64_t>::min();
+    for (size_t i=0; i<hits.size(); i++) {
+      const size_t k = (i%2 && i+1<hits.size()) ? i+1 : ((i%2==0 && i) ? i-1 : i);
+      streaming.AddHit(CompactDAQHit(hits[k].GetDOMIndex(), int64_t(hits[k].GetTime())*10));
+      if (i%50==49) {
+        streaming.AdvanceTime(int64_t(hits[std::max<size_t>(i, 1)-1].GetTime())*10);
+        ENSURE(streaming.DecidedUntil()>=decided, "The stream only moves forward");
+        decided = streaming.DecidedUntil();
+        BOOST_FOREACH(const AbsDAQHit& h, streaming.PullCleaned()) {
+          ENSURE(cleanHits.empty() || cleanHits.back()<CompactDAQHit(h), "Hits are emitted in time order");
+          cleanHits.push_back(CompactDAQHit(h));
+        }
+      }
+    }
+    streaming.Finalize();
+    ENSURE_EQUAL(streaming.DecidedUntil(), std::numeric_limits<int64_t>::max());
+    ENSURE_EQUAL(streaming.NumberOfHeldHits(), 0u, "Nothing is held after finalizing");
+    BOOST_FOREACH(const AbsDAQHit& h, streaming.PullCleaned())
+      cleanHits.push_back(CompactDAQHit(h));
+    
+    ENSURE_EQUAL(cleanHits.size(), expected.size(), "Same number of hits is kept");
+    for (size_t i=0; i<std::min(cleanHits.size(), expected.size()); i++) {
+      ENSURE_EQUAL(cleanHits[i].GetDOMIndex(), expected[i].GetDOMIndex(), "Same hits are kept");
+      ENSURE_EQUAL(cleanHits[i].GetDAQTicks(), int64_t(expected[i].GetTime())*10, "Same hits are kept");
+    }
+  }
+};
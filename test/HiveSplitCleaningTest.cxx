@@ -0,0 +1,103 @@
+/**
+ * \file HiveSplitCleaningTest.cxx
+ *
+ * $Id: HiveSplitCleaningTest.cxx 153794 2017-03-09 10:43:19Z mzoll $
+ * $Author: mzoll $
+ * $Date: 2017-03-09 11:43:19 +0100 (Thu, 09 Mar 2017) $
+ * $Revision: 153794 $
+ *
+ * A Unit test which splits and cleans artificial hits in one go and in sequence
+ */
+
+#include <I3Test.h>
+
+#include "IceHiveZ/algorithms/HiveSplitCleaning.h"
+
+#include "ToolZ/IC86Topology.h"
+
+#include <boost/make_shared.hpp>
+#include <boost/foreach.hpp>
+
+#include "TestHelpers.h"
+
+using namespace std;
+using namespace hivesplitter;
+
+TEST_GROUP(HiveSplitCleaning);
+
+const I3GeometryConstPtr geometry = boost::make_shared<I3Geometry>(IC86Topology::Build_IC86_Geometry());
+const HashedGeometryConstPtr hashedGeo = boost::make_shared<const HashedGeometry>(geometry->omgeo);
+
+///DOMs are related to the DOMs close by on the same string; symmetric
+struct SameStringClose {
+  bool operator()(const OMKey& a, const OMKey& b) const
+    {return a.GetString()==b.GetString() && a.GetOM()!=b.GetOM() && std::abs(int(a.GetOM())-int(b.GetOM()))<=4;};
+};
+
+///DOMs are related to the DOMs closely above on the same string; not symmetric
+struct CloseAbove {
+  bool operator()(const OMKey& a, const OMKey& b) const
+    {return a.GetString()==b.GetString() && a.GetOM()>b.GetOM() && a.GetOM()-b.GetOM()<=3;};
+};
+
+TEST(SplitClean_Equals_Sequential) {
+  const CompactOMKeyHashServiceConstPtr hasher = hashedGeo->GetHashService();
+  //bursts of hits on neighbouring DOMs of one string, and hits in between
+  AbsHitSet hits;
+  BOOST_FOREACH(const AbsDAQHit& h, GenerateBurstsAndNoise(hasher, 4242, 40, 12, 6, 1, 12, 6000, 200000))
+    hits.insert(hits.end(), AbsHit(h.GetDOMIndex(), double(h.GetDAQTicks())/10.));
+
+  const ConnectorBlockPtr close = boost::make_shared<ConnectorBlock>(hashedGeo);
+  close->AddConnector(boost::make_shared<Connector>("SameStringClose",
+                                                    hashedGeo,
+                                                    boost::make_shared<DeltaTimeConnection>(hashedGeo, 300., 300.),
+                                                    boost::make_shared<Relation>(hasher, SameStringClose(), Relation::SPARSE)));
+  const ConnectorBlockPtr above = boost::make_shared<ConnectorBlock>(hashedGeo);
+  above->AddConnector(boost::make_shared<Connector>("CloseAbove",
+                                                    hashedGeo,
+                                                    boost::make_shared<DeltaTimeConnection>(hashedGeo, 200., 200.),
+                                                    boost::make_shared<Relation>(hasher, CloseAbove(), Relation::SPARSE)));
+
+  HiveSplitter_ParameterSet hs_param_set;
+  hs_param_set.multiplicity = 3;
+  hs_param_set.multiplicityTimeWindow = 500.;
+  hs_param_set.connectorBlock = close;
+
+  //once sharing the ConnectorBlock, once not
+  const ConnectorBlockPtr cleaningBlocks[] = {close, above};
+  BOOST_FOREACH(const ConnectorBlockPtr& cleaningBlock, cleaningBlocks) {
+    HiveCleaning_ParameterSet hc_param_set;
+    hc_param_set.multiplicity = 4;
+    hc_param_set.max_tresidual_early = 100.;
+    hc_param_set.max_tresidual_late = 100.;
+    hc_param_set.connectorBlock = cleaningBlock;
+
+    HiveSplitter hiveSplitter(hs_param_set);
+    HiveCleaning hiveCleaning(hc_param_set);
+    const AbsHitSetSequence expected = hiveSplitter.Split(hits);
+    ENSURE(expected.size()>=20, "Bursts are split into subevents");
+
+    HiveSplitCleaning hiveSplitCleaning(hs_param_set, hc_param_set);
+    std::vector<std::vector<uint8_t> > keep;
+    const AbsHitSetSequence subEvents = hiveSplitCleaning.SplitClean(hits, keep);
+    ENSURE(hiveSplitCleaning.GetNumberOfEvaluations()>0);
+    ENSURE_EQUAL(subEvents.size(), expected.size(), "Same number of subevents");
+    ENSURE_EQUAL(keep.size(), subEvents.size(), "A mask for every subevent");
+    ENSURE(std::equal(subEvents.begin(), subEvents.end(), expected.begin()), "Same subevents");
+
+    const AbsHitSetSequence cleanSubEvents = hiveSplitCleaning.SplitClean(hits);
+    ENSURE_EQUAL(cleanSubEvents.size(), expected.size());
+    AbsHitSetSequence::const_iterator clean = cleanSubEvents.begin();
+    size_t k=0;
+    size_t n_cleaned=0;
+    BOOST_FOREACH(const AbsHitSet& subEvent, expected) {
+      const AbsHitSet expectedClean = hiveCleaning.Clean(subEvent);
+      ENSURE(*clean==expectedClean, "Same hits are kept");
+      ENSURE_EQUAL(keep[k].size(), subEvent.size(), "The mask is aligned with the subevent");
+      n_cleaned += subEvent.size()-expectedClean.size();
+      ++clean;
+      ++k;
+    }
+    ENSURE(n_cleaned>0, "Some hits are cleaned away");
+  }
+};
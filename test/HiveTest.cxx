@@ -17,6 +17,8 @@
 
 #include "TestHelpers.h"
 
+#include <cstdio>
+#include <fstream>
 #include <boost/make_shared.hpp>
 
 using namespace hive;
@@ -80,6 +82,77 @@ TEST(Build_a_hive) {
   ENSURE(ht.IsRingX(4,1,3));
 }
 
+TEST(Compile_a_hive) {
+  HiveTopology ht;
+  StringRings sr(1);
+  uint first_ring[] = {2, 3};
+  sr.SetRing(1, Ring(first_ring, first_ring+2));
+  sr.AddStringToRing(5,2);
+  ht.AddStringRing(sr);
+  ht.MutualAddStringToRing(4, 2, 1);
+  ht.MutualAddStringToRing(4, 1, 3);
+  
+  const CompiledHiveTopology cht(ht);
+  ENSURE_EQUAL(cht.NStrings(), 6u);
+  
+  //same answers as the HiveTopology, also for strings which are not known at all
+  for (StringNbr center=0; center<8; center++) {
+    ENSURE_EQUAL(cht.HoldsCenterString(center), ht.HoldsCenterString(center));
+    for (StringNbr string=0; string<8; string++)
+      ENSURE_EQUAL(cht.WhichRing(center, string), ht.WhichRing(center, string));
+  }
+  
+  ENSURE_EQUAL(cht.GetNRings(1), 3u);
+  ENSURE_EQUAL(cht.GetNRings(3), 0u);
+  std::pair<const StringNbr*, const StringNbr*> ring = cht.GetRing(1, 1);
+  ENSURE_EQUAL(ring.second-ring.first, 2);
+  ENSURE_EQUAL(ring.first[0], 2u);
+  ENSURE_EQUAL(ring.first[1], 3u);
+  ring = cht.GetRing(1, 0);
+  ENSURE_EQUAL(ring.second-ring.first, 1);
+  ENSURE_EQUAL(ring.first[0], 1u);
+  ring = cht.GetRing(1, 4);
+  ENSURE(ring.first==ring.second, "No such ring");
+  ring = cht.GetRing(7, 0);
+  ENSURE(ring.first==ring.second, "No such center");
+}
+
+TEST(HiveTopology_Binary) {
+  HiveTopology ht;
+  for (StringNbr center=1; center<=20; center++) {
+    std::vector<Ring> rings(3);
+    for (StringNbr s=1; s<=20; s++) {
+      const unsigned d = std::abs(int(s)-int(center));
+      if (d>=1 && d<=3)
+        rings[d-1].insert(s);
+    }
+    ht.AddStringRing(StringRings(center, rings));
+  }
+  
+  const std::string path = std::string(P_tmpdir)+"/hivetopology_test.bin";
+  ENSURE(ht.Save(path));
+  const HiveTopologyPtr ht_read = HiveTopology::Load(path);
+  ENSURE(bool(ht_read));
+  ENSURE_EQUAL(ht_read->Dump(), ht.Dump());
+  for (StringNbr center=0; center<=21; center++) {
+    for (StringNbr s=0; s<=21; s++)
+      ENSURE_EQUAL(ht_read->WhichRing(center, s), ht.WhichRing(center, s));
+  }
+  
+  //a truncated file is not loaded
+  std::string content;
+  {
+    std::ifstream ifs(path.c_str(), std::ios::binary);
+    content.assign((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+  }
+  {
+    std::ofstream ofs(path.c_str(), std::ios::binary | std::ios::trunc);
+    ofs.write(content.data(), content.size()-1);
+  }
+  ENSURE(! HiveTopology::Load(path));
+  std::remove(path.c_str());
+};
+
 #if SERIALIZATION_ENABLED
 TEST(StringRing_Serialize_raw_ptr){
   StringRings* ht_save = new StringRings(1);
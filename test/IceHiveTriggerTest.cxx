@@ -16,6 +16,9 @@
 #include <boost/make_shared.hpp>
 #include <boost/foreach.hpp>
 
+#include <chrono>
+#include <thread>
+
 #include "TestHelpers.h"
 #include "ToolZ/IC86Topology.h"
 
@@ -48,10 +51,7 @@ TEST(IceHiveTrigger) {
 
   IceHiveTrigger iht(ht_param_set);
   
-  I3DOMLaunchSeriesMap launchMap(GenerateDetectorNoiseDOMLaunches(10*I3Units::ms));
-  
-  typedef std::list<I3DOMLaunch_HitObject> I3DOMLaunch_HitObjectList;
-  I3DOMLaunch_HitObjectList hitobj = OMKeyMap_To_HitObjects<I3DOMLaunch, I3DOMLaunch_HitObjectList>(launchMap);
+  const I3DOMLaunch_HitObjectList hitobj = GenerateDetectorNoiseLaunchObjects(10*I3Units::ms);
   
   BOOST_FOREACH(const I3DOMLaunch_HitObject& ho, hitobj)
     iht.Feed(ho.GetOMKey(), ho.GetResponseObj(), ho.GetDAQTicks());
@@ -61,3 +61,178 @@ TEST(IceHiveTrigger) {
   
   iht.GetTriggers();
 };
+
+///the launches of 1ms of detector noise, which the tests feed; generated once, when first asked for
+const I3DOMLaunch_HitObjectList& NoiseLaunches() {
+  static const I3DOMLaunch_HitObjectList noiseLaunches = GenerateDetectorNoiseLaunchObjects(1*I3Units::ms);
+  return noiseLaunches;
+};
+
+///trigger on hits which are all connected to each other; accept at once, reject for a microsecond
+HiveTrigger_ParameterSet ConnectAllTriggerParameterSet() {
+  HiveTrigger_ParameterSet ht_param_set;
+  ht_param_set.acceptTimeWindow = 0.;
+  ht_param_set.rejectTimeWindow = 1000.;
+  ht_param_set.connectorBlock = ConnectAllConnectorBlock(hashedGeo);
+  return ht_param_set;
+};
+
+///clean on the same connections as the trigger, with hits within this residual of each other being partners
+HiveCleaning_ParameterSet ConnectAllCleaningParameterSet(const double max_tresidual) {
+  HiveCleaning_ParameterSet hc_param_set;
+  hc_param_set.max_tresidual_early = -max_tresidual;
+  hc_param_set.max_tresidual_late = max_tresidual;
+  hc_param_set.connectorBlock = ConnectAllConnectorBlock(hashedGeo);
+  return hc_param_set;
+};
+
+/** feed the launches one by one, and advance time to the end of time thereafter
+ * @param advanceEvery advance time to the latest launch every this many launches; 0 for never
+ * @return the time finalized until after each advance
+ */
+std::vector<DAQTicks> FeedLaunches(
+  IceHiveTrigger& iht,
+  const I3DOMLaunch_HitObjectList& hitobj,
+  const size_t advanceEvery=0)
+{
+  std::vector<DAQTicks> finalized;
+  size_t n=0;
+  BOOST_FOREACH(const I3DOMLaunch_HitObject& ho, hitobj) {
+    iht.Feed(ho.GetOMKey(), ho.GetResponseObj(), ho.GetDAQTicks());
+    if (advanceEvery && ++n%advanceEvery==0) {
+      iht.AdvanceUntil(ho.GetDAQTicks());
+      if (iht.IsPipelined())
+        iht.SyncPipeline();
+      finalized.push_back(iht.FinalizedUntil());
+    }
+  }
+  iht.AdvanceUntil(std::numeric_limits<DAQTicks>::max());
+  finalized.push_back(iht.FinalizedUntil());
+  return finalized;
+};
+
+TEST(EatBatch_Equals_Feed) {
+  //the same launches, once one by one, once in blocks; time advances by itself in the middle of blocks
+  IceHiveTrigger iht(ConnectAllTriggerParameterSet());
+  IceHiveTrigger ihtBatch(ConnectAllTriggerParameterSet());
+  iht.SetAutoAdvance(100000, 10000);
+  ihtBatch.SetAutoAdvance(100000, 10000);
+  FeedLaunches(iht, NoiseLaunches());
+  IceHiveTrigger::LaunchBlock block;
+  BOOST_FOREACH(const I3DOMLaunch_HitObject& ho, NoiseLaunches()) {
+    block.push_back(IceHiveTrigger::LaunchTime(ho.GetOMKey(), ho.GetDAQTicks()));
+    if (block.size()==100) {
+      ihtBatch.EatBatch(block);
+      block.clear();
+    }
+  }
+  ihtBatch.EatBatch(block);
+  ihtBatch.AdvanceUntil(std::numeric_limits<DAQTicks>::max());
+
+  ENSURE_EQUAL(ihtBatch.FinalizedUntil(), iht.FinalizedUntil());
+  ENSURE(ihtBatch.GetTriggers()==iht.GetTriggers(), "Same triggers");
+};
+
+TEST(Pipelined_Equals_Serial) {
+  //the same launches, once on one thread, once pipelined through small rings; time is advanced every so often
+  IceHiveTrigger iht(ConnectAllTriggerParameterSet());
+  IceHiveTrigger ihtPipelined(ConnectAllTriggerParameterSet());
+  ihtPipelined.StartPipeline(64);
+  ENSURE(ihtPipelined.IsPipelined());
+  const std::vector<DAQTicks> finalized = FeedLaunches(iht, NoiseLaunches(), 500);
+  ENSURE(FeedLaunches(ihtPipelined, NoiseLaunches(), 500)==finalized, "Finalized as far after each advance");
+  ENSURE(ihtPipelined.GetTriggers()==iht.GetTriggers(), "Same triggers");
+};
+
+TEST(Pipelined_Throughput) {
+  const I3DOMLaunch_HitObjectList hitobj = GenerateDetectorNoiseLaunchObjects(10*I3Units::ms);
+
+  //the same launches, once on one thread, once pipelined; time is advanced every microsecond,
+  // which the pipeline must take without waiting for its stages each time
+  IceHiveTrigger iht(ConnectAllTriggerParameterSet());
+  IceHiveTrigger ihtPipelined(ConnectAllTriggerParameterSet());
+  iht.SetAutoAdvance(10000, 10000);
+  ihtPipelined.SetAutoAdvance(10000, 10000);
+  ihtPipelined.StartPipeline(1024);
+
+  const std::chrono::steady_clock::time_point startSerial = std::chrono::steady_clock::now();
+  FeedLaunches(iht, hitobj);
+  const double serialMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now()-startSerial).count();
+  const std::chrono::steady_clock::time_point startPipelined = std::chrono::steady_clock::now();
+  FeedLaunches(ihtPipelined, hitobj);
+  const double pipelinedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now()-startPipelined).count();
+
+  std::cout<<hitobj.size()<<" launches: serial "<<serialMs<<" ms, pipelined "<<pipelinedMs<<" ms"<<std::endl;
+  ENSURE(ihtPipelined.GetTriggers()==iht.GetTriggers(), "Same triggers");
+  //the stages need a core each, else the pipeline only adds handover cost
+  if (std::thread::hardware_concurrency()>=3)
+    ENSURE(pipelinedMs<1.5*serialMs, "Frequent advances do not stall the pipeline");
+};
+
+TEST(AutoAdvance_Follows_Watermark) {
+  //advance every 10us, trailing the latest hit by 1us
+  IceHiveTrigger iht(ConnectAllTriggerParameterSet());
+  iht.SetAutoAdvance(100000, 10000);
+  DAQTicks latest = std::numeric_limits<DAQTicks>::min();
+  BOOST_FOREACH(const I3DOMLaunch_HitObject& ho, NoiseLaunches()) {
+    iht.Feed(ho.GetOMKey(), ho.GetResponseObj(), ho.GetDAQTicks());
+    latest = std::max(latest, ho.GetDAQTicks());
+  }
+  ENSURE_EQUAL(iht.Watermark(), latest-10000);
+  ENSURE(iht.FinalizedUntil()>std::numeric_limits<DAQTicks>::min(), "Time has advanced without being asked to");
+  ENSURE(iht.GetTriggers().size()>0, "Triggers are out without being asked for");
+};
+
+TEST(Padded_Triggers_Not_Split) {
+  //the same launches, once with time advanced every so often, once all at the end
+  IceHiveTrigger iht(ConnectAllTriggerParameterSet());
+  IceHiveTrigger ihtOnce(ConnectAllTriggerParameterSet());
+  iht.SetReadoutPadding(1000, 5000);
+  ihtOnce.SetReadoutPadding(1000, 5000);
+  FeedLaunches(iht, NoiseLaunches(), 100);
+  FeedLaunches(ihtOnce, NoiseLaunches());
+  ENSURE(iht.GetTriggers()==ihtOnce.GetTriggers(), "Advancing in steps does not split triggers");
+};
+
+TEST(Cleaning_First) {
+  //the same launches, once cleaned first, once not; in a window this wide every noise hit finds a partner,
+  // so nothing is cleaned away; no subevent holds more hits than there are
+  IceHiveTrigger iht(ConnectAllTriggerParameterSet(), 2);
+  IceHiveTrigger ihtCleaned(ConnectAllTriggerParameterSet(), ConnectAllCleaningParameterSet(10000.), 2);
+  IceHiveTrigger ihtTooSmall(ConnectAllTriggerParameterSet(), NoiseLaunches().size()+1);
+  FeedLaunches(iht, NoiseLaunches());
+  FeedLaunches(ihtCleaned, NoiseLaunches());
+  FeedLaunches(ihtTooSmall, NoiseLaunches());
+  ENSURE_EQUAL(ihtCleaned.FinalizedUntil(), std::numeric_limits<DAQTicks>::max(), "The cleaning holds back nothing at the end of time");
+  ENSURE(ihtCleaned.GetTriggers()==iht.GetTriggers(), "Cleaning which keeps every hit changes no trigger");
+  ENSURE(ihtTooSmall.GetTriggers().size()==0, "Subevents smaller than the minimal event size are no triggers");
+};
+
+TEST(Late_Hits_Dropped) {
+  const I3DOMLaunch_HitObject& first = NoiseLaunches().front();
+
+  //the same launches, once without, once with the first one repeated after time has been advanced beyond it;
+  // the cleaning would refuse it, so it must never get there
+  IceHiveTrigger iht(ConnectAllTriggerParameterSet(), ConnectAllCleaningParameterSet(1000.));
+  IceHiveTrigger ihtLate(ConnectAllTriggerParameterSet(), ConnectAllCleaningParameterSet(1000.));
+  IceHiveTrigger ihtPipelined(ConnectAllTriggerParameterSet(), ConnectAllCleaningParameterSet(1000.));
+  ihtPipelined.StartPipeline(64);
+  FeedLaunches(iht, NoiseLaunches(), NoiseLaunches().size()/2);
+  size_t n=0;
+  BOOST_FOREACH(const I3DOMLaunch_HitObject& ho, NoiseLaunches()) {
+    ihtLate.Feed(ho.GetOMKey(), ho.GetResponseObj(), ho.GetDAQTicks());
+    ihtPipelined.Feed(ho.GetOMKey(), ho.GetResponseObj(), ho.GetDAQTicks());
+    if (++n==NoiseLaunches().size()/2) {
+      ihtLate.AdvanceUntil(ho.GetDAQTicks());
+      ihtPipelined.AdvanceUntil(ho.GetDAQTicks());
+      ihtLate.Feed(first.GetOMKey(), first.GetResponseObj(), first.GetDAQTicks());
+      ihtLate.EatBatch(IceHiveTrigger::LaunchBlock(1, IceHiveTrigger::LaunchTime(first.GetOMKey(), first.GetDAQTicks())));
+      ihtPipelined.Feed(first.GetOMKey(), first.GetResponseObj(), first.GetDAQTicks());
+    }
+  }
+  ihtLate.AdvanceUntil(std::numeric_limits<DAQTicks>::max());
+  ihtPipelined.AdvanceUntil(std::numeric_limits<DAQTicks>::max());
+  ENSURE_EQUAL(ihtLate.FinalizedUntil(), iht.FinalizedUntil());
+  ENSURE_EQUAL(ihtPipelined.FinalizedUntil(), iht.FinalizedUntil(), "The late hit has not failed the pipeline");
+  ENSURE(ihtLate.GetTriggers()==iht.GetTriggers(), "Late hits are dropped");
+};
@@ -0,0 +1,94 @@
+/**
+ * \file ProfilerTest.cxx
+ *
+ * (c) 2013 the IceCube Collaboration
+ *
+ * $Id: ProfilerTest.cxx 148312 2016-07-11 17:41:28Z mzoll $
+ * \version $Revision: 148312 $
+ * \date $Date: 2016-07-11 19:41:28 +0200 (mån, 11 jul 2016) $
+ * \author mzoll <marcel.zoll@fysik.su.se>
+ *
+ * Unit test to test the latency histograms and the sampling of the profiler
+ */
+
+#include <I3Test.h>
+
+#include "IceHiveZ/internals/Profiler.h"
+
+#include <cmath>
+#include <limits>
+
+TEST_GROUP(Profiler);
+
+TEST(LatencyHistogram_Quantiles) {
+  //every value falls in a bucket which starts at or below it and ends above it
+  for (uint64_t v=0; v<100000; v+=7) {
+    const size_t b = LatencyHistogram::BucketOf(v);
+    ENSURE(b<LatencyHistogram::nBuckets);
+    ENSURE(LatencyHistogram::LowerEdge(b)<=v);
+    ENSURE(v-LatencyHistogram::LowerEdge(b)<LatencyHistogram::Width(b));
+  }
+  ENSURE_EQUAL(LatencyHistogram::BucketOf(std::numeric_limits<uint64_t>::max()), LatencyHistogram::nBuckets-1);
+
+  LatencyHistogram histogram;
+  ENSURE_EQUAL(histogram.Quantile(0.5), 0u, "Nothing to tell if empty");
+  //small values are held exactly
+  for (uint64_t v=1; v<=4; v++)
+    histogram.Add(v);
+  ENSURE_EQUAL(histogram.Quantile(0.5), 2u);
+  ENSURE_EQUAL(histogram.Quantile(1.), 4u);
+  histogram.Reset();
+
+  //a tail of 1 in 1000 far beyond the bulk
+  for (uint64_t i=0; i<100000; i++)
+    histogram.Add((i%1000==0) ? 1000000 : 100+i%100);
+  ENSURE_EQUAL(histogram.Count(), 100000u);
+  ENSURE_EQUAL(histogram.Max(), 1000000u);
+  const double resolution = 1./(1<<LatencyHistogram::subBits);
+  ENSURE(std::abs(double(histogram.Quantile(0.5))-150.)<=150.*resolution, "Median of the bulk");
+  ENSURE(histogram.Quantile(0.99)<=200.*(1.+resolution), "p99 is in the bulk");
+  ENSURE(std::abs(double(histogram.Quantile(0.9995))-1e6)<=1e6*resolution, "p9995 is in the tail");
+
+  LatencyHistogram other;
+  other.Add(5000000);
+  histogram.Merge(other);
+  ENSURE_EQUAL(histogram.Count(), 100001u);
+  ENSURE_EQUAL(histogram.Max(), 5000000u);
+};
+
+TEST(SamplingProfiler_Samples) {
+  std::vector<std::string> names;
+  names.push_back("Fast");
+  names.push_back("Slow");
+  SamplingProfiler profiler(names, 50);
+  ENSURE_EQUAL(profiler.GetSampleInterval(), 64u, "Rounded up to a power of two");
+
+  for (size_t i=0; i<640; i++) {
+    if (profiler.Sample(0))
+      profiler.Record(0, 10);
+    if (i%2==0 && profiler.Sample(1))
+      profiler.Record(1, 1000);
+  }
+  ENSURE_EQUAL(profiler.GetCalls(0), 640u);
+  ENSURE_EQUAL(profiler.GetHistogram(0).Count(), 10u, "Every 64th call is sampled");
+  ENSURE_EQUAL(profiler.GetCalls(1), 320u);
+  ENSURE_EQUAL(profiler.GetHistogram(1).Count(), 5u, "Stages are sampled on their own calls");
+  ENSURE(profiler.NsPerCycle()>0.);
+
+  const std::string report = profiler.Report();
+  ENSURE(report.find("Fast: 640 calls, 10 sampled")!=std::string::npos);
+  ENSURE(report.find("Slow: 320 calls, 5 sampled")!=std::string::npos);
+  ENSURE(report.find("p999")!=std::string::npos);
+
+  profiler.SetSampleInterval(0);
+  ENSURE_EQUAL(profiler.GetSampleInterval(), 0u);
+  ENSURE(!profiler.Sample(0), "Nothing is sampled if disabled");
+
+  profiler.Reset();
+  ENSURE_EQUAL(profiler.GetCalls(0), 0u);
+  ENSURE_EQUAL(profiler.GetHistogram(1).Count(), 0u);
+
+  //the cycle counter does not run backwards
+  const uint64_t before = ReadCycleCounter();
+  ENSURE(ReadCycleCounter()>=before);
+};
@@ -13,6 +13,13 @@
 
 #include <I3Test.h>
 
+#include <cmath>
+#include <vector>
+#include <sstream>
+#include <fstream>
+#include <cstdio>
+#include <boost/foreach.hpp>
+
 #include "IceHiveZ/internals/Relation.h"
 
 #include "ToolZ/IC86Topology.h"
@@ -78,6 +85,438 @@ TEST(SetAndGet) {
 }
 
 
+//make a struct that evaluates true for OMs with close by OM numbers
+struct CloseOMs {
+  bool operator() (const OMKey& omkey_A, const OMKey& omkey_B) const 
+    {return (std::abs(int(omkey_A.GetOM())-int(omkey_B.GetOM()))<=2);};
+};
+
+TEST(Sparse_Equals_Dense) {
+  CloseOMs cos;
+  Relation rel_dense(hashService, cos, Relation::DENSE);
+  Relation rel_sparse(hashService, cos, Relation::SPARSE);
+  ENSURE_EQUAL(rel_dense.GetStorageType(), Relation::DENSE);
+  ENSURE_EQUAL(rel_sparse.GetStorageType(), Relation::SPARSE);
+  ENSURE_EQUAL(rel_dense.NumberOfRelated(), rel_sparse.NumberOfRelated());
+  
+  for (uint64_t i=0; i<hashService->HashSize(); i++) {
+    for (uint64_t j=0; j<hashService->HashSize(); j++) {
+      ENSURE_EQUAL(rel_sparse.AreRelated(i, j), rel_dense.AreRelated(i, j));
+    }
+  }
+  
+  //convert back and forth
+  rel_sparse.ConvertStorage(Relation::DENSE);
+  rel_dense.ConvertStorage(Relation::SPARSE);
+  for (uint64_t i=0; i<hashService->HashSize(); i++) {
+    for (uint64_t j=0; j<hashService->HashSize(); j++) {
+      ENSURE_EQUAL(rel_sparse.AreRelated(i, j), cos(hashService->OMKeyFromHash(i), hashService->OMKeyFromHash(j)));
+      ENSURE_EQUAL(rel_dense.AreRelated(i, j), cos(hashService->OMKeyFromHash(i), hashService->OMKeyFromHash(j)));
+    }
+  }
+};
+
+TEST(Bulk_Fill) {
+  const CompactHash size = hashService->HashSize();
+  const Relation::StorageType storages[] = {Relation::DENSE, Relation::SPARSE};
+  BOOST_FOREACH(const Relation::StorageType storage, storages) {
+    Relation rel(hashService, false, storage);
+    rel.SetAllRelated();
+    ENSURE_EQUAL(rel.NumberOfRelated(), size_t(size*size));
+    ENSURE(rel.AreRelated(0, size-1));
+    
+    rel.SetRowRelated(3, false);
+    ENSURE_EQUAL(rel.NumberOfRelated(), size_t(size*size-size));
+    ENSURE(! rel.AreRelated(3, 7));
+    ENSURE(rel.AreRelated(7, 3));
+    
+    rel.SetNoneRelated();
+    ENSURE_EQUAL(rel.NumberOfRelated(), 0u);
+    rel.SetRowRelated(5, true);
+    ENSURE_EQUAL(rel.NumberOfRelated(), size_t(size));
+    ENSURE(rel.AreRelated(5, size-1));
+    ENSURE(! rel.AreRelated(4, 5));
+  }
+  
+  //payload of the edges which are kept is kept
+  Relation rel(hashService, CloseOMs(), Relation::SPARSE);
+  rel.EnablePayload(Relation::DISTANCE);
+  rel.SetEdge(5, 6, RelationEdge(1.5));
+  rel.SetEdge(6, 5, RelationEdge(2.5));
+  rel.SetRowRelated(5, true);
+  ENSURE_EQUAL(rel.GetEdge(5, 6).distance, 1.5f);
+  ENSURE(std::isnan(rel.GetEdge(5, 50).distance));
+  ENSURE_EQUAL(rel.GetEdge(6, 5).distance, 2.5f);
+  rel.SetRowRelated(5, false);
+  ENSURE_EQUAL(rel.GetEdge(6, 5).distance, 2.5f);
+};
+
+//the rows of CloseOMs, handed out in descending order
+struct CloseOMRows {
+  CloseOMs cos_;
+  void operator() (const CompactHash a, std::vector<CompactHash>& related) const {
+    for (CompactHash b=hashService->HashSize(); b-->0;) {
+      if (cos_(hashService->OMKeyFromHash(a), hashService->OMKeyFromHash(b)))
+        related.push_back(b);
+    }
+  };
+};
+
+TEST(Predicate_Rows_Threads) {
+  CloseOMs cos;
+  const Relation reference(hashService, cos, Relation::DENSE);
+  const Relation::StorageType storages[] = {Relation::DENSE, Relation::SPARSE};
+  const unsigned threads[] = {1, 3, 0};
+  BOOST_FOREACH(const Relation::StorageType storage, storages) {
+    BOOST_FOREACH(const unsigned n_threads, threads) {
+      Relation rel(hashService, true, storage);
+      rel.PredicateRelated(cos, n_threads);
+      Relation rel_rows(hashService, false, storage);
+      rel_rows.PredicateRelatedRows(CloseOMRows(), n_threads);
+      ENSURE_EQUAL(rel.NumberOfRelated(), reference.NumberOfRelated());
+      ENSURE_EQUAL(rel_rows.NumberOfRelated(), reference.NumberOfRelated());
+      for (CompactHash i=0; i<hashService->HashSize(); i++) {
+        for (CompactHash j=0; j<hashService->HashSize(); j++) {
+          ENSURE_EQUAL(rel.AreRelated(i, j), reference.AreRelated(i, j));
+          ENSURE_EQUAL(rel_rows.AreRelated(i, j), reference.AreRelated(i, j));
+        }
+      }
+    }
+  }
+};
+
+TEST(Predicate_While_Disabled) {
+  CloseOMs cos;
+  const Relation reference(hashService, cos, Relation::DENSE);
+  std::vector<CompactHash> disabled;
+  disabled.push_back(3);
+  disabled.push_back(4);
+  const Relation::StorageType storages[] = {Relation::DENSE, Relation::SPARSE};
+  BOOST_FOREACH(const Relation::StorageType storage, storages) {
+    //refilled while some DOMs are disabled, the relations of these are held aside
+    Relation rel(hashService, true, storage);
+    rel.DisableDOMs(disabled);
+    rel.PredicateRelated(cos, 3);
+    Relation rel_rows(hashService, true, storage);
+    rel_rows.DisableDOMs(disabled);
+    rel_rows.PredicateRelatedRows(CloseOMRows(), 3);
+    ENSURE_EQUAL(rel.NumberOfDisabledDOMs(), 2u);
+    for (CompactHash i=0; i<hashService->HashSize(); i++) {
+      for (CompactHash j=0; j<hashService->HashSize(); j++) {
+        const bool masked = (i==3 || i==4 || j==3 || j==4);
+        ENSURE_EQUAL(rel.AreRelated(i, j), reference.AreRelated(i, j) && !masked);
+        ENSURE_EQUAL(rel_rows.AreRelated(i, j), reference.AreRelated(i, j) && !masked);
+      }
+    }
+    
+    //enabled again, they hold the relations of the new fill
+    rel.EnableDOMs(disabled);
+    rel_rows.EnableDOMs(disabled);
+    ENSURE_EQUAL(rel.NumberOfRelated(), reference.NumberOfRelated());
+    ENSURE_EQUAL(rel_rows.NumberOfRelated(), reference.NumberOfRelated());
+    for (CompactHash i=0; i<hashService->HashSize(); i++) {
+      for (CompactHash j=0; j<hashService->HashSize(); j++) {
+        ENSURE_EQUAL(rel.AreRelated(i, j), reference.AreRelated(i, j));
+        ENSURE_EQUAL(rel_rows.AreRelated(i, j), reference.AreRelated(i, j));
+      }
+    }
+  }
+};
+
+//collect the indices which are passed
+struct Collect {
+  std::vector<CompactHash>& c_;
+  Collect(std::vector<CompactHash>& c) : c_(c) {};
+  void operator() (const CompactHash b) {c_.push_back(b);};
+};
+
+TEST(Iterate_Related) {
+  CloseOMs cos;
+  const Relation rel_dense(hashService, cos, Relation::DENSE);
+  const Relation rel_sparse(hashService, cos, Relation::SPARSE);
+  
+  for (uint64_t i=0; i<hashService->HashSize(); i++) {
+    std::vector<CompactHash> expected;
+    for (uint64_t j=0; j<hashService->HashSize(); j++) {
+      if (cos(hashService->OMKeyFromHash(i), hashService->OMKeyFromHash(j)))
+        expected.push_back(j);
+    }
+    
+    std::vector<CompactHash> dense_each, sparse_each;
+    rel_dense.ForEachRelated(i, Collect(dense_each));
+    rel_sparse.ForEachRelated(i, Collect(sparse_each));
+    ENSURE(dense_each==expected);
+    ENSURE(sparse_each==expected);
+    
+    std::vector<CompactHash> dense_span, sparse_span;
+    BOOST_FOREACH(const CompactHash b, rel_dense.RelatedSpan(i))
+      dense_span.push_back(b);
+    BOOST_FOREACH(const CompactHash b, rel_sparse.RelatedSpan(i))
+      sparse_span.push_back(b);
+    ENSURE(dense_span==expected);
+    ENSURE(sparse_span==expected);
+  }
+};
+
+TEST(Sparse_SetAndGet) {
+  Relation rel(hashService, false, Relation::SPARSE);
+  const CompactHash maxHash = hashService->HashSize()-1;
+  
+  rel.SetRelated(0, maxHash, true);
+  rel.SetRelated(maxHash, 0, true);
+  rel.SetRelated(0, 1, true);
+  ENSURE_EQUAL(rel.NumberOfRelated(), (size_t)3);
+  ENSURE_EQUAL(rel.AreRelated(0, maxHash), true);
+  ENSURE_EQUAL(rel.AreRelated(maxHash, 0), true);
+  ENSURE_EQUAL(rel.AreRelated(0, 1), true);
+  ENSURE_EQUAL(rel.AreRelated(1, 0), false);
+  
+  rel.SetRelated(0, maxHash, false);
+  ENSURE_EQUAL(rel.NumberOfRelated(), (size_t)2);
+  ENSURE_EQUAL(rel.AreRelated(0, maxHash), false);
+  ENSURE_EQUAL(rel.AreRelated(maxHash, 0), true);
+};
+
+TEST(Join_Intersect_Mixed) {
+  CloseOMs cos;
+  Relation rel_dense(hashService, cos, Relation::DENSE);
+  Relation rel_sparse(hashService, cos, Relation::SPARSE);
+  
+  Relation rel_diag(hashService, false, Relation::SPARSE);
+  for (uint64_t i=0; i<hashService->HashSize(); i++)
+    rel_diag.SetRelated(i, (i+10)%hashService->HashSize(), true);
+  
+  rel_dense.Join(rel_diag);
+  rel_sparse.Join(rel_diag);
+  for (uint64_t i=0; i<hashService->HashSize(); i++) {
+    for (uint64_t j=0; j<hashService->HashSize(); j++) {
+      const bool expected = cos(hashService->OMKeyFromHash(i), hashService->OMKeyFromHash(j)) || j==(i+10)%hashService->HashSize();
+      ENSURE_EQUAL(rel_dense.AreRelated(i, j), expected);
+      ENSURE_EQUAL(rel_sparse.AreRelated(i, j), expected);
+    }
+  }
+  
+  rel_dense.Intersect(rel_diag);
+  rel_sparse.Intersect(rel_diag);
+  ENSURE_EQUAL(rel_dense.NumberOfRelated(), hashService->HashSize());
+  ENSURE_EQUAL(rel_sparse.NumberOfRelated(), hashService->HashSize());
+};
+
+
+TEST(Edge_Payload) {
+  CloseOMs cos;
+  Relation rel_dense(hashService, cos, Relation::DENSE);
+  Relation rel_sparse(hashService, cos, Relation::SPARSE);
+  ENSURE_EQUAL(rel_sparse.HasPayload(), false);
+  
+  rel_dense.EnablePayload(Relation::GEOMETRY);
+  rel_sparse.EnablePayload(Relation::GEOMETRY);
+  ENSURE_EQUAL(rel_sparse.GetPayloadType(), Relation::GEOMETRY);
+  
+  //mark every edge by its indices
+  for (uint64_t i=0; i<hashService->HashSize(); i++) {
+    BOOST_FOREACH(const CompactHash j, rel_sparse.RelatedSpan(i)) {
+      rel_dense.SetEdge(i, j, RelationEdge(i*1000+j, float(j)-float(i), 1));
+      rel_sparse.SetEdge(i, j, RelationEdge(i*1000+j, float(j)-float(i), 1));
+    }
+  }
+  
+  //insert a new relation in front of existing ones and remove one; the other edges have to keep their payload
+  rel_sparse.SetRelated(0, hashService->HashSize()-1, true);
+  rel_sparse.SetRelated(1, 0, false);
+  ENSURE(std::isnan(rel_sparse.GetEdge(0, hashService->HashSize()-1).distance));
+  ENSURE(std::isnan(rel_sparse.GetEdge(1, 0).distance));
+  rel_sparse.ConvertStorage(Relation::DENSE);
+  rel_dense.ConvertStorage(Relation::SPARSE);
+  
+  for (uint64_t i=0; i<hashService->HashSize(); i++) {
+    for (uint64_t j=0; j<hashService->HashSize(); j++) {
+      if (!cos(hashService->OMKeyFromHash(i), hashService->OMKeyFromHash(j)) || (i==1 && j==0))
+        continue;
+      const RelationEdge edge_s = rel_sparse.GetEdge(i, j);
+      const RelationEdge edge_d = rel_dense.GetEdge(i, j);
+      ENSURE_EQUAL(edge_s.distance, float(i*1000+j));
+      ENSURE_EQUAL(edge_d.distance, float(i*1000+j));
+      ENSURE_EQUAL(edge_d.dz, float(j)-float(i));
+      ENSURE_EQUAL(edge_d.ring, 1);
+      double dr;
+      ENSURE(rel_dense.RelatedDistance(i, j, dr));
+      ENSURE_EQUAL(dr, double(i*1000+j));
+    }
+  }
+  
+  //no edge for unrelated DOMs
+  double dr;
+  ENSURE(!rel_sparse.RelatedDistance(1, 0, dr));
+  ENSURE(std::isnan(rel_sparse.GetEdge(1, 0).distance));
+};
+
+TEST(Binary_Roundtrip) {
+  CloseOMs cos;
+  const Relation::StorageType storages[] = {Relation::DENSE, Relation::SPARSE};
+  BOOST_FOREACH(const Relation::StorageType storage, storages) {
+    Relation rel(hashService, cos, storage);
+    rel.EnablePayload(Relation::GEOMETRY);
+    for (uint64_t i=0; i<hashService->HashSize(); i++) {
+      BOOST_FOREACH(const CompactHash j, rel.RelatedSpan(i))
+        rel.SetEdge(i, j, RelationEdge(i*1000+j, float(j)-float(i), j%3));
+    }
+    
+    std::stringstream ss;
+    binaryio::BinaryWriter writer(ss);
+    rel.WriteBinary(writer);
+    binaryio::BinaryReader reader(ss);
+    const RelationPtr rel_read = Relation::ReadBinary(reader, hashService);
+    ENSURE(reader.Good());
+    ENSURE_EQUAL(reader.Checksum(), writer.Checksum());
+    ENSURE(bool(rel_read));
+    ENSURE_EQUAL(rel_read->GetStorageType(), storage);
+    ENSURE_EQUAL(rel_read->GetPayloadType(), Relation::GEOMETRY);
+    
+    for (uint64_t i=0; i<hashService->HashSize(); i++) {
+      for (uint64_t j=0; j<hashService->HashSize(); j++) {
+        ENSURE_EQUAL(rel_read->AreRelated(i, j), rel.AreRelated(i, j));
+        if (!rel.AreRelated(i, j))
+          continue;
+        ENSURE_EQUAL(rel_read->GetEdge(i, j).distance, rel.GetEdge(i, j).distance);
+        ENSURE_EQUAL(rel_read->GetEdge(i, j).dz, rel.GetEdge(i, j).dz);
+        ENSURE_EQUAL(rel_read->GetEdge(i, j).ring, rel.GetEdge(i, j).ring);
+      }
+    }
+    
+    //a relation for a differently sized hasher is not accepted
+    std::stringstream ss_other(ss.str());
+    binaryio::BinaryReader reader_other(ss_other);
+    ENSURE(! Relation::ReadBinary(reader_other, DummyHashService(50)));
+    ENSURE(! reader_other.Good());
+  }
+};
+
+TEST(Save_Load) {
+  const std::string path = std::string(P_tmpdir)+"/relation_test.bin";
+  std::remove(path.c_str());
+  ENSURE(! Relation::Load(path, hashService), "No file written yet");
+  
+  Relation rel(hashService, CloseOMs(), Relation::SPARSE);
+  rel.EnablePayload(Relation::DISTANCE);
+  rel.SetEdge(5, 6, RelationEdge(1.5));
+  ENSURE(rel.Save(path));
+  const RelationPtr rel_read = Relation::Load(path, hashService);
+  ENSURE(bool(rel_read));
+  ENSURE_EQUAL(rel_read->NumberOfRelated(), rel.NumberOfRelated());
+  ENSURE_EQUAL(rel_read->GetEdge(5, 6).distance, 1.5f);
+  ENSURE(! Relation::Load(path, DummyHashService(50)), "The hasher has to fit");
+  
+  //a single flipped bit is caught by the checksum
+  std::string content;
+  {
+    std::ifstream ifs(path.c_str(), std::ios::binary);
+    content.assign((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+  }
+  content[content.size()-20] ^= 1;
+  {
+    std::ofstream ofs(path.c_str(), std::ios::binary | std::ios::trunc);
+    ofs.write(content.data(), content.size());
+  }
+  ENSURE(! Relation::Load(path, hashService), "Corrupt files are not loaded");
+  std::remove(path.c_str());
+};
+
+TEST(Save_Load_Disabled) {
+  const std::string path = std::string(P_tmpdir)+"/relation_disabled_test.bin";
+  Relation rel(hashService, CloseOMs(), Relation::SPARSE);
+  rel.EnablePayload(Relation::DISTANCE);
+  rel.SetEdge(5, 6, RelationEdge(1.5));
+  const Relation orig(rel);
+  rel.DisableDOMs(std::vector<CompactHash>(1, 5));
+  ENSURE(rel.Save(path));
+  const RelationPtr rel_read = Relation::Load(path, hashService);
+  std::remove(path.c_str());
+  ENSURE(bool(rel_read));
+  ENSURE_EQUAL(rel_read->NumberOfDisabledDOMs(), 1u, "The mask is kept");
+  ENSURE(! rel_read->AreRelated(5, 6));
+  
+  //the DOM can be enabled again after loading, with its edges as they were
+  rel_read->EnableDOMs(std::vector<CompactHash>(1, 5));
+  ENSURE_EQUAL(rel_read->NumberOfDisabledDOMs(), 0u);
+  ENSURE_EQUAL(rel_read->NumberOfRelated(), orig.NumberOfRelated());
+  ENSURE(rel_read->AreRelated(5, 6));
+  ENSURE_EQUAL(rel_read->GetEdge(5, 6).distance, 1.5f);
+};
+
+TEST(Disable_Enable_DOMs) {
+  CloseOMs cos;
+  const Relation::StorageType storages[] = {Relation::DENSE, Relation::SPARSE};
+  BOOST_FOREACH(const Relation::StorageType storage, storages) {
+    Relation rel(hashService, cos, storage);
+    rel.EnablePayload(Relation::DISTANCE);
+    for (uint64_t i=0; i<hashService->HashSize(); i++) {
+      BOOST_FOREACH(const CompactHash j, rel.RelatedSpan(i))
+        rel.SetEdge(i, j, RelationEdge(i*1000+j));
+    }
+    const Relation orig(rel);
+    
+    std::vector<CompactHash> first, second;
+    first.push_back(3);
+    first.push_back(4);
+    second.push_back(4);
+    second.push_back(5);
+    rel.DisableDOMs(first);
+    rel.DisableDOMs(second);
+    ENSURE_EQUAL(rel.NumberOfDisabledDOMs(), 3u);
+    ENSURE(! rel.IsDOMEnabled(4));
+    for (uint64_t i=0; i<hashService->HashSize(); i++) {
+      for (uint64_t j=0; j<hashService->HashSize(); j++) {
+        const bool masked = (i>=3 && i<=5) || (j>=3 && j<=5);
+        ENSURE_EQUAL(rel.AreRelated(i, j), orig.AreRelated(i, j) && !masked);
+        if (rel.AreRelated(i, j))
+          ENSURE_EQUAL(rel.GetEdge(i, j).distance, orig.GetEdge(i, j).distance);
+      }
+    }
+    
+    //enabling only some restores only the relations between enabled DOMs
+    rel.EnableDOMs(first);
+    ENSURE_EQUAL(rel.NumberOfDisabledDOMs(), 1u);
+    ENSURE(rel.AreRelated(3, 4) == orig.AreRelated(3, 4));
+    ENSURE(! rel.AreRelated(4, 5));
+    rel.EnableDOMs(second);
+    ENSURE_EQUAL(rel.NumberOfDisabledDOMs(), 0u);
+    ENSURE_EQUAL(rel.NumberOfRelated(), orig.NumberOfRelated());
+    for (uint64_t i=0; i<hashService->HashSize(); i++) {
+      for (uint64_t j=0; j<hashService->HashSize(); j++) {
+        ENSURE_EQUAL(rel.AreRelated(i, j), orig.AreRelated(i, j));
+        if (rel.AreRelated(i, j))
+          ENSURE_EQUAL(rel.GetEdge(i, j).distance, orig.GetEdge(i, j).distance);
+      }
+    }
+  }
+};
+
+TEST(Symmetric_Closure) {
+  CloseOMs cos;
+  ENSURE(Relation(hashService, cos, Relation::DENSE).IsSymmetric());
+  
+  for (int storage=Relation::DENSE; storage<=Relation::SPARSE; storage++) {
+    Relation rel(hashService, false, Relation::StorageType(storage));
+    for (uint64_t i=0; i+3<hashService->HashSize(); i++)
+      rel.SetRelated(i, i+3, true);
+    rel.SetRelated(5, 5, true);
+    ENSURE(!rel.IsSymmetric());
+    
+    const RelationPtr transposed = rel.Transposed();
+    const RelationPtr closure = rel.SymmetricClosure();
+    ENSURE_EQUAL(transposed->GetStorageType(), rel.GetStorageType());
+    ENSURE(closure->IsSymmetric());
+    ENSURE_EQUAL(closure->NumberOfRelated(), 2*rel.NumberOfRelated()-1);
+    for (uint64_t i=0; i<hashService->HashSize(); i++) {
+      for (uint64_t j=0; j<hashService->HashSize(); j++) {
+        ENSURE_EQUAL(transposed->AreRelated(i, j), rel.AreRelated(j, i));
+        ENSURE_EQUAL(closure->AreRelated(i, j), rel.AreRelated(i, j) || rel.AreRelated(j, i));
+      }
+    }
+  }
+};
+
 #if SERIALIZATION_ENABLED
 TEST(Serialize_raw_ptr){
   Relation* rel_save = new Relation(hashService, false);
@@ -93,4 +532,13 @@ TEST(Serialize_boost_shared_ptr){
   
   serialize_object(rel_save, rel_load);
 };
+
+TEST(Serialize_sparse){
+  RelationPtr rel_save= boost::make_shared<Relation>(hashService, CloseOMs(), Relation::SPARSE);
+  RelationPtr rel_load;
+  
+  serialize_object(rel_save, rel_load);
+  ENSURE_EQUAL(rel_load->GetStorageType(), Relation::SPARSE);
+  ENSURE_EQUAL(rel_load->NumberOfRelated(), rel_save->NumberOfRelated());
+};
 #endif //SERIALIZATION_ENABLED
@@ -0,0 +1,55 @@
+/**
+ * \file SPSCRingTest.cxx
+ *
+ * (c) 2013 the IceCube Collaboration
+ *
+ * $Id: SPSCRingTest.cxx 148312 2016-07-11 17:41:28Z mzoll $
+ * \version $Revision: 148312 $
+ * \date $Date: 2016-07-11 19:41:28 +0200 (mån, 11 jul 2016) $
+ * \author mzoll <marcel.zoll@fysik.su.se>
+ *
+ * Unit test to test the ring connecting a producing and a consuming thread
+ */
+
+#include <I3Test.h>
+
+#include "IceHiveZ/internals/SPSCRing.h"
+
+#include <thread>
+
+TEST_GROUP(SPSCRing);
+
+TEST(Bounded_FIFO) {
+  SPSCRing<int> ring(5);
+  ENSURE_EQUAL(ring.Capacity(), 8u, "Rounded up to a power of two");
+  ENSURE(ring.Empty());
+  int item;
+  ENSURE(!ring.TryPop(item), "Nothing to pop");
+  for (int i=0; i<8; i++)
+    ENSURE(ring.TryPush(i));
+  ENSURE(!ring.TryPush(8), "No space left");
+  for (int i=0; i<8; i++) {
+    ENSURE(ring.TryPop(item));
+    ENSURE_EQUAL(item, i, "First in, first out");
+  }
+  ENSURE(ring.Empty());
+};
+
+TEST(Across_Threads) {
+  //a small ring, so that both threads have to wait for each other over and over
+  SPSCRing<uint64_t> ring(16);
+  const uint64_t n_items = 1000000;
+  std::thread producer([&]() {
+    for (uint64_t i=0; i<n_items; i++)
+      ring.Push(i);
+  });
+  uint64_t n_in_order = 0;
+  for (uint64_t i=0; i<n_items; i++) {
+    uint64_t item;
+    ring.Pop(item);
+    n_in_order += (item==i);
+  }
+  producer.join();
+  ENSURE_EQUAL(n_in_order, n_items, "Every item arrives once and in order");
+  ENSURE(ring.Empty());
+};
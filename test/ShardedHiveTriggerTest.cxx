@@ -0,0 +1,98 @@
+/**
+ * \file ShardedHiveTriggerTest.cxx
+ *
+ * $Id: ShardedHiveTriggerTest.cxx 150050 2016-09-15 12:45:28Z mzoll $
+ * $Author: mzoll $
+ * $Date: 2016-09-15 14:45:28 +0200 (tor, 15 sep 2016) $
+ * $Revision: 150050 $
+ *
+ * A Unit test which triggers on artificial hits once with one HiveTrigger, once sharded over regions of the detector
+ */
+
+#include <I3Test.h>
+
+#include "IceHiveZ/algorithms/ShardedHiveTrigger.h"
+
+#include "ToolZ/IC86Topology.h"
+
+#include <boost/make_shared.hpp>
+#include <boost/foreach.hpp>
+
+#include "TestHelpers.h"
+
+using namespace std;
+using namespace hivetrigger;
+
+TEST_GROUP(ShardedHiveTrigger);
+
+const I3GeometryConstPtr geometry = boost::make_shared<I3Geometry>(IC86Topology::Build_IC86_Geometry());
+const HashedGeometryConstPtr hashedGeo = boost::make_shared<const HashedGeometry>(geometry->omgeo);
+
+///DOMs are related to the DOMs close by on the same and the neighbouring strings; symmetric
+struct CloseBy {
+  bool operator()(const OMKey& a, const OMKey& b) const
+    {return std::abs(a.GetString()-b.GetString())<=1 && std::abs(int(a.GetOM())-int(b.GetOM()))<=2 && !(a==b);};
+};
+
+TEST(Sharded_Equals_Single) {
+  const CompactOMKeyHashServiceConstPtr hasher = hashedGeo->GetHashService();
+  HiveTrigger_ParameterSet params;
+  params.multiplicity = 3;
+  params.multiplicityTimeWindow = 400.;
+  params.acceptTimeWindow = 0.;
+  params.rejectTimeWindow = 1000.;
+  params.connectorBlock = boost::make_shared<ConnectorBlock>(hashedGeo);
+  params.connectorBlock->AddConnector(boost::make_shared<Connector>("CloseBy",
+                                                                    hashedGeo,
+                                                                    boost::make_shared<DeltaTimeConnection>(hashedGeo, 300., 300.),
+                                                                    boost::make_shared<Relation>(hasher, CloseBy(), Relation::SPARSE)));
+
+  //regions of 10 strings each
+  std::vector<unsigned> coreRegion(hasher->HashSize());
+  for (CompactHash h=0; h<hasher->HashSize(); h++)
+    coreRegion[h] = (hasher->OMKeyFromHash(h).GetString()-1)/10;
+
+  ShardedHiveTrigger sharded(params, coreRegion, 1, 4);
+  ENSURE(sharded.NumberOfRegions()>=8);
+  const CompactHash border = hasher->HashFromOMKey(OMKey(10, 30));
+  ENSURE_EQUAL(sharded.GetRegions(border).size(), 2u, "A DOM on the border is seen by both regions");
+  ENSURE_EQUAL(sharded.GetRegions(border)[0], 0u, "The core region comes first");
+
+  //bursts of hits on neighbouring DOMs, some across the borders of the regions, and hits in between
+  const AbsDAQHitSet hits = GenerateBurstsAndNoise(hasher, 777, 60, 10, 10, 3, 4, 3000, 200000);
+  HiveTrigger single(params);
+  AbsDAQHitSetSequence expected;
+  AbsDAQHitSetSequence subEvents;
+  size_t n=0;
+  BOOST_FOREACH(const AbsDAQHit& h, hits) {
+    single.AddHit(h);
+    sharded.AddHit(h);
+    ENSURE(sharded.FinalizedUntil()<=h.GetDAQTicks(), "Nothing is final beyond a hit still buffered");
+    if (++n%100==0) {
+      single.AdvanceTime(h.GetDAQTicks());
+      sharded.AdvanceTime(h.GetDAQTicks());
+      const AbsDAQHitSetSequence out = sharded.PullSubEvents();
+      subEvents.insert(subEvents.end(), out.begin(), out.end());
+    }
+  }
+  ENSURE(subEvents.size()>0, "Subevents come out as time advances, not only at the end");
+  //well beyond the last hit every subevent is complete, without waiting for the end of time
+  const DAQTicks beyond = hits.rbegin()->GetDAQTicks()+1000000;
+  sharded.AdvanceTime(beyond);
+  ENSURE_EQUAL(sharded.FinalizedUntil(), beyond, "No region holds back complete subevents");
+  single.FinalizeSubEvents();
+  sharded.FinalizeSubEvents();
+  ENSURE_EQUAL(sharded.FinalizedUntil(), std::numeric_limits<DAQTicks>::max());
+  expected = single.PullSubEvents();
+  const AbsDAQHitSetSequence out = sharded.PullSubEvents();
+  subEvents.insert(subEvents.end(), out.begin(), out.end());
+  ENSURE(expected.size()>=40, "The bursts trigger");
+
+  //the same subevents, in the order of their first hit
+  std::vector<AbsDAQHitSet> e(expected.begin(), expected.end());
+  std::vector<AbsDAQHitSet> s(subEvents.begin(), subEvents.end());
+  std::sort(e.begin(), e.end());
+  ENSURE_EQUAL(s.size(), e.size(), "Same number of subevents");
+  std::sort(s.begin(), s.end());
+  ENSURE(s==e, "Same subevents");
+};
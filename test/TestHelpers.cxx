@@ -13,6 +13,8 @@
 
 #include "boost/make_shared.hpp"
 
+#include <algorithm>
+
 #include "ToolZ/OMKeyHash.h"
 #include "ToolZ/HitSorting.h"
 
@@ -196,6 +198,74 @@ I3DOMLaunchSeriesMap GenerateDetectorNoiseDOMLaunches(const double max_time_rang
   return recoMap;
 };
 
+I3DOMLaunch_HitObjectList GenerateDetectorNoiseLaunchObjects(const double max_time_range_ns) {
+  const I3DOMLaunchSeriesMap launchMap(GenerateDetectorNoiseDOMLaunches(max_time_range_ns));
+  return HitSorting::OMKeyMap_To_HitObjects<I3DOMLaunch, I3DOMLaunch_HitObjectList>(launchMap);
+};
+
+ConnectorBlockPtr ConnectAllConnectorBlock(const HashedGeometryConstPtr& hashedGeo) {
+  const ConnectorBlockPtr connectorBlock = boost::make_shared<ConnectorBlock>(hashedGeo);
+  connectorBlock->AddConnector(boost::make_shared<Connector>("ConnectAll",
+                                                             hashedGeo,
+                                                             boost::make_shared<BoolConnection>(hashedGeo, true),
+                                                             boost::make_shared<Relation>(hashedGeo->GetHashService(), true)));
+  return connectorBlock;
+};
+
+///advance the seed as a linear congruential generator
+static uint64_t NextRandom(uint64_t& seed) {
+  seed = seed*6364136223846793005ULL+1442695040888963407ULL;
+  return seed;
+};
+
+CompactHitSeries GenerateRandomHits(
+  const size_t n_hits,
+  const CompactHash n_doms,
+  const uint64_t n_steps,
+  const double stepsPerNs,
+  uint64_t seed,
+  const size_t equalTimeEvery)
+{
+  CompactHitSeries hits;
+  for (size_t n=0; n<n_hits; n++) {
+    NextRandom(seed);
+    const CompactHash dom = (seed>>33)%n_doms;
+    const double time = (equalTimeEvery && n && n%equalTimeEvery==0) ? hits.back().GetTime() : double((seed>>20)%n_steps)/stepsPerNs;
+    hits.push_back(CompactHit(dom, time));
+  }
+  std::sort(hits.begin(), hits.end());
+  return hits;
+};
+
+AbsDAQHitSet GenerateBurstsAndNoise(
+  const CompactOMKeyHashServiceConstPtr& hasher,
+  uint64_t seed,
+  const size_t n_bursts,
+  const size_t n_burstHits,
+  const size_t n_noiseHits,
+  const int n_burstStrings,
+  const unsigned n_burstOMs,
+  const int64_t burstDuration,
+  const int64_t burstSpacing)
+{
+  //bursts are on the strings up to 80, on the OMs from 20 on
+  AbsDAQHitSet hits;
+  for (size_t burst=0; burst<n_bursts; burst++) {
+    const int64_t t0 = burst*burstSpacing;
+    const int string = 1+(NextRandom(seed)>>33)%(81-n_burstStrings);
+    for (size_t n=0; n<n_burstHits; n++) {
+      NextRandom(seed);
+      const OMKey omkey(string+(seed>>40)%n_burstStrings, 20+(seed>>33)%n_burstOMs);
+      hits.insert(AbsDAQHit(hasher->HashFromOMKey(omkey), t0+int64_t((seed>>20)%burstDuration)));
+    }
+    for (size_t n=0; n<n_noiseHits; n++) {
+      NextRandom(seed);
+      hits.insert(AbsDAQHit((seed>>33)%hasher->HashSize(), t0+int64_t((seed>>20)%burstSpacing)));
+    }
+  }
+  return hits;
+};
+
 
 //create some (global) objects which are used in all the hashings
 // I3GeometryConstPtr geo = boost::make_shared<const I3Geometry>(IC86Topology::Build_IC86_Geometry());
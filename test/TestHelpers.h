@@ -18,6 +18,12 @@
 
 #include "IceHiveZ/__SERIALIZATION.h"
 
+#include <list>
+
+#include "ToolZ/HitSorting.h"
+#include "IceHiveZ/internals/Connector.h"
+#include "IceHiveZ/internals/CompactHits.h"
+
 ///directly init all relevant fields of a I3RecoPulse
 I3RecoPulse MakeRecoPulse (const double t, const double c, const double w=1., const uint8_t flags=0);
 
@@ -36,6 +42,55 @@ I3DOMLaunchSeriesMap GenerateTestDOMLaunches();
 ///generate a number of RecoPulses in a I3RecoPulseSeriesMap of detector Noise
 I3DOMLaunchSeriesMap GenerateDetectorNoiseDOMLaunches(const double max_time_range);
 
+///a list of DOMLaunches as hit objects, in the order they are fed to a trigger
+typedef std::list<HitSorting::I3DOMLaunch_HitObject> I3DOMLaunch_HitObjectList;
+
+///generate DOMLaunches of detector Noise as hit objects
+I3DOMLaunch_HitObjectList GenerateDetectorNoiseLaunchObjects(const double max_time_range);
+
+///a ConnectorBlock which connects all hits to each other
+ConnectorBlockPtr ConnectAllConnectorBlock(const HashedGeometryConstPtr& hashedGeo);
+
+/** generate hits on the lowest DOM indices at random times on a grid, sorted in time;
+ * the same seed gives the same hits on every platform
+ * @param n_hits this many hits are generated, some of them can be duplicates
+ * @param n_doms the hits are on the DOM indices below this
+ * @param n_steps the times are on this many steps of the grid, from 0 on
+ * @param stepsPerNs the grid has this many steps to the nanosecond
+ * @param seed the seed of the pseudo random numbers
+ * @param equalTimeEvery every this many hits one is at the time of the hit before; 0 for none
+ */
+CompactHitSeries GenerateRandomHits(
+  const size_t n_hits,
+  const CompactHash n_doms,
+  const uint64_t n_steps,
+  const double stepsPerNs,
+  const uint64_t seed,
+  const size_t equalTimeEvery=0);
+
+/** generate bursts of hits on neighbouring DOMs, one burst every burst spacing, and noise hits on any DOM in between;
+ * the same seed gives the same hits on every platform
+ * @param hasher the hash service of the detector
+ * @param seed the seed of the pseudo random numbers
+ * @param n_bursts this many bursts are generated
+ * @param n_burstHits the number of hits in each burst
+ * @param n_noiseHits the number of noise hits following each burst
+ * @param n_burstStrings a burst covers this many neighbouring strings
+ * @param n_burstOMs a burst covers this many neighbouring OMs of each string
+ * @param burstDuration a burst lasts this many ticks
+ * @param burstSpacing a burst starts this many ticks after the one before
+ */
+AbsDAQHitSet GenerateBurstsAndNoise(
+  const CompactOMKeyHashServiceConstPtr& hasher,
+  const uint64_t seed,
+  const size_t n_bursts,
+  const size_t n_burstHits,
+  const size_t n_noiseHits,
+  const int n_burstStrings,
+  const unsigned n_burstOMs,
+  const int64_t burstDuration,
+  const int64_t burstSpacing);
+
 
 #if SERIALIZATION_ENABLED
 template <class T>
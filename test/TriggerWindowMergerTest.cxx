@@ -0,0 +1,106 @@
+/**
+ * \file TriggerWindowMergerTest.cxx
+ *
+ * (c) 2013 the IceCube Collaboration
+ *
+ * $Id: TriggerWindowMergerTest.cxx 148312 2016-07-11 17:41:28Z mzoll $
+ * \version $Revision: 148312 $
+ * \date $Date: 2016-07-11 19:41:28 +0200 (mån, 11 jul 2016) $
+ * \author mzoll <marcel.zoll@fysik.su.se>
+ *
+ * Unit test to test the merging, padding and releasing of readout windows
+ */
+
+#include <I3Test.h>
+
+#include "IceHiveZ/internals/TriggerWindowMerger.h"
+
+#include <limits>
+#include <vector>
+
+using namespace hitspooltrigger;
+
+TEST_GROUP(TriggerWindowMerger);
+
+TEST(Merge_Overlapping) {
+  TriggerWindowMerger merger;
+  merger.Insert(TriggerWindow(100, 200));
+  merger.Insert(TriggerWindow(300, 400));
+  merger.Insert(TriggerWindow(500, 600));
+  ENSURE_EQUAL(merger.Size(), 3u, "Disjoint windows are held apart");
+  //windows coming out of order, bridging the ones held
+  merger.Insert(TriggerWindow(150, 300));
+  ENSURE_EQUAL(merger.Size(), 2u, "Windows sharing a tick are merged");
+  merger.Insert(TriggerWindow(0, 1000));
+  ENSURE_EQUAL(merger.Size(), 1u, "A window holding all others swallows them");
+  merger.Insert(TriggerWindow(10, 20));
+  ENSURE_EQUAL(merger.Size(), 1u, "A window held by another changes nothing");
+
+  std::vector<TriggerWindow> released;
+  merger.Flush(released);
+  ENSURE_EQUAL(released.size(), 1u);
+  ENSURE_EQUAL(released[0].start, 0);
+  ENSURE_EQUAL(released[0].end, 1000);
+  ENSURE_EQUAL(merger.Size(), 0u);
+};
+
+TEST(Padding) {
+  TriggerWindowMerger merger(10, 20);
+  ENSURE_EQUAL(merger.GetPrePadding(), 10);
+  ENSURE_EQUAL(merger.GetPostPadding(), 20);
+  merger.Insert(TriggerWindow(100, 200));
+  //apart by 15 ticks, but closer than the padding
+  merger.Insert(TriggerWindow(215, 300));
+  merger.Insert(TriggerWindow(400, 500));
+  ENSURE_EQUAL(merger.Size(), 2u, "Windows overlapping with the padding are merged");
+
+  std::vector<TriggerWindow> released;
+  merger.Flush(released);
+  ENSURE_EQUAL(released.size(), 2u);
+  ENSURE_EQUAL(released[0].start, 90);
+  ENSURE_EQUAL(released[0].end, 320);
+  ENSURE_EQUAL(released[1].start, 390);
+  ENSURE_EQUAL(released[1].end, 520);
+};
+
+TEST(Release_Only_Final) {
+  TriggerWindowMerger merger(10, 0);
+  merger.Insert(TriggerWindow(100, 200));
+  merger.Insert(TriggerWindow(300, 400));
+  std::vector<TriggerWindow> released;
+
+  //a trigger to come starting at 210 is opened at 200, and so overlaps the first window
+  merger.Release(210, released);
+  ENSURE(released.empty(), "Nothing is released which could still be overlapped");
+  ENSURE_EQUAL(merger.FinalizedUntil(210), 90, "Final until the first held window");
+  merger.Release(211, released);
+  ENSURE_EQUAL(released.size(), 1u, "Released as soon as nothing can overlap it");
+  ENSURE_EQUAL(released[0].start, 90);
+  ENSURE_EQUAL(merger.FinalizedUntil(211), 201);
+
+  //a late trigger bridging the gap merges into the held window instead of coming out split
+  merger.Insert(TriggerWindow(250, 295));
+  merger.Release(350, released);
+  ENSURE_EQUAL(released.size(), 1u);
+  merger.Release(std::numeric_limits<hitspooltime::DAQTicks>::max(), released);
+  ENSURE_EQUAL(released.size(), 2u, "Everything is released at the end of time");
+  ENSURE_EQUAL(released[1].start, 240);
+  ENSURE_EQUAL(released[1].end, 400);
+  ENSURE_EQUAL(merger.FinalizedUntil(std::numeric_limits<hitspooltime::DAQTicks>::max()), std::numeric_limits<hitspooltime::DAQTicks>::max());
+};
+
+TEST(Many_Windows) {
+  //windows chained pairwise by overlaps, inserted from both ends towards the middle
+  TriggerWindowMerger merger;
+  const int n_windows = 10000;
+  for (int i=0; i<n_windows/2; i++) {
+    merger.Insert(TriggerWindow(i*10, i*10+10));
+    merger.Insert(TriggerWindow((n_windows-1-i)*10, (n_windows-1-i)*10+10));
+  }
+  ENSURE_EQUAL(merger.Size(), 1u, "The chain is merged into one window");
+  std::vector<TriggerWindow> released;
+  merger.Release(n_windows*10+1, released);
+  ENSURE_EQUAL(released.size(), 1u);
+  ENSURE_EQUAL(released[0].start, 0);
+  ENSURE_EQUAL(released[0].end, n_windows*10);
+};